@@ -33,6 +33,9 @@
 #include <iconv.h>
 #endif
 #include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifdef _MSC_VER
 #define FORCE_INLINE(RET_TYPE) __forceinline RET_TYPE
@@ -913,31 +916,133 @@ g_utf8_to_ucs4_fast (const gchar *str, glong len, glong *items_written)
 	return outbuf;
 }
 
-static gunichar2 *
-eg_utf8_to_utf16_general (const gchar *str, glong len, glong *items_read, glong *items_written, gboolean include_nuls, GError **err)
+/*
+ * ASCII fast paths for the UTF-8 <-> UTF-16 conversions: runs of 7-bit
+ * characters are validated and widened (or narrowed) a block at a time
+ * instead of going through decode_utf8 ()/decode_utf16 () for each
+ * character. Blocks containing a nul are left to the per-character loop
+ * unless @include_nuls is set. @outptr may be NULL to only measure the run.
+ */
+static FORCE_INLINE (size_t)
+utf8_ascii_run (const unsigned char *inptr, size_t inleft, gboolean include_nuls, gunichar2 *outptr)
 {
-	gunichar2 *outbuf, *outptr;
-	size_t outlen = 0;
-	size_t inleft;
-	char *inptr;
-	gunichar c;
-	int u, n;
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128 ();
 	
-	g_return_val_if_fail (str != NULL, NULL);
+	while (inleft - i >= 16) {
+		__m128i v = _mm_loadu_si128 ((const __m128i *) (inptr + i));
+		int mask = _mm_movemask_epi8 (v);
+		
+		if (!include_nuls)
+			mask |= _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, zero));
+		
+		if (mask)
+			break;
+		
+		if (outptr) {
+			_mm_storeu_si128 ((__m128i *) (outptr + i), _mm_unpacklo_epi8 (v, zero));
+			_mm_storeu_si128 ((__m128i *) (outptr + i + 8), _mm_unpackhi_epi8 (v, zero));
+		}
+		
+		i += 16;
+	}
+#else
+	while (inleft - i >= 8) {
+		guint64 w;
+		int j;
+		
+		memcpy (&w, inptr + i, 8);
+		
+		if (w & 0x8080808080808080ULL)
+			break;
+		
+		if (!include_nuls && ((w - 0x0101010101010101ULL) & ~w & 0x8080808080808080ULL))
+			break;
+		
+		if (outptr) {
+			for (j = 0; j < 8; j++)
+				outptr[i + j] = inptr[i + j];
+		}
+		
+		i += 8;
+	}
+#endif
 	
-	if (len < 0) {
-		if (include_nuls) {
-			g_set_error (err, G_CONVERT_ERROR, G_CONVERT_ERROR_FAILED, "Conversions with embedded nulls must pass the string length");
-			return NULL;
+	return i;
+}
+
+static FORCE_INLINE (size_t)
+utf16_ascii_run (const gunichar2 *inptr, size_t inleft, gboolean include_nuls, gchar *outptr)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i high = _mm_set1_epi16 ((short) 0xff80);
+	
+	while (inleft - i >= 8) {
+		__m128i v = _mm_loadu_si128 ((const __m128i *) (inptr + i));
+		__m128i bad = _mm_and_si128 (v, high);
+		
+		if (!include_nuls)
+			bad = _mm_or_si128 (bad, _mm_cmpeq_epi16 (v, zero));
+		
+		if (_mm_movemask_epi8 (_mm_cmpeq_epi16 (bad, zero)) != 0xffff)
+			break;
+		
+		if (outptr)
+			_mm_storel_epi64 ((__m128i *) (outptr + i), _mm_packus_epi16 (v, v));
+		
+		i += 8;
+	}
+#else
+	while (inleft - i >= 4) {
+		guint64 w;
+		int j;
+		
+		memcpy (&w, inptr + i, 8);
+		
+		if (w & 0xff80ff80ff80ff80ULL)
+			break;
+		
+		if (!include_nuls && ((w - 0x0001000100010001ULL) & ~w & 0x8000800080008000ULL))
+			break;
+		
+		if (outptr) {
+			for (j = 0; j < 4; j++)
+				outptr[i + j] = (gchar) inptr[i + j];
 		}
 		
-		len = strlen (str);
+		i += 4;
 	}
+#endif
 	
-	inptr = (char *) str;
-	inleft = len;
+	return i;
+}
+
+/*
+ * Validates @str and returns the number of UTF-16 code units needed to hold
+ * it, or -1 with errno set. @nread is set to the number of bytes that can be
+ * handed to utf8_to_utf16_convert () (or to the offset of the error).
+ */
+static glong
+utf8_to_utf16_count (const gchar *str, size_t len, gboolean include_nuls, size_t *nread)
+{
+	char *inptr = (char *) str;
+	size_t inleft = len;
+	size_t outlen = 0;
+	size_t run;
+	gunichar c;
+	int u, n;
 	
 	while (inleft > 0) {
+		if (!(*inptr & 0x80) && (run = utf8_ascii_run ((unsigned char *) inptr, inleft, include_nuls, NULL)) > 0) {
+			outlen += run;
+			inleft -= run;
+			inptr += run;
+			continue;
+		}
+		
 		if ((n = decode_utf8 (inptr, inleft, &c)) < 0)
 			goto error;
 		
@@ -954,29 +1059,72 @@ eg_utf8_to_utf16_general (const gchar *str, glong len, glong *items_read, glong
 		inptr += n;
 	}
 	
-	if (items_read)
-		*items_read = inptr - str;
+	*nread = inptr - str;
 	
-	if (items_written)
-		*items_written = outlen;
+	return outlen;
 	
-	outptr = outbuf = g_malloc ((outlen + 1) * sizeof (gunichar2));
-	inptr = (char *) str;
-	inleft = len;
+ error:
+	*nread = inptr - str;
+	
+	return -1;
+}
+
+/* Converts @len bytes of UTF-8 already validated by utf8_to_utf16_count () */
+static void
+utf8_to_utf16_convert (const gchar *str, size_t len, gunichar2 *outbuf)
+{
+	gunichar2 *outptr = outbuf;
+	char *inptr = (char *) str;
+	size_t inleft = len;
+	size_t run;
+	gunichar c;
+	int n;
 	
 	while (inleft > 0) {
-		if ((n = decode_utf8 (inptr, inleft, &c)) < 0)
-			break;
-		
-		if (c == 0 && !include_nuls)
-			break;
+		if (!(*inptr & 0x80) && (run = utf8_ascii_run ((unsigned char *) inptr, inleft, TRUE, outptr)) > 0) {
+			outptr += run;
+			inleft -= run;
+			inptr += run;
+			continue;
+		}
 		
+		n = decode_utf8 (inptr, inleft, &c);
 		outptr += g_unichar_to_utf16 (c, outptr);
 		inleft -= n;
 		inptr += n;
 	}
+}
+
+static gunichar2 *
+eg_utf8_to_utf16_general (const gchar *str, glong len, glong *items_read, glong *items_written, gboolean include_nuls, GError **err)
+{
+	gunichar2 *outbuf;
+	size_t nread;
+	glong outlen;
 	
-	*outptr = '\0';
+	g_return_val_if_fail (str != NULL, NULL);
+	
+	if (len < 0) {
+		if (include_nuls) {
+			g_set_error (err, G_CONVERT_ERROR, G_CONVERT_ERROR_FAILED, "Conversions with embedded nulls must pass the string length");
+			return NULL;
+		}
+		
+		len = strlen (str);
+	}
+	
+	if ((outlen = utf8_to_utf16_count (str, len, include_nuls, &nread)) < 0)
+		goto error;
+	
+	if (items_read)
+		*items_read = nread;
+	
+	if (items_written)
+		*items_written = outlen;
+	
+	outbuf = g_malloc ((outlen + 1) * sizeof (gunichar2));
+	utf8_to_utf16_convert (str, nread, outbuf);
+	outbuf[outlen] = '\0';
 	
 	return outbuf;
 	
@@ -992,7 +1140,7 @@ eg_utf8_to_utf16_general (const gchar *str, glong len, glong *items_read, glong
 	}
 	
 	if (items_read)
-		*items_read = inptr - str;
+		*items_read = nread;
 	
 	if (items_written)
 		*items_written = 0;
@@ -1012,6 +1160,63 @@ eg_utf8_to_utf16_with_nuls (const gchar *str, glong len, glong *items_read, glon
 	return eg_utf8_to_utf16_general (str, len, items_read, items_written, TRUE, err);
 }
 
+/**
+ * eg_utf8_to_utf16_len:
+ *
+ * Validates @str like g_utf8_to_utf16 () (or eg_utf8_to_utf16_with_nuls () if
+ * @include_nuls is set) and returns the number of UTF-16 code units it
+ * converts to, without allocating anything. On success @items_read is set
+ * to the number of bytes to pass to eg_utf8_to_utf16_buf (). Returns -1 and
+ * sets @err on invalid or truncated input.
+ **/
+glong
+eg_utf8_to_utf16_len (const gchar *str, glong len, glong *items_read, gboolean include_nuls, GError **err)
+{
+	size_t nread;
+	glong outlen;
+	
+	g_return_val_if_fail (str != NULL, -1);
+	g_return_val_if_fail (items_read != NULL, -1);
+	
+	if (len < 0) {
+		if (include_nuls) {
+			g_set_error (err, G_CONVERT_ERROR, G_CONVERT_ERROR_FAILED, "Conversions with embedded nulls must pass the string length");
+			return -1;
+		}
+		
+		len = strlen (str);
+	}
+	
+	if ((outlen = utf8_to_utf16_count (str, len, include_nuls, &nread)) < 0) {
+		if (errno == EILSEQ) {
+			g_set_error (err, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+				     "Illegal byte sequence encounted in the input.");
+		} else {
+			g_set_error (err, G_CONVERT_ERROR, G_CONVERT_ERROR_PARTIAL_INPUT,
+				     "Partial byte sequence encountered in the input.");
+		}
+		
+		return -1;
+	}
+	
+	*items_read = nread;
+	
+	return outlen;
+}
+
+/**
+ * eg_utf8_to_utf16_buf:
+ *
+ * Converts the @items_read bytes measured by eg_utf8_to_utf16_len () into
+ * @outbuf, which must have room for the returned number of code units. No
+ * terminator is written.
+ **/
+void
+eg_utf8_to_utf16_buf (const gchar *str, glong items_read, gunichar2 *outbuf)
+{
+	utf8_to_utf16_convert (str, items_read, outbuf);
+}
+
 gunichar *
 g_utf8_to_ucs4 (const gchar *str, glong len, glong *items_read, glong *items_written, GError **err)
 {
@@ -1084,27 +1289,30 @@ g_utf8_to_ucs4 (const gchar *str, glong len, glong *items_read, glong *items_wri
 	return outbuf;
 }
 
-gchar *
-g_utf16_to_utf8 (const gunichar2 *str, glong len, glong *items_read, glong *items_written, GError **err)
+/*
+ * Validates @str up to the first nul and returns the number of bytes its
+ * UTF-8 form takes, or -1 with errno set. @nread is set to the number of
+ * code units that can be handed to utf16_to_utf8_convert () (or to the
+ * offset of the error).
+ */
+static glong
+utf16_to_utf8_count (const gunichar2 *str, size_t len, size_t *nread)
 {
-	char *inptr, *outbuf, *outptr;
+	char *inptr = (char *) str;
+	size_t inleft = len * 2;
 	size_t outlen = 0;
-	size_t inleft;
+	size_t run;
 	gunichar c;
 	int n;
 	
-	g_return_val_if_fail (str != NULL, NULL);
-	
-	if (len < 0) {
-		len = 0;
-		while (str[len])
-			len++;
-	}
-	
-	inptr = (char *) str;
-	inleft = len * 2;
-	
 	while (inleft > 0) {
+		if (*(gunichar2 *) inptr < 0x80 && (run = utf16_ascii_run ((gunichar2 *) inptr, inleft / 2, FALSE, NULL)) > 0) {
+			outlen += run;
+			inleft -= run * 2;
+			inptr += run * 2;
+			continue;
+		}
+		
 		if ((n = decode_utf16 (inptr, inleft, &c)) < 0) {
 			if (n == -2 && inleft > 2) {
 				/* This means that the first UTF-16 char was read, but second failed */
@@ -1112,24 +1320,9 @@ g_utf16_to_utf8 (const gunichar2 *str, glong len, glong *items_read, glong *item
 				inptr += 2;
 			}
 			
-			if (errno == EILSEQ) {
-				g_set_error (err, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
-					     "Illegal byte sequence encounted in the input.");
-			} else if (items_read) {
-				/* partial input is ok if we can let our caller know... */
-				break;
-			} else {
-				g_set_error (err, G_CONVERT_ERROR, G_CONVERT_ERROR_PARTIAL_INPUT,
-					     "Partial byte sequence encountered in the input.");
-			}
-			
-			if (items_read)
-				*items_read = (inptr - (char *) str) / 2;
-			
-			if (items_written)
-				*items_written = 0;
+			*nread = (inptr - (char *) str) / 2;
 			
-			return NULL;
+			return -1;
 		} else if (c == 0)
 			break;
 		
@@ -1138,32 +1331,144 @@ g_utf16_to_utf8 (const gunichar2 *str, glong len, glong *items_read, glong *item
 		inptr += n;
 	}
 	
-	if (items_read)
-		*items_read = (inptr - (char *) str) / 2;
+	*nread = (inptr - (char *) str) / 2;
 	
-	if (items_written)
-		*items_written = outlen;
-	
-	outptr = outbuf = g_malloc (outlen + 1);
-	inptr = (char *) str;
-	inleft = len * 2;
+	return outlen;
+}
+
+/* Converts @len code units already validated by utf16_to_utf8_count () */
+static void
+utf16_to_utf8_convert (const gunichar2 *str, size_t len, gchar *outbuf)
+{
+	char *inptr = (char *) str;
+	size_t inleft = len * 2;
+	char *outptr = outbuf;
+	size_t run;
+	gunichar c;
+	int n;
 	
 	while (inleft > 0) {
+		if (*(gunichar2 *) inptr < 0x80 && (run = utf16_ascii_run ((gunichar2 *) inptr, inleft / 2, TRUE, outptr)) > 0) {
+			outptr += run;
+			inleft -= run * 2;
+			inptr += run * 2;
+			continue;
+		}
+		
 		if ((n = decode_utf16 (inptr, inleft, &c)) < 0)
 			break;
-		else if (c == 0)
-			break;
 		
 		outptr += g_unichar_to_utf8 (c, outptr);
 		inleft -= n;
 		inptr += n;
 	}
+}
+
+gchar *
+g_utf16_to_utf8 (const gunichar2 *str, glong len, glong *items_read, glong *items_written, GError **err)
+{
+	char *outbuf;
+	size_t nread;
+	glong outlen;
+	
+	g_return_val_if_fail (str != NULL, NULL);
+	
+	if (len < 0) {
+		len = 0;
+		while (str[len])
+			len++;
+	}
+	
+	if ((outlen = utf16_to_utf8_count (str, len, &nread)) < 0) {
+		if (errno == EILSEQ) {
+			g_set_error (err, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+				     "Illegal byte sequence encounted in the input.");
+		} else if (items_read) {
+			/* partial input is ok if we can let our caller know... */
+			outlen = utf16_to_utf8_count (str, nread, &nread);
+			goto convert;
+		} else {
+			g_set_error (err, G_CONVERT_ERROR, G_CONVERT_ERROR_PARTIAL_INPUT,
+				     "Partial byte sequence encountered in the input.");
+		}
+		
+		if (items_read)
+			*items_read = nread;
+		
+		if (items_written)
+			*items_written = 0;
+		
+		return NULL;
+	}
+	
+ convert:
+	if (items_read)
+		*items_read = nread;
 	
-	*outptr = '\0';
+	if (items_written)
+		*items_written = outlen;
+	
+	outbuf = g_malloc (outlen + 1);
+	utf16_to_utf8_convert (str, nread, outbuf);
+	outbuf[outlen] = '\0';
 	
 	return outbuf;
 }
 
+/**
+ * eg_utf16_to_utf8_len:
+ *
+ * Validates @str like g_utf16_to_utf8 () and returns the number of bytes
+ * its UTF-8 form takes, without allocating anything. On success
+ * @items_read is set to the number of code units to pass to
+ * eg_utf16_to_utf8_buf (), the conversion stopping at the first nul.
+ * Returns -1 and sets @err on invalid or truncated input.
+ **/
+glong
+eg_utf16_to_utf8_len (const gunichar2 *str, glong len, glong *items_read, GError **err)
+{
+	size_t nread;
+	glong outlen;
+	
+	g_return_val_if_fail (str != NULL, -1);
+	g_return_val_if_fail (items_read != NULL, -1);
+	
+	if (len < 0) {
+		len = 0;
+		while (str[len])
+			len++;
+	}
+	
+	if ((outlen = utf16_to_utf8_count (str, len, &nread)) < 0) {
+		if (errno == EILSEQ) {
+			g_set_error (err, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+				     "Illegal byte sequence encounted in the input.");
+		} else {
+			g_set_error (err, G_CONVERT_ERROR, G_CONVERT_ERROR_PARTIAL_INPUT,
+				     "Partial byte sequence encountered in the input.");
+		}
+		
+		return -1;
+	}
+	
+	*items_read = nread;
+	
+	return outlen;
+}
+
+/**
+ * eg_utf16_to_utf8_buf:
+ *
+ * Converts the @items_read code units measured by eg_utf16_to_utf8_len ()
+ * into @outbuf, which must have room for the returned number of bytes. No
+ * terminator is written.
+ **/
+void
+eg_utf16_to_utf8_buf (const gunichar2 *str, glong items_read, gchar *outbuf)
+{
+	utf16_to_utf8_convert (str, items_read, outbuf);
+}
+
 gunichar *
 g_utf16_to_ucs4 (const gunichar2 *str, glong len, glong *items_read, glong *items_written, GError **err)
 {
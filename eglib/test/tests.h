@@ -20,6 +20,7 @@ DEFINE_TEST_GROUP_INIT_H(dir_tests_init);
 DEFINE_TEST_GROUP_INIT_H(markup_tests_init);
 DEFINE_TEST_GROUP_INIT_H(unicode_tests_init);
 DEFINE_TEST_GROUP_INIT_H(utf8_tests_init);
+DEFINE_TEST_GROUP_INIT_H(transcode_tests_init);
 DEFINE_TEST_GROUP_INIT_H(endian_tests_init);
 DEFINE_TEST_GROUP_INIT_H(module_tests_init);
 DEFINE_TEST_GROUP_INIT_H(memory_tests_init);
@@ -50,6 +51,7 @@ static Group test_groups [] = {
 	{"dir",       dir_tests_init},
 	{"unicode",   unicode_tests_init},
 	{"utf8",      utf8_tests_init},
+	{"transcode", transcode_tests_init},
 	{"endian",    endian_tests_init},
 	{"memory",    memory_tests_init},
 	{NULL, NULL}
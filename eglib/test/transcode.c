@@ -0,0 +1,177 @@
+#include <string.h>
+#include <glib.h>
+#include "test.h"
+
+/*
+ * UTF-8 <-> UTF-16 round trips over inputs large enough to go through the
+ * block-at-a-time ASCII paths as well as the per-character ones. Run with
+ * "test-eglib -tqi N transcode" to time the conversions.
+ */
+
+#define TRANSCODE_REPEAT 256
+
+static gchar *
+make_input (const gchar *chunk)
+{
+	GString *s = g_string_new ("");
+	int i;
+
+	for (i = 0; i < TRANSCODE_REPEAT; i++)
+		g_string_append (s, chunk);
+
+	return g_string_free (s, FALSE);
+}
+
+static RESULT
+round_trip (const gchar *chunk, glong chunk_utf16_len)
+{
+	gchar *input, *output;
+	gunichar2 *utf16;
+	glong len, read, written, written2;
+	GError *err = NULL;
+	RESULT result = OK;
+
+	input = make_input (chunk);
+	len = strlen (input);
+
+	utf16 = g_utf8_to_utf16 (input, len, &read, &written, &err);
+	if (!utf16) {
+		result = FAILED ("g_utf8_to_utf16 failed: %s", err->message);
+		g_error_free (err);
+		goto out;
+	}
+
+	if (read != len || written != chunk_utf16_len * TRANSCODE_REPEAT) {
+		result = FAILED ("g_utf8_to_utf16 read %ld written %ld", read, written);
+		g_free (utf16);
+		goto out;
+	}
+
+	output = g_utf16_to_utf8 (utf16, written, NULL, &written2, &err);
+	if (!output) {
+		result = FAILED ("g_utf16_to_utf8 failed: %s", err->message);
+		g_error_free (err);
+	} else if (written2 != len || memcmp (input, output, len + 1) != 0) {
+		result = FAILED ("round trip mismatch, %ld bytes instead of %ld", written2, len);
+	}
+
+	g_free (output);
+	g_free (utf16);
+ out:
+	g_free (input);
+	return result;
+}
+
+RESULT
+test_transcode_ascii ()
+{
+	return round_trip ("The quick brown fox jumps over the lazy dog. 0123456789\n", 56);
+}
+
+RESULT
+test_transcode_latin1 ()
+{
+	/* "Çà coûte très cher, même à Zürich. " */
+	return round_trip ("\xC3\x87\xC3\xA0 co\xC3\xBBte tr\xC3\xA8s cher, m\xC3\xAAme \xC3\xA0 Z\xC3\xBCrich. ", 35);
+}
+
+RESULT
+test_transcode_cjk ()
+{
+	/* "日本語のテキスト" followed by a surrogate pair (U+20BB7) */
+	return round_trip ("\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E\xE3\x81\xAE\xE3\x83\x86\xE3\x82\xAD\xE3\x82\xB9\xE3\x83\x88\xF0\xA0\xAE\xB7", 10);
+}
+
+RESULT
+test_transcode_boundaries ()
+{
+	gchar buf [64];
+	gunichar2 ubuf [64], *utf16;
+	gchar *utf8;
+	glong written;
+	GError *err = NULL;
+	int i;
+
+	/* a nul inside a block stops the conversion */
+	memset (buf, 'a', sizeof (buf));
+	buf [37] = 0;
+	utf16 = g_utf8_to_utf16 (buf, sizeof (buf), NULL, &written, NULL);
+	if (!utf16 || written != 37 || utf16 [36] != 'a' || utf16 [37] != 0)
+		return FAILED ("nul in utf8 block: written %ld", written);
+	g_free (utf16);
+
+	for (i = 0; i < 64; i++)
+		ubuf [i] = 'b';
+	ubuf [21] = 0;
+	utf8 = g_utf16_to_utf8 (ubuf, 64, NULL, &written, NULL);
+	if (!utf8 || written != 21 || utf8 [20] != 'b' || utf8 [21] != 0)
+		return FAILED ("nul in utf16 block: written %ld", written);
+	g_free (utf8);
+
+	/* invalid input after a run of ascii is still rejected */
+	memset (buf, 'a', sizeof (buf));
+	buf [40] = (gchar) 0xff;
+	utf16 = g_utf8_to_utf16 (buf, sizeof (buf), NULL, NULL, &err);
+	if (utf16 || !err)
+		return FAILED ("invalid utf8 after ascii accepted");
+	g_error_free (err);
+	err = NULL;
+
+	for (i = 0; i < 64; i++)
+		ubuf [i] = 'b';
+	ubuf [30] = 0xdc00;
+	utf8 = g_utf16_to_utf8 (ubuf, 64, NULL, NULL, &err);
+	if (utf8 || !err)
+		return FAILED ("lone surrogate after ascii accepted");
+	g_error_free (err);
+
+	return OK;
+}
+
+RESULT
+test_transcode_len_buf ()
+{
+#if defined(EGLIB_TESTS)
+	gchar *input, *utf8;
+	gunichar2 *utf16;
+	glong len, read, ulen, read2, blen;
+
+	input = make_input ("abc \xC3\xA9\xE6\x97\xA5 defghijklmnopqrstuvwxyz ");
+	len = strlen (input);
+
+	ulen = eg_utf8_to_utf16_len (input, len, &read, FALSE, NULL);
+	if (ulen != 31 * TRANSCODE_REPEAT || read != len)
+		return FAILED ("eg_utf8_to_utf16_len returned %ld, read %ld", ulen, read);
+
+	utf16 = g_new (gunichar2, ulen);
+	eg_utf8_to_utf16_buf (input, read, utf16);
+
+	blen = eg_utf16_to_utf8_len (utf16, ulen, &read2, NULL);
+	if (blen != len || read2 != ulen)
+		return FAILED ("eg_utf16_to_utf8_len returned %ld, read %ld", blen, read2);
+
+	utf8 = g_malloc (blen);
+	eg_utf16_to_utf8_buf (utf16, read2, utf8);
+	if (memcmp (utf8, input, len) != 0)
+		return FAILED ("eg_utf16_to_utf8_buf mismatch");
+
+	if (eg_utf8_to_utf16_len ("a\xE6\x97", 3, &read, FALSE, NULL) != -1)
+		return FAILED ("truncated utf8 accepted");
+
+	g_free (utf8);
+	g_free (utf16);
+	g_free (input);
+#endif
+	return OK;
+}
+
+static Test transcode_tests [] = {
+	{"ascii", test_transcode_ascii},
+	{"latin1", test_transcode_latin1},
+	{"cjk", test_transcode_cjk},
+	{"boundaries", test_transcode_boundaries},
+	{"len_buf", test_transcode_len_buf},
+	{NULL, NULL}
+};
+
+DEFINE_TEST_GROUP_INIT(transcode_tests_init, transcode_tests)
@@ -0,0 +1,715 @@
+// Vector.cs
+//
+// Copyright 2014 Xamarin, Inc (http://www.xamarin.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+using System;
+using System.Text;
+
+namespace Mono.Simd
+{
+	//
+	// A vector of Count elements of type T, which can be any of the primitive
+	// numeric types. The vector is 128 bits wide, so Count is 16 / sizeof (T),
+	// code reading Count instead of assuming it keeps working if that changes.
+	// The JIT replaces most of the methods below with SIMD instructions on
+	// platforms that support them.
+	//
+	// The methods below are the fallbacks used when that's not the case, they
+	// are implemented using the fixed width vector types.
+	//
+	public struct Vector<T> where T : struct
+	{
+		// Generic types can't have an explicit layout, so the fallbacks access
+		// this through the properties at the end
+		internal Vector16b bits;
+
+		public static int Count {
+			get {
+				switch (GetKind ()) {
+				case Kind.Double:
+				case Kind.Int64:
+				case Kind.UInt64:
+					return 2;
+				case Kind.Single:
+				case Kind.Int32:
+				case Kind.UInt32:
+					return 4;
+				case Kind.Int16:
+				case Kind.UInt16:
+					return 8;
+				default:
+					return 16;
+				}
+			}
+		}
+
+		//
+		// Mono replaces the method below at JIT time on platforms that support
+		// SIMD with TRUE
+		//
+		public static bool IsHardwareAccelerated {
+			get { return false; }
+		}
+
+		public static Vector<T> Zero {
+			get { return new Vector<T> (); }
+		}
+
+		public Vector (T value)
+		{
+			bits = new Vector16b ();
+			for (int i = 0; i < Count; ++i)
+				SetElement (i, value);
+		}
+
+		public Vector (T[] values) : this (values, 0)
+		{
+		}
+
+		public Vector (T[] values, int index)
+		{
+			if (index < 0 || values.Length - index < Count)
+				throw new IndexOutOfRangeException ();
+			bits = new Vector16b ();
+			for (int i = 0; i < Count; ++i)
+				SetElement (i, values [index + i]);
+		}
+
+		public T this [int index] {
+			get {
+				if (index < 0 || index >= Count)
+					throw new ArgumentOutOfRangeException ("index");
+				switch (GetKind ()) {
+				case Kind.Single:
+					return (T)(object)F [index];
+				case Kind.Double:
+					return (T)(object)D [index];
+				case Kind.SByte:
+					return (T)(object)SB [index];
+				case Kind.Byte:
+					return (T)(object)bits [index];
+				case Kind.Int16:
+					return (T)(object)S [index];
+				case Kind.UInt16:
+					return (T)(object)US [index];
+				case Kind.Int32:
+					return (T)(object)I [index];
+				case Kind.UInt32:
+					return (T)(object)UI [index];
+				case Kind.Int64:
+					return (T)(object)L [index];
+				default:
+					return (T)(object)UL [index];
+				}
+			}
+		}
+
+		public void CopyTo (T[] destination)
+		{
+			CopyTo (destination, 0);
+		}
+
+		public void CopyTo (T[] destination, int index)
+		{
+			if (index < 0 || destination.Length - index < Count)
+				throw new IndexOutOfRangeException ();
+			for (int i = 0; i < Count; ++i)
+				destination [index + i] = this [i];
+		}
+
+		public static Vector<T> operator + (Vector<T> v1, Vector<T> v2)
+		{
+			Vector<T> res = new Vector<T> ();
+			switch (GetKind ()) {
+			case Kind.Single:
+				res.F = v1.F + v2.F;
+				break;
+			case Kind.Double:
+				res.D = v1.D + v2.D;
+				break;
+			case Kind.SByte:
+			case Kind.Byte:
+				res.bits = v1.bits + v2.bits;
+				break;
+			case Kind.Int16:
+			case Kind.UInt16:
+				res.US = v1.US + v2.US;
+				break;
+			case Kind.Int32:
+			case Kind.UInt32:
+				res.UI = v1.UI + v2.UI;
+				break;
+			default:
+				res.UL = v1.UL + v2.UL;
+				break;
+			}
+			return res;
+		}
+
+		public static Vector<T> operator - (Vector<T> v1, Vector<T> v2)
+		{
+			Vector<T> res = new Vector<T> ();
+			switch (GetKind ()) {
+			case Kind.Single:
+				res.F = v1.F - v2.F;
+				break;
+			case Kind.Double:
+				res.D = v1.D - v2.D;
+				break;
+			case Kind.SByte:
+			case Kind.Byte:
+				res.bits = v1.bits - v2.bits;
+				break;
+			case Kind.Int16:
+			case Kind.UInt16:
+				res.US = v1.US - v2.US;
+				break;
+			case Kind.Int32:
+			case Kind.UInt32:
+				res.UI = v1.UI - v2.UI;
+				break;
+			default:
+				res.UL = v1.UL - v2.UL;
+				break;
+			}
+			return res;
+		}
+
+		public static Vector<T> operator * (Vector<T> v1, Vector<T> v2)
+		{
+			Vector<T> res = new Vector<T> ();
+			switch (GetKind ()) {
+			case Kind.Single:
+				res.F = v1.F * v2.F;
+				break;
+			case Kind.Double:
+				res.D = v1.D * v2.D;
+				break;
+			case Kind.Int16:
+			case Kind.UInt16:
+				res.US = v1.US * v2.US;
+				break;
+			case Kind.Int32:
+			case Kind.UInt32:
+				res.UI = v1.UI * v2.UI;
+				break;
+			default:
+				res = LaneOp (v1, v2, Op.Multiply);
+				break;
+			}
+			return res;
+		}
+
+		public static Vector<T> operator / (Vector<T> v1, Vector<T> v2)
+		{
+			Vector<T> res = new Vector<T> ();
+			switch (GetKind ()) {
+			case Kind.Single:
+				res.F = v1.F / v2.F;
+				break;
+			case Kind.Double:
+				res.D = v1.D / v2.D;
+				break;
+			default:
+				res = LaneOp (v1, v2, Op.Divide);
+				break;
+			}
+			return res;
+		}
+
+		public static Vector<T> operator & (Vector<T> v1, Vector<T> v2)
+		{
+			Vector<T> res = new Vector<T> ();
+			res.bits = v1.bits & v2.bits;
+			return res;
+		}
+
+		public static Vector<T> operator | (Vector<T> v1, Vector<T> v2)
+		{
+			Vector<T> res = new Vector<T> ();
+			res.bits = v1.bits | v2.bits;
+			return res;
+		}
+
+		public static Vector<T> operator ^ (Vector<T> v1, Vector<T> v2)
+		{
+			Vector<T> res = new Vector<T> ();
+			res.bits = v1.bits ^ v2.bits;
+			return res;
+		}
+
+		public static bool operator == (Vector<T> v1, Vector<T> v2)
+		{
+			switch (GetKind ()) {
+			case Kind.Single:
+				return v1.F == v2.F;
+			case Kind.Double:
+				return v1.D.X == v2.D.X && v1.D.Y == v2.D.Y;
+			case Kind.Int64:
+			case Kind.UInt64:
+				return v1.UL.X == v2.UL.X && v1.UL.Y == v2.UL.Y;
+			default:
+				return v1.bits == v2.bits;
+			}
+		}
+
+		public static bool operator != (Vector<T> v1, Vector<T> v2)
+		{
+			return !(v1 == v2);
+		}
+
+		public static Vector<T> Min (Vector<T> v1, Vector<T> v2)
+		{
+			Vector<T> res = new Vector<T> ();
+			switch (GetKind ()) {
+			case Kind.Single:
+				res.F = v1.F.Min (v2.F);
+				break;
+			case Kind.Double:
+				res.D = v1.D.Min (v2.D);
+				break;
+			case Kind.SByte:
+				res.SB = v1.SB.Min (v2.SB);
+				break;
+			case Kind.Byte:
+				res.bits = v1.bits.Min (v2.bits);
+				break;
+			case Kind.Int16:
+				res.S = v1.S.Min (v2.S);
+				break;
+			case Kind.UInt16:
+				res.US = v1.US.Min (v2.US);
+				break;
+			case Kind.Int32:
+				res.I = v1.I.Min (v2.I);
+				break;
+			case Kind.UInt32:
+				res.UI = v1.UI.Min (v2.UI);
+				break;
+			default:
+				res = LaneOp (v1, v2, Op.Min);
+				break;
+			}
+			return res;
+		}
+
+		public static Vector<T> Max (Vector<T> v1, Vector<T> v2)
+		{
+			Vector<T> res = new Vector<T> ();
+			switch (GetKind ()) {
+			case Kind.Single:
+				res.F = v1.F.Max (v2.F);
+				break;
+			case Kind.Double:
+				res.D = v1.D.Max (v2.D);
+				break;
+			case Kind.SByte:
+				res.SB = v1.SB.Max (v2.SB);
+				break;
+			case Kind.Byte:
+				res.bits = v1.bits.Max (v2.bits);
+				break;
+			case Kind.Int16:
+				res.S = v1.S.Max (v2.S);
+				break;
+			case Kind.UInt16:
+				res.US = v1.US.Max (v2.US);
+				break;
+			case Kind.Int32:
+				res.I = v1.I.Max (v2.I);
+				break;
+			case Kind.UInt32:
+				res.UI = v1.UI.Max (v2.UI);
+				break;
+			default:
+				res = LaneOp (v1, v2, Op.Max);
+				break;
+			}
+			return res;
+		}
+
+		//
+		// The comparisons return a vector with all bits of an element set if the
+		// comparison is true for that element, and cleared otherwise.
+		//
+		public static Vector<T> CompareEqual (Vector<T> v1, Vector<T> v2)
+		{
+			Vector<T> res = new Vector<T> ();
+			switch (GetKind ()) {
+			case Kind.Single:
+				res.F = v1.F.CompareEqual (v2.F);
+				break;
+			case Kind.Double:
+				res.D = v1.D.CompareEqual (v2.D);
+				break;
+			case Kind.SByte:
+			case Kind.Byte:
+				res.bits = v1.bits.CompareEqual (v2.bits);
+				break;
+			case Kind.Int16:
+			case Kind.UInt16:
+				res.US = v1.US.CompareEqual (v2.US);
+				break;
+			case Kind.Int32:
+			case Kind.UInt32:
+				res.UI = v1.UI.CompareEqual (v2.UI);
+				break;
+			default:
+				res.UL = v1.UL.CompareEqual (v2.UL);
+				break;
+			}
+			return res;
+		}
+
+		public static Vector<T> CompareGreaterThan (Vector<T> v1, Vector<T> v2)
+		{
+			Vector<T> res = new Vector<T> ();
+			switch (GetKind ()) {
+			case Kind.Single:
+				res.F = v2.F.CompareLessThan (v1.F);
+				break;
+			case Kind.Double:
+				res.D = v2.D.CompareLessThan (v1.D);
+				break;
+			case Kind.SByte:
+				res.SB = v1.SB.CompareGreaterThan (v2.SB);
+				break;
+			case Kind.Int16:
+				res.S = v1.S.CompareGreaterThan (v2.S);
+				break;
+			case Kind.Int32:
+				res.I = v1.I.CompareGreaterThan (v2.I);
+				break;
+			case Kind.Int64:
+				res.L = v1.L.CompareGreaterThan (v2.L);
+				break;
+			default:
+				res = LaneOp (v1, v2, Op.GreaterThan);
+				break;
+			}
+			return res;
+		}
+
+		public static Vector<T> CompareLessThan (Vector<T> v1, Vector<T> v2)
+		{
+			return CompareGreaterThan (v2, v1);
+		}
+
+		//
+		// The elements are added up in pairs, i.e. ((a0*b0 + a1*b1) + (a2*b2 + a3*b3))
+		// for four elements, which is the order the SIMD implementation uses.
+		//
+		public static T Dot (Vector<T> v1, Vector<T> v2)
+		{
+			Vector<T> prod = v1 * v2;
+
+			switch (GetKind ()) {
+			case Kind.Single: {
+				Vector4f f = prod.F;
+				return (T)(object)((f.X + f.Y) + (f.Z + f.W));
+			}
+			case Kind.Double:
+				return (T)(object)(prod.D.X + prod.D.Y);
+			default: {
+				long sum = 0;
+				for (int i = 0; i < Count; ++i)
+					sum += prod.GetLong (i);
+				Vector<T> res = new Vector<T> ();
+				res.SetLong (0, sum);
+				return res [0];
+			}
+			}
+		}
+
+		public override bool Equals (object obj)
+		{
+			if (!(obj is Vector<T>))
+				return false;
+			return this == (Vector<T>)obj;
+		}
+
+		public override int GetHashCode ()
+		{
+			Vector4i v = I;
+			return v.X ^ v.Y ^ v.Z ^ v.W;
+		}
+
+		public override string ToString ()
+		{
+			StringBuilder sb = new StringBuilder ("<");
+			for (int i = 0; i < Count; ++i) {
+				if (i > 0)
+					sb.Append (", ");
+				sb.Append (this [i]);
+			}
+			sb.Append (">");
+			return sb.ToString ();
+		}
+
+		enum Kind {
+			Single,
+			Double,
+			SByte,
+			Byte,
+			Int16,
+			UInt16,
+			Int32,
+			UInt32,
+			Int64,
+			UInt64
+		}
+
+		enum Op {
+			Multiply,
+			Divide,
+			Min,
+			Max,
+			GreaterThan
+		}
+
+		static Kind GetKind ()
+		{
+			Type t = typeof (T);
+
+			if (t == typeof (float))
+				return Kind.Single;
+			if (t == typeof (double))
+				return Kind.Double;
+			if (t == typeof (sbyte))
+				return Kind.SByte;
+			if (t == typeof (byte))
+				return Kind.Byte;
+			if (t == typeof (short))
+				return Kind.Int16;
+			if (t == typeof (ushort))
+				return Kind.UInt16;
+			if (t == typeof (int))
+				return Kind.Int32;
+			if (t == typeof (uint))
+				return Kind.UInt32;
+			if (t == typeof (long))
+				return Kind.Int64;
+			if (t == typeof (ulong))
+				return Kind.UInt64;
+			throw new NotSupportedException (String.Format ("Type {0} is not supported as a vector element type.", t));
+		}
+
+		static bool IsUnsigned (Kind kind)
+		{
+			return kind == Kind.Byte || kind == Kind.UInt16 || kind == Kind.UInt32 || kind == Kind.UInt64;
+		}
+
+		// Applies OP to each pair of integer elements
+		static Vector<T> LaneOp (Vector<T> v1, Vector<T> v2, Op op)
+		{
+			Vector<T> res = new Vector<T> ();
+			bool unsigned = IsUnsigned (GetKind ());
+
+			for (int i = 0; i < Count; ++i) {
+				long a = v1.GetLong (i);
+				long b = v2.GetLong (i);
+				long r;
+
+				switch (op) {
+				case Op.Multiply:
+					r = a * b;
+					break;
+				case Op.Divide:
+					r = unsigned ? (long)((ulong)a / (ulong)b) : a / b;
+					break;
+				case Op.Min:
+					r = (unsigned ? (ulong)a < (ulong)b : a < b) ? a : b;
+					break;
+				case Op.Max:
+					r = (unsigned ? (ulong)a > (ulong)b : a > b) ? a : b;
+					break;
+				default:
+					r = (unsigned ? (ulong)a > (ulong)b : a > b) ? -1 : 0;
+					break;
+				}
+				res.SetLong (i, r);
+			}
+			return res;
+		}
+
+		// Integer elements are sign or zero extended to a long
+		long GetLong (int index)
+		{
+			switch (GetKind ()) {
+			case Kind.SByte:
+				return SB [index];
+			case Kind.Byte:
+				return bits [index];
+			case Kind.Int16:
+				return S [index];
+			case Kind.UInt16:
+				return US [index];
+			case Kind.Int32:
+				return I [index];
+			case Kind.UInt32:
+				return UI [index];
+			case Kind.Int64:
+				return L [index];
+			default:
+				return (long)UL [index];
+			}
+		}
+
+		void SetLong (int index, long value)
+		{
+			switch (GetKind ()) {
+			case Kind.SByte: {
+				Vector16sb v = SB;
+				v [index] = (sbyte)value;
+				SB = v;
+				break;
+			}
+			case Kind.Byte:
+				bits [index] = (byte)value;
+				break;
+			case Kind.Int16: {
+				Vector8s v = S;
+				v [index] = (short)value;
+				S = v;
+				break;
+			}
+			case Kind.UInt16: {
+				Vector8us v = US;
+				v [index] = (ushort)value;
+				US = v;
+				break;
+			}
+			case Kind.Int32: {
+				Vector4i v = I;
+				v [index] = (int)value;
+				I = v;
+				break;
+			}
+			case Kind.UInt32: {
+				Vector4ui v = UI;
+				v [index] = (uint)value;
+				UI = v;
+				break;
+			}
+			case Kind.Int64: {
+				Vector2l v = L;
+				v [index] = value;
+				L = v;
+				break;
+			}
+			default: {
+				Vector2ul v = UL;
+				v [index] = (ulong)value;
+				UL = v;
+				break;
+			}
+			}
+		}
+
+		void SetElement (int index, T value)
+		{
+			switch (GetKind ()) {
+			case Kind.Single: {
+				Vector4f v = F;
+				v [index] = (float)(object)value;
+				F = v;
+				break;
+			}
+			case Kind.Double: {
+				Vector2d v = D;
+				v [index] = (double)(object)value;
+				D = v;
+				break;
+			}
+			case Kind.SByte:
+				SetLong (index, (sbyte)(object)value);
+				break;
+			case Kind.Byte:
+				SetLong (index, (byte)(object)value);
+				break;
+			case Kind.Int16:
+				SetLong (index, (short)(object)value);
+				break;
+			case Kind.UInt16:
+				SetLong (index, (ushort)(object)value);
+				break;
+			case Kind.Int32:
+				SetLong (index, (int)(object)value);
+				break;
+			case Kind.UInt32:
+				SetLong (index, (uint)(object)value);
+				break;
+			case Kind.Int64:
+				SetLong (index, (long)(object)value);
+				break;
+			default:
+				SetLong (index, (long)(ulong)(object)value);
+				break;
+			}
+		}
+
+		unsafe Vector4f F {
+			get { fixed (Vector16b *p = &bits) return *(Vector4f*)p; }
+			set { fixed (Vector16b *p = &bits) *(Vector4f*)p = value; }
+		}
+
+		unsafe Vector2d D {
+			get { fixed (Vector16b *p = &bits) return *(Vector2d*)p; }
+			set { fixed (Vector16b *p = &bits) *(Vector2d*)p = value; }
+		}
+
+		unsafe Vector16sb SB {
+			get { fixed (Vector16b *p = &bits) return *(Vector16sb*)p; }
+			set { fixed (Vector16b *p = &bits) *(Vector16sb*)p = value; }
+		}
+
+		unsafe Vector8s S {
+			get { fixed (Vector16b *p = &bits) return *(Vector8s*)p; }
+			set { fixed (Vector16b *p = &bits) *(Vector8s*)p = value; }
+		}
+
+		unsafe Vector8us US {
+			get { fixed (Vector16b *p = &bits) return *(Vector8us*)p; }
+			set { fixed (Vector16b *p = &bits) *(Vector8us*)p = value; }
+		}
+
+		unsafe Vector4i I {
+			get { fixed (Vector16b *p = &bits) return *(Vector4i*)p; }
+			set { fixed (Vector16b *p = &bits) *(Vector4i*)p = value; }
+		}
+
+		unsafe Vector4ui UI {
+			get { fixed (Vector16b *p = &bits) return *(Vector4ui*)p; }
+			set { fixed (Vector16b *p = &bits) *(Vector4ui*)p = value; }
+		}
+
+		unsafe Vector2l L {
+			get { fixed (Vector16b *p = &bits) return *(Vector2l*)p; }
+			set { fixed (Vector16b *p = &bits) *(Vector2l*)p = value; }
+		}
+
+		unsafe Vector2ul UL {
+			get { fixed (Vector16b *p = &bits) return *(Vector2ul*)p; }
+			set { fixed (Vector16b *p = &bits) *(Vector2ul*)p = value; }
+		}
+	}
+}
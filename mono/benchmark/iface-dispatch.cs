@@ -0,0 +1,87 @@
+using System;
+
+/*
+ * Interface and virtual calls with one, two and many receiver classes per
+ * call site, to measure the guarded devirtualization done with --tiered or
+ * --pgo against plain IMT and vtable dispatch.
+ */
+
+interface IValue {
+	int Get ();
+}
+
+class One : IValue {
+	public virtual int Get () { return 1; }
+}
+
+class Two : One {
+	public override int Get () { return 2; }
+}
+
+class Three : IValue {
+	public int Get () { return 3; }
+}
+
+class Four : IValue {
+	public int Get () { return 4; }
+}
+
+class Five : IValue {
+	public int Get () { return 5; }
+}
+
+public class Test {
+
+	/*
+	 * Methods with loops are not compiled at tier 0, so the call sites are in
+	 * these, one for each kind of site.
+	 */
+	static int get_mono (IValue v) {
+		return v.Get ();
+	}
+
+	static int get_poly (IValue v) {
+		return v.Get ();
+	}
+
+	static int get_mega (IValue v) {
+		return v.Get ();
+	}
+
+	static int get_virtual (One v) {
+		return v.Get ();
+	}
+
+	public static int Main (string[] args) {
+		int repeat = 1;
+
+		if (args.Length == 1)
+			repeat = Convert.ToInt32 (args [0]);
+
+		Console.WriteLine ("Repeat = " + repeat);
+
+		IValue[] all = new IValue [] { new One (), new Two (), new Three (), new Four (), new Five () };
+		One[] virt = new One [] { new One (), new Two () };
+
+		for (int i = 0; i < (repeat * 1000); i++) {
+			int mono = 0, poly = 0, mega = 0, virtual_sum = 0;
+
+			for (int j = 0; j < 10000; j++) {
+				mono += get_mono (all [0]);
+				poly += get_poly (all [j & 1]);
+				mega += get_mega (all [j % 5]);
+				virtual_sum += get_virtual (virt [j & 1]);
+			}
+			if (mono != 10000)
+				return 1;
+			if (poly != 15000)
+				return 2;
+			if (mega != 30000)
+				return 3;
+			if (virtual_sum != 15000)
+				return 4;
+		}
+
+		return 0;
+	}
+}
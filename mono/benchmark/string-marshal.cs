@@ -0,0 +1,58 @@
+using System;
+using System.Text;
+using System.Runtime.InteropServices;
+
+/*
+ * Round trips ASCII, Latin-1 and CJK strings through the runtime's UTF-16 <->
+ * UTF-8 conversions: StringToHGlobalAnsi () uses mono_string_to_utf8 () and
+ * PtrToStringAnsi () uses mono_string_new ().
+ */
+
+public class Test {
+
+	static string make (string chunk, int len) {
+		var sb = new StringBuilder ();
+		while (sb.Length < len)
+			sb.Append (chunk);
+		return sb.ToString (0, len);
+	}
+
+	static bool round_trip (string s, int count) {
+		for (int i = 0; i < count; i++) {
+			IntPtr p = Marshal.StringToHGlobalAnsi (s);
+			string res = Marshal.PtrToStringAnsi (p);
+			Marshal.FreeHGlobal (p);
+			if (res.Length != s.Length)
+				return false;
+		}
+		return true;
+	}
+
+	public static int Main (string[] args) {
+		int repeat = 1;
+
+		if (args.Length == 1)
+			repeat = Convert.ToInt32 (args [0]);
+
+		Console.WriteLine ("Repeat = " + repeat);
+
+		string[] names = { "ASCII:   ", "Latin-1: ", "CJK:     " };
+		string[] chunks = {
+			"The quick brown fox jumps over the lazy dog. ",
+			"Ça coûte très cher, même à Zürich. ",
+			"日本語のテキスト。"
+		};
+
+		for (int k = 0; k < chunks.Length; ++k) {
+			foreach (int len in new int [] { 16, 256, 4096 }) {
+				string s = make (chunks [k], len);
+				DateTime start = DateTime.Now;
+				if (!round_trip (s, repeat * (1 << 20) / len))
+					return k + 1;
+				Console.WriteLine (names [k] + len + " chars: " + (DateTime.Now - start).TotalMilliseconds + " ms");
+			}
+		}
+
+		return 0;
+	}
+}
@@ -0,0 +1,82 @@
+using System;
+using Mono.Simd;
+
+/*
+ * Sums and dot products over float and int arrays, once with scalar loops and
+ * once with Vector<T>, whose operations are compiled to SSE instructions when
+ * the JIT is run with -O=simd.
+ */
+
+public class Test {
+
+	static float sum_scalar (float[] arr) {
+		float sum = 0;
+		for (int i = 0; i < arr.Length; ++i)
+			sum += arr [i];
+		return sum;
+	}
+
+	static float sum_vector (float[] arr) {
+		var acc = Vector<float>.Zero;
+		int i = 0;
+		for (; i <= arr.Length - Vector<float>.Count; i += Vector<float>.Count)
+			acc += new Vector<float> (arr, i);
+		float sum = Vector<float>.Dot (acc, new Vector<float> (1));
+		for (; i < arr.Length; ++i)
+			sum += arr [i];
+		return sum;
+	}
+
+	static int dot_scalar (int[] a, int[] b) {
+		int sum = 0;
+		for (int i = 0; i < a.Length; ++i)
+			sum += a [i] * b [i];
+		return sum;
+	}
+
+	static int dot_vector (int[] a, int[] b) {
+		var acc = Vector<int>.Zero;
+		int i = 0;
+		for (; i <= a.Length - Vector<int>.Count; i += Vector<int>.Count)
+			acc += new Vector<int> (a, i) * new Vector<int> (b, i);
+		int sum = Vector<int>.Dot (acc, new Vector<int> (1));
+		for (; i < a.Length; ++i)
+			sum += a [i] * b [i];
+		return sum;
+	}
+
+	public static int Main (string[] args) {
+		int repeat = 1;
+
+		if (args.Length == 1)
+			repeat = Convert.ToInt32 (args [0]);
+
+		Console.WriteLine ("Repeat = " + repeat);
+		Console.WriteLine ("Accelerated = " + Vector<float>.IsHardwareAccelerated);
+
+		float[] f = new float [1027];
+		int[] a = new int [1027];
+		int[] b = new int [1027];
+		for (int i = 0; i < f.Length; ++i) {
+			f [i] = i & 7;
+			a [i] = i & 15;
+			b [i] = 3 - (i & 3);
+		}
+
+		for (int k = 0; k < 2; ++k) {
+			bool vector = k == 1;
+			DateTime start = DateTime.Now;
+			for (int i = 0; i < (repeat * 1000); i++) {
+				float fsum = vector ? sum_vector (f) : sum_scalar (f);
+				int dot = vector ? dot_vector (a, b) : dot_scalar (a, b);
+				if (fsum != 3587)
+					return 1;
+				if (dot != 10244)
+					return 2;
+			}
+			Console.WriteLine ((vector ? "Vector<T>: " : "Scalar:    ") + (DateTime.Now - start).TotalMilliseconds + " ms");
+		}
+
+		return 0;
+	}
+}
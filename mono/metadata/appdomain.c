@@ -2310,6 +2310,10 @@ unload_thread_main (void *arg)
 		goto failure;
 	}
 
+	/* Wait for background JIT work, like tiered recompilation, to leave the domain */
+	if (mono_get_runtime_callbacks ()->remove_domain_jit_jobs)
+		mono_get_runtime_callbacks ()->remove_domain_jit_jobs (domain);
+
 	/* Finalize all finalizable objects in the doomed appdomain */
 	if (!mono_domain_finalize (domain, -1)) {
 		data->failure_reason = g_strdup_printf ("Finalization of domain %s timed out.", domain->friendly_name);
@@ -5940,6 +5940,44 @@ mono_generic_class_setup_parent (MonoClass *klass, MonoClass *gtd)
 }
 
 
+/*
+ * is_simd_vector_inst:
+ *
+ *   Return whenever GCLASS is an instance of Mono.Simd.Vector<T> with one of
+ * the primitive numeric types as T. These are treated as simd types by the
+ * JIT, with the lane count depending on T.
+ */
+static gboolean
+is_simd_vector_inst (MonoGenericClass *gclass)
+{
+	MonoClass *gklass = gclass->container_class;
+	MonoType *t;
+
+	if (strcmp (gklass->name, "Vector`1") || strcmp (gklass->name_space, "Mono.Simd"))
+		return FALSE;
+	if (!gklass->image->assembly_name || strcmp (gklass->image->assembly_name, "Mono.Simd"))
+		return FALSE;
+
+	t = gclass->context.class_inst->type_argv [0];
+	if (t->byref)
+		return FALSE;
+	switch (t->type) {
+	case MONO_TYPE_I1:
+	case MONO_TYPE_U1:
+	case MONO_TYPE_I2:
+	case MONO_TYPE_U2:
+	case MONO_TYPE_I4:
+	case MONO_TYPE_U4:
+	case MONO_TYPE_I8:
+	case MONO_TYPE_U8:
+	case MONO_TYPE_R4:
+	case MONO_TYPE_R8:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
 /*
  * Create the `MonoClass' for an instantiation of a generic type.
  * We only do this if we actually need it.
@@ -5988,6 +6026,7 @@ mono_generic_class_get_class (MonoGenericClass *gclass)
 	klass->this_arg.byref = TRUE;
 	klass->enumtype = gklass->enumtype;
 	klass->valuetype = gklass->valuetype;
+	klass->simd_type = is_simd_vector_inst (gclass);
 
 	klass->cast_class = klass->element_class = klass;
 
@@ -227,6 +227,8 @@ struct _MonoJitInfo {
 	gboolean    dbg_step_through:1;
 	gboolean    dbg_non_user_code_inited:1;
 	gboolean    dbg_non_user_code:1;
+	/* Whenever this is tier 0 code which will be replaced by optimized code once it gets hot */
+	gboolean    tier0:1;
 
 	/* FIXME: Embed this after the structure later*/
 	gpointer    gc_info; /* Currently only used by SGen */
@@ -279,6 +281,9 @@ typedef struct _MonoThunkFreeList {
 
 typedef struct _MonoJitCodeHash MonoJitCodeHash;
 
+/* Lock-free table of interned strings, see object.c */
+typedef struct _MonoInternTable MonoInternTable;
+
 typedef struct _MonoTlsDataRecord MonoTlsDataRecord;
 struct _MonoTlsDataRecord {
 	MonoTlsDataRecord *next;
@@ -318,7 +323,7 @@ struct _MonoDomain {
 	 */
 #define MONO_DOMAIN_FIRST_GC_TRACKED env
 	MonoGHashTable     *env;
-	MonoGHashTable     *ldstr_table;
+	MonoInternTable    *ldstr_table;
 	/* hashtables for Reflection handles */
 	MonoGHashTable     *type_hash;
 	MonoGHashTable     *refobject_hash;
@@ -483,6 +488,12 @@ mono_jit_info_table_add    (MonoDomain *domain, MonoJitInfo *ji) MONO_INTERNAL;
 void
 mono_jit_info_table_remove (MonoDomain *domain, MonoJitInfo *ji) MONO_INTERNAL;
 
+MonoInternTable *
+mono_intern_table_new (void) MONO_INTERNAL;
+
+void
+mono_intern_table_destroy (MonoInternTable *table) MONO_INTERNAL;
+
 void
 mono_jit_info_add_aot_module (MonoImage *image, gpointer start, gpointer end) MONO_INTERNAL;
 
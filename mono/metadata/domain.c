@@ -424,7 +424,7 @@ mono_domain_create (void)
 
 	mono_profiler_appdomain_event (domain, MONO_PROFILE_START_LOAD);
 
-	domain->mp = mono_mempool_new ();
+	domain->mp = mono_mempool_new_concurrent ();
 	domain->code_mp = mono_code_manager_new ();
 	domain->lock_free_mp = lock_free_mempool_new ();
 	domain->env = mono_g_hash_table_new_type ((GHashFunc)mono_string_hash, (GCompareFunc)mono_string_equal, MONO_HASH_KEY_VALUE_GC);
@@ -435,7 +435,7 @@ mono_domain_create (void)
 	domain->proxy_vtable_hash = g_hash_table_new ((GHashFunc)mono_ptrarray_hash, (GCompareFunc)mono_ptrarray_equal);
 	domain->static_data_array = NULL;
 	mono_jit_code_hash_init (&domain->jit_code_hash);
-	domain->ldstr_table = mono_g_hash_table_new_type ((GHashFunc)mono_string_hash, (GCompareFunc)mono_string_equal, MONO_HASH_KEY_VALUE_GC);
+	domain->ldstr_table = mono_intern_table_new ();
 	domain->num_jit_info_tables = 1;
 	domain->jit_info_table = mono_jit_info_table_new (domain);
 	domain->jit_info_free_queue = NULL;
@@ -1114,7 +1114,7 @@ mono_domain_free (MonoDomain *domain, gboolean force)
 	 * no more such references, or we'll crash if a collection
 	 * occurs.
 	 */
-	mono_g_hash_table_destroy (domain->ldstr_table);
+	mono_intern_table_destroy (domain->ldstr_table);
 	domain->ldstr_table = NULL;
 
 	mono_g_hash_table_destroy (domain->env);
@@ -1322,19 +1322,17 @@ mono_domain_get_id (MonoDomain *domain)
 /*
  * mono_domain_alloc:
  *
- * LOCKING: Acquires the domain lock.
+ * LOCKING: Lock free, the domain mempool is a concurrent one.
  */
 gpointer
 mono_domain_alloc (MonoDomain *domain, guint size)
 {
 	gpointer res;
 
-	mono_domain_lock (domain);
 #ifndef DISABLE_PERFCOUNTERS
 	mono_perfcounters->loader_bytes += size;
 #endif
 	res = mono_mempool_alloc (domain->mp, size);
-	mono_domain_unlock (domain);
 
 	return res;
 }
@@ -1342,19 +1340,17 @@ mono_domain_alloc (MonoDomain *domain, guint size)
 /*
  * mono_domain_alloc0:
  *
- * LOCKING: Acquires the domain lock.
+ * LOCKING: Lock free, the domain mempool is a concurrent one.
  */
 gpointer
 mono_domain_alloc0 (MonoDomain *domain, guint size)
 {
 	gpointer res;
 
-	mono_domain_lock (domain);
 #ifndef DISABLE_PERFCOUNTERS
 	mono_perfcounters->loader_bytes += size;
 #endif
 	res = mono_mempool_alloc0 (domain->mp, size);
-	mono_domain_unlock (domain);
 
 	return res;
 }
@@ -80,6 +80,7 @@
 #include <mono/io-layer/io-layer.h>
 #include <mono/utils/strtod.h>
 #include <mono/utils/monobitset.h>
+#include <mono/utils/mono-conc-hashtable.h>
 #include <mono/utils/mono-time.h>
 #include <mono/utils/mono-proclib.h>
 #include <mono/utils/mono-string.h>
@@ -7775,8 +7776,197 @@ icall_symbols [] = {
 
 #endif /* DISABLE_ICALL_TABLES */
 
+#ifndef DISABLE_ICALL_TABLES
+
+/*
+ * Minimal perfect hash over the static icall tables, keyed by the class name
+ * and the method name as it appears in icall-def.h (with or without a
+ * signature). It maps every key to a distinct slot holding its icall index,
+ * so a lookup is one hash plus two string compares instead of two binary
+ * searches. It is built by hash-and-displace in mono_icall_init (): the
+ * tables depend on the configure flags, so they are only final once compiled.
+ */
+typedef struct {
+	guint32 hash;
+	guint16 type;
+	guint16 icall;
+} IcallHashSlot;
+
+#define ICALL_PHASH_BUCKET_SIZE 4
+#define ICALL_PHASH_MAX_DISP 0xffff
+
+static IcallHashSlot *icall_phash_slots;
+static guint16 *icall_phash_disp;
+static int icall_phash_nbuckets;
+
+static inline guint32
+icall_phash_str (guint32 h, const char *s, int len)
+{
+	int i;
+
+	for (i = 0; i < len; ++i)
+		h = (h ^ (guint8)s [i]) * 16777619;
+	return h;
+}
+
+static inline guint32
+icall_phash_key (const char *klass, int klass_len, const char *name, int name_len)
+{
+	guint32 h = icall_phash_str (2166136261U, klass, klass_len);
+	return icall_phash_str (h ^ ':', name, name_len);
+}
+
+static inline int
+icall_phash_slot (guint32 hash, guint16 disp)
+{
+	guint32 h = hash ^ (disp * 0x9e3779b9U);
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h % Icall_last;
+}
+
+static int
+icall_phash_bucket_cmp (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	const int *sizes = user_data;
+
+	return sizes [*(const int*)b] - sizes [*(const int*)a];
+}
+
+static void
+icall_phash_init (void)
+{
+	int nbuckets = Icall_last / ICALL_PHASH_BUCKET_SIZE + 1;
+	guint32 *hashes = g_new (guint32, Icall_last);
+	guint16 *types = g_new (guint16, Icall_last);
+	int *bucket_sizes = g_new0 (int, nbuckets);
+	int *bucket_start = g_new0 (int, nbuckets + 1);
+	int *bucket_keys = g_new (int, Icall_last);
+	int *order = g_new (int, nbuckets);
+	int *slots = g_new (int, ICALL_PHASH_BUCKET_SIZE * 8);
+	guint8 *used = g_new0 (guint8, Icall_last);
+	IcallHashSlot *table = g_new0 (IcallHashSlot, Icall_last);
+	guint16 *disp = g_new0 (guint16, nbuckets);
+	int i, j, k, t;
+
+	for (t = 0; t < Icall_type_num; ++t) {
+		const char *klass = icall_type_name_get (t);
+		const IcallTypeDesc *desc = &icall_type_descs [t];
+
+		for (i = desc->first_icall; i < desc [1].first_icall; ++i) {
+			const char *name = icall_name_get (i);
+
+			hashes [i] = icall_phash_key (klass, strlen (klass), name, strlen (name));
+			types [i] = t;
+			bucket_sizes [hashes [i] % nbuckets]++;
+		}
+	}
+
+	for (i = 0; i < nbuckets; ++i)
+		bucket_start [i + 1] = bucket_start [i] + bucket_sizes [i];
+	for (i = 0; i < Icall_last; ++i) {
+		int b = hashes [i] % nbuckets;
+		bucket_keys [bucket_start [b] + --bucket_sizes [b]] = i;
+	}
+	for (i = 0; i < nbuckets; ++i) {
+		bucket_sizes [i] = bucket_start [i + 1] - bucket_start [i];
+		order [i] = i;
+	}
+
+	/* Place the largest buckets first, while most slots are still free */
+	g_qsort_with_data (order, nbuckets, sizeof (int), icall_phash_bucket_cmp, bucket_sizes);
+
+	for (i = 0; i < nbuckets; ++i) {
+		int b = order [i];
+		int size = bucket_sizes [b];
+		int *keys = bucket_keys + bucket_start [b];
+		int d;
+
+		if (size == 0)
+			break;
+		if (size > ICALL_PHASH_BUCKET_SIZE * 8)
+			goto fail;
+
+		for (d = 0; d <= ICALL_PHASH_MAX_DISP; ++d) {
+			for (j = 0; j < size; ++j) {
+				slots [j] = icall_phash_slot (hashes [keys [j]], d);
+				if (used [slots [j]])
+					break;
+				for (k = 0; k < j; ++k) {
+					if (slots [k] == slots [j])
+						break;
+				}
+				if (k < j)
+					break;
+			}
+			if (j == size)
+				break;
+		}
+		/* Only possible with duplicate entries in icall-def.h */
+		if (d > ICALL_PHASH_MAX_DISP)
+			goto fail;
+
+		disp [b] = d;
+		for (j = 0; j < size; ++j) {
+			used [slots [j]] = 1;
+			table [slots [j]].hash = hashes [keys [j]];
+			table [slots [j]].type = types [keys [j]];
+			table [slots [j]].icall = keys [j];
+		}
+	}
+
+	icall_phash_nbuckets = nbuckets;
+	icall_phash_disp = disp;
+	icall_phash_slots = table;
+	table = NULL;
+	disp = NULL;
+
+fail:
+	/* On failure lookups fall back to binary searches over the tables */
+	g_free (table);
+	g_free (disp);
+	g_free (used);
+	g_free (slots);
+	g_free (order);
+	g_free (bucket_keys);
+	g_free (bucket_start);
+	g_free (bucket_sizes);
+	g_free (types);
+	g_free (hashes);
+}
+
+static void
+icall_phash_cleanup (void)
+{
+	g_free (icall_phash_slots);
+	g_free (icall_phash_disp);
+	icall_phash_slots = NULL;
+	icall_phash_disp = NULL;
+}
+
+#endif /* !DISABLE_ICALL_TABLES */
+
+/* The registrations of a "Class::method" name in icall_names */
+typedef struct {
+	/* The icall registered without a signature, if any */
+	gconstpointer func;
+	/* Whenever icalls were registered with a signature too */
+	gboolean has_sig;
+} IcallName;
+
 static mono_mutex_t icall_mutex;
 static GHashTable *icall_hash = NULL;
+/*
+ * Maps the "Class::method" part of the names in icall_hash to IcallName's, so
+ * lookups of other methods skip formatting their signature and taking the icall
+ * lock. Lookups don't need a lock.
+ */
+static mono_mutex_t icall_names_mutex;
+static MonoConcurrentHashTable *icall_names;
 static GHashTable *jit_icall_hash_name = NULL;
 static GHashTable *jit_icall_hash_addr = NULL;
 
@@ -7810,10 +8000,14 @@ mono_icall_init (void)
 			}
 		}
 	}
+
+	icall_phash_init ();
 #endif
 
 	icall_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	mono_mutex_init (&icall_mutex);
+	mono_mutex_init (&icall_names_mutex);
+	icall_names = mono_conc_hashtable_new_full (&icall_names_mutex, g_str_hash, g_str_equal, g_free, g_free);
 }
 
 static void
@@ -7832,18 +8026,45 @@ void
 mono_icall_cleanup (void)
 {
 	g_hash_table_destroy (icall_hash);
+	mono_conc_hashtable_destroy (icall_names);
 	g_hash_table_destroy (jit_icall_hash_name);
 	g_hash_table_destroy (jit_icall_hash_addr);
+#ifndef DISABLE_ICALL_TABLES
+	icall_phash_cleanup ();
+#endif
 	mono_mutex_destroy (&icall_mutex);
+	mono_mutex_destroy (&icall_names_mutex);
 }
 
 void
 mono_add_internal_call (const char *name, gconstpointer method)
 {
+	IcallName *iname;
+	const char *sig;
+	char *mname;
+
 	mono_icall_lock ();
 
 	g_hash_table_insert (icall_hash, g_strdup (name), (gpointer) method);
 
+	sig = strchr (name, '(');
+	mname = sig ? g_strndup (name, sig - name) : g_strdup (name);
+	iname = mono_conc_hashtable_lookup (icall_names, mname);
+	if (!iname) {
+		iname = g_new0 (IcallName, 1);
+		if (sig)
+			iname->has_sig = TRUE;
+		else
+			iname->func = method;
+		mono_conc_hashtable_insert (icall_names, mname, iname);
+	} else {
+		g_free (mname);
+		if (sig)
+			iname->has_sig = TRUE;
+		else
+			iname->func = method;
+	}
+
 	mono_icall_unlock ();
 }
 
@@ -7857,13 +8078,13 @@ compare_method_imap (const void *key, const void *elem)
 	return strcmp (key, method_name);
 }
 
-static gpointer
+static int
 find_method_icall (const IcallTypeDesc *imap, const char *name)
 {
 	const guint16 *nameslot = mono_binary_search (name, icall_names_idx + imap->first_icall, icall_desc_num_icalls (imap), sizeof (icall_names_idx [0]), compare_method_imap);
 	if (!nameslot)
-		return NULL;
-	return (gpointer)icall_functions [(nameslot - &icall_names_idx [0])];
+		return -1;
+	return nameslot - &icall_names_idx [0];
 }
 
 static int
@@ -7891,13 +8112,13 @@ compare_method_imap (const void *key, const void *elem)
 	return strcmp (key, *method_name);
 }
 
-static gpointer
+static int
 find_method_icall (const IcallTypeDesc *imap, const char *name)
 {
 	const char **nameslot = mono_binary_search (name, icall_names + imap->first_icall, icall_desc_num_icalls (imap), sizeof (icall_names [0]), compare_method_imap);
 	if (!nameslot)
-		return NULL;
-	return (gpointer)icall_functions [(nameslot - icall_names)];
+		return -1;
+	return nameslot - icall_names;
 }
 
 static int
@@ -7918,6 +8139,42 @@ find_class_icalls (const char *name)
 
 #endif /* HAVE_ARRAY_ELEM_INIT */
 
+/*
+ * find_icall:
+ *
+ *   Return the index of the icall NAME of the class whose name is the first
+ * KLASS_LEN chars of KLASS, or -1.
+ */
+static int
+find_icall (char *klass, int klass_len, const char *name)
+{
+	const IcallTypeDesc *imap;
+	char saved;
+
+	if (icall_phash_slots) {
+		int name_len = strlen (name);
+		guint32 hash = icall_phash_key (klass, klass_len, name, name_len);
+		const IcallHashSlot *slot = &icall_phash_slots [icall_phash_slot (hash, icall_phash_disp [hash % icall_phash_nbuckets])];
+		const char *slot_klass, *slot_name;
+
+		if (slot->hash != hash)
+			return -1;
+		slot_klass = icall_type_name_get (slot->type);
+		slot_name = icall_name_get (slot->icall);
+		if (strncmp (slot_klass, klass, klass_len) || slot_klass [klass_len] || strcmp (slot_name, name))
+			return -1;
+		return slot->icall;
+	}
+
+	saved = klass [klass_len];
+	klass [klass_len] = 0;
+	imap = find_class_icalls (klass);
+	klass [klass_len] = saved;
+	if (!imap)
+		return -1;
+	return find_method_icall (imap, name);
+}
+
 #endif /* DISABLE_ICALL_TABLES */
 
 /* 
@@ -7949,16 +8206,44 @@ no_icall_table (void)
 }
 #endif
 
+/*
+ * append_signature_desc:
+ *
+ *   Write the signature of METHOD in parens to SIGSTART, which points into the
+ * MNAME_SIZE sized buffer MNAME. Return FALSE if it doesn't fit.
+ */
+static gboolean
+append_signature_desc (MonoMethod *method, char *mname, int mname_size, char *sigstart)
+{
+	char *tmpsig;
+	int siglen;
+
+	tmpsig = mono_signature_get_desc (mono_method_signature (method), TRUE);
+	siglen = strlen (tmpsig);
+	if ((sigstart - mname) + siglen + 4 > mname_size) {
+		g_free (tmpsig);
+		return FALSE;
+	}
+	sigstart [0] = '(';
+	memcpy (sigstart + 1, tmpsig, siglen);
+	sigstart [siglen + 1] = ')';
+	sigstart [siglen + 2] = 0;
+	g_free (tmpsig);
+	return TRUE;
+}
+
 gpointer
 mono_lookup_internal_call (MonoMethod *method)
 {
 	char *sigstart;
-	char *tmpsig;
 	char mname [2048];
-	int typelen = 0, mlen, siglen;
-	gpointer res;
+	int typelen = 0, mlen;
+	gboolean has_sig = FALSE;
+	gpointer res = NULL;
+	IcallName *iname;
+	MonoMethodPInvoke *piinfo = NULL;
 #ifndef DISABLE_ICALL_TABLES
-	const IcallTypeDesc *imap = NULL;
+	int idx;
 #endif
 
 	g_assert (method != NULL);
@@ -7966,6 +8251,13 @@ mono_lookup_internal_call (MonoMethod *method)
 	if (method->is_inflated)
 		method = ((MonoMethodInflated *) method)->declaring;
 
+	/* Icall methods are MonoMethodPInvokes, their addr field caches the result */
+	if (method->iflags & METHOD_IMPL_ATTRIBUTE_INTERNAL_CALL) {
+		piinfo = (MonoMethodPInvoke *) method;
+		if (piinfo->addr)
+			return piinfo->addr;
+	}
+
 	if (method->klass->nested_in) {
 		int pos = concat_class_name (mname, sizeof (mname)-2, method->klass->nested_in);
 		if (!pos)
@@ -7985,45 +8277,40 @@ mono_lookup_internal_call (MonoMethod *method)
 			return NULL;
 	}
 
-#ifndef DISABLE_ICALL_TABLES
-	imap = find_class_icalls (mname);
-#endif
-
 	mname [typelen] = ':';
 	mname [typelen + 1] = ':';
 
 	mlen = strlen (method->name);
+	if (typelen + mlen + 3 > sizeof (mname))
+		return NULL;
 	memcpy (mname + typelen + 2, method->name, mlen);
 	sigstart = mname + typelen + 2 + mlen;
 	*sigstart = 0;
 
-	tmpsig = mono_signature_get_desc (mono_method_signature (method), TRUE);
-	siglen = strlen (tmpsig);
-	if (typelen + mlen + siglen + 6 > sizeof (mname))
-		return NULL;
-	sigstart [0] = '(';
-	memcpy (sigstart + 1, tmpsig, siglen);
-	sigstart [siglen + 1] = ')';
-	sigstart [siglen + 2] = 0;
-	g_free (tmpsig);
-	
-	mono_icall_lock ();
+	/*
+	 * Icalls registered with mono_add_internal_call () take precedence over the
+	 * static tables. The signature is only needed when one of them was registered
+	 * with a signature, or for the few overloaded entries in icall-def.h.
+	 */
+	iname = mono_conc_hashtable_lookup (icall_names, mname);
+	if (iname) {
+		if (iname->has_sig) {
+			if (!append_signature_desc (method, mname, sizeof (mname), sigstart))
+				return NULL;
+			has_sig = TRUE;
 
-	res = g_hash_table_lookup (icall_hash, mname);
-	if (res) {
-		mono_icall_unlock ();;
-		return res;
-	}
-	/* try without signature */
-	*sigstart = 0;
-	res = g_hash_table_lookup (icall_hash, mname);
-	if (res) {
-		mono_icall_unlock ();
-		return res;
+			mono_icall_lock ();
+			res = g_hash_table_lookup (icall_hash, mname);
+			mono_icall_unlock ();
+		}
+		/* try without signature */
+		if (!res)
+			res = (gpointer)iname->func;
+		if (res)
+			goto found;
 	}
 
 #ifdef DISABLE_ICALL_TABLES
-	mono_icall_unlock ();
 	/* Fail only when the result is actually used */
 	/* mono_marshal_get_native_wrapper () depends on this */
 	if (method->klass == mono_defaults.string_class && !strcmp (method->name, ".ctor"))
@@ -8031,24 +8318,27 @@ mono_lookup_internal_call (MonoMethod *method)
 	else
 		return no_icall_table;
 #else
-	/* it wasn't found in the static call tables */
-	if (!imap) {
-		mono_icall_unlock ();
-		return NULL;
-	}
-	res = find_method_icall (imap, sigstart - mlen);
-	if (res) {
-		mono_icall_unlock ();
-		return res;
+	*sigstart = 0;
+	idx = find_icall (mname, typelen, sigstart - mlen);
+	if (idx < 0) {
+		/* try _with_ signature */
+		if (has_sig)
+			*sigstart = '(';
+		else if (!append_signature_desc (method, mname, sizeof (mname), sigstart))
+			return NULL;
+		idx = find_icall (mname, typelen, sigstart - mlen);
 	}
-	/* try _with_ signature */
-	*sigstart = '(';
-	res = find_method_icall (imap, sigstart - mlen);
-	if (res) {
-		mono_icall_unlock ();
-		return res;
+	if (idx >= 0) {
+		res = (gpointer)icall_functions [idx];
+		goto found;
 	}
 
+	/* Only complain about classes which do have icalls */
+	mname [typelen] = 0;
+	if (!find_class_icalls (mname))
+		return NULL;
+	mname [typelen] = ':';
+
 	g_warning ("cant resolve internal call to \"%s\" (tested without signature also)", mname);
 	g_print ("\nYour mono runtime and class libraries are out of sync.\n");
 	g_print ("The out of sync library is: %s\n", method->klass->image->name);
@@ -8057,19 +8347,14 @@ mono_lookup_internal_call (MonoMethod *method)
 	g_print ("If you see other errors or faults after this message they are probably related\n");
 	g_print ("and you need to fix your mono install first.\n");
 
-	mono_icall_unlock ();
-
 	return NULL;
 #endif
-}
 
-#ifdef ENABLE_ICALL_SYMBOL_MAP
-static int
-func_cmp (gconstpointer key, gconstpointer p)
-{
-	return (gsize)key - (gsize)*(gsize*)p;
+found:
+	if (piinfo)
+		piinfo->addr = res;
+	return res;
 }
-#endif
 
 /*
  * mono_lookup_icall_symbol:
@@ -8084,48 +8369,27 @@ mono_lookup_icall_symbol (MonoMethod *m)
 	return NULL;
 #else
 #ifdef ENABLE_ICALL_SYMBOL_MAP
+	static GHashTable *func_to_symbol;
+	GHashTable *hash;
 	gpointer func;
+	const char *res;
 	int i;
-	gpointer slot;
-	static gconstpointer *functions_sorted;
-	static const char**symbols_sorted;
-	static gboolean inited;
-
-	if (!inited) {
-		gboolean changed;
-
-		functions_sorted = g_malloc (G_N_ELEMENTS (icall_functions) * sizeof (gpointer));
-		memcpy (functions_sorted, icall_functions, G_N_ELEMENTS (icall_functions) * sizeof (gpointer));
-		symbols_sorted = g_malloc (G_N_ELEMENTS (icall_functions) * sizeof (gpointer));
-		memcpy (symbols_sorted, icall_symbols, G_N_ELEMENTS (icall_functions) * sizeof (gpointer));
-		/* Bubble sort the two arrays */
-		changed = TRUE;
-		while (changed) {
-			changed = FALSE;
-			for (i = 0; i < G_N_ELEMENTS (icall_functions) - 1; ++i) {
-				if (functions_sorted [i] > functions_sorted [i + 1]) {
-					gconstpointer tmp;
-
-					tmp = functions_sorted [i];
-					functions_sorted [i] = functions_sorted [i + 1];
-					functions_sorted [i + 1] = tmp;
-					tmp = symbols_sorted [i];
-					symbols_sorted [i] = symbols_sorted [i + 1];
-					symbols_sorted [i + 1] = tmp;
-					changed = TRUE;
-				}
-			}
-		}
-	}
 
 	func = mono_lookup_internal_call (m);
 	if (!func)
 		return NULL;
-	slot = mono_binary_search (func, functions_sorted, G_N_ELEMENTS (icall_functions), sizeof (gpointer), func_cmp);
-	if (!slot)
-		return NULL;
-	g_assert (slot);
-	return symbols_sorted [(gpointer*)slot - (gpointer*)functions_sorted];
+
+	mono_icall_lock ();
+	if (!func_to_symbol) {
+		/* Icalls sharing a function share the symbol too */
+		hash = g_hash_table_new (NULL, NULL);
+		for (i = 0; i < Icall_last; ++i)
+			g_hash_table_insert (hash, (gpointer)icall_functions [i], (gpointer)icall_symbols [i]);
+		func_to_symbol = hash;
+	}
+	res = g_hash_table_lookup (func_to_symbol, func);
+	mono_icall_unlock ();
+	return res;
 #else
 	fprintf (stderr, "icall symbol maps not enabled, pass --enable-icall-symbol-map to configure.\n");
 	g_assert_not_reached ();
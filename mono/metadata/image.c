@@ -38,6 +38,7 @@
 #include <mono/metadata/security-core-clr.h>
 #include <mono/metadata/verify-internals.h>
 #include <mono/metadata/verify.h>
+#include <mono/metadata/mempool-internals.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #ifdef HAVE_UNISTD_H
@@ -674,7 +675,7 @@ mono_image_init (MonoImage *image)
 	mono_mutex_init_recursive (&image->lock);
 	mono_mutex_init_recursive (&image->szarray_cache_lock);
 
-	image->mempool = mono_mempool_new_size (512);
+	image->mempool = mono_mempool_new_concurrent ();
 	mono_internal_hash_table_init (&image->class_cache,
 				       g_direct_hash,
 				       class_key_extract,
@@ -1476,6 +1477,13 @@ free_hash (GHashTable *hash)
 		g_hash_table_destroy (hash);
 }
 
+static inline void
+free_conc_hash (MonoConcurrentHashTable *hash)
+{
+	if (hash)
+		mono_conc_hashtable_destroy (hash);
+}
+
 /*
  * Returns whether mono_image_close_finish() must be called as well.
  * We must unload images in two steps because clearing the domain in
@@ -1604,6 +1612,8 @@ mono_image_close_except_pools (MonoImage *image)
 		g_hash_table_destroy (image->methodref_cache);
 	mono_internal_hash_table_destroy (&image->class_cache);
 	mono_conc_hashtable_destroy (image->field_cache);
+	if (image->cattr_cache)
+		mono_conc_hashtable_destroy (image->cattr_cache);
 	if (image->array_cache) {
 		g_hash_table_foreach (image->array_cache, free_array_cache_entry, NULL);
 		g_hash_table_destroy (image->array_cache);
@@ -1617,38 +1627,40 @@ mono_image_close_except_pools (MonoImage *image)
 		g_hash_table_destroy (image->name_cache);
 	}
 
-	free_hash (image->native_wrapper_cache);
-	free_hash (image->managed_wrapper_cache);
+	free_conc_hash (image->native_wrapper_cache);
+	free_conc_hash (image->managed_wrapper_cache);
 	free_hash (image->delegate_begin_invoke_cache);
 	free_hash (image->delegate_end_invoke_cache);
 	free_hash (image->delegate_invoke_cache);
 	free_hash (image->delegate_abstract_invoke_cache);
-	free_hash (image->delegate_bound_static_invoke_cache);
-	free_hash (image->delegate_invoke_generic_cache);
-	free_hash (image->delegate_begin_invoke_generic_cache);
-	free_hash (image->delegate_end_invoke_generic_cache);
-	free_hash (image->synchronized_generic_cache);
+	free_conc_hash (image->delegate_bound_static_invoke_cache);
+	free_conc_hash (image->delegate_invoke_generic_cache);
+	free_conc_hash (image->delegate_begin_invoke_generic_cache);
+	free_conc_hash (image->delegate_end_invoke_generic_cache);
+	free_conc_hash (image->synchronized_generic_cache);
 	free_hash (image->remoting_invoke_cache);
 	free_hash (image->runtime_invoke_cache);
 	free_hash (image->runtime_invoke_vtype_cache);
-	free_hash (image->runtime_invoke_direct_cache);
-	free_hash (image->runtime_invoke_vcall_cache);
-	free_hash (image->synchronized_cache);
-	free_hash (image->unbox_wrapper_cache);
-	free_hash (image->cominterop_invoke_cache);
-	free_hash (image->cominterop_wrapper_cache);
+	free_conc_hash (image->runtime_invoke_direct_cache);
+	free_conc_hash (image->runtime_invoke_vcall_cache);
+	free_conc_hash (image->synchronized_cache);
+	free_conc_hash (image->unbox_wrapper_cache);
+	free_conc_hash (image->cominterop_invoke_cache);
+	free_conc_hash (image->cominterop_wrapper_cache);
 	free_hash (image->typespec_cache);
-	free_hash (image->ldfld_wrapper_cache);
-	free_hash (image->ldflda_wrapper_cache);
-	free_hash (image->stfld_wrapper_cache);
-	free_hash (image->isinst_cache);
-	free_hash (image->castclass_cache);
-	free_hash (image->proxy_isinst_cache);
-	free_hash (image->thunk_invoke_cache);
+	free_conc_hash (image->ldfld_wrapper_cache);
+	free_conc_hash (image->ldflda_wrapper_cache);
+	free_conc_hash (image->stfld_wrapper_cache);
+	free_conc_hash (image->isinst_cache);
+	free_conc_hash (image->castclass_cache);
+	free_conc_hash (image->proxy_isinst_cache);
+	free_conc_hash (image->thunk_invoke_cache);
 	free_hash (image->var_cache_slow);
 	free_hash (image->mvar_cache_slow);
 	free_hash (image->wrapper_param_names);
-	free_hash (image->native_wrapper_aot_cache);
+	free_conc_hash (image->native_wrapper_aot_cache);
+	free_conc_hash (image->native_func_wrapper_aot_cache);
+	free_conc_hash (image->array_accessor_cache);
 	free_hash (image->pinvoke_scopes);
 	free_hash (image->pinvoke_scope_filenames);
 	free_hash (image->gsharedvt_types);
@@ -2245,9 +2257,7 @@ mono_image_alloc (MonoImage *image, guint size)
 #ifndef DISABLE_PERFCOUNTERS
 	mono_perfcounters->loader_bytes += size;
 #endif
-	mono_image_lock (image);
 	res = mono_mempool_alloc (image->mempool, size);
-	mono_image_unlock (image);
 
 	return res;
 }
@@ -2260,9 +2270,7 @@ mono_image_alloc0 (MonoImage *image, guint size)
 #ifndef DISABLE_PERFCOUNTERS
 	mono_perfcounters->loader_bytes += size;
 #endif
-	mono_image_lock (image);
 	res = mono_mempool_alloc0 (image->mempool, size);
-	mono_image_unlock (image);
 
 	return res;
 }
@@ -2275,9 +2283,7 @@ mono_image_strdup (MonoImage *image, const char *s)
 #ifndef DISABLE_PERFCOUNTERS
 	mono_perfcounters->loader_bytes += strlen (s);
 #endif
-	mono_image_lock (image);
 	res = mono_mempool_strdup (image->mempool, s);
-	mono_image_unlock (image);
 
 	return res;
 }
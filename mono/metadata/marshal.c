@@ -644,18 +644,11 @@ mono_byvalarray_to_array (MonoArray *arr, gpointer native_arr, MonoClass *elclas
 	g_assert (arr->obj.vtable->klass->element_class == mono_defaults.char_class);
 
 	if (elclass == mono_defaults.byte_class) {
-		GError *error = NULL;
-		guint16 *ut;
-		glong items_written;
-
-		ut = g_utf8_to_utf16 (native_arr, elnum, NULL, &items_written, &error);
+		glong items_read;
 
-		if (!error) {
-			memcpy (mono_array_addr (arr, guint16, 0), ut, items_written * sizeof (guint16));
-			g_free (ut);
-		}
-		else
-			g_error_free (error);
+		/* Every byte decodes to at most one char, so the array has room */
+		if (eg_utf8_to_utf16_len (native_arr, elnum, &items_read, FALSE, NULL) >= 0)
+			eg_utf8_to_utf16_buf (native_arr, items_read, mono_array_addr (arr, gunichar2, 0));
 	}
 	else
 		g_assert_not_reached ();
@@ -701,30 +694,33 @@ mono_string_utf8_to_builder (MonoStringBuilder *sb, char *text)
 {
 	GError *error = NULL;
 	guint16 *ut;
-	glong items_written;
-	int l;
+	glong items_read, len, items_written;
 
 	if (!sb || !text)
 		return;
 
-	l = strlen (text);
-
-	ut = g_utf8_to_utf16 (text, l, NULL, &items_written, &error);
-	
-	if (items_written > mono_stringbuilder_capacity (sb))
-		items_written = mono_stringbuilder_capacity (sb);
-	
-	if (!error) {
-		if (! sb->str || sb->str == sb->cached_str)
-			MONO_OBJECT_SETREF (sb, str, mono_string_new_size (mono_domain_get (), items_written));
-		
-		memcpy (mono_string_chars (sb->str), ut, items_written * 2);
-		sb->length = items_written;
-		sb->cached_str = NULL;
-	} else 
+	len = eg_utf8_to_utf16_len (text, strlen (text), &items_read, FALSE, &error);
+	if (len < 0) {
 		g_error_free (error);
+		return;
+	}
+
+	items_written = MIN (len, mono_stringbuilder_capacity (sb));
 
-	g_free (ut);
+	if (! sb->str || sb->str == sb->cached_str)
+		MONO_OBJECT_SETREF (sb, str, mono_string_new_size (mono_domain_get (), items_written));
+
+	if (items_written == len) {
+		eg_utf8_to_utf16_buf (text, items_read, mono_string_chars (sb->str));
+	} else {
+		/* the text is truncated to the capacity of the builder */
+		ut = g_new (guint16, len);
+		eg_utf8_to_utf16_buf (text, items_read, ut);
+		memcpy (mono_string_chars (sb->str), ut, items_written * 2);
+		g_free (ut);
+	}
+	sb->length = items_written;
+	sb->cached_str = NULL;
 }
 
 MonoStringBuilder *
@@ -909,8 +905,8 @@ static gpointer
 mono_string_to_lpstr (MonoString *s)
 {
 #ifdef TARGET_WIN32
-	char *as, *tmp;
-	glong len;
+	char *as;
+	glong len, items_read;
 	GError *error = NULL;
 
 	if (s == NULL)
@@ -922,16 +918,16 @@ mono_string_to_lpstr (MonoString *s)
 		return as;
 	}
 
-	tmp = g_utf16_to_utf8 (mono_string_chars (s), s->length, NULL, &len, &error);
-	if (error) {
+	len = eg_utf16_to_utf8_len (mono_string_chars (s), s->length, &items_read, &error);
+	if (len < 0) {
 		MonoException *exc = mono_get_exception_argument ("string", error->message);
 		g_error_free (error);
 		mono_raise_exception(exc);
 		return NULL;
 	} else {
 		as = CoTaskMemAlloc (len + 1);
-		memcpy (as, tmp, len + 1);
-		g_free (tmp);
+		eg_utf16_to_utf8_buf (mono_string_chars (s), items_read, as);
+		as [len] = '\0';
 		return as;
 	}
 #else
@@ -2344,15 +2340,17 @@ mono_marshal_need_free (MonoType *t, MonoMethodPInvoke *piinfo, MonoMarshalSpec
 
 /*
  * Return the hash table pointed to by VAR, lazily creating it if neccesary.
+ * Lookups in the returned table are lock-free, the marshal lock is only
+ * taken by writers.
  */
-static GHashTable*
-get_cache (GHashTable **var, GHashFunc hash_func, GCompareFunc equal_func)
+static MonoConcurrentHashTable*
+get_cache (MonoConcurrentHashTable **var, GHashFunc hash_func, GCompareFunc equal_func)
 {
 	if (!(*var)) {
 		mono_marshal_lock ();
 		if (!(*var)) {
-			GHashTable *cache = 
-				g_hash_table_new (hash_func, equal_func);
+			MonoConcurrentHashTable *cache = 
+				mono_conc_hashtable_new (&marshal_mutex, hash_func, (GEqualFunc)equal_func);
 			mono_memory_barrier ();
 			*var = cache;
 		}
@@ -2361,21 +2359,16 @@ get_cache (GHashTable **var, GHashFunc hash_func, GCompareFunc equal_func)
 	return *var;
 }
 
-GHashTable*
-mono_marshal_get_cache (GHashTable **var, GHashFunc hash_func, GCompareFunc equal_func)
+MonoConcurrentHashTable*
+mono_marshal_get_cache (MonoConcurrentHashTable **var, GHashFunc hash_func, GCompareFunc equal_func)
 {
 	return get_cache (var, hash_func, equal_func);
 }
 
 MonoMethod*
-mono_marshal_find_in_cache (GHashTable *cache, gpointer key)
+mono_marshal_find_in_cache (MonoConcurrentHashTable *cache, gpointer key)
 {
-	MonoMethod *res;
-
-	mono_marshal_lock ();
-	res = g_hash_table_lookup (cache, key);
-	mono_marshal_unlock ();
-	return res;
+	return mono_conc_hashtable_lookup (cache, key);
 }
 
 /*
@@ -2397,50 +2390,114 @@ mono_mb_create (MonoMethodBuilder *mb, MonoMethodSignature *sig,
 
 /* Create the method from the builder and place it in the cache */
 MonoMethod*
-mono_mb_create_and_cache_full (GHashTable *cache, gpointer key,
+mono_mb_create_and_cache_full (MonoConcurrentHashTable *cache, gpointer key,
 							   MonoMethodBuilder *mb, MonoMethodSignature *sig,
 							   int max_stack, WrapperInfo *info, gboolean *out_found)
 {
-	MonoMethod *res;
+	MonoMethod *res, *newm;
 
 	if (out_found)
 		*out_found = FALSE;
 
-	mono_marshal_lock ();
-	res = g_hash_table_lookup (cache, key);
-	mono_marshal_unlock ();
-	if (!res) {
-		MonoMethod *newm;
-		newm = mono_mb_create_method (mb, sig, max_stack);
-		mono_marshal_lock ();
-		res = g_hash_table_lookup (cache, key);
-		if (!res) {
-			res = newm;
-			g_hash_table_insert (cache, key, res);
-			if (info)
-				mono_marshal_set_wrapper_info (res, info);
-			else
-				mono_marshal_set_wrapper_info (res, key);
-			mono_marshal_unlock ();
-		} else {
-			if (out_found)
-				*out_found = TRUE;
-			mono_marshal_unlock ();
-			mono_free_method (newm);
-		}
+	res = mono_conc_hashtable_lookup (cache, key);
+	if (res)
+		return res;
+
+	newm = mono_mb_create_method (mb, sig, max_stack);
+	/* The wrapper info has to be in place before other threads can see NEWM */
+	if (info)
+		mono_marshal_set_wrapper_info (newm, info);
+	else
+		mono_marshal_set_wrapper_info (newm, key);
+	res = mono_conc_hashtable_insert (cache, key, newm);
+	if (res) {
+		/* Another thread won the race */
+		if (out_found)
+			*out_found = TRUE;
+		mono_free_method (newm);
+	} else {
+		res = newm;
 	}
 
 	return res;
 }		
 
 MonoMethod*
-mono_mb_create_and_cache (GHashTable *cache, gpointer key,
+mono_mb_create_and_cache (MonoConcurrentHashTable *cache, gpointer key,
 							   MonoMethodBuilder *mb, MonoMethodSignature *sig,
 							   int max_stack)
 {
 	return mono_mb_create_and_cache_full (cache, key, mb, sig, max_stack, NULL, NULL);
 }
 
+/*
+ * Caches keyed by signatures are plain hash tables protected by the marshal lock:
+ * mono_marshal_free_inflated_wrappers () removes entries whose key is about to be
+ * freed, and a lock-free reader could still be comparing against that key.
+ */
+static GHashTable*
+get_sig_cache (GHashTable **var, GHashFunc hash_func, GCompareFunc equal_func)
+{
+	if (!(*var)) {
+		mono_marshal_lock ();
+		if (!(*var)) {
+			GHashTable *cache = 
+				g_hash_table_new (hash_func, equal_func);
+			mono_memory_barrier ();
+			*var = cache;
+		}
+		mono_marshal_unlock ();
+	}
+	return *var;
+}
+
+static MonoMethod*
+find_in_sig_cache (GHashTable *cache, MonoMethodSignature *sig)
+{
+	MonoMethod *res;
+
+	mono_marshal_lock ();
+	res = g_hash_table_lookup (cache, sig);
+	mono_marshal_unlock ();
+	return res;
+}
+
+/*
+ * create_and_cache_sig:
+ *
+ *   Same as mono_mb_create_and_cache_full () for the caches returned by
+ * get_sig_cache ().
+ */
+static MonoMethod*
+create_and_cache_sig (GHashTable *cache, MonoMethodSignature *key,
+					  MonoMethodBuilder *mb, MonoMethodSignature *sig,
+					  int max_stack, WrapperInfo *info)
+{
+	MonoMethod *res, *newm;
+
+	res = find_in_sig_cache (cache, key);
+	if (res)
+		return res;
+
+	newm = mono_mb_create_method (mb, sig, max_stack);
+	mono_marshal_lock ();
+	res = g_hash_table_lookup (cache, key);
+	if (!res) {
+		res = newm;
+		g_hash_table_insert (cache, key, res);
+		if (info)
+			mono_marshal_set_wrapper_info (res, info);
+		else
+			mono_marshal_set_wrapper_info (res, key);
+		mono_marshal_unlock ();
+	} else {
+		mono_marshal_unlock ();
+		mono_free_method (newm);
+	}
+
+	return res;
+}
+
 MonoMethod *
 mono_marshal_method_from_wrapper (MonoMethod *wrapper)
 {
@@ -2577,7 +2634,7 @@ get_wrapper_target_class (MonoImage *image)
  * generic method definition.
  */
 static MonoMethod*
-check_generic_wrapper_cache (GHashTable *cache, MonoMethod *orig_method, gpointer key, gpointer def_key)
+check_generic_wrapper_cache (MonoConcurrentHashTable *cache, MonoMethod *orig_method, gpointer key, gpointer def_key)
 {
 	MonoMethod *res;
 	MonoMethod *inst, *def;
@@ -2602,21 +2659,16 @@ check_generic_wrapper_cache (GHashTable *cache, MonoMethod *orig_method, gpointe
 	if (def) {
 		inst = mono_class_inflate_generic_method (def, ctx);
 		/* Cache it */
-		mono_memory_barrier ();
-		mono_marshal_lock ();
-		res = g_hash_table_lookup (cache, key);
-		if (!res) {
-			g_hash_table_insert (cache, key, inst);
+		res = mono_conc_hashtable_insert (cache, key, inst);
+		if (!res)
 			res = inst;
-		}
-		mono_marshal_unlock ();
 		return res;
 	}
 	return NULL;
 }
 
 static MonoMethod*
-cache_generic_wrapper (GHashTable *cache, MonoMethod *orig_method, MonoMethod *def, MonoGenericContext *ctx, gpointer key)
+cache_generic_wrapper (MonoConcurrentHashTable *cache, MonoMethod *orig_method, MonoMethod *def, MonoGenericContext *ctx, gpointer key)
 {
 	MonoMethod *inst, *res;
 
@@ -2624,19 +2676,14 @@ cache_generic_wrapper (GHashTable *cache, MonoMethod *orig_method, MonoMethod *d
 	 * We use the same cache for the generic definition and the instances.
 	 */
 	inst = mono_class_inflate_generic_method (def, ctx);
-	mono_memory_barrier ();
-	mono_marshal_lock ();
-	res = g_hash_table_lookup (cache, key);
-	if (!res) {
-		g_hash_table_insert (cache, key, inst);
+	res = mono_conc_hashtable_insert (cache, key, inst);
+	if (!res)
 		res = inst;
-	}
-	mono_marshal_unlock ();
 	return res;
 }
 
 static MonoMethod*
-check_generic_delegate_wrapper_cache (GHashTable *cache, MonoMethod *orig_method, MonoMethod *def_method, MonoGenericContext *ctx)
+check_generic_delegate_wrapper_cache (MonoConcurrentHashTable *cache, MonoMethod *orig_method, MonoMethod *def_method, MonoGenericContext *ctx)
 {
 	MonoMethod *res;
 	MonoMethod *inst, *def;
@@ -2655,21 +2702,16 @@ check_generic_delegate_wrapper_cache (GHashTable *cache, MonoMethod *orig_method
 	if (def) {
 		inst = mono_class_inflate_generic_method (def, ctx);
 		/* Cache it */
-		mono_memory_barrier ();
-		mono_marshal_lock ();
-		res = g_hash_table_lookup (cache, orig_method->klass);
-		if (!res) {
-			g_hash_table_insert (cache, orig_method->klass, inst);
+		res = mono_conc_hashtable_insert (cache, orig_method->klass, inst);
+		if (!res)
 			res = inst;
-		}
-		mono_marshal_unlock ();
 		return res;
 	}
 	return NULL;
 }
 
 static MonoMethod*
-cache_generic_delegate_wrapper (GHashTable *cache, MonoMethod *orig_method, MonoMethod *def, MonoGenericContext *ctx)
+cache_generic_delegate_wrapper (MonoConcurrentHashTable *cache, MonoMethod *orig_method, MonoMethod *def, MonoGenericContext *ctx)
 {
 	MonoMethod *inst, *res;
 
@@ -2677,14 +2719,9 @@ cache_generic_delegate_wrapper (GHashTable *cache, MonoMethod *orig_method, Mono
 	 * We use the same cache for the generic definition and the instances.
 	 */
 	inst = mono_class_inflate_generic_method (def, ctx);
-	mono_memory_barrier ();
-	mono_marshal_lock ();
-	res = g_hash_table_lookup (cache, orig_method->klass);
-	if (!res) {
-		g_hash_table_insert (cache, orig_method->klass, inst);
+	res = mono_conc_hashtable_insert (cache, orig_method->klass, inst);
+	if (!res)
 		res = inst;
-	}
-	mono_marshal_unlock ();
 	return res;
 }
 
@@ -2694,7 +2731,8 @@ mono_marshal_get_delegate_begin_invoke (MonoMethod *method)
 	MonoMethodSignature *sig;
 	MonoMethodBuilder *mb;
 	MonoMethod *res;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache = NULL;
+	GHashTable *sig_cache = NULL;
 	int params_var;
 	char *name;
 	MonoGenericContext *ctx = NULL;
@@ -2723,10 +2761,10 @@ mono_marshal_get_delegate_begin_invoke (MonoMethod *method)
 		if (res)
 			return res;
 	} else {
-		cache = get_cache (&method->klass->image->delegate_begin_invoke_cache,
-						   (GHashFunc)mono_signature_hash, 
-						   (GCompareFunc)mono_metadata_signature_equal);
-		if ((res = mono_marshal_find_in_cache (cache, sig)))
+		sig_cache = get_sig_cache (&method->klass->image->delegate_begin_invoke_cache,
+								   (GHashFunc)mono_signature_hash, 
+								   (GCompareFunc)mono_metadata_signature_equal);
+		if ((res = find_in_sig_cache (sig_cache, sig)))
 			return res;
 	}
 
@@ -2753,7 +2791,7 @@ mono_marshal_get_delegate_begin_invoke (MonoMethod *method)
 		def = mono_mb_create_and_cache (cache, method->klass, mb, sig, sig->param_count + 16);
 		res = cache_generic_delegate_wrapper (cache, orig_method, def, ctx);
 	} else {
-		res = mono_mb_create_and_cache (cache, sig, mb, sig, sig->param_count + 16);
+		res = create_and_cache_sig (sig_cache, sig, mb, sig, sig->param_count + 16, NULL);
 	}
 
 	mono_mb_free (mb);
@@ -2904,7 +2942,8 @@ mono_marshal_get_delegate_end_invoke (MonoMethod *method)
 	MonoMethodSignature *sig;
 	MonoMethodBuilder *mb;
 	MonoMethod *res;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache = NULL;
+	GHashTable *sig_cache = NULL;
 	int params_var;
 	char *name;
 	MonoGenericContext *ctx = NULL;
@@ -2933,10 +2972,10 @@ mono_marshal_get_delegate_end_invoke (MonoMethod *method)
 		if (res)
 			return res;
 	} else {
-		cache = get_cache (&method->klass->image->delegate_end_invoke_cache,
-						   (GHashFunc)mono_signature_hash, 
-						   (GCompareFunc)mono_metadata_signature_equal);
-		if ((res = mono_marshal_find_in_cache (cache, sig)))
+		sig_cache = get_sig_cache (&method->klass->image->delegate_end_invoke_cache,
+								   (GHashFunc)mono_signature_hash, 
+								   (GCompareFunc)mono_metadata_signature_equal);
+		if ((res = find_in_sig_cache (sig_cache, sig)))
 			return res;
 	}
 
@@ -2968,8 +3007,8 @@ mono_marshal_get_delegate_end_invoke (MonoMethod *method)
 		def = mono_mb_create_and_cache (cache, method->klass, mb, sig, sig->param_count + 16);
 		res = cache_generic_delegate_wrapper (cache, orig_method, def, ctx);
 	} else {
-		res = mono_mb_create_and_cache (cache, sig,
-										mb, sig, sig->param_count + 16);
+		res = create_and_cache_sig (sig_cache, sig,
+									mb, sig, sig->param_count + 16, NULL);
 	}
 	mono_mb_free (mb);
 
@@ -3018,7 +3057,9 @@ mono_marshal_get_delegate_invoke_internal (MonoMethod *method, gboolean callvirt
 	int i;
 	MonoMethodBuilder *mb;
 	MonoMethod *res;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache = NULL;
+	GHashTable *sig_cache = NULL;
+	GHashTable *abstract_cache = NULL;
 	gpointer cache_key = NULL;
 	SignatureMethodPair key;
 	SignatureMethodPair *new_key;
@@ -3032,7 +3073,6 @@ mono_marshal_get_delegate_invoke_internal (MonoMethod *method, gboolean callvirt
 	MonoMethod *orig_method = NULL;
 	WrapperInfo *info;
 	WrapperSubtype subtype = WRAPPER_SUBTYPE_NONE;
-	gboolean found;
 
 	g_assert (method && method->klass->parent == mono_defaults.multicastdelegate_class &&
 		  !strcmp (method->name, "Invoke"));
@@ -3107,25 +3147,27 @@ mono_marshal_get_delegate_invoke_internal (MonoMethod *method, gboolean callvirt
 
 		cache_ptr = &method->klass->image->delegate_abstract_invoke_cache;
 
-		/* We need to cache the signature+method pair */
+		/*
+		 * We need to cache the signature+method pair. The pairs are freed when
+		 * dynamic methods go away, so this cache stays under the marshal lock.
+		 */
 		mono_marshal_lock ();
 		if (!*cache_ptr)
 			*cache_ptr = g_hash_table_new_full (signature_method_pair_hash, (GEqualFunc)signature_method_pair_equal, (GDestroyNotify)free_signature_method_pair, NULL);
-		cache = *cache_ptr;
+		abstract_cache = *cache_ptr;
 		key.sig = invoke_sig;
 		key.method = target_method;
-		res = g_hash_table_lookup (cache, &key);
+		res = g_hash_table_lookup (abstract_cache, &key);
 		mono_marshal_unlock ();
 		if (res)
 			return res;
 	} else {
-		cache = get_cache (&method->klass->image->delegate_invoke_cache,
-						   (GHashFunc)mono_signature_hash, 
-						   (GCompareFunc)mono_metadata_signature_equal);
-		res = mono_marshal_find_in_cache (cache, sig);
+		sig_cache = get_sig_cache (&method->klass->image->delegate_invoke_cache,
+								   (GHashFunc)mono_signature_hash, 
+								   (GCompareFunc)mono_metadata_signature_equal);
+		res = find_in_sig_cache (sig_cache, sig);
 		if (res)
 			return res;
-		cache_key = sig;
 	}
 
 	static_sig = signature_dup (method->klass->image, sig);
@@ -3261,18 +3303,30 @@ mono_marshal_get_delegate_invoke_internal (MonoMethod *method, gboolean callvirt
 		def = mono_mb_create_and_cache (cache, cache_key, mb, sig, sig->param_count + 16);
 		res = cache_generic_delegate_wrapper (cache, orig_method, def, ctx);
 	} else if (callvirt) {
-		new_key = g_new0 (SignatureMethodPair, 1);
-		*new_key = key;
+		MonoMethod *newm;
 
 		info = mono_wrapper_info_create (mb, subtype);
+		newm = mono_mb_create (mb, sig, sig->param_count + 16, info);
 
-		res = mono_mb_create_and_cache_full (cache, new_key, mb, sig, sig->param_count + 16, info, &found);
-		if (found)
-			g_free (new_key);
-	} else {
+		mono_marshal_lock ();
+		res = g_hash_table_lookup (abstract_cache, &key);
+		if (!res) {
+			new_key = g_new0 (SignatureMethodPair, 1);
+			*new_key = key;
+			g_hash_table_insert (abstract_cache, new_key, newm);
+			res = newm;
+		}
+		mono_marshal_unlock ();
+		if (res != newm)
+			mono_free_method (newm);
+	} else if (static_method_with_first_arg_bound) {
 		info = mono_wrapper_info_create (mb, subtype);
 
 		res = mono_mb_create_and_cache_full (cache, cache_key, mb, sig, sig->param_count + 16, info, NULL);
+	} else {
+		info = mono_wrapper_info_create (mb, subtype);
+
+		res = create_and_cache_sig (sig_cache, sig, mb, sig, sig->param_count + 16, info);
 	}
 	mono_mb_free (mb);
 
@@ -3767,7 +3821,8 @@ mono_marshal_get_runtime_invoke (MonoMethod *method, gboolean virtual)
 {
 	MonoMethodSignature *sig, *csig, *callsig;
 	MonoMethodBuilder *mb;
-	GHashTable *cache = NULL;
+	MonoConcurrentHashTable *cache = NULL;
+	GHashTable *sig_cache = NULL;
 	MonoClass *target_klass;
 	MonoMethod *res = NULL;
 	static MonoMethodSignature *cctor_signature = NULL;
@@ -3846,18 +3901,15 @@ mono_marshal_get_runtime_invoke (MonoMethod *method, gboolean virtual)
 
 		if (method->klass->valuetype && mono_method_signature (method)->hasthis)
 			/* These have a different csig */
-			cache = get_cache (&target_klass->image->runtime_invoke_vtype_cache,
-							   (GHashFunc)mono_signature_hash,
-							   (GCompareFunc)runtime_invoke_signature_equal);
+			sig_cache = get_sig_cache (&target_klass->image->runtime_invoke_vtype_cache,
+									   (GHashFunc)mono_signature_hash,
+									   (GCompareFunc)runtime_invoke_signature_equal);
 		else
-			cache = get_cache (&target_klass->image->runtime_invoke_cache,
-							   (GHashFunc)mono_signature_hash,
-							   (GCompareFunc)runtime_invoke_signature_equal);
+			sig_cache = get_sig_cache (&target_klass->image->runtime_invoke_cache,
+									   (GHashFunc)mono_signature_hash,
+									   (GCompareFunc)runtime_invoke_signature_equal);
 
-		/* from mono_marshal_find_in_cache */
-		mono_marshal_lock ();
-		res = g_hash_table_lookup (cache, callsig);
-		mono_marshal_unlock ();
+		res = find_in_sig_cache (sig_cache, callsig);
 
 		if (res) {
 			g_free (callsig);
@@ -3911,9 +3963,7 @@ mono_marshal_get_runtime_invoke (MonoMethod *method, gboolean virtual)
 		res = mono_mb_create_and_cache_full (cache, method, mb, csig, sig->param_count + 16, info, NULL);
 	} else {
 		/* taken from mono_mb_create_and_cache */
-		mono_marshal_lock ();
-		res = g_hash_table_lookup (cache, callsig);
-		mono_marshal_unlock ();
+		res = find_in_sig_cache (sig_cache, callsig);
 
 		info = mono_wrapper_info_create (mb, WRAPPER_SUBTYPE_RUNTIME_INVOKE_NORMAL);
 		info->d.runtime_invoke.sig = callsig;
@@ -3921,19 +3971,23 @@ mono_marshal_get_runtime_invoke (MonoMethod *method, gboolean virtual)
 		/* Somebody may have created it before us */
 		if (!res) {
 			MonoMethod *newm;
+			MonoConcurrentHashTable *direct_cache;
+
 			newm = mono_mb_create (mb, csig, sig->param_count + 16, info);
+			direct_cache = get_cache (&method->klass->image->runtime_invoke_direct_cache, mono_aligned_addr_hash, NULL);
 
 			mono_marshal_lock ();
-			res = g_hash_table_lookup (cache, callsig);
+			res = g_hash_table_lookup (sig_cache, callsig);
 			if (!res) {
 				res = newm;
-				g_hash_table_insert (cache, callsig, res);
+				g_hash_table_insert (sig_cache, callsig, res);
 				/* Can't insert it into wrapper_hash since the key is a signature */
-				g_hash_table_insert (method->klass->image->runtime_invoke_direct_cache, method, res);
+				mono_conc_hashtable_insert (direct_cache, method, res);
+				mono_marshal_unlock ();
 			} else {
+				mono_marshal_unlock ();
 				mono_free_method (newm);
 			}
-			mono_marshal_unlock ();
 		}
 
 		/* end mono_mb_create_and_cache */
@@ -7133,7 +7187,7 @@ mono_marshal_get_native_wrapper (MonoMethod *method, gboolean check_exceptions,
 	MonoMethodBuilder *mb;
 	MonoMarshalSpec **mspecs;
 	MonoMethod *res;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	gboolean pinvoke = FALSE;
 	gpointer iter;
 	int i;
@@ -7353,7 +7407,7 @@ mono_marshal_get_native_func_wrapper (MonoImage *image, MonoMethodSignature *sig
 
 	MonoMethodBuilder *mb;
 	MonoMethod *res;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	char *name;
 
 	cache = get_cache (&image->native_wrapper_cache, mono_aligned_addr_hash, NULL);
@@ -7389,7 +7443,7 @@ mono_marshal_get_native_func_wrapper_aot (MonoClass *klass)
 	MonoMethodSignature *sig, *csig;
 	MonoMethodBuilder *mb;
 	MonoMethod *res;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	char *name;
 	WrapperInfo *info;
 	MonoMethodPInvoke mpiinfo;
@@ -7723,7 +7777,7 @@ mono_marshal_get_managed_wrapper (MonoMethod *method, MonoClass *delegate_klass,
 	MonoMethod *res, *invoke;
 	MonoMarshalSpec **mspecs;
 	MonoMethodPInvoke piinfo;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	int i;
 	EmitMarshalContext m;
 
@@ -8181,7 +8235,7 @@ MonoMethod *
 mono_marshal_get_isinst (MonoClass *klass)
 {
 	static MonoMethodSignature *isint_sig = NULL;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	MonoMethod *res;
 	WrapperInfo *info;
 	int pos_was_ok, pos_end;
@@ -8290,7 +8344,7 @@ MonoMethod *
 mono_marshal_get_castclass (MonoClass *klass)
 {
 	static MonoMethodSignature *castclass_sig = NULL;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	MonoMethod *res;
 #ifndef DISABLE_REMOTING
 	int pos_was_ok, pos_was_ok2;
@@ -8561,7 +8615,7 @@ mono_marshal_get_synchronized_wrapper (MonoMethod *method)
 	MonoExceptionClause *clause;
 	MonoMethodBuilder *mb;
 	MonoMethod *res;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	int i, pos, this_local, ret_local = 0;
 	MonoGenericContext *ctx = NULL;
 	MonoMethod *orig_method = NULL;
@@ -8738,7 +8792,7 @@ mono_marshal_get_unbox_wrapper (MonoMethod *method)
 	int i;
 	MonoMethodBuilder *mb;
 	MonoMethod *res;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 
 	cache = get_cache (&method->klass->image->unbox_wrapper_cache, mono_aligned_addr_hash, NULL);
 	if ((res = mono_marshal_find_in_cache (cache, method)))
@@ -9675,7 +9729,7 @@ mono_marshal_get_array_accessor_wrapper (MonoMethod *method)
 	MonoMethodSignature *sig;
 	MonoMethodBuilder *mb;
 	MonoMethod *res;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	int i;
 	MonoGenericContext *ctx = NULL;
 	MonoMethod *orig_method = NULL;
@@ -10942,7 +10996,7 @@ mono_marshal_get_thunk_invoke_wrapper (MonoMethod *method)
 	MonoExceptionClause *clause;
 	MonoImage *image;
 	MonoClass *klass;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	MonoMethod *res;
 	int i, param_count, sig_size, pos_leave;
 
@@ -11099,12 +11153,12 @@ mono_marshal_free_dynamic_wrappers (MonoMethod *method)
 	 * they could be shared with other methods ?
 	 */
 	if (image->runtime_invoke_direct_cache)
-		g_hash_table_remove (image->runtime_invoke_direct_cache, method);
+		mono_conc_hashtable_remove (image->runtime_invoke_direct_cache, method);
 	if (image->delegate_abstract_invoke_cache)
 		g_hash_table_foreach_remove (image->delegate_abstract_invoke_cache, signature_method_pair_matches_method, method);
 	// FIXME: Need to clear the caches in other images as well
 	if (image->delegate_bound_static_invoke_cache)
-		g_hash_table_remove (image->delegate_bound_static_invoke_cache, mono_method_signature (method));
+		mono_conc_hashtable_remove (image->delegate_bound_static_invoke_cache, mono_method_signature (method));
 
 	if (marshal_mutex_initialized)
 		mono_marshal_unlock ();
@@ -11167,25 +11221,25 @@ mono_marshal_free_inflated_wrappers (MonoMethod *method)
          * indexed by MonoMethod pointers
          */
        if (method->klass->image->runtime_invoke_direct_cache)
-               g_hash_table_remove (method->klass->image->runtime_invoke_direct_cache, method);
+               mono_conc_hashtable_remove (method->klass->image->runtime_invoke_direct_cache, method);
        if (method->klass->image->managed_wrapper_cache)
-               g_hash_table_remove (method->klass->image->managed_wrapper_cache, method);
+               mono_conc_hashtable_remove (method->klass->image->managed_wrapper_cache, method);
        if (method->klass->image->native_wrapper_cache)
-               g_hash_table_remove (method->klass->image->native_wrapper_cache, method);
+               mono_conc_hashtable_remove (method->klass->image->native_wrapper_cache, method);
        if (method->klass->image->remoting_invoke_cache)
                g_hash_table_remove (method->klass->image->remoting_invoke_cache, method);
        if (method->klass->image->synchronized_cache)
-               g_hash_table_remove (method->klass->image->synchronized_cache, method);
+               mono_conc_hashtable_remove (method->klass->image->synchronized_cache, method);
        if (method->klass->image->unbox_wrapper_cache)
-               g_hash_table_remove (method->klass->image->unbox_wrapper_cache, method);
+               mono_conc_hashtable_remove (method->klass->image->unbox_wrapper_cache, method);
        if (method->klass->image->cominterop_invoke_cache)
-               g_hash_table_remove (method->klass->image->cominterop_invoke_cache, method);
+               mono_conc_hashtable_remove (method->klass->image->cominterop_invoke_cache, method);
        if (method->klass->image->cominterop_wrapper_cache)
-               g_hash_table_remove (method->klass->image->cominterop_wrapper_cache, method);
+               mono_conc_hashtable_remove (method->klass->image->cominterop_wrapper_cache, method);
        if (method->klass->image->thunk_invoke_cache)
-               g_hash_table_remove (method->klass->image->thunk_invoke_cache, method);
+               mono_conc_hashtable_remove (method->klass->image->thunk_invoke_cache, method);
        if (method->klass->image->native_func_wrapper_aot_cache)
-               g_hash_table_remove (method->klass->image->native_func_wrapper_aot_cache, method);
+               mono_conc_hashtable_remove (method->klass->image->native_func_wrapper_aot_cache, method);
 
        mono_marshal_unlock ();
 }
@@ -19,6 +19,7 @@
 #include <mono/metadata/reflection.h>
 #include <mono/metadata/method-builder.h>
 #include <mono/metadata/remoting.h>
+#include <mono/utils/mono-conc-hashtable.h>
 
 #define mono_marshal_find_bitfield_offset(type, elem, byte_offset, bitmask) \
 	do { \
@@ -570,14 +571,14 @@ mono_marshal_emit_native_wrapper (MonoImage *image, MonoMethodBuilder *mb, MonoM
 void
 mono_marshal_emit_managed_wrapper (MonoMethodBuilder *mb, MonoMethodSignature *invoke_sig, MonoMarshalSpec **mspecs, EmitMarshalContext* m, MonoMethod *method, uint32_t target_handle) MONO_INTERNAL;
 
-GHashTable*
-mono_marshal_get_cache (GHashTable **var, GHashFunc hash_func, GCompareFunc equal_func) MONO_INTERNAL;
+MonoConcurrentHashTable*
+mono_marshal_get_cache (MonoConcurrentHashTable **var, GHashFunc hash_func, GCompareFunc equal_func) MONO_INTERNAL;
 
 MonoMethod*
-mono_marshal_find_in_cache (GHashTable *cache, gpointer key) MONO_INTERNAL;
+mono_marshal_find_in_cache (MonoConcurrentHashTable *cache, gpointer key) MONO_INTERNAL;
 
 MonoMethod*
-mono_mb_create_and_cache (GHashTable *cache, gpointer key,
+mono_mb_create_and_cache (MonoConcurrentHashTable *cache, gpointer key,
 						  MonoMethodBuilder *mb, MonoMethodSignature *sig,
 						  int max_stack) MONO_INTERNAL;
 void
@@ -603,7 +604,7 @@ mono_mb_create (MonoMethodBuilder *mb, MonoMethodSignature *sig,
 				int max_stack, WrapperInfo *info) MONO_INTERNAL;
 
 MonoMethod*
-mono_mb_create_and_cache_full (GHashTable *cache, gpointer key,
+mono_mb_create_and_cache_full (MonoConcurrentHashTable *cache, gpointer key,
 							   MonoMethodBuilder *mb, MonoMethodSignature *sig,
 							   int max_stack, WrapperInfo *info, gboolean *out_found) MONO_INTERNAL;
 
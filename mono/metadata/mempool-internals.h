@@ -57,6 +57,9 @@ g_slist_append_mempool (MonoMemPool *mp, GSList *list, gpointer data)
 		return new_list;
 }
 
+MonoMemPool*
+mono_mempool_new_concurrent (void) MONO_INTERNAL;
+
 long
 mono_mempool_get_bytes_allocated (void) MONO_INTERNAL;
 
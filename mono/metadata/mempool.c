@@ -4,6 +4,11 @@
  * MonoMemPool is for fast allocation of memory. We free
  * all memory when the pool is destroyed.
  *
+ * Concurrent pools can be used from several threads without a lock:
+ * allocations are carved out of the chunks with a CAS, each thread
+ * remembers the chunk it allocates from, so threads mostly use different
+ * chunks, and chunks are added to the pool with a CAS.
+ *
  * Author:
  *   Dietmar Maurer (dietmar@ximian.com)
  *
@@ -18,6 +23,9 @@
 
 #include "mempool.h"
 #include "mempool-internals.h"
+#include "utils/atomic.h"
+#include "utils/mono-tls.h"
+#include "utils/mono-memory-model.h"
 
 #if USE_MALLOC_FOR_MEMPOOLS
 #define MALLOC_ALLOCATION
@@ -61,14 +69,52 @@ struct _MonoMemPool {
 	gint rest;
 	guint8 *pos, *end;
 	guint32 size;
+	/* Non-zero for concurrent pools, and unique among them */
+	guint32 id;
 	union {
 		double pad; /* to assure proper alignment */
 		guint32 allocated;
 	} d;
 };
+
+/* Allocations at least this large get a chunk of their own in concurrent pools */
+#define THREAD_CHUNK_MAX_ALLOC	(MONO_MEMPOOL_PAGESIZE / 4)
+#define THREAD_CACHE_SIZE	4
+/* How many of the newest chunks of a concurrent pool are searched for space before adding one */
+#define CHUNK_SEARCH_DEPTH	4
+
+/*
+ * The chunk a thread is currently allocating from in a concurrent pool.
+ * The pool ID tells stale entries apart from ones for a new pool that
+ * was allocated at the address of a destroyed one, so the chunk is only
+ * accessed once the entry is known to belong to a live pool.
+ */
+typedef struct {
+	MonoMemPool *pool;
+	guint32 id;
+	MonoMemPool *chunk;
+} ThreadChunk;
+
+typedef struct {
+	ThreadChunk chunks [THREAD_CACHE_SIZE];
+	int next_victim;
+} ThreadCache;
+
+#ifdef HOST_WIN32
+/* TlsAlloc () doesn't support destructors, fiber local storage does */
+static DWORD thread_cache_key;
+#define thread_cache_get() ((ThreadCache*)FlsGetValue (thread_cache_key))
+#define thread_cache_set(cache) FlsSetValue (thread_cache_key, (cache))
+#else
+static MonoNativeTlsKey thread_cache_key;
+#define thread_cache_get() ((ThreadCache*)mono_native_tls_get_value (thread_cache_key))
+#define thread_cache_set(cache) mono_native_tls_set_value (thread_cache_key, (cache))
+#endif
+static volatile gint32 thread_cache_key_state;
+static volatile gint32 last_pool_id;
 #endif
 
-static long total_bytes_allocated = 0;
+static volatile gint64 total_bytes_allocated = 0;
 
 /**
  * mono_mempool_new:
@@ -96,7 +142,71 @@ mono_mempool_new_size (int initial_size)
 	pool->pos = (guint8*)pool + SIZEOF_MEM_POOL;
 	pool->end = pool->pos + initial_size - SIZEOF_MEM_POOL;
 	pool->d.allocated = pool->size = initial_size;
-	total_bytes_allocated += initial_size;
+	pool->id = 0;
+	InterlockedAdd64 (&total_bytes_allocated, initial_size);
+	return pool;
+#endif
+}
+
+#ifndef MALLOC_ALLOCATION
+#ifdef HOST_WIN32
+static void WINAPI
+thread_cache_free (PVOID cache)
+{
+	g_free (cache);
+}
+#endif
+
+static void
+thread_cache_key_init (void)
+{
+	if (thread_cache_key_state == 2)
+		return;
+
+	if (InterlockedCompareExchange (&thread_cache_key_state, 1, 0) == 0) {
+#ifdef HOST_WIN32
+		thread_cache_key = FlsAlloc (thread_cache_free);
+		g_assert (thread_cache_key != FLS_OUT_OF_INDEXES);
+#else
+		mono_native_tls_alloc (&thread_cache_key, g_free);
+#endif
+		mono_memory_barrier ();
+		thread_cache_key_state = 2;
+	} else {
+		while (thread_cache_key_state != 2)
+			mono_memory_barrier ();
+	}
+}
+#endif
+
+/**
+ * mono_mempool_new_concurrent:
+ *
+ * Returns: a new memory pool that can be allocated from by several
+ * threads at the same time.  Such pools cannot be emptied.
+ */
+MonoMemPool *
+mono_mempool_new_concurrent (void)
+{
+#ifdef MALLOC_ALLOCATION
+	/* Chunks are always added with a CAS */
+	return g_new0 (MonoMemPool, 1);
+#else
+	MonoMemPool *pool;
+	guint32 id;
+
+	thread_cache_key_init ();
+
+	/* Everything is allocated from chunks, so the pool is just the header */
+	pool = g_malloc (SIZEOF_MEM_POOL);
+	pool->next = NULL;
+	pool->pos = pool->end = (guint8*)pool + SIZEOF_MEM_POOL;
+	pool->d.allocated = pool->size = SIZEOF_MEM_POOL;
+	do {
+		id = InterlockedIncrement (&last_pool_id);
+	} while (!id);
+	pool->id = id;
+	InterlockedAdd64 (&total_bytes_allocated, SIZEOF_MEM_POOL);
 	return pool;
 #endif
 }
@@ -117,7 +227,7 @@ mono_mempool_destroy (MonoMemPool *pool)
 #else
 	MonoMemPool *p, *n;
 
-	total_bytes_allocated -= pool->d.allocated;
+	InterlockedAdd64 (&total_bytes_allocated, -(gint64)pool->d.allocated);
 
 	p = pool;
 	while (p) {
@@ -167,6 +277,8 @@ mono_mempool_empty (MonoMemPool *pool)
 
 	pool->allocated = 0;
 #else
+	g_assert (!pool->id);
+
 	pool->pos = (guint8*)pool + SIZEOF_MEM_POOL;
 	pool->end = pool->pos + pool->size - SIZEOF_MEM_POOL;
 #endif
@@ -251,6 +363,106 @@ get_next_size (MonoMemPool *pool, int size)
 		target = MONO_MEMPOOL_PAGESIZE;
 	return target;
 }
+
+/*
+ * Adds a chunk with SIZE bytes of space to a concurrent pool, and
+ * returns the start of its space, of which the first ALLOC_SIZE bytes
+ * are allocated.
+ */
+static MonoMemPool*
+concurrent_chunk_new (MonoMemPool *pool, guint size, guint alloc_size)
+{
+	MonoMemPool *np = g_malloc (SIZEOF_MEM_POOL + size);
+	MonoMemPool *next;
+
+	np->size = SIZEOF_MEM_POOL + size;
+	np->pos = (guint8*)np + SIZEOF_MEM_POOL + alloc_size;
+	np->end = (guint8*)np + np->size;
+	np->id = 0;
+
+	do {
+		next = pool->next;
+		np->next = next;
+	} while (InterlockedCompareExchangePointer ((volatile gpointer*)&pool->next, np, next) != next);
+
+	InterlockedAdd ((volatile gint32*)&pool->d.allocated, np->size);
+	InterlockedAdd64 (&total_bytes_allocated, np->size);
+
+	return np;
+}
+
+/* Allocates SIZE bytes from the space left in the chunk NP, or returns NULL */
+static inline gpointer
+concurrent_chunk_alloc (MonoMemPool *np, guint size)
+{
+	guint8 *pos;
+
+	do {
+		pos = np->pos;
+		if (pos + size > np->end)
+			return NULL;
+	} while (InterlockedCompareExchangePointer ((volatile gpointer*)&np->pos, pos + size, pos) != pos);
+
+	return pos;
+}
+
+static gpointer
+concurrent_alloc (MonoMemPool *pool, guint size)
+{
+	ThreadCache *cache;
+	ThreadChunk *chunk = NULL;
+	MonoMemPool *np;
+	gpointer rval;
+	guint chunk_size;
+	int i;
+
+	cache = thread_cache_get ();
+	if (G_UNLIKELY (!cache)) {
+		cache = g_new0 (ThreadCache, 1);
+		thread_cache_set (cache);
+	}
+
+	for (i = 0; i < THREAD_CACHE_SIZE; ++i) {
+		if (cache->chunks [i].pool == pool && cache->chunks [i].id == pool->id) {
+			chunk = &cache->chunks [i];
+			rval = concurrent_chunk_alloc (chunk->chunk, size);
+			if (G_LIKELY (rval))
+				return rval;
+			break;
+		}
+	}
+
+	if (size >= THREAD_CHUNK_MAX_ALLOC)
+		return (guint8*)concurrent_chunk_new (pool, size, size) + SIZEOF_MEM_POOL;
+
+	if (!chunk) {
+		chunk = &cache->chunks [cache->next_victim];
+		cache->next_victim = (cache->next_victim + 1) % THREAD_CACHE_SIZE;
+		chunk->pool = pool;
+		chunk->id = pool->id;
+	}
+
+	/*
+	 * The space left in the chunks stays in the pool, so the chunks dropped by
+	 * this thread or by others, which are usually among the newest ones, are
+	 * used up before a new chunk is added.
+	 */
+	for (np = pool->next, i = 0; np && i < CHUNK_SEARCH_DEPTH; np = np->next, ++i) {
+		rval = concurrent_chunk_alloc (np, size);
+		if (rval) {
+			chunk->chunk = np;
+			return rval;
+		}
+	}
+
+	/* The chunks grow with the pool, so pools which are barely used stay small */
+	chunk_size = MAX (pool->d.allocated, MONO_MEMPOOL_MINSIZE);
+	chunk_size = MIN (chunk_size, MONO_MEMPOOL_PAGESIZE) - SIZEOF_MEM_POOL;
+	chunk_size = MAX (chunk_size, size);
+	np = concurrent_chunk_new (pool, chunk_size, size);
+	chunk->chunk = np;
+	return (guint8*)np + SIZEOF_MEM_POOL;
+}
 #endif
 
 /**
@@ -272,16 +484,23 @@ mono_mempool_alloc (MonoMemPool *pool, guint size)
 #ifdef MALLOC_ALLOCATION
 	{
 		Chunk *c = g_malloc (size + sizeof (Chunk));
+		Chunk *next;
 
-		c->next = pool->chunks;
-		pool->chunks = c;
 		c->size = size - sizeof(Chunk);
+		/* Pools from mono_mempool_new_concurrent () need this to be thread-safe */
+		do {
+			next = pool->chunks;
+			c->next = next;
+		} while (InterlockedCompareExchangePointer ((volatile gpointer*)&pool->chunks, c, next) != next);
 
-		pool->allocated += size;
+		InterlockedAdd ((volatile gint32*)&pool->allocated, size);
 
 		rval = ((guint8*)c) + sizeof (Chunk);
 	}
 #else
+	if (G_UNLIKELY (pool->id))
+		return concurrent_alloc (pool, size);
+
 	rval = pool->pos;
 	pool->pos = (guint8*)rval + size;
 
@@ -300,7 +519,7 @@ mono_mempool_alloc (MonoMemPool *pool, guint size)
 			np->size = SIZEOF_MEM_POOL + size;
 			np->end = np->pos + np->size - SIZEOF_MEM_POOL;
 			pool->d.allocated += SIZEOF_MEM_POOL + size;
-			total_bytes_allocated += SIZEOF_MEM_POOL + size;
+			InterlockedAdd64 (&total_bytes_allocated, SIZEOF_MEM_POOL + size);
 			return (guint8*)np + SIZEOF_MEM_POOL;
 		} else {
 			int new_size = get_next_size (pool, size);
@@ -313,7 +532,7 @@ mono_mempool_alloc (MonoMemPool *pool, guint size)
 			np->end = np->pos;
 			pool->end = pool->pos + new_size - SIZEOF_MEM_POOL;
 			pool->d.allocated += new_size;
-			total_bytes_allocated += new_size;
+			InterlockedAdd64 (&total_bytes_allocated, new_size);
 
 			rval = pool->pos;
 			pool->pos += size;
@@ -339,6 +558,12 @@ mono_mempool_alloc0 (MonoMemPool *pool, guint size)
 #else
 	size = ALIGN_SIZE (size);
 
+	if (G_UNLIKELY (pool->id)) {
+		rval = concurrent_alloc (pool, size);
+		memset (rval, 0, size);
+		return rval;
+	}
+
 	rval = pool->pos;
 	pool->pos = (guint8*)rval + size;
 
@@ -437,5 +662,5 @@ mono_mempool_get_allocated (MonoMemPool *pool)
 long
 mono_mempool_get_bytes_allocated (void)
 {
-	return total_bytes_allocated;
+	return (long)InterlockedRead64 (&total_bytes_allocated);
 }
@@ -227,6 +227,12 @@ struct _MonoImage {
 	 */
 	MonoConcurrentHashTable *field_cache; /*protected by the image lock*/
 
+	/*
+	 * Decoded custom attributes, indexed by MONO_CUSTOM_ATTR_* encoded parent
+	 * indexes. Created lazily, writers hold the image lock.
+	 */
+	MonoConcurrentHashTable *cattr_cache;
+
 	/* indexed by typespec tokens. */
 	GHashTable *typespec_cache; /* protected by the image lock */
 	/* indexed by token */
@@ -251,6 +257,11 @@ struct _MonoImage {
 	/* This has a separate lock to improve scalability */
 	mono_mutex_t szarray_cache_lock;
 
+	/*
+	 * The MonoConcurrentHashTable wrapper caches below are read without
+	 * locking, writers hold the marshal lock.
+	 */
+
 	/*
 	 * indexed by MonoMethodSignature 
 	 */
@@ -263,44 +274,44 @@ struct _MonoImage {
 	/*
 	 * indexed by SignatureMethodPair
 	 */
-	GHashTable *delegate_abstract_invoke_cache;
+	GHashTable *delegate_abstract_invoke_cache; /* LOCKING: marshal lock */
 
 	/*
 	 * indexed by SignatureMethodPair
 	 */
-	GHashTable *delegate_bound_static_invoke_cache;
+	MonoConcurrentHashTable *delegate_bound_static_invoke_cache;
 	/*
 	 * indexed by MonoMethod pointers 
 	 */
-	GHashTable *runtime_invoke_direct_cache;
-	GHashTable *runtime_invoke_vcall_cache;
-	GHashTable *managed_wrapper_cache;
-	GHashTable *native_wrapper_cache;
-	GHashTable *native_wrapper_aot_cache;
-	GHashTable *native_func_wrapper_aot_cache;
-	GHashTable *remoting_invoke_cache;
-	GHashTable *synchronized_cache;
-	GHashTable *unbox_wrapper_cache;
-	GHashTable *cominterop_invoke_cache;
-	GHashTable *cominterop_wrapper_cache; /* LOCKING: marshal lock */
-	GHashTable *thunk_invoke_cache;
+	MonoConcurrentHashTable *runtime_invoke_direct_cache;
+	MonoConcurrentHashTable *runtime_invoke_vcall_cache;
+	MonoConcurrentHashTable *managed_wrapper_cache;
+	MonoConcurrentHashTable *native_wrapper_cache;
+	MonoConcurrentHashTable *native_wrapper_aot_cache;
+	MonoConcurrentHashTable *native_func_wrapper_aot_cache;
+	GHashTable *remoting_invoke_cache; /* LOCKING: remoting lock */
+	MonoConcurrentHashTable *synchronized_cache;
+	MonoConcurrentHashTable *unbox_wrapper_cache;
+	MonoConcurrentHashTable *cominterop_invoke_cache;
+	MonoConcurrentHashTable *cominterop_wrapper_cache; /* LOCKING: marshal lock */
+	MonoConcurrentHashTable *thunk_invoke_cache;
 	GHashTable *wrapper_param_names;
-	GHashTable *synchronized_generic_cache;
-	GHashTable *array_accessor_cache;
+	MonoConcurrentHashTable *synchronized_generic_cache;
+	MonoConcurrentHashTable *array_accessor_cache;
 
 	/*
 	 * indexed by MonoClass pointers
 	 */
-	GHashTable *ldfld_wrapper_cache;
-	GHashTable *ldflda_wrapper_cache;
-	GHashTable *stfld_wrapper_cache;
-	GHashTable *isinst_cache;
-	GHashTable *castclass_cache;
-	GHashTable *proxy_isinst_cache;
+	MonoConcurrentHashTable *ldfld_wrapper_cache;
+	MonoConcurrentHashTable *ldflda_wrapper_cache;
+	MonoConcurrentHashTable *stfld_wrapper_cache;
+	MonoConcurrentHashTable *isinst_cache;
+	MonoConcurrentHashTable *castclass_cache;
+	MonoConcurrentHashTable *proxy_isinst_cache;
 	GHashTable *rgctx_template_hash; /* LOCKING: templates lock */
-	GHashTable *delegate_invoke_generic_cache;
-	GHashTable *delegate_begin_invoke_generic_cache;
-	GHashTable *delegate_end_invoke_generic_cache;
+	MonoConcurrentHashTable *delegate_invoke_generic_cache;
+	MonoConcurrentHashTable *delegate_begin_invoke_generic_cache;
+	MonoConcurrentHashTable *delegate_end_invoke_generic_cache;
 
 	/* Contains rarely used fields of runtime structures belonging to this image */
 	MonoPropertyHash *property_hash;
@@ -28,7 +28,10 @@
 #include <mono/utils/mono-threads.h>
 #include <mono/metadata/profiler-private.h>
 #include <mono/utils/mono-time.h>
+#include <mono/utils/mono-counters.h>
+#include <mono/utils/mono-proclib.h>
 #include <mono/utils/atomic.h>
+#include <mono/utils/mono-memory-model.h>
 
 /*
  * Pull the list of opcodes
@@ -65,14 +68,15 @@ enum {
  * Bacon's thin locks have a fast path that doesn't need a lock record
  * for the common case of locking an unlocked or shallow-nested
  * object, but the technique relies on encoding the thread ID in 15
- * bits (to avoid too much per-object space overhead.)  Unfortunately
- * I don't think it's possible to reliably encode a pthread_t into 15
- * bits. (The JVM implementation used seems to have a 15-bit
- * per-thread identifier available.)
+ * bits (to avoid too much per-object space overhead.)  We can't encode
+ * a pthread_t in so few bits, but the small ids handed out by
+ * mono_thread_info_get_small_id () fit comfortably, so uncontended
+ * locks live entirely in the object's lock word (see monitor.h).
  *
- * This implementation then combines Dice's basic lock model with
- * Bacon's simplification of keeping a lock record for the lifetime of
- * an object.
+ * Once a lock is contended, waited on or needs to share the lock word
+ * with a hash code it is inflated, and from then on this implementation
+ * combines Dice's basic lock model with Bacon's simplification of
+ * keeping a lock record for the lifetime of an object.
  */
 
 
@@ -91,6 +95,18 @@ static MonoThreadsSync *monitor_freelist;
 static MonitorArray *monitor_allocated;
 static int array_size = 16;
 
+/*
+ * Spinning budget for contended inflated locks, in pause instructions. The
+ * budget of each lock adapts between the two limits, see mon_spin ().
+ */
+#define MONITOR_SPIN_MIN	32
+#define MONITOR_SPIN_MAX	4096
+#define MONITOR_SPIN_MAX_BACKOFF	64
+
+static gboolean monitor_spin_enabled;
+static gint32 monitor_spin_acquired;
+static gint32 monitor_spin_failed;
+
 static inline guint32
 mon_status_get_owner (guint32 status)
 {
@@ -135,10 +151,149 @@ mon_status_have_waiters (guint32 status)
 	return status & ENTRY_COUNT_WAITERS;
 }
 
+typedef union {
+	gsize lock_word;
+	MonoThreadsSync *sync;
+} LockWord;
+
+static inline gboolean
+lock_word_is_free (LockWord lw)
+{
+	return !lw.lock_word;
+}
+
+static inline gboolean
+lock_word_is_flat (LockWord lw)
+{
+	/* A free lock word is also flat */
+	return !(lw.lock_word & LOCK_WORD_STATUS_MASK);
+}
+
+static inline gboolean
+lock_word_is_inflated (LockWord lw)
+{
+	return lw.lock_word & LOCK_WORD_INFLATED;
+}
+
+static inline gboolean
+lock_word_has_hash (LockWord lw)
+{
+	return lw.lock_word & LOCK_WORD_HAS_HASH;
+}
+
+static inline gboolean
+lock_word_is_nested (LockWord lw)
+{
+	return lw.lock_word & LOCK_WORD_NEST_MASK;
+}
+
+static inline gboolean
+lock_word_is_max_nest (LockWord lw)
+{
+	return (lw.lock_word & LOCK_WORD_NEST_MASK) == LOCK_WORD_NEST_MASK;
+}
+
+static inline guint32
+lock_word_get_owner (LockWord lw)
+{
+	return lw.lock_word >> LOCK_WORD_OWNER_SHIFT;
+}
+
+static inline guint32
+lock_word_get_nest (LockWord lw)
+{
+	if (lock_word_is_free (lw))
+		return 0;
+	/* Inflated locks count nest from 1 too, so a flat lock stores nest - 1 */
+	return ((lw.lock_word & LOCK_WORD_NEST_MASK) >> LOCK_WORD_NEST_SHIFT) + 1;
+}
+
+static inline unsigned int
+lock_word_get_hash (LockWord lw)
+{
+	return (unsigned int)(lw.lock_word >> LOCK_WORD_HASH_SHIFT);
+}
+
+static inline MonoThreadsSync*
+lock_word_get_inflated_lock (LockWord lw)
+{
+	lw.lock_word &= ~LOCK_WORD_STATUS_MASK;
+	return lw.sync;
+}
+
+static inline LockWord
+lock_word_new_flat (guint32 owner)
+{
+	LockWord lw;
+	lw.lock_word = (gsize)owner << LOCK_WORD_OWNER_SHIFT;
+	return lw;
+}
+
+static inline LockWord
+lock_word_new_thin_hash (unsigned int hash)
+{
+	LockWord lw;
+	lw.lock_word = ((gsize)hash << LOCK_WORD_HASH_SHIFT) | LOCK_WORD_HAS_HASH;
+	return lw;
+}
+
+static inline LockWord
+lock_word_new_inflated (MonoThreadsSync *mon)
+{
+	LockWord lw;
+	lw.sync = mon;
+	lw.lock_word |= LOCK_WORD_INFLATED;
+	return lw;
+}
+
+static inline LockWord
+lock_word_increment_nest (LockWord lw)
+{
+	lw.lock_word += 1 << LOCK_WORD_NEST_SHIFT;
+	return lw;
+}
+
+static inline LockWord
+lock_word_decrement_nest (LockWord lw)
+{
+	lw.lock_word -= 1 << LOCK_WORD_NEST_SHIFT;
+	return lw;
+}
+
+static inline LockWord
+lock_word_cas (MonoObject *obj, LockWord nlw, LockWord expected)
+{
+	LockWord lw;
+	lw.sync = InterlockedCompareExchangePointer ((gpointer*)&obj->synchronisation, nlw.sync, expected.sync);
+	return lw;
+}
+
+/*
+ * mon_get_owner:
+ *
+ * Returns the small id of the thread holding the lock in @lw, or 0 if
+ * nobody holds it.
+ */
+static inline guint32
+mon_get_owner (LockWord lw)
+{
+	if (lock_word_is_inflated (lw))
+		return mon_status_get_owner (lock_word_get_inflated_lock (lw)->status);
+	if (lock_word_is_flat (lw))
+		return lock_word_get_owner (lw);
+	return 0;
+}
+
 void
 mono_monitor_init (void)
 {
 	mono_mutex_init_recursive (&monitor_mutex);
+
+	/* Spinning only helps if the owner can run while we spin */
+	monitor_spin_enabled = mono_cpu_count () > 1;
+
+	mono_counters_register ("Monitor spin acquisitions", MONO_COUNTER_RUNTIME | MONO_COUNTER_INT, &monitor_spin_acquired);
+	mono_counters_register ("Monitor spin failures", MONO_COUNTER_RUNTIME | MONO_COUNTER_INT, &monitor_spin_failed);
 }
  
 void
@@ -185,9 +340,10 @@ monitor_is_on_freelist (MonoThreadsSync *mon)
  * mono_locks_dump:
  * @include_untaken:
  *
- * Print a report on stdout of the managed locks currently held by
- * threads. If @include_untaken is specified, list also inflated locks
- * which are unheld.
+ * Print a report on stdout of the inflated managed locks currently held
+ * by threads. If @include_untaken is specified, list also inflated locks
+ * which are unheld. Flat locks only live in the object header and are
+ * not listed.
  * This is supposed to be used in debuggers like gdb.
  */
 void
@@ -210,6 +366,7 @@ mono_locks_dump (gboolean include_untaken)
 			} else {
 				if (!monitor_is_on_freelist (mon->data)) {
 					MonoObject *holder = mono_gc_weak_link_get (&mon->data);
+					gboolean listed = TRUE;
 					if (mon_status_get_owner (mon->status)) {
 						g_print ("Lock %p in object %p held by thread %d, nest level: %d\n",
 							mon, holder, mon_status_get_owner (mon->status), mon->nest);
@@ -217,7 +374,11 @@ mono_locks_dump (gboolean include_untaken)
 							g_print ("\tWaiting on semaphore %p: %d\n", mon->entry_sem, mon_status_get_entry_count (mon->status));
 					} else if (include_untaken) {
 						g_print ("Lock %p in object %p untaken\n", mon, holder);
+					} else {
+						listed = FALSE;
 					}
+					if (listed && mon->contentions)
+						g_print ("\tContended %d times, waited %lld ms in total\n", mon->contentions, (long long)(mon->wait_time / 10000));
 					used++;
 				}
 			}
@@ -318,6 +479,9 @@ mon_new (gsize id)
 	new->status = mon_status_init_entry_count (new->status);
 	new->nest = 1;
 	new->data = NULL;
+	new->spin_avg = 0;
+	new->contentions = 0;
+	new->wait_time = 0;
 	
 #ifndef DISABLE_PERFCOUNTERS
 	mono_perfcounters->gc_sync_blocks++;
@@ -326,25 +490,51 @@ mon_new (gsize id)
 }
 
 /*
- * Format of the lock word:
- * thinhash | fathash | data
+ * mono_monitor_inflate:
  *
- * thinhash is the lower bit: if set data is the shifted hashcode of the object.
- * fathash is another bit: if set the hash code is stored in the MonoThreadsSync
- *   struct pointed to by data
- * if neither bit is set and data is non-NULL, data is a MonoThreadsSync
+ * Replace the flat lock or thin hash in the lock word of @obj with a
+ * MonoThreadsSync, carrying over the owner, nest count and hash code. This
+ * can be called by any thread: the owner of a flat lock only changes the
+ * lock word with a CAS, so it will notice and switch to the inflated lock.
  */
-typedef union {
-	gsize lock_word;
-	MonoThreadsSync *sync;
-} LockWord;
+static void
+mono_monitor_inflate (MonoObject *obj)
+{
+	MonoThreadsSync *mon;
+	LockWord lw, nlw;
 
-enum {
-	LOCK_WORD_THIN_HASH = 1,
-	LOCK_WORD_FAT_HASH = 1 << 1,
-	LOCK_WORD_BITS_MASK = 0x3,
-	LOCK_WORD_HASH_SHIFT = 2
-};
+	LOCK_DEBUG (g_message ("%s: (%d) Inflating lock of object %p", __func__, mono_thread_info_get_small_id (), obj));
+
+	mono_monitor_allocator_lock ();
+	mon = mon_new (0);
+	for (;;) {
+		lw.sync = obj->synchronisation;
+		if (lock_word_is_inflated (lw)) {
+			/* Someone beat us to it */
+			mon_finalize (mon);
+			break;
+		}
+
+		nlw = lock_word_new_inflated (mon);
+		mon->status = mon_status_set_owner (mon->status, 0);
+		mon->nest = 1;
+		if (lock_word_has_hash (lw)) {
+#ifdef HAVE_MOVING_COLLECTOR
+			mon->hash_code = lock_word_get_hash (lw);
+#endif
+			nlw.lock_word |= LOCK_WORD_HAS_HASH;
+		} else if (!lock_word_is_free (lw)) {
+			mon->status = mon_status_set_owner (mon->status, lock_word_get_owner (lw));
+			mon->nest = lock_word_get_nest (lw);
+		}
+
+		if (lock_word_cas (obj, nlw, lw).sync == lw.sync) {
+			mono_gc_weak_link_add (&mon->data, obj, TRUE);
+			break;
+		}
+	}
+	mono_monitor_allocator_unlock ();
+}
 
 #define MONO_OBJECT_ALIGNMENT_SHIFT	3
 
@@ -363,14 +553,13 @@ mono_object_hash (MonoObject* obj)
 	if (!obj)
 		return 0;
 	lw.sync = obj->synchronisation;
-	if (lw.lock_word & LOCK_WORD_THIN_HASH) {
-		/*g_print ("fast thin hash %d for obj %p store\n", (unsigned int)lw.lock_word >> LOCK_WORD_HASH_SHIFT, obj);*/
-		return (unsigned int)lw.lock_word >> LOCK_WORD_HASH_SHIFT;
-	}
-	if (lw.lock_word & LOCK_WORD_FAT_HASH) {
-		lw.lock_word &= ~LOCK_WORD_BITS_MASK;
-		/*g_print ("fast fat hash %d for obj %p store\n", lw.sync->hash_code, obj);*/
-		return lw.sync->hash_code;
+	if (lock_word_has_hash (lw)) {
+		if (lock_word_is_inflated (lw)) {
+			/*g_print ("fast fat hash %d for obj %p store\n", lock_word_get_inflated_lock (lw)->hash_code, obj);*/
+			return lock_word_get_inflated_lock (lw)->hash_code;
+		}
+		/*g_print ("fast thin hash %d for obj %p store\n", lock_word_get_hash (lw), obj);*/
+		return lock_word_get_hash (lw);
 	}
 	/*
 	 * while we are inside this function, the GC will keep this object pinned,
@@ -381,30 +570,28 @@ mono_object_hash (MonoObject* obj)
 	 */
 	hash = (GPOINTER_TO_UINT (obj) >> MONO_OBJECT_ALIGNMENT_SHIFT) * 2654435761u;
 	/* clear the top bits as they can be discarded */
-	hash &= ~(LOCK_WORD_BITS_MASK << 30);
-	/* no hash flags were set, so it must be a MonoThreadsSync pointer if not NULL */
-	if (lw.sync) {
-		lw.sync->hash_code = hash;
-		/*g_print ("storing hash code %d for obj %p in sync %p\n", hash, obj, lw.sync);*/
-		lw.lock_word |= LOCK_WORD_FAT_HASH;
-		/* this is safe since we don't deflate locks */
-		obj->synchronisation = lw.sync;
-	} else {
+	hash &= ~(LOCK_WORD_STATUS_MASK << 30);
+	if (lock_word_is_free (lw)) {
 		/*g_print ("storing thin hash code %d for obj %p\n", hash, obj);*/
-		lw.lock_word = LOCK_WORD_THIN_HASH | (hash << LOCK_WORD_HASH_SHIFT);
-		if (InterlockedCompareExchangePointer ((gpointer*)&obj->synchronisation, lw.sync, NULL) == NULL)
+		lw = lock_word_cas (obj, lock_word_new_thin_hash (hash), lw);
+		if (lock_word_is_free (lw))
 			return hash;
 		/*g_print ("failed store\n");*/
-		/* someone set the hash flag or someone inflated the object */
-		lw.sync = obj->synchronisation;
-		if (lw.lock_word & LOCK_WORD_THIN_HASH)
+		/* someone set the hash flag, locked the object or inflated it */
+		if (lock_word_has_hash (lw))
 			return hash;
-		lw.lock_word &= ~LOCK_WORD_BITS_MASK;
-		lw.sync->hash_code = hash;
-		lw.lock_word |= LOCK_WORD_FAT_HASH;
-		/* this is safe since we don't deflate locks */
-		obj->synchronisation = lw.sync;
 	}
+	if (!lock_word_is_inflated (lw)) {
+		/* the lock word can't hold both the owner and the hash */
+		mono_monitor_inflate (obj);
+		lw.sync = obj->synchronisation;
+	}
+	lock_word_get_inflated_lock (lw)->hash_code = hash;
+	/*g_print ("storing hash code %d for obj %p in sync %p\n", hash, obj, lock_word_get_inflated_lock (lw));*/
+	mono_memory_write_barrier ();
+	lw.lock_word |= LOCK_WORD_HAS_HASH;
+	/* this is safe since we don't deflate locks */
+	obj->synchronisation = lw.sync;
 	return hash;
 #else
 /*
@@ -432,6 +619,67 @@ mon_decrement_entry_count (MonoThreadsSync *mon)
 	}
 }
 
+static inline void
+mon_spin_pause (void)
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	__asm__ __volatile__ ("rep; nop" : : : "memory");
+#else
+	mono_memory_read_barrier ();
+#endif
+}
+
+/*
+ * mon_spin:
+ *
+ * Spin with exponential backoff, hoping the owner of @mon releases it
+ * before we have to block on the entry semaphore. The budget adapts to how
+ * long it took to get this lock by spinning recently, which tracks how long
+ * its owners hold it: short critical sections keep the budget up, while
+ * spinning that fails shrinks it so long-held locks block almost right away.
+ * Returns TRUE if the lock was acquired.
+ */
+static gboolean
+mon_spin (MonoThreadsSync *mon, gsize id)
+{
+	guint32 old_status, new_status;
+	gint32 avg = mon->spin_avg;
+	int limit, spins, backoff, i;
+
+	if (!monitor_spin_enabled)
+		return FALSE;
+
+	limit = MIN (MONITOR_SPIN_MIN + 2 * avg, MONITOR_SPIN_MAX);
+	for (spins = 0, backoff = 1; spins < limit; spins += backoff) {
+		for (i = 0; i < backoff; ++i)
+			mon_spin_pause ();
+		if (backoff < MONITOR_SPIN_MAX_BACKOFF)
+			backoff <<= 1;
+
+		old_status = mon->status;
+		if (mon_status_get_owner (old_status) != 0)
+			continue;
+		new_status = mon_status_set_owner (old_status, id);
+		if (InterlockedCompareExchange ((gint32*)&mon->status, new_status, old_status) == old_status) {
+			g_assert (mon->nest == 1);
+			/* Racy, but it is only a heuristic */
+			mon->spin_avg = avg + (spins - avg) / 4;
+			InterlockedIncrement (&monitor_spin_acquired);
+			return TRUE;
+		}
+	}
+
+	mon->spin_avg = avg / 2;
+	InterlockedIncrement (&monitor_spin_failed);
+	return FALSE;
+}
+
+static inline void
+mon_add_wait_time (MonoThreadsSync *mon, gint64 start)
+{
+	InterlockedAdd64 (&mon->wait_time, mono_100ns_ticks () - start);
+}
+
 /* If allow_interruption==TRUE, the method will be interrumped if abort or suspend
  * is requested. In this case it returns -1.
  */ 
@@ -439,6 +687,7 @@ static inline gint32
 mono_monitor_try_enter_internal (MonoObject *obj, guint32 ms, gboolean allow_interruption)
 {
 	MonoThreadsSync *mon;
+	LockWord lw;
 	gsize id = mono_thread_info_get_small_id ();
 	HANDLE sem;
 	guint32 then = 0, now, delta;
@@ -447,6 +696,7 @@ mono_monitor_try_enter_internal (MonoObject *obj, guint32 ms, gboolean allow_int
 	guint32 new_status, old_status, tmp_status;
 	MonoInternalThread *thread;
 	gboolean interrupted = FALSE;
+	gint64 contention_start;
 
 	LOCK_DEBUG (g_message("%s: (%d) Trying to lock object %p (%d ms)", __func__, id, obj, ms));
 
@@ -456,88 +706,48 @@ mono_monitor_try_enter_internal (MonoObject *obj, guint32 ms, gboolean allow_int
 	}
 
 retry:
-	mon = obj->synchronisation;
+	lw.sync = obj->synchronisation;
 
-	/* If the object has never been locked... */
-	if (G_UNLIKELY (mon == NULL)) {
-		mono_monitor_allocator_lock ();
-		mon = mon_new (id);
-		if (InterlockedCompareExchangePointer ((gpointer*)&obj->synchronisation, mon, NULL) == NULL) {
-			mono_gc_weak_link_add (&mon->data, obj, TRUE);
-			mono_monitor_allocator_unlock ();
-			/* Successfully locked */
-			return 1;
-		} else {
-#ifdef HAVE_MOVING_COLLECTOR
-			LockWord lw;
-			lw.sync = obj->synchronisation;
-			if (lw.lock_word & LOCK_WORD_THIN_HASH) {
-				MonoThreadsSync *oldlw = lw.sync;
-				/* move the already calculated hash */
-				mon->hash_code = lw.lock_word >> LOCK_WORD_HASH_SHIFT;
-				lw.sync = mon;
-				lw.lock_word |= LOCK_WORD_FAT_HASH;
-				if (InterlockedCompareExchangePointer ((gpointer*)&obj->synchronisation, lw.sync, oldlw) == oldlw) {
-					mono_gc_weak_link_add (&mon->data, obj, TRUE);
-					mono_monitor_allocator_unlock ();
-					/* Successfully locked */
-					return 1;
-				} else {
-					mon_finalize (mon);
-					mono_monitor_allocator_unlock ();
-					goto retry;
-				}
-			} else if (lw.lock_word & LOCK_WORD_FAT_HASH) {
-				mon_finalize (mon);
-				mono_monitor_allocator_unlock ();
-				/* get the old lock without the fat hash bit */
-				lw.lock_word &= ~LOCK_WORD_BITS_MASK;
-				mon = lw.sync;
-			} else {
-				mon_finalize (mon);
-				mono_monitor_allocator_unlock ();
-				mon = obj->synchronisation;
-			}
-#else
-			mon_finalize (mon);
-			mono_monitor_allocator_unlock ();
-			mon = obj->synchronisation;
-#endif
-		}
-	} else {
-#ifdef HAVE_MOVING_COLLECTOR
-		LockWord lw;
-		lw.sync = mon;
-		if (lw.lock_word & LOCK_WORD_THIN_HASH) {
-			MonoThreadsSync *oldlw = lw.sync;
-			mono_monitor_allocator_lock ();
-			mon = mon_new (id);
-			/* move the already calculated hash */
-			mon->hash_code = lw.lock_word >> LOCK_WORD_HASH_SHIFT;
-			lw.sync = mon;
-			lw.lock_word |= LOCK_WORD_FAT_HASH;
-			if (InterlockedCompareExchangePointer ((gpointer*)&obj->synchronisation, lw.sync, oldlw) == oldlw) {
-				mono_gc_weak_link_add (&mon->data, obj, TRUE);
-				mono_monitor_allocator_unlock ();
-				/* Successfully locked */
+	if (G_LIKELY (lock_word_is_flat (lw))) {
+		/* If the object isn't locked, take a flat lock */
+		if (G_LIKELY (lock_word_is_free (lw))) {
+			if (lock_word_is_free (lock_word_cas (obj, lock_word_new_flat (id), lw)))
 				return 1;
-			} else {
-				mon_finalize (mon);
-				mono_monitor_allocator_unlock ();
+			goto retry;
+		}
+
+		/* If the object is flat locked by this thread... */
+		if (lock_word_get_owner (lw) == id) {
+			if (G_UNLIKELY (lock_word_is_max_nest (lw))) {
+				mono_monitor_inflate (obj);
 				goto retry;
 			}
+			/* Failure means someone inflated the lock under us */
+			if (lock_word_cas (obj, lock_word_increment_nest (lw), lw).sync != lw.sync)
+				goto retry;
+			return 1;
 		}
+
+		/* The object is flat locked by someone else */
+		if (ms == 0) {
+#ifndef DISABLE_PERFCOUNTERS
+			mono_perfcounters->thread_contentions++;
 #endif
+			LOCK_DEBUG (g_message ("%s: (%d) timed out, returning FALSE", __func__, id));
+			return 0;
+		}
+		/* Inflate it so we have a semaphore to wait on */
+		mono_monitor_inflate (obj);
+		goto retry;
 	}
 
-#ifdef HAVE_MOVING_COLLECTOR
-	{
-		LockWord lw;
-		lw.sync = mon;
-		lw.lock_word &= ~LOCK_WORD_BITS_MASK;
-		mon = lw.sync;
+	if (G_UNLIKELY (!lock_word_is_inflated (lw))) {
+		/* A thin hash takes up the whole lock word */
+		mono_monitor_inflate (obj);
+		goto retry;
 	}
-#endif
+
+	mon = lock_word_get_inflated_lock (lw);
 
 	/* If the object has previously been locked but isn't now... */
 
@@ -579,8 +789,22 @@ retry:
 		return 0;
 	}
 
+	/*
+	 * The profiler brackets the spinning and the blocking below with CONTENTION
+	 * and DONE/FAIL events, so its per-object contention counts and wait times
+	 * cover both.
+	 */
 	mono_profiler_monitor_event (obj, MONO_PROFILER_MONITOR_CONTENTION);
 
+	InterlockedIncrement (&mon->contentions);
+	contention_start = mono_100ns_ticks ();
+
+	if (mon_spin (mon, id)) {
+		mon_add_wait_time (mon, contention_start);
+		mono_profiler_monitor_event (obj, MONO_PROFILER_MONITOR_DONE);
+		return 1;
+	}
+
 	/* The slow path begins here. */
 retry_contended:
 	/* a small amount of duplicated code, but it allows us to insert the profiler
@@ -602,6 +826,7 @@ retry_contended:
 		if (G_LIKELY (tmp_status == old_status)) {
 			/* Success */
 			g_assert (mon->nest == 1);
+			mon_add_wait_time (mon, contention_start);
 			mono_profiler_monitor_event (obj, MONO_PROFILER_MONITOR_DONE);
 			return 1;
 		}
@@ -610,6 +835,7 @@ retry_contended:
 	/* If the object is currently locked by this thread... */
 	if (mon_status_get_owner (old_status) == id) {
 		mon->nest++;
+		mon_add_wait_time (mon, contention_start);
 		mono_profiler_monitor_event (obj, MONO_PROFILER_MONITOR_DONE);
 		return 1;
 	}
@@ -709,6 +935,7 @@ retry_contended:
 	/* Timed out or interrupted */
 	mon_decrement_entry_count (mon);
 
+	mon_add_wait_time (mon, contention_start);
 	mono_profiler_monitor_event (obj, MONO_PROFILER_MONITOR_FAIL);
 
 	if (ret == WAIT_IO_COMPLETION) {
@@ -739,6 +966,7 @@ void
 mono_monitor_exit (MonoObject *obj)
 {
 	MonoThreadsSync *mon;
+	LockWord lw, nlw;
 	guint32 nest;
 	guint32 new_status, old_status, tmp_status;
 	
@@ -749,22 +977,29 @@ mono_monitor_exit (MonoObject *obj)
 		return;
 	}
 
-	mon = obj->synchronisation;
+	lw.sync = obj->synchronisation;
 
-#ifdef HAVE_MOVING_COLLECTOR
-	{
-		LockWord lw;
-		lw.sync = mon;
-		if (lw.lock_word & LOCK_WORD_THIN_HASH)
+	if (G_LIKELY (lock_word_is_flat (lw))) {
+		/* This also ignores unlocked objects, as MS does */
+		if (G_UNLIKELY (lock_word_get_owner (lw) != mono_thread_info_get_small_id ()))
 			return;
-		lw.lock_word &= ~LOCK_WORD_BITS_MASK;
-		mon = lw.sync;
+		if (lock_word_is_nested (lw))
+			nlw = lock_word_decrement_nest (lw);
+		else
+			nlw.sync = NULL;
+		if (G_LIKELY (lock_word_cas (obj, nlw, lw).sync == lw.sync)) {
+			LOCK_DEBUG (g_message ("%s: (%d) Object %p is now unlocked", __func__, mono_thread_info_get_small_id (), obj));
+			return;
+		}
+		/* A contending thread inflated the lock under us */
+		lw.sync = obj->synchronisation;
 	}
-#endif
-	if (G_UNLIKELY (mon == NULL)) {
+
+	if (G_UNLIKELY (!lock_word_is_inflated (lw))) {
 		/* No one ever used Enter. Just ignore the Exit request as MS does */
 		return;
 	}
+	mon = lock_word_get_inflated_lock (lw);
 
 	old_status = mon->status;
 	if (G_UNLIKELY (mon_status_get_owner (old_status) != mono_thread_info_get_small_id ())) {
@@ -813,12 +1048,8 @@ mono_monitor_get_object_monitor_weak_link (MonoObject *object)
 	MonoThreadsSync *sync = NULL;
 
 	lw.sync = object->synchronisation;
-	if (lw.lock_word & LOCK_WORD_FAT_HASH) {
-		lw.lock_word &= ~LOCK_WORD_BITS_MASK;
-		sync = lw.sync;
-	} else if (!(lw.lock_word & LOCK_WORD_THIN_HASH)) {
-		sync = lw.sync;
-	}
+	if (lock_word_is_inflated (lw))
+		sync = lock_word_get_inflated_lock (lw);
 
 	if (sync && sync->data)
 		return &sync->data;
@@ -884,26 +1115,12 @@ mono_monitor_enter_v4 (MonoObject *obj, char *lock_taken)
 gboolean 
 ves_icall_System_Threading_Monitor_Monitor_test_owner (MonoObject *obj)
 {
-	MonoThreadsSync *mon;
+	LockWord lw;
 	
 	LOCK_DEBUG (g_message ("%s: Testing if %p is owned by thread %d", __func__, obj, mono_thread_info_get_small_id()));
 
-	mon = obj->synchronisation;
-#ifdef HAVE_MOVING_COLLECTOR
-	{
-		LockWord lw;
-		lw.sync = mon;
-		if (lw.lock_word & LOCK_WORD_THIN_HASH)
-			return FALSE;
-		lw.lock_word &= ~LOCK_WORD_BITS_MASK;
-		mon = lw.sync;
-	}
-#endif
-	if (mon == NULL) {
-		return FALSE;
-	}
-	
-	if (mon_status_get_owner (mon->status) == mono_thread_info_get_small_id ()) {
+	lw.sync = obj->synchronisation;
+	if (mon_get_owner (lw) == mono_thread_info_get_small_id ()) {
 		return(TRUE);
 	}
 	
@@ -913,26 +1130,12 @@ ves_icall_System_Threading_Monitor_Monitor_test_owner (MonoObject *obj)
 gboolean 
 ves_icall_System_Threading_Monitor_Monitor_test_synchronised (MonoObject *obj)
 {
-	MonoThreadsSync *mon;
+	LockWord lw;
 
 	LOCK_DEBUG (g_message("%s: (%d) Testing if %p is owned by any thread", __func__, mono_thread_info_get_small_id (), obj));
 	
-	mon = obj->synchronisation;
-#ifdef HAVE_MOVING_COLLECTOR
-	{
-		LockWord lw;
-		lw.sync = mon;
-		if (lw.lock_word & LOCK_WORD_THIN_HASH)
-			return FALSE;
-		lw.lock_word &= ~LOCK_WORD_BITS_MASK;
-		mon = lw.sync;
-	}
-#endif
-	if (mon == NULL) {
-		return FALSE;
-	}
-	
-	if (mon_status_get_owner (mon->status) != 0) {
+	lw.sync = obj->synchronisation;
+	if (mon_get_owner (lw) != 0) {
 		return TRUE;
 	}
 	
@@ -944,34 +1147,37 @@ ves_icall_System_Threading_Monitor_Monitor_test_synchronised (MonoObject *obj)
  * any extra struct locking
  */
 
+static gboolean
+mono_monitor_ensure_owned (LockWord lw)
+{
+	guint32 owner = mon_get_owner (lw);
+
+	if (owner == 0) {
+		mono_raise_exception (mono_get_exception_synchronization_lock ("Not locked"));
+		return FALSE;
+	}
+	if (owner != mono_thread_info_get_small_id ()) {
+		mono_raise_exception (mono_get_exception_synchronization_lock ("Not locked by this thread"));
+		return FALSE;
+	}
+	return TRUE;
+}
+
 void
 ves_icall_System_Threading_Monitor_Monitor_pulse (MonoObject *obj)
 {
 	MonoThreadsSync *mon;
+	LockWord lw;
 	
 	LOCK_DEBUG (g_message ("%s: (%d) Pulsing %p", __func__, mono_thread_info_get_small_id (), obj));
 	
-	mon = obj->synchronisation;
-#ifdef HAVE_MOVING_COLLECTOR
-	{
-		LockWord lw;
-		lw.sync = mon;
-		if (lw.lock_word & LOCK_WORD_THIN_HASH) {
-			mono_raise_exception (mono_get_exception_synchronization_lock ("Not locked"));
-			return;
-		}
-		lw.lock_word &= ~LOCK_WORD_BITS_MASK;
-		mon = lw.sync;
-	}
-#endif
-	if (mon == NULL) {
-		mono_raise_exception (mono_get_exception_synchronization_lock ("Not locked"));
+	lw.sync = obj->synchronisation;
+	if (!mono_monitor_ensure_owned (lw))
 		return;
-	}
-	if (mon_status_get_owner (mon->status) != mono_thread_info_get_small_id ()) {
-		mono_raise_exception (mono_get_exception_synchronization_lock ("Not locked by this thread"));
+	/* Nobody can be waiting on a flat lock */
+	if (!lock_word_is_inflated (lw))
 		return;
-	}
+	mon = lock_word_get_inflated_lock (lw);
 
 	LOCK_DEBUG (g_message ("%s: (%d) %d threads waiting", __func__, mono_thread_info_get_small_id (), g_slist_length (mon->wait_list)));
 	
@@ -987,30 +1193,17 @@ void
 ves_icall_System_Threading_Monitor_Monitor_pulse_all (MonoObject *obj)
 {
 	MonoThreadsSync *mon;
+	LockWord lw;
 	
 	LOCK_DEBUG (g_message("%s: (%d) Pulsing all %p", __func__, mono_thread_info_get_small_id (), obj));
 
-	mon = obj->synchronisation;
-#ifdef HAVE_MOVING_COLLECTOR
-	{
-		LockWord lw;
-		lw.sync = mon;
-		if (lw.lock_word & LOCK_WORD_THIN_HASH) {
-			mono_raise_exception (mono_get_exception_synchronization_lock ("Not locked"));
-			return;
-		}
-		lw.lock_word &= ~LOCK_WORD_BITS_MASK;
-		mon = lw.sync;
-	}
-#endif
-	if (mon == NULL) {
-		mono_raise_exception (mono_get_exception_synchronization_lock ("Not locked"));
+	lw.sync = obj->synchronisation;
+	if (!mono_monitor_ensure_owned (lw))
 		return;
-	}
-	if (mon_status_get_owner (mon->status) != mono_thread_info_get_small_id ()) {
-		mono_raise_exception (mono_get_exception_synchronization_lock ("Not locked by this thread"));
+	/* Nobody can be waiting on a flat lock */
+	if (!lock_word_is_inflated (lw))
 		return;
-	}
+	mon = lock_word_get_inflated_lock (lw);
 
 	LOCK_DEBUG (g_message ("%s: (%d) %d threads waiting", __func__, mono_thread_info_get_small_id (), g_slist_length (mon->wait_list)));
 
@@ -1026,6 +1219,7 @@ gboolean
 ves_icall_System_Threading_Monitor_Monitor_wait (MonoObject *obj, guint32 ms)
 {
 	MonoThreadsSync *mon;
+	LockWord lw;
 	HANDLE event;
 	guint32 nest;
 	guint32 ret;
@@ -1035,27 +1229,15 @@ ves_icall_System_Threading_Monitor_Monitor_wait (MonoObject *obj, guint32 ms)
 
 	LOCK_DEBUG (g_message ("%s: (%d) Trying to wait for %p with timeout %dms", __func__, mono_thread_info_get_small_id (), obj, ms));
 	
-	mon = obj->synchronisation;
-#ifdef HAVE_MOVING_COLLECTOR
-	{
-		LockWord lw;
-		lw.sync = mon;
-		if (lw.lock_word & LOCK_WORD_THIN_HASH) {
-			mono_raise_exception (mono_get_exception_synchronization_lock ("Not locked"));
-			return FALSE;
-		}
-		lw.lock_word &= ~LOCK_WORD_BITS_MASK;
-		mon = lw.sync;
-	}
-#endif
-	if (mon == NULL) {
-		mono_raise_exception (mono_get_exception_synchronization_lock ("Not locked"));
-		return FALSE;
-	}
-	if (mon_status_get_owner (mon->status) != mono_thread_info_get_small_id ()) {
-		mono_raise_exception (mono_get_exception_synchronization_lock ("Not locked by this thread"));
+	lw.sync = obj->synchronisation;
+	if (!mono_monitor_ensure_owned (lw))
 		return FALSE;
+	if (!lock_word_is_inflated (lw)) {
+		/* We need a wait list */
+		mono_monitor_inflate (obj);
+		lw.sync = obj->synchronisation;
 	}
+	mon = lock_word_get_inflated_lock (lw);
 
 	/* Do this WaitSleepJoin check before creating the event handle */
 	mono_thread_current_check_pending_interrupt ();
@@ -23,6 +23,31 @@ G_BEGIN_DECLS
 #define ENTRY_COUNT_ZERO	0x7fff0000
 #define ENTRY_COUNT_SHIFT	16
 
+/*
+ * Format of the lock word (MonoObject.synchronisation):
+ *
+ *   flat lock:	owner | nest | 00
+ *   thin hash:	hash | 01
+ *   inflated:	MonoThreadsSync* | 10
+ *   fat hash:	MonoThreadsSync* | 11	(the hash is in the MonoThreadsSync)
+ *
+ * A zero lock word is an unlocked flat lock. owner is the small id of the
+ * thread holding the lock and nest is the recursion count minus one, so
+ * taking and releasing an uncontended lock is a single CAS on the object
+ * header. The lock is inflated to a MonoThreadsSync when it is contended,
+ * waited on or pulsed, when a hash code is requested while it is held, or
+ * when nest overflows. Inflated locks are never deflated.
+ */
+#define LOCK_WORD_HAS_HASH	1
+#define LOCK_WORD_INFLATED	2
+#define LOCK_WORD_STATUS_MASK	3
+#define LOCK_WORD_HASH_SHIFT	2
+#define LOCK_WORD_NEST_SHIFT	2
+#define LOCK_WORD_NEST_BITS	8
+#define LOCK_WORD_NEST_MASK	(((1 << LOCK_WORD_NEST_BITS) - 1) << LOCK_WORD_NEST_SHIFT)
+#define LOCK_WORD_OWNER_SHIFT	(LOCK_WORD_NEST_SHIFT + LOCK_WORD_NEST_BITS)
+#define LOCK_WORD_OWNER_MASK	(~(LOCK_WORD_NEST_MASK | LOCK_WORD_STATUS_MASK))
+
 struct _MonoThreadsSync
 {
 	/*
@@ -42,6 +67,10 @@ struct _MonoThreadsSync
 	HANDLE entry_sem;
 	GSList *wait_list;
 	void *data;
+	/* Adaptive spinning state and contention statistics */
+	gint32 spin_avg;
+	gint32 contentions;
+	gint64 wait_time;		/* in 100ns ticks */
 };
 
 
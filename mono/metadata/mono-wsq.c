@@ -8,11 +8,34 @@
  * Copyright 2011 Xamarin, Inc (http://www.xamarin.com)
  */
 
+/*
+ * This is a Chase-Lev work-stealing deque ("Dynamic Circular Work-Stealing
+ * Deque", SPAA 2005, with the fences from Le et al., PPoPP 2013).
+ *
+ * The owner thread pushes and pops at the tail without taking any lock; the
+ * only atomic operation it ever needs is a CAS on head when it races with a
+ * thief for the last element. Thieves take elements from the head with a CAS.
+ *
+ * head and tail are monotonically increasing and are only ever compared
+ * through their difference, so wrapping around is harmless.
+ *
+ * The ring buffer is a managed array so the GC sees the queued objects. When
+ * the owner grows it, the old array is left untouched: a thief that read the
+ * old pointer still finds the right element in it, and its CAS on head tells
+ * it whether the element is still its to take. The old array is kept alive
+ * by the thief's stack for as long as it is needed.
+ *
+ * Thieves never clear the slot they took, since the owner might already have
+ * reused it, so stolen objects stay referenced until the owner pushes over
+ * them.
+ */
+
 #include <string.h>
 #include <mono/metadata/object.h>
 #include <mono/metadata/mono-wsq.h>
-#include <mono/utils/mono-semaphore.h>
 #include <mono/utils/mono-tls.h>
+#include <mono/utils/mono-time.h>
+#include <mono/utils/mono-memory-model.h>
 #include <mono/utils/atomic.h>
 
 #define INITIAL_LENGTH	32
@@ -20,18 +43,22 @@
 //#define WSQ_DEBUG(...) g_message(__VA_ARGS__)
 
 struct _MonoWSQ {
-	volatile gint head;
-	volatile gint tail;
-	MonoArray *queue;
-	gint32 mask;
+	volatile gint32 head;
+	volatile gint32 tail;
+	/* Only written by the owner, read by thieves */
+	MonoArray * volatile queue;
 	gint32 suspended;
-	MonoSemType lock;
 };
 
 #define NO_KEY ((guint32) -1)
 static MonoNativeTlsKey wsq_tlskey;
 static gboolean wsq_tlskey_inited = FALSE;
 
+/* Number of elements between @head and @tail, wrap-around safe */
+#define WSQ_SIZE(head,tail) ((gint32) ((guint32) (tail) - (guint32) (head)))
+#define WSQ_MASK(queue) ((guint32) mono_array_length ((queue)) - 1)
+#define WSQ_SLOT(queue,index) ((guint32) (index) & WSQ_MASK ((queue)))
+
 void
 mono_wsq_init ()
 {
@@ -61,12 +88,10 @@ mono_wsq_create ()
 		return NULL;
 
 	wsq = g_new0 (MonoWSQ, 1);
-	wsq->mask = INITIAL_LENGTH - 1;
 	wsq->suspended = 0;
 	MONO_GC_REGISTER_ROOT_SINGLE (wsq->queue);
 	root = mono_get_root_domain ();
 	wsq->queue = mono_array_new_cached (root, mono_defaults.object_class, INITIAL_LENGTH);
-	MONO_SEM_INIT (&wsq->lock, 1);
 	if (!mono_native_tls_set_value (wsq_tlskey, wsq)) {
 		mono_wsq_destroy (wsq);
 		wsq = NULL;
@@ -88,7 +113,6 @@ mono_wsq_destroy (MonoWSQ *wsq)
 
 	g_assert (mono_wsq_count (wsq) == 0);
 	MONO_GC_UNREGISTER_ROOT (wsq->queue);
-	MONO_SEM_DESTROY (&wsq->lock);
 	memset (wsq, 0, sizeof (MonoWSQ));
 	if (wsq_tlskey_inited && mono_native_tls_get_value (wsq_tlskey) == wsq)
 		mono_native_tls_set_value (wsq_tlskey, NULL);
@@ -98,17 +122,43 @@ mono_wsq_destroy (MonoWSQ *wsq)
 gint
 mono_wsq_count (MonoWSQ *wsq)
 {
+	gint32 count;
+
 	if (!wsq)
 		return 0;
-	return ((wsq->tail - wsq->head) & wsq->mask);
+	/* The owner transiently moves tail below head while popping from an empty queue */
+	count = WSQ_SIZE (wsq->head, wsq->tail);
+	return count > 0 ? count : 0;
+}
+
+/*
+ * Called by the owner only. Copies the live elements into an array twice as
+ * big and publishes it. The elements keep their logical index, so thieves
+ * holding on to the old array can still finish a steal from it.
+ */
+static MonoArray *
+wsq_grow (MonoWSQ *wsq, gint32 head, gint32 tail)
+{
+	MonoArray *old_array, *new_array;
+	gint32 i;
+
+	old_array = wsq->queue;
+	new_array = mono_array_new_cached (mono_get_root_domain (), mono_defaults.object_class, mono_array_length (old_array) * 2);
+	for (i = head; WSQ_SIZE (i, tail) > 0; i++)
+		mono_array_setref (new_array, WSQ_SLOT (new_array, i), mono_array_get (old_array, MonoObject*, WSQ_SLOT (old_array, i)));
+
+	/* The copied elements must be visible before thieves can see the new array */
+	mono_atomic_store_release (&wsq->queue, new_array);
+	WSQ_DEBUG ("grow: %p %d\n", wsq, mono_array_length (new_array));
+	return new_array;
 }
 
 gboolean
 mono_wsq_local_push (void *obj)
 {
-	int tail;
-	int head;
-	int count;
+	gint32 tail;
+	gint32 head;
+	MonoArray *queue;
 	MonoWSQ *wsq;
 
 	if (obj == NULL || !wsq_tlskey_inited)
@@ -126,43 +176,25 @@ mono_wsq_local_push (void *obj)
 	}
 
 	tail = wsq->tail;
-	if (tail < wsq->head + wsq->mask) {
-		mono_array_setref (wsq->queue, tail & wsq->mask, (MonoObject *) obj);
-		wsq->tail = tail + 1;
-		WSQ_DEBUG ("local_push: OK %p %p\n", wsq, obj);
-		return TRUE;
-	}
-
-	MONO_SEM_WAIT (&wsq->lock);
 	head = wsq->head;
-	count = wsq->tail - wsq->head;
-	if (count >= wsq->mask) {
-		MonoArray *new_array;
-		int length;
-		int i;
-
-		length = mono_array_length (wsq->queue);
-		new_array = mono_array_new_cached (mono_get_root_domain (), mono_defaults.object_class, length * 2);
-		for (i = 0; i < length; i++)
-			mono_array_setref (new_array, i, mono_array_get (wsq->queue, MonoObject*, (i + head) & wsq->mask));
-
-		mono_gc_bzero_aligned (mono_array_addr (wsq->queue, MonoObject *, 0), sizeof (MonoObject*) * length);
-		wsq->queue = new_array;
-		wsq->head = 0;
-		wsq->tail = tail = count;
-		wsq->mask = (wsq->mask << 1) | 1;
-	}
-	mono_array_setref (wsq->queue, tail & wsq->mask, obj);
-	wsq->tail = tail + 1;
-	MONO_SEM_POST (&wsq->lock);
-	WSQ_DEBUG ("local_push: LOCK %p  %p\n", wsq, obj);
+	queue = wsq->queue;
+	if (WSQ_SIZE (head, tail) >= (gint32) WSQ_MASK (queue))
+		queue = wsq_grow (wsq, head, tail);
+
+	mono_array_setref (queue, WSQ_SLOT (queue, tail), (MonoObject *) obj);
+	/* The element must be visible before thieves can see the new tail */
+	mono_atomic_store_release (&wsq->tail, tail + 1);
+	WSQ_DEBUG ("local_push: OK %p %p\n", wsq, obj);
 	return TRUE;
 }
 
 gboolean
 mono_wsq_local_pop (void **ptr)
 {
-	int tail;
+	gint32 tail;
+	gint32 head;
+	gint32 size;
+	MonoArray *queue;
 	gboolean res;
 	MonoWSQ *wsq;
 
@@ -175,56 +207,81 @@ mono_wsq_local_pop (void **ptr)
 		return FALSE;
 	}
 
-	tail = wsq->tail;
-	if (wsq->head >= tail) {
+	tail = wsq->tail - 1;
+	queue = wsq->queue;
+	wsq->tail = tail;
+	/* Thieves must see the reserved tail before we look at head */
+	STORE_LOAD_FENCE;
+	head = wsq->head;
+
+	size = WSQ_SIZE (head, tail);
+	if (size < 0) {
+		/* Empty */
+		wsq->tail = head;
 		WSQ_DEBUG ("local_pop: empty\n");
 		return FALSE;
 	}
-	tail--;
-	InterlockedExchange (&wsq->tail, tail);
-	if (wsq->head <= tail) {
-		*ptr = mono_array_get (wsq->queue, void *, tail & wsq->mask);
-		mono_array_set (wsq->queue, void *, tail & wsq->mask, NULL);
+
+	*ptr = mono_array_get (queue, void *, WSQ_SLOT (queue, tail));
+	if (size > 0) {
+		/* More than one element left, no thief can reach this one */
+		mono_array_set (queue, void *, WSQ_SLOT (queue, tail), NULL);
 		WSQ_DEBUG ("local_pop: GOT ONE %p %p\n", wsq, *ptr);
 		return TRUE;
 	}
 
-	MONO_SEM_WAIT (&wsq->lock);
-	if (wsq->head <= tail) {
-		*ptr = mono_array_get (wsq->queue, void *, tail & wsq->mask);
-		mono_array_set (wsq->queue, void *, tail & wsq->mask, NULL);
-		res = TRUE;
-	} else {
-		wsq->tail = tail + 1;
-		res = FALSE;
-	}
-	MONO_SEM_POST (&wsq->lock);
-	WSQ_DEBUG ("local_pop: LOCK %d %p %p\n", res, wsq, *ptr);
+	/* Last element: race the thieves for it */
+	res = InterlockedCompareExchange (&wsq->head, head + 1, head) == head;
+	wsq->tail = head + 1;
+	if (res)
+		mono_array_set (queue, void *, WSQ_SLOT (queue, tail), NULL);
+	else
+		*ptr = NULL;
+	WSQ_DEBUG ("local_pop: LAST %d %p %p\n", res, wsq, *ptr);
 	return res;
 }
 
+/*
+ * Try to take one element from the head of @wsq. If we lose a race with
+ * another thief or with the owner, retry for up to @ms_timeout milliseconds
+ * as long as the queue is not empty.
+ */
 void
 mono_wsq_try_steal (MonoWSQ *wsq, void **ptr, guint32 ms_timeout)
 {
+	guint32 start = 0;
+
 	if (wsq == NULL || ptr == NULL || *ptr != NULL || !wsq_tlskey_inited)
 		return;
 
 	if (mono_native_tls_get_value (wsq_tlskey) == wsq)
 		return;
 
-	if (mono_sem_timedwait (&wsq->lock, ms_timeout, FALSE) == 0) {
-		int head;
+	for (;;) {
+		gint32 head, tail;
+		MonoArray *queue;
+		void *obj;
 
 		head = wsq->head;
-		InterlockedExchange (&wsq->head, head + 1);
-		if (head < wsq->tail) {
-			*ptr = mono_array_get (wsq->queue, void *, head & wsq->mask);
-			mono_array_set (wsq->queue, void *, head & wsq->mask, NULL);
+		/* Pairs with the fence in local_pop: head must be read before tail */
+		mono_memory_barrier ();
+		tail = wsq->tail;
+		if (WSQ_SIZE (head, tail) <= 0)
+			return;
+
+		mono_atomic_load_acquire (queue, MonoArray *, &wsq->queue);
+		obj = mono_array_get (queue, void *, WSQ_SLOT (queue, head));
+		if (InterlockedCompareExchange (&wsq->head, head + 1, head) == head) {
+			*ptr = obj;
 			WSQ_DEBUG ("STEAL %p %p\n", wsq, *ptr);
-		} else {
-			wsq->head = head;
+			return;
 		}
-		MONO_SEM_POST (&wsq->lock);
+
+		if (ms_timeout == 0)
+			return;
+		if (start == 0)
+			start = mono_msec_ticks ();
+		else if (mono_msec_ticks () - start >= ms_timeout)
+			return;
 	}
 }
-
@@ -43,6 +43,8 @@
 #include <mono/utils/mono-counters.h>
 #include <mono/utils/mono-error-internals.h>
 #include <mono/utils/mono-memory-model.h>
+#include <mono/utils/hazard-pointer.h>
+#include <mono/utils/atomic.h>
 #include "cominterop.h"
 
 #ifdef HAVE_BOEHM_GC
@@ -87,10 +89,6 @@ static char *
 mono_string_to_utf8_internal (MonoMemPool *mp, MonoImage *image, MonoString *s, gboolean ignore_error, MonoError *error);
 
 
-#define ldstr_lock() mono_mutex_lock (&ldstr_section)
-#define ldstr_unlock() mono_mutex_unlock (&ldstr_section)
-static mono_mutex_t ldstr_section;
-
 static gboolean profile_allocs = TRUE;
 
 void
@@ -190,7 +188,6 @@ mono_type_initialization_init (void)
 	mono_mutex_init_recursive (&type_initialization_section);
 	type_initialization_hash = g_hash_table_new (NULL, NULL);
 	blocked_thread_hash = g_hash_table_new (NULL, NULL);
-	mono_mutex_init_recursive (&ldstr_section);
 }
 
 void
@@ -204,7 +201,6 @@ mono_type_initialization_cleanup (void)
 	g_hash_table_destroy (type_initialization_hash);
 	type_initialization_hash = NULL;
 #endif
-	mono_mutex_destroy (&ldstr_section);
 	g_hash_table_destroy (blocked_thread_hash);
 	blocked_thread_hash = NULL;
 
@@ -5092,18 +5088,19 @@ MonoString*
 mono_string_new_len (MonoDomain *domain, const char *text, guint length)
 {
 	GError *error = NULL;
-	MonoString *o = NULL;
-	guint16 *ut;
-	glong items_written;
-
-	ut = eg_utf8_to_utf16_with_nuls (text, length, NULL, &items_written, &error);
-
-	if (!error)
-		o = mono_string_new_utf16 (domain, ut, items_written);
-	else 
-		g_error_free (error);
+	MonoString *o;
+	glong items_read, len;
+
+	/* Size the string first so the characters are decoded straight into it */
+	len = eg_utf8_to_utf16_len (text, length, &items_read, TRUE, &error);
+	if (len < 0) {
+		if (error)
+			g_error_free (error);
+		return NULL;
+	}
 
-	g_free (ut);
+	o = mono_string_new_size (domain, len);
+	eg_utf8_to_utf16_buf (text, items_read, mono_string_chars (o));
 
 	return o;
 }
@@ -5117,41 +5114,19 @@ mono_string_new_len (MonoDomain *domain, const char *text, guint length)
 MonoString*
 mono_string_new (MonoDomain *domain, const char *text)
 {
-    GError *error = NULL;
-    MonoString *o = NULL;
-    guint16 *ut;
-    glong items_written;
-    int l;
-
-    l = strlen (text);
-   
-    ut = g_utf8_to_utf16 (text, l, NULL, &items_written, &error);
-
-    if (!error)
-        o = mono_string_new_utf16 (domain, ut, items_written);
-    else
-        g_error_free (error);
-
-    g_free (ut);
-/*FIXME g_utf8_get_char, g_utf8_next_char and g_utf8_validate are not part of eglib.*/
-#if 0
-	gunichar2 *str;
-	const gchar *end;
-	int len;
-	MonoString *o = NULL;
+	GError *error = NULL;
+	MonoString *o;
+	glong items_read, len;
 
-	if (!g_utf8_validate (text, -1, &end))
+	len = eg_utf8_to_utf16_len (text, strlen (text), &items_read, FALSE, &error);
+	if (len < 0) {
+		g_error_free (error);
 		return NULL;
+	}
 
-	len = g_utf8_strlen (text, -1);
 	o = mono_string_new_size (domain, len);
-	str = mono_string_chars (o);
+	eg_utf8_to_utf16_buf (text, items_read, mono_string_chars (o));
 
-	while (text < end) {
-		*str++ = g_utf8_get_char (text);
-		text = g_utf8_next_char (text);
-	}
-#endif
 	return o;
 }
 
@@ -5430,9 +5405,266 @@ mono_object_castclass_mbyref (MonoObject *obj, MonoClass *klass)
 	return NULL;
 }
 
+/*
+ * Lock-free table of interned strings.
+ *
+ * This is an open addressing table of string references which only ever
+ * grows, so lookups run without taking any lock and inserts claim an empty
+ * slot with a CAS. The hash of every string is cached next to its slot, so
+ * probing rarely has to touch the strings themselves and growing the table
+ * never needs to hash them again.
+ *
+ * The table is grown under a mutex: every empty slot of the old table is
+ * CASed to a FROZEN marker before the live entries are copied, so a racing
+ * insert either landed before and gets copied, or sees the marker and
+ * retries on the new table once it is published. Old tables are freed
+ * through hazard pointers, like in utils/mono-conc-hashtable.c.
+ *
+ * The slots are allocated with mono_gc_alloc_fixed () without a descriptor,
+ * so they are scanned conservatively and keep the strings alive. With SGen,
+ * interned strings are allocated pinned, so the slots never need updating.
+ */
+
+#define INTERN_TABLE_INITIAL_SIZE 256
+#define INTERN_TABLE_LOAD_FACTOR 0.75f
+#define INTERN_TABLE_FROZEN ((MonoString*)(gssize)-1)
+
+typedef struct {
+	int size;
+	/* Points into the same allocation, after the strings, 0 if not set yet */
+	guint32 *hashes;
+	MonoString *strings [MONO_ZERO_LEN_ARRAY];
+} InternTableData;
+
+struct _MonoInternTable {
+	InternTableData *volatile data; /* goes to HP0 */
+	mono_mutex_t mutex;
+	gint32 count;
+	int overflow_count;
+};
+
+static InternTableData*
+intern_table_data_new (int size)
+{
+	InternTableData *data;
+
+	/* alloc_fixed () returns zeroed memory */
+	data = mono_gc_alloc_fixed (sizeof (InternTableData) + size * (sizeof (MonoString*) + sizeof (guint32)), NULL);
+	data->size = size;
+	data->hashes = (guint32*)&data->strings [size];
+	return data;
+}
+
+/* Same as mono_string_hash (), @chars doesn't need to be aligned */
+static guint32
+mono_intern_table_hash (const gunichar2 *chars, int len)
+{
+	const guint8 *p = (const guint8*)chars;
+	guint32 h = 0;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		guint16 c;
+
+		memcpy (&c, p + i * 2, sizeof (c));
+		h = (h << 5) - h + c;
+	}
+
+	/* 0 marks a slot whose hash is not stored yet */
+	return h ? h : 1;
+}
+
+static inline int
+intern_table_mix_hash (guint32 hash)
+{
+	return ((hash * 215497) >> 16) ^ (hash * 1823231 + hash);
+}
+
+static inline gboolean
+intern_table_string_equal (MonoString *s, const gunichar2 *chars, int len)
+{
+	return mono_string_length (s) == len && memcmp (mono_string_chars (s), chars, len * 2) == 0;
+}
+
+MonoInternTable*
+mono_intern_table_new (void)
+{
+	MonoInternTable *table;
+
+	/* With Boehm, this keeps the data reachable from the domain */
+	table = mono_gc_alloc_fixed (sizeof (MonoInternTable), NULL);
+	mono_mutex_init (&table->mutex);
+	table->data = intern_table_data_new (INTERN_TABLE_INITIAL_SIZE);
+	table->overflow_count = (int)(INTERN_TABLE_INITIAL_SIZE * INTERN_TABLE_LOAD_FACTOR);
+	return table;
+}
+
+void
+mono_intern_table_destroy (MonoInternTable *table)
+{
+	mono_gc_free_fixed (table->data);
+	mono_mutex_destroy (&table->mutex);
+	mono_gc_free_fixed (table);
+}
+
+static void
+intern_table_insert_local (InternTableData *data, MonoString *str, guint32 hash)
+{
+	int mask = data->size - 1;
+	int i = intern_table_mix_hash (hash) & mask;
+
+	while (data->strings [i])
+		i = (i + 1) & mask;
+
+	data->strings [i] = str;
+	data->hashes [i] = hash;
+}
+
+static void
+intern_table_grow (MonoInternTable *table)
+{
+	InternTableData *old_data, *new_data;
+	int i;
+
+	mono_mutex_lock (&table->mutex);
+
+	/* Somebody else grew it already */
+	if (table->count < table->overflow_count) {
+		mono_mutex_unlock (&table->mutex);
+		return;
+	}
+
+	old_data = table->data;
+	new_data = intern_table_data_new (old_data->size * 2);
+
+	for (i = 0; i < old_data->size; ++i) {
+		MonoString *s;
+		guint32 hash;
+
+		/* Make sure no insert can land in the old table after it is copied */
+		while (!(s = old_data->strings [i])) {
+			if (!InterlockedCompareExchangePointer ((gpointer volatile*)&old_data->strings [i], INTERN_TABLE_FROZEN, NULL)) {
+				s = INTERN_TABLE_FROZEN;
+				break;
+			}
+		}
+		if (s == INTERN_TABLE_FROZEN)
+			continue;
+
+		/* The inserting thread might not have stored the hash yet */
+		hash = old_data->hashes [i];
+		if (!hash)
+			hash = mono_intern_table_hash (mono_string_chars (s), mono_string_length (s));
+		intern_table_insert_local (new_data, s, hash);
+	}
+
+	mono_memory_barrier ();
+	table->data = new_data;
+	table->overflow_count = (int)(new_data->size * INTERN_TABLE_LOAD_FACTOR);
+	mono_mutex_unlock (&table->mutex);
+
+	mono_thread_hazardous_free_or_queue (old_data, mono_gc_free_fixed, TRUE, FALSE);
+}
+
+/**
+ * mono_intern_table_lookup:
+ *
+ * Returns the string in @table equal to the @len characters at @chars, or
+ * NULL. @hash must come from mono_intern_table_hash (). Never takes a lock.
+ */
+static MonoString*
+mono_intern_table_lookup (MonoInternTable *table, const gunichar2 *chars, int len, guint32 hash)
+{
+	MonoThreadHazardPointers *hp = mono_hazard_pointer_get ();
+	InternTableData *data;
+	MonoString *s;
+	int i, mask;
+
+retry:
+	data = get_hazardous_pointer ((gpointer volatile*)&table->data, hp, 0);
+	mask = data->size - 1;
+
+	for (i = intern_table_mix_hash (hash) & mask; (s = data->strings [i]) && s != INTERN_TABLE_FROZEN; i = (i + 1) & mask) {
+		guint32 h;
+
+		/* The slot must be read before its hash */
+		mono_memory_read_barrier ();
+		h = data->hashes [i];
+		if ((!h || h == hash) && intern_table_string_equal (s, chars, len)) {
+			mono_hazard_pointer_clear (hp, 0);
+			return s;
+		}
+	}
+
+	/* The table might have grown and the string be in the new one */
+	mono_memory_barrier ();
+	if (table->data != data)
+		goto retry;
+
+	mono_hazard_pointer_clear (hp, 0);
+	return NULL;
+}
+
+/**
+ * mono_intern_table_insert:
+ *
+ * Adds @str to @table unless an equal string is there already. Returns the
+ * string which is in the table afterwards. @str must not move.
+ */
+static MonoString*
+mono_intern_table_insert (MonoInternTable *table, MonoString *str, guint32 hash)
+{
+	MonoThreadHazardPointers *hp = mono_hazard_pointer_get ();
+	InternTableData *data;
+	MonoString *s;
+	int i, mask;
+
+retry:
+	if (table->count >= table->overflow_count)
+		intern_table_grow (table);
+
+	data = get_hazardous_pointer ((gpointer volatile*)&table->data, hp, 0);
+	mask = data->size - 1;
+	i = intern_table_mix_hash (hash) & mask;
+
+	for (;;) {
+		guint32 h;
+
+		s = data->strings [i];
+		if (!s) {
+			s = InterlockedCompareExchangePointer ((gpointer volatile*)&data->strings [i], str, NULL);
+			if (!s) {
+				data->hashes [i] = hash;
+				InterlockedIncrement (&table->count);
+				mono_hazard_pointer_clear (hp, 0);
+				return str;
+			}
+			/* Lost the slot, the winner might be an equal string */
+		}
+
+		if (s == INTERN_TABLE_FROZEN) {
+			/* The table is being grown, wait until the new one is published */
+			mono_hazard_pointer_clear (hp, 0);
+			mono_mutex_lock (&table->mutex);
+			mono_mutex_unlock (&table->mutex);
+			goto retry;
+		}
+
+		mono_memory_read_barrier ();
+		h = data->hashes [i];
+		if ((!h || h == hash) && intern_table_string_equal (s, mono_string_chars (str), mono_string_length (str))) {
+			mono_hazard_pointer_clear (hp, 0);
+			return s;
+		}
+
+		i = (i + 1) & mask;
+	}
+}
+
 typedef struct {
 	MonoDomain *orig_domain;
 	MonoString *ins;
+	guint32 hash;
 	MonoString *res;
 } LDStrInfo;
 
@@ -5442,7 +5674,7 @@ str_lookup (MonoDomain *domain, gpointer user_data)
 	LDStrInfo *info = user_data;
 	if (info->res || domain == info->orig_domain)
 		return;
-	info->res = mono_g_hash_table_lookup (domain->ldstr_table, info->ins);
+	info->res = mono_intern_table_lookup (domain->ldstr_table, mono_string_chars (info->ins), mono_string_length (info->ins), info->hash);
 }
 
 #ifdef HAVE_SGEN_GC
@@ -5468,27 +5700,26 @@ mono_string_get_pinned (MonoString *str)
 static MonoString*
 mono_string_is_interned_lookup (MonoString *str, int insert)
 {
-	MonoGHashTable *ldstr_table;
+	MonoInternTable *ldstr_table;
 	MonoString *res;
 	MonoDomain *domain;
+	guint32 hash;
 	
 	domain = ((MonoObject *)str)->vtable->domain;
 	ldstr_table = domain->ldstr_table;
-	ldstr_lock ();
-	if ((res = mono_g_hash_table_lookup (ldstr_table, str))) {
-		ldstr_unlock ();
+	hash = mono_intern_table_hash (mono_string_chars (str), mono_string_length (str));
+	if ((res = mono_intern_table_lookup (ldstr_table, mono_string_chars (str), mono_string_length (str), hash)))
 		return res;
-	}
 	if (insert) {
 		str = mono_string_get_pinned (str);
 		if (str)
-			mono_g_hash_table_insert (ldstr_table, str, str);
-		ldstr_unlock ();
+			str = mono_intern_table_insert (ldstr_table, str, hash);
 		return str;
 	} else {
 		LDStrInfo ldstr_info;
 		ldstr_info.orig_domain = domain;
 		ldstr_info.ins = str;
+		ldstr_info.hash = hash;
 		ldstr_info.res = NULL;
 
 		mono_domain_foreach (str_lookup, &ldstr_info);
@@ -5497,12 +5728,12 @@ mono_string_is_interned_lookup (MonoString *str, int insert)
 			 * the string was already interned in some other domain:
 			 * intern it in the current one as well.
 			 */
-			mono_g_hash_table_insert (ldstr_table, str, str);
-			ldstr_unlock ();
+			str = mono_string_get_pinned (str);
+			if (str)
+				str = mono_intern_table_insert (ldstr_table, str, hash);
 			return str;
 		}
 	}
-	ldstr_unlock ();
 	return NULL;
 }
 
@@ -5568,10 +5799,18 @@ mono_ldstr_metadata_sig (MonoDomain *domain, const char* sig)
 	const char *str = sig;
 	MonoString *o, *interned;
 	size_t len2;
+	guint32 hash;
 
 	len2 = mono_metadata_decode_blob_size (str, &str);
 	len2 >>= 1;
 
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+	/* Most ldstrs hit the table, look the string up before allocating it */
+	hash = mono_intern_table_hash ((gunichar2*)str, len2);
+	if ((interned = mono_intern_table_lookup (domain->ldstr_table, (gunichar2*)str, len2, hash)))
+		return interned;
+#endif
+
 	o = mono_string_new_utf16 (domain, (guint16*)str, len2);
 #if G_BYTE_ORDER != G_LITTLE_ENDIAN
 	{
@@ -5582,18 +5821,15 @@ mono_ldstr_metadata_sig (MonoDomain *domain, const char* sig)
 			++p2;
 		}
 	}
-#endif
-	ldstr_lock ();
-	if ((interned = mono_g_hash_table_lookup (domain->ldstr_table, o))) {
-		ldstr_unlock ();
+	hash = mono_intern_table_hash (mono_string_chars (o), len2);
+	if ((interned = mono_intern_table_lookup (domain->ldstr_table, mono_string_chars (o), len2, hash)))
 		/* o will get garbage collected */
 		return interned;
-	}
+#endif
 
 	o = mono_string_get_pinned (o);
 	if (o)
-		mono_g_hash_table_insert (domain->ldstr_table, o, o);
-	ldstr_unlock ();
+		o = mono_intern_table_insert (domain->ldstr_table, o, hash);
 
 	return o;
 }
@@ -5618,6 +5854,41 @@ mono_string_to_utf8 (MonoString *s)
 	return result;
 }
 
+/*
+ * Converts @s into a single buffer allocated from @mp, @image or the heap,
+ * sized by a validating pass over the characters. Returns NULL and sets
+ * @gerror if @s is not valid UTF-16.
+ */
+static char *
+mono_string_to_utf8_alloc (MonoMemPool *mp, MonoImage *image, MonoString *s, GError **gerror)
+{
+	glong items_read, written, size;
+	char *as;
+
+	written = eg_utf16_to_utf8_len (mono_string_chars (s), s->length, &items_read, gerror);
+	if (written < 0)
+		return NULL;
+
+	size = written + 1;
+	if (mp) {
+		as = mono_mempool_alloc (mp, size);
+	} else if (image) {
+		as = mono_image_alloc (image, size);
+	} else {
+		/*
+		 * The conversion stops at the first nul (#335488), but the heap
+		 * buffer still covers the total length of the string.
+		 */
+		size = MAX (size, s->length);
+		as = g_malloc (size);
+	}
+
+	eg_utf16_to_utf8_buf (mono_string_chars (s), items_read, as);
+	memset (as + written, 0, size - written);
+
+	return as;
+}
+
 /**
  * mono_string_to_utf8_checked:
  * @s: a System.String
@@ -5630,7 +5901,6 @@ mono_string_to_utf8 (MonoString *s)
 char *
 mono_string_to_utf8_checked (MonoString *s, MonoError *error)
 {
-	long written = 0;
 	char *as;
 	GError *gerror = NULL;
 
@@ -5642,20 +5912,12 @@ mono_string_to_utf8_checked (MonoString *s, MonoError *error)
 	if (!s->length)
 		return g_strdup ("");
 
-	as = g_utf16_to_utf8 (mono_string_chars (s), s->length, NULL, &written, &gerror);
-	if (gerror) {
+	as = mono_string_to_utf8_alloc (NULL, NULL, s, &gerror);
+	if (!as) {
 		mono_error_set_argument (error, "string", "%s", gerror->message);
 		g_error_free (gerror);
 		return NULL;
 	}
-	/* g_utf16_to_utf8  may not be able to complete the convertion (e.g. NULL values were found, #335488) */
-	if (s->length > written) {
-		/* allocate the total length and copy the part of the string that has been converted */
-		char *as2 = g_malloc0 (s->length);
-		memcpy (as2, as, written);
-		g_free (as);
-		as = as2;
-	}
 
 	return as;
 }
@@ -5672,7 +5934,6 @@ mono_string_to_utf8_checked (MonoString *s, MonoError *error)
 char *
 mono_string_to_utf8_ignore (MonoString *s)
 {
-	long written = 0;
 	char *as;
 
 	if (s == NULL)
@@ -5681,16 +5942,9 @@ mono_string_to_utf8_ignore (MonoString *s)
 	if (!s->length)
 		return g_strdup ("");
 
-	as = g_utf16_to_utf8 (mono_string_chars (s), s->length, NULL, &written, NULL);
-
-	/* g_utf16_to_utf8  may not be able to complete the convertion (e.g. NULL values were found, #335488) */
-	if (s->length > written) {
-		/* allocate the total length and copy the part of the string that has been converted */
-		char *as2 = g_malloc0 (s->length);
-		memcpy (as2, as, written);
-		g_free (as);
-		as = as2;
-	}
+	as = mono_string_to_utf8_alloc (NULL, NULL, s, NULL);
+	if (!as)
+		as = g_malloc0 (s->length);
 
 	return as;
 }
@@ -5831,30 +6085,25 @@ mono_string_from_utf32 (mono_unichar4 *data)
 static char *
 mono_string_to_utf8_internal (MonoMemPool *mp, MonoImage *image, MonoString *s, gboolean ignore_error, MonoError *error)
 {
-	char *r;
+	GError *gerror = NULL;
 	char *mp_s;
-	int len;
-
-	if (ignore_error) {
-		r = mono_string_to_utf8_ignore (s);
-	} else {
-		r = mono_string_to_utf8_checked (s, error);
-		if (!mono_error_ok (error))
-			return NULL;
-	}
 
 	if (!mp && !image)
-		return r;
+		return ignore_error ? mono_string_to_utf8_ignore (s) : mono_string_to_utf8_checked (s, error);
 
-	len = strlen (r) + 1;
-	if (mp)
-		mp_s = mono_mempool_alloc (mp, len);
-	else
-		mp_s = mono_image_alloc (image, len);
+	if (!ignore_error)
+		mono_error_init (error);
 
-	memcpy (mp_s, r, len);
+	if (s == NULL)
+		return NULL;
 
-	g_free (r);
+	mp_s = mono_string_to_utf8_alloc (mp, image, s, ignore_error ? NULL : &gerror);
+	if (!mp_s && ignore_error) {
+		mp_s = mp ? mono_mempool_alloc0 (mp, 1) : mono_image_alloc0 (image, 1);
+	} else if (!mp_s) {
+		mono_error_set_argument (error, "string", "%s", gerror->message);
+		g_error_free (gerror);
+	}
 
 	return mp_s;
 }
@@ -8698,19 +8698,16 @@ mono_custom_attrs_data_construct (MonoCustomAttrInfo *cinfo)
 	return result;
 }
 
-/**
- * mono_custom_attrs_from_index:
- *
- * Returns: NULL if no attributes are found or if a loading error occurs.
- */
-MonoCustomAttrInfo*
-mono_custom_attrs_from_index (MonoImage *image, guint32 idx)
+/* Marks parents without custom attributes in the image cattr_cache */
+static int cattr_cache_none;
+
+static MonoCustomAttrInfo*
+custom_attrs_decode_index (MonoImage *image, guint32 idx)
 {
-	guint32 mtoken, i, len;
+	guint32 mtoken, i, first, len;
 	guint32 cols [MONO_CUSTOM_ATTR_SIZE];
 	MonoTableInfo *ca;
 	MonoCustomAttrInfo *ainfo;
-	GList *tmp, *list = NULL;
 	const char *data;
 
 	ca = &image->tables [MONO_TABLE_CUSTOMATTRIBUTE];
@@ -8718,21 +8715,20 @@ mono_custom_attrs_from_index (MonoImage *image, guint32 idx)
 	i = mono_metadata_custom_attrs_from_index (image, idx);
 	if (!i)
 		return NULL;
-	i --;
-	while (i < ca->rows) {
+	first = i - 1;
+	for (i = first; i < ca->rows; ++i) {
 		if (mono_metadata_decode_row_col (ca, i, MONO_CUSTOM_ATTR_PARENT) != idx)
 			break;
-		list = g_list_prepend (list, GUINT_TO_POINTER (i));
-		++i;
 	}
-	len = g_list_length (list);
+	len = i - first;
 	if (!len)
 		return NULL;
 	ainfo = g_malloc0 (MONO_SIZEOF_CUSTOM_ATTR_INFO + sizeof (MonoCustomAttrEntry) * len);
 	ainfo->num_attrs = len;
 	ainfo->image = image;
-	for (i = 0, tmp = list; i < len; ++i, tmp = tmp->next) {
-		mono_metadata_decode_row (ca, GPOINTER_TO_UINT (tmp->data), cols, MONO_CUSTOM_ATTR_SIZE);
+	/* Keep the reverse table order the attributes were returned in before */
+	for (i = 0; i < len; ++i) {
+		mono_metadata_decode_row (ca, first + len - 1 - i, cols, MONO_CUSTOM_ATTR_SIZE);
 		mtoken = cols [MONO_CUSTOM_ATTR_TYPE] >> MONO_CUSTOM_ATTR_TYPE_BITS;
 		switch (cols [MONO_CUSTOM_ATTR_TYPE] & MONO_CUSTOM_ATTR_TYPE_MASK) {
 		case MONO_CUSTOM_ATTR_TYPE_METHODDEF:
@@ -8748,7 +8744,6 @@ mono_custom_attrs_from_index (MonoImage *image, guint32 idx)
 		ainfo->attrs [i].ctor = mono_get_method (image, mtoken, NULL);
 		if (!ainfo->attrs [i].ctor) {
 			g_warning ("Can't find custom attr constructor image: %s mtoken: 0x%08x", image->name, mtoken);
-			g_list_free (list);
 			g_free (ainfo);
 			return NULL;
 		}
@@ -8756,7 +8751,6 @@ mono_custom_attrs_from_index (MonoImage *image, guint32 idx)
 		if (!mono_verifier_verify_cattr_blob (image, cols [MONO_CUSTOM_ATTR_VALUE], NULL)) {
 			/*FIXME raising an exception here doesn't make any sense*/
 			g_warning ("Invalid custom attribute blob on image %s for index %x", image->name, idx);
-			g_list_free (list);
 			g_free (ainfo);
 			return NULL;
 		}
@@ -8764,11 +8758,60 @@ mono_custom_attrs_from_index (MonoImage *image, guint32 idx)
 		ainfo->attrs [i].data_size = mono_metadata_decode_value (data, &data);
 		ainfo->attrs [i].data = (guchar*)data;
 	}
-	g_list_free (list);
 
 	return ainfo;
 }
 
+/**
+ * mono_custom_attrs_from_index:
+ *
+ * Returns: NULL if no attributes are found or if a loading error occurs.
+ * Successfully decoded attributes are cached in the image, so repeated
+ * queries for the same parent neither resolve the constructors nor verify
+ * the blobs again, and don't allocate.
+ */
+MonoCustomAttrInfo*
+mono_custom_attrs_from_index (MonoImage *image, guint32 idx)
+{
+	MonoConcurrentHashTable *cache;
+	MonoCustomAttrInfo *ainfo, *res;
+	int size;
+
+	if (!image->cattr_cache) {
+		mono_image_lock (image);
+		if (!image->cattr_cache) {
+			cache = mono_conc_hashtable_new (&image->lock, NULL, NULL);
+			mono_memory_barrier ();
+			image->cattr_cache = cache;
+		}
+		mono_image_unlock (image);
+	}
+	cache = image->cattr_cache;
+
+	res = mono_conc_hashtable_lookup (cache, GUINT_TO_POINTER (idx));
+	if (res)
+		return res == (gpointer)&cattr_cache_none ? NULL : res;
+
+	ainfo = custom_attrs_decode_index (image, idx);
+	if (!ainfo) {
+		/* Loading errors are not cached, so they are reported every time */
+		if (!mono_metadata_custom_attrs_from_index (image, idx))
+			mono_conc_hashtable_insert (cache, GUINT_TO_POINTER (idx), &cattr_cache_none);
+		return NULL;
+	}
+
+	/* Move it to the image, the cached flag makes mono_custom_attrs_free () a nop */
+	size = MONO_SIZEOF_CUSTOM_ATTR_INFO + sizeof (MonoCustomAttrEntry) * ainfo->num_attrs;
+	res = mono_image_alloc (image, size);
+	memcpy (res, ainfo, size);
+	res->cached = 1;
+	g_free (ainfo);
+
+	ainfo = mono_conc_hashtable_insert (cache, GUINT_TO_POINTER (idx), res);
+	/* Another thread won the race, RES is leaked to the mempool */
+	return ainfo ? ainfo : res;
+}
+
 MonoCustomAttrInfo*
 mono_custom_attrs_from_method (MonoMethod *method)
 {
@@ -8991,7 +9034,6 @@ mono_custom_attrs_get_attr_checked (MonoCustomAttrInfo *ainfo, MonoClass *attr_k
 {
 	int i, attr_index;
 	MonoClass *klass;
-	MonoArray *attrs;
 
 	mono_error_init (error);
 
@@ -9006,10 +9048,8 @@ mono_custom_attrs_get_attr_checked (MonoCustomAttrInfo *ainfo, MonoClass *attr_k
 	if (attr_index == -1)
 		return NULL;
 
-	attrs = mono_custom_attrs_construct_by_type (ainfo, NULL, error);
-	if (!mono_error_ok (error))
-		return NULL;
-	return mono_array_get (attrs, MonoObject*, attr_index);
+	/* Only the matching attribute has to be constructed */
+	return create_custom_attr (ainfo->image, ainfo->attrs [attr_index].ctor, ainfo->attrs [attr_index].data, ainfo->attrs [attr_index].data_size, error);
 }
 
 /*
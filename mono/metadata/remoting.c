@@ -97,22 +97,6 @@ remoting_unlock (void)
 /*
  * Return the hash table pointed to by VAR, lazily creating it if neccesary.
  */
-static GHashTable*
-get_cache (GHashTable **var, GHashFunc hash_func, GCompareFunc equal_func)
-{
-	if (!(*var)) {
-		remoting_lock ();
-		if (!(*var)) {
-			GHashTable *cache = 
-				g_hash_table_new (hash_func, equal_func);
-			mono_memory_barrier ();
-			*var = cache;
-		}
-		remoting_unlock ();
-	}
-	return *var;
-}
-
 static GHashTable*
 get_cache_full (GHashTable **var, GHashFunc hash_func, GCompareFunc equal_func, GDestroyNotify key_destroy_func, GDestroyNotify value_destroy_func)
 {
@@ -1328,7 +1312,7 @@ mono_marshal_get_ldfld_wrapper (MonoType *type)
 	MonoMethodBuilder *mb;
 	MonoMethod *res;
 	MonoClass *klass;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	WrapperInfo *info;
 	char *name;
 	int t, pos0, pos1 = 0;
@@ -1358,7 +1342,7 @@ mono_marshal_get_ldfld_wrapper (MonoType *type)
 		klass = mono_defaults.int_class;
 	}
 
-	cache = get_cache (&klass->image->ldfld_wrapper_cache, mono_aligned_addr_hash, NULL);
+	cache = mono_marshal_get_cache (&klass->image->ldfld_wrapper_cache, mono_aligned_addr_hash, NULL);
 	if ((res = mono_marshal_find_in_cache (cache, klass)))
 		return res;
 
@@ -1485,7 +1469,7 @@ mono_marshal_get_ldflda_wrapper (MonoType *type)
 	MonoMethodBuilder *mb;
 	MonoMethod *res;
 	MonoClass *klass;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	WrapperInfo *info;
 	char *name;
 	int t, pos0, pos1, pos2, pos3;
@@ -1515,7 +1499,7 @@ mono_marshal_get_ldflda_wrapper (MonoType *type)
 		klass = mono_defaults.int_class;
 	}
 
-	cache = get_cache (&klass->image->ldflda_wrapper_cache, mono_aligned_addr_hash, NULL);
+	cache = mono_marshal_get_cache (&klass->image->ldflda_wrapper_cache, mono_aligned_addr_hash, NULL);
 	if ((res = mono_marshal_find_in_cache (cache, klass)))
 		return res;
 
@@ -1689,7 +1673,7 @@ mono_marshal_get_stfld_wrapper (MonoType *type)
 	MonoMethodBuilder *mb;
 	MonoMethod *res;
 	MonoClass *klass;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	WrapperInfo *info;
 	char *name;
 	int t, pos;
@@ -1718,7 +1702,7 @@ mono_marshal_get_stfld_wrapper (MonoType *type)
 		klass = mono_defaults.int_class;
 	}
 
-	cache = get_cache (&klass->image->stfld_wrapper_cache, mono_aligned_addr_hash, NULL);
+	cache = mono_marshal_get_cache (&klass->image->stfld_wrapper_cache, mono_aligned_addr_hash, NULL);
 	if ((res = mono_marshal_find_in_cache (cache, klass)))
 		return res;
 
@@ -1814,7 +1798,7 @@ MonoMethod *
 mono_marshal_get_proxy_cancast (MonoClass *klass)
 {
 	static MonoMethodSignature *isint_sig = NULL;
-	GHashTable *cache;
+	MonoConcurrentHashTable *cache;
 	MonoMethod *res;
 	WrapperInfo *info;
 	int pos_failed, pos_end;
@@ -1823,7 +1807,7 @@ mono_marshal_get_proxy_cancast (MonoClass *klass)
 	MonoMethodDesc *desc;
 	MonoMethodBuilder *mb;
 
-	cache = get_cache (&klass->image->proxy_isinst_cache, mono_aligned_addr_hash, NULL);
+	cache = mono_marshal_get_cache (&klass->image->proxy_isinst_cache, mono_aligned_addr_hash, NULL);
 	if ((res = mono_marshal_find_in_cache (cache, klass)))
 		return res;
 
@@ -34,6 +34,19 @@
 #include "utils/mono-counters.h"
 #include "utils/mono-time.h"
 #include "utils/mono-memory-model.h"
+#include "utils/mono-hwcap.h"
+
+/*
+ * The vector versions of the card loops are compiled for their
+ * instruction sets with function attributes and only called if
+ * mono-hwcap says the CPU has them.
+ */
+#if defined(__x86_64__) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SGEN_CARD_TABLE_X86_KERNELS	1
+#include <immintrin.h>
+#include "utils/mono-hwcap-x86.h"
+#define TARGET_AVX2	__attribute__ ((target ("avx2")))
+#endif
 
 //#define CARDTABLE_STATS
 
@@ -70,6 +83,8 @@ static guint64 los_card_scan_time;
 static guint64 last_major_scan_time;
 static guint64 last_los_scan_time;
 
+static const SgenCardTableKernels *kernels;
+
 static void sgen_card_tables_collect_stats (gboolean begin);
 
 
@@ -261,12 +276,7 @@ sgen_card_table_is_range_marked (guint8 *cards, mword address, mword size)
 	guint8 *end = cards + cards_in_range (address, size);
 
 	/*This is safe since this function is only called by code that only passes continuous card blocks*/
-	while (cards != end) {
-		if (*cards++)
-			return TRUE;
-	}
-	return FALSE;
-
+	return kernels->find_next_card (cards, end) != end;
 }
 
 static void
@@ -291,13 +301,10 @@ sgen_card_table_find_address_with_cards (char *cards_start, guint8 *cards, char
 static void
 update_mod_union (guint8 *dest, gboolean init, guint8 *start_card, size_t num_cards)
 {
-	if (init) {
+	if (init)
 		memcpy (dest, start_card, num_cards);
-	} else {
-		int i;
-		for (i = 0; i < num_cards; ++i)
-			dest [i] |= start_card [i];
-	}
+	else
+		kernels->update_mod_union (dest, start_card, num_cards);
 }
 
 static guint8*
@@ -425,11 +432,8 @@ sgen_card_table_finish_minor_collection (void)
 }
 
 static void
-sgen_card_table_finish_scan_remsets (void *start_nursery, void *end_nursery, SgenGrayQueue *queue)
+sgen_card_table_begin_scan_remsets (void *start_nursery, void *end_nursery)
 {
-	SGEN_TV_DECLARE (atv);
-	SGEN_TV_DECLARE (btv);
-
 	sgen_card_tables_collect_stats (TRUE);
 
 #ifdef SGEN_HAVE_OVERLAPPING_CARDS
@@ -441,12 +445,25 @@ sgen_card_table_finish_scan_remsets (void *start_nursery, void *end_nursery, Sge
 	/*Then we clear*/
 	sgen_card_table_prepare_for_major_collection ();
 #endif
+}
+
+/*
+ * Scans the share of the major heap and the LOS that belongs to job
+ * JOB_INDEX of JOB_SPLIT_COUNT.  Each block and each large object is
+ * scanned by exactly one job, so the jobs can run in parallel.
+ */
+static void
+sgen_card_table_finish_scan_remsets (void *start_nursery, void *end_nursery, int job_index, int job_split_count, SgenGrayQueue *queue)
+{
+	SGEN_TV_DECLARE (atv);
+	SGEN_TV_DECLARE (btv);
+
 	SGEN_TV_GETTIME (atv);
-	sgen_major_collector_scan_card_table (queue);
+	sgen_major_collector_scan_card_table (job_index, job_split_count, queue);
 	SGEN_TV_GETTIME (btv);
 	last_major_scan_time = SGEN_TV_ELAPSED (atv, btv); 
 	major_card_scan_time += last_major_scan_time;
-	sgen_los_scan_card_table (FALSE, queue);
+	sgen_los_scan_card_table (FALSE, job_index, job_split_count, queue);
 	SGEN_TV_GETTIME (atv);
 	last_los_scan_time = SGEN_TV_ELAPSED (btv, atv);
 	los_card_scan_time += last_los_scan_time;
@@ -522,7 +539,7 @@ find_card_offset (mword card)
 }
 
 static guint8*
-find_next_card (guint8 *card_data, guint8 *end)
+find_next_card_scalar (guint8 *card_data, guint8 *end)
 {
 	mword *cards, *cards_end;
 	mword card;
@@ -555,6 +572,165 @@ find_next_card (guint8 *card_data, guint8 *end)
 	return end;
 }
 
+static void
+update_mod_union_scalar (guint8 *dest, guint8 *start_card, size_t num_cards)
+{
+	size_t i;
+	for (i = 0; i < num_cards; ++i)
+		dest [i] |= start_card [i];
+}
+
+static const SgenCardTableKernels scalar_kernels = {
+	"scalar",
+	find_next_card_scalar,
+	update_mod_union_scalar
+};
+
+#ifdef SGEN_CARD_TABLE_X86_KERNELS
+
+/*
+ * Sparse card tables are the common case, so both versions first
+ * check four vectors at a time and only look for the exact card once
+ * they've found a block with a marked card in it.
+ */
+
+static guint8*
+find_next_card_sse2 (guint8 *card_data, guint8 *end)
+{
+	__m128i zero = _mm_setzero_si128 ();
+
+	while ((((mword)card_data) & 15) && card_data < end) {
+		if (*card_data)
+			return card_data;
+		++card_data;
+	}
+
+	while (card_data + 64 <= end) {
+		__m128i a = _mm_load_si128 ((__m128i*)card_data);
+		__m128i b = _mm_load_si128 ((__m128i*)(card_data + 16));
+		__m128i c = _mm_load_si128 ((__m128i*)(card_data + 32));
+		__m128i d = _mm_load_si128 ((__m128i*)(card_data + 48));
+		__m128i any = _mm_or_si128 (_mm_or_si128 (a, b), _mm_or_si128 (c, d));
+		if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (any, zero)) != 0xffff)
+			break;
+		card_data += 64;
+	}
+
+	while (card_data + 16 <= end) {
+		int mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_load_si128 ((__m128i*)card_data), zero));
+		if (mask != 0xffff)
+			return card_data + __builtin_ctz (~mask);
+		card_data += 16;
+	}
+
+	while (card_data < end) {
+		if (*card_data)
+			return card_data;
+		++card_data;
+	}
+
+	return end;
+}
+
+static void
+update_mod_union_sse2 (guint8 *dest, guint8 *start_card, size_t num_cards)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= num_cards; i += 16) {
+		__m128i d = _mm_loadu_si128 ((__m128i*)(dest + i));
+		__m128i c = _mm_loadu_si128 ((__m128i*)(start_card + i));
+		_mm_storeu_si128 ((__m128i*)(dest + i), _mm_or_si128 (d, c));
+	}
+	for (; i < num_cards; ++i)
+		dest [i] |= start_card [i];
+}
+
+static const SgenCardTableKernels sse2_kernels = {
+	"sse2",
+	find_next_card_sse2,
+	update_mod_union_sse2
+};
+
+static TARGET_AVX2 guint8*
+find_next_card_avx2 (guint8 *card_data, guint8 *end)
+{
+	__m256i zero = _mm256_setzero_si256 ();
+
+	while ((((mword)card_data) & 31) && card_data < end) {
+		if (*card_data)
+			return card_data;
+		++card_data;
+	}
+
+	while (card_data + 128 <= end) {
+		__m256i a = _mm256_load_si256 ((__m256i*)card_data);
+		__m256i b = _mm256_load_si256 ((__m256i*)(card_data + 32));
+		__m256i c = _mm256_load_si256 ((__m256i*)(card_data + 64));
+		__m256i d = _mm256_load_si256 ((__m256i*)(card_data + 96));
+		__m256i any = _mm256_or_si256 (_mm256_or_si256 (a, b), _mm256_or_si256 (c, d));
+		if (!_mm256_testz_si256 (any, any))
+			break;
+		card_data += 128;
+	}
+
+	while (card_data + 32 <= end) {
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_load_si256 ((__m256i*)card_data), zero));
+		if (mask != 0xffffffff)
+			return card_data + __builtin_ctz (~mask);
+		card_data += 32;
+	}
+
+	while (card_data < end) {
+		if (*card_data)
+			return card_data;
+		++card_data;
+	}
+
+	return end;
+}
+
+static TARGET_AVX2 void
+update_mod_union_avx2 (guint8 *dest, guint8 *start_card, size_t num_cards)
+{
+	size_t i;
+
+	for (i = 0; i + 32 <= num_cards; i += 32) {
+		__m256i d = _mm256_loadu_si256 ((__m256i*)(dest + i));
+		__m256i c = _mm256_loadu_si256 ((__m256i*)(start_card + i));
+		_mm256_storeu_si256 ((__m256i*)(dest + i), _mm256_or_si256 (d, c));
+	}
+	for (; i < num_cards; ++i)
+		dest [i] |= start_card [i];
+}
+
+static const SgenCardTableKernels avx2_kernels = {
+	"avx2",
+	find_next_card_avx2,
+	update_mod_union_avx2
+};
+
+#endif
+
+int
+sgen_card_table_get_available_kernels (const SgenCardTableKernels **available)
+{
+	int num = 0;
+
+	mono_hwcap_init ();
+
+	available [num++] = &scalar_kernels;
+#ifdef SGEN_CARD_TABLE_X86_KERNELS
+	if (mono_hwcap_x86_has_sse2)
+		available [num++] = &sse2_kernels;
+	if (mono_hwcap_x86_has_avx2)
+		available [num++] = &avx2_kernels;
+#endif
+
+	g_assert (num <= SGEN_CARD_TABLE_MAX_KERNELS);
+	return num;
+}
+
 void
 sgen_cardtable_scan_object (char *obj, mword block_obj_size, guint8 *cards, gboolean mod_union, SgenGrayQueue *queue)
 {
@@ -612,8 +788,8 @@ sgen_cardtable_scan_object (char *obj, mword block_obj_size, guint8 *cards, gboo
 LOOP_HEAD:
 #endif
 
-		card_data = find_next_card (card_data, card_data_end);
-		for (; card_data < card_data_end; card_data = find_next_card (card_data + 1, card_data_end)) {
+		card_data = kernels->find_next_card (card_data, card_data_end);
+		for (; card_data < card_data_end; card_data = kernels->find_next_card (card_data + 1, card_data_end)) {
 			size_t index;
 			size_t idx = (card_data - card_base) + extra_idx;
 			char *start = (char*)(obj_start + idx * CARD_SIZE_IN_BYTES);
@@ -746,6 +922,11 @@ sgen_card_tables_collect_stats (gboolean begin)
 void
 sgen_card_table_init (SgenRemeberedSet *remset)
 {
+	const SgenCardTableKernels *available [SGEN_CARD_TABLE_MAX_KERNELS];
+
+	kernels = available [sgen_card_table_get_available_kernels (available) - 1];
+	SGEN_LOG (1, "Using %s card table kernels", kernels->name);
+
 	sgen_cardtable = sgen_alloc_os_memory (CARD_COUNT_IN_BYTES, SGEN_ALLOC_INTERNAL | SGEN_ALLOC_ACTIVATE, "card table");
 
 #ifdef SGEN_HAVE_OVERLAPPING_CARDS
@@ -776,6 +957,7 @@ sgen_card_table_init (SgenRemeberedSet *remset)
 	remset->wbarrier_generic_nostore = sgen_card_table_wbarrier_generic_nostore;
 	remset->record_pointer = sgen_card_table_record_pointer;
 
+	remset->begin_scan_remsets = sgen_card_table_begin_scan_remsets;
 	remset->finish_scan_remsets = sgen_card_table_finish_scan_remsets;
 
 	remset->finish_minor_collection = sgen_card_table_finish_minor_collection;
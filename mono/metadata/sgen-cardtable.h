@@ -37,6 +37,23 @@ guint8* sgen_card_table_update_mod_union (guint8 *dest, char *obj, mword obj_siz
 
 void sgen_card_table_init (SgenRemeberedSet *remset) MONO_INTERNAL;
 
+/*
+ * The loops over card bytes, with a plain C version and versions
+ * that use the vector instructions of the CPU we're running on.
+ */
+typedef struct {
+	const char *name;
+	/* Returns the first marked card in [CARD_DATA, END), or END */
+	guint8* (*find_next_card) (guint8 *card_data, guint8 *end);
+	/* ORs NUM_CARDS cards from START_CARD into DEST */
+	void (*update_mod_union) (guint8 *dest, guint8 *start_card, size_t num_cards);
+} SgenCardTableKernels;
+
+#define SGEN_CARD_TABLE_MAX_KERNELS	3
+
+/* Fills KERNELS with the versions this CPU supports, fastest last, and returns how many there are. */
+int sgen_card_table_get_available_kernels (const SgenCardTableKernels **kernels) MONO_INTERNAL;
+
 /*How many bytes a single card covers*/
 #define CARD_BITS 9
 
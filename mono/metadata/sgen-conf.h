@@ -171,6 +171,19 @@ typedef guint64 mword;
 */
 #define SGEN_MAX_NURSERY_WASTE 512
 
+/*
+ * Upper bound on the number of worker threads used by the parallel
+ * nursery collector.  Beyond this the workers mostly contend on the
+ * distribute gray queue.
+ */
+#define SGEN_MAX_PARALLEL_WORKERS 16
+
+/*
+ * Upper bound on the number of NUMA nodes the workers are spread over.
+ * Nodes beyond this are folded onto the lower ones.
+ */
+#define SGEN_MAX_NUMA_NODES 8
+
 
 /*
  * Minimum allowance for nursery allocations, as a multiple of the size of nursery.
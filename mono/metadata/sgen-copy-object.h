@@ -100,3 +100,68 @@ copy_object_no_checks (void *obj, SgenGrayQueue *queue)
 
 	return destination;
 }
+
+#ifdef COLLECTOR_PARALLEL_ALLOC_FOR_PROMOTION
+/*
+ * The version of copy_object_no_checks () used by the parallel
+ * nursery collector.  Several workers can race to copy the same
+ * object, so the object is copied first and then forwarded with a CAS
+ * on its vtable word.  Only the winner enqueues its copy; the losers
+ * give theirs back and use the winner's.
+ *
+ * Like copy_object_no_checks () this returns OBJ itself if it had to
+ * be pinned because we're out of memory.
+ */
+static MONO_NEVER_INLINE void*
+copy_object_no_checks_par (void *obj, SgenGrayQueue *queue)
+{
+	mword vtable_word = *(mword*)obj;
+	MonoVTable *vt;
+	gboolean has_references;
+	mword objsize;
+	char *destination;
+	mword old_vtable_word;
+
+	if (SGEN_POINTER_IS_TAGGED_FORWARDED (vtable_word))
+		return SGEN_POINTER_UNTAG_VTABLE (vtable_word);
+	if (SGEN_POINTER_IS_TAGGED_PINNED (vtable_word))
+		return obj;
+
+	/*
+	 * From here on we must not load the vtable from OBJ anymore,
+	 * since another worker might forward it at any time.
+	 */
+	vt = (MonoVTable*)SGEN_POINTER_UNTAG_VTABLE (vtable_word);
+	has_references = SGEN_VTABLE_HAS_REFERENCES (vt);
+	objsize = SGEN_ALIGN_UP (sgen_par_object_get_size (vt, (MonoObject*)obj));
+	destination = COLLECTOR_PARALLEL_ALLOC_FOR_PROMOTION (vt, obj, objsize, has_references);
+
+	if (G_UNLIKELY (!destination)) {
+		void *result = obj;
+		sgen_parallel_pin_or_update (&result, obj, vt, queue);
+		if (result == obj)
+			sgen_set_pinned_from_failed_allocation (objsize);
+		return result;
+	}
+
+	par_copy_object_no_checks (destination, vt, obj, objsize, NULL);
+	/* The copy must be complete before other workers can see the forwarding pointer. */
+	mono_memory_write_barrier ();
+
+	old_vtable_word = (mword)SGEN_CAS_PTR ((gpointer*)obj, SGEN_POINTER_TAG_FORWARDED (destination), (gpointer)vtable_word);
+	if (G_UNLIKELY (old_vtable_word != vtable_word)) {
+		/* We lost the race.  Pinning is only done on allocation failure, see above. */
+		COLLECTOR_PARALLEL_FREE_PROMOTED (destination, objsize);
+		HEAVY_STAT (++stat_nursery_copy_object_failed_forwarded);
+		if (SGEN_POINTER_IS_TAGGED_FORWARDED (old_vtable_word))
+			return SGEN_POINTER_UNTAG_VTABLE (old_vtable_word);
+		SGEN_ASSERT (0, SGEN_POINTER_IS_TAGGED_PINNED (old_vtable_word), "object %p changed under us but is neither forwarded nor pinned", obj);
+		return obj;
+	}
+
+	if (has_references)
+		GRAY_OBJECT_ENQUEUE (queue, destination, sgen_vtable_get_descriptor (vt));
+
+	return destination;
+}
+#endif
@@ -284,6 +284,8 @@ static gboolean do_scan_starts_check = FALSE;
  * GC.Collect().
  */
 static gboolean allow_synchronous_major = TRUE;
+/* 0 means one per NUMA node */
+static int num_concurrent_mark_workers = 0;
 static gboolean disable_minor_collections = FALSE;
 static gboolean disable_major_collections = FALSE;
 gboolean do_pin_stats = FALSE;
@@ -419,7 +421,7 @@ gboolean sgen_try_free_some_memory;
 static mword pagesize = 4096;
 size_t degraded_mode = 0;
 
-static mword bytes_pinned_from_failed_allocation = 0;
+static volatile mword bytes_pinned_from_failed_allocation = 0;
 
 GCMemSection *nursery_section = NULL;
 static volatile mword lowest_heap_address = ~(mword)0;
@@ -447,6 +449,8 @@ typedef struct {
 
 int current_collection_generation = -1;
 volatile gboolean concurrent_collection_in_progress = FALSE;
+/* Whether the current nursery collection is done by the workers */
+static gboolean parallel_collection_in_progress = FALSE;
 
 /* objects that are ready to be finalized */
 static FinalizeReadyEntry *fin_ready_list = NULL;
@@ -600,7 +604,7 @@ gray_queue_redirect (SgenGrayQueue *queue)
 	}
 
 	if (wake) {
-		g_assert (concurrent_collection_in_progress);
+		g_assert (concurrent_collection_in_progress || parallel_collection_in_progress);
 		if (sgen_workers_have_started ()) {
 			sgen_workers_ensure_awake ();
 		} else {
@@ -613,7 +617,7 @@ gray_queue_redirect (SgenGrayQueue *queue)
 static void
 gray_queue_enable_redirect (SgenGrayQueue *queue)
 {
-	if (!concurrent_collection_in_progress)
+	if (!concurrent_collection_in_progress && !parallel_collection_in_progress)
 		return;
 
 	sgen_gray_queue_set_alloc_prepare (queue, gray_queue_redirect, sgen_workers_get_distribute_section_gray_queue ());
@@ -1117,6 +1121,9 @@ sgen_pin_object (void *object, GrayQueue *queue)
 #endif
 }
 
+/* Protects the pin queue while workers pin objects in parallel */
+static LOCK_DECLARE (parallel_pin_mutex);
+
 void
 sgen_parallel_pin_or_update (void **ptr, void *obj, MonoVTable *vt, SgenGrayQueue *queue)
 {
@@ -1126,7 +1133,9 @@ sgen_parallel_pin_or_update (void **ptr, void *obj, MonoVTable *vt, SgenGrayQueu
 
 		if (sgen_ptr_in_nursery (obj)) {
 			if (SGEN_CAS_PTR (obj, SGEN_POINTER_TAG_PINNED (vt), vt) == vt) {
+				mono_mutex_lock (&parallel_pin_mutex);
 				sgen_pin_object (obj, queue);
+				mono_mutex_unlock (&parallel_pin_mutex);
 				break;
 			}
 		} else {
@@ -2003,10 +2012,14 @@ reset_pinned_from_failed_allocation (void)
 	bytes_pinned_from_failed_allocation = 0;
 }
 
+/*
+ * Called from the copy functions, which run on all workers during a parallel
+ * nursery collection.
+ */
 void
 sgen_set_pinned_from_failed_allocation (mword objsize)
 {
-	bytes_pinned_from_failed_allocation += objsize;
+	SGEN_ATOMIC_ADD_P (bytes_pinned_from_failed_allocation, objsize);
 }
 
 gboolean
@@ -2028,10 +2041,25 @@ sgen_concurrent_collection_in_progress (void)
 	return concurrent_collection_in_progress;
 }
 
+gboolean
+sgen_collection_is_parallel (void)
+{
+	switch (current_collection_generation) {
+	case GENERATION_NURSERY:
+		return parallel_collection_in_progress;
+	case GENERATION_OLD:
+		return FALSE;
+	default:
+		g_error ("Invalid current generation %d", current_collection_generation);
+	}
+}
+
 typedef struct
 {
 	char *heap_start;
 	char *heap_end;
+	int job_index;
+	int job_split_count;
 } FinishRememberedSetScanJobData;
 
 static void
@@ -2039,7 +2067,7 @@ job_finish_remembered_set_scan (WorkerData *worker_data, void *job_data_untyped)
 {
 	FinishRememberedSetScanJobData *job_data = job_data_untyped;
 
-	remset.finish_scan_remsets (job_data->heap_start, job_data->heap_end, sgen_workers_get_job_gray_queue (worker_data));
+	remset.finish_scan_remsets (job_data->heap_start, job_data->heap_end, job_data->job_index, job_data->job_split_count, sgen_workers_get_job_gray_queue (worker_data));
 	sgen_free_internal_dynamic (job_data, sizeof (FinishRememberedSetScanJobData), INTERNAL_MEM_WORKER_JOB_DATA);
 }
 
@@ -2088,18 +2116,19 @@ job_scan_finalizer_entries (WorkerData *worker_data, void *job_data_untyped)
 	scan_finalizer_entries (list, ctx);
 }
 
+/* There's one of these per NUMA node, each scanning the blocks on its node. */
 static void
 job_scan_major_mod_union_cardtable (WorkerData *worker_data, void *job_data_untyped)
 {
 	g_assert (concurrent_collection_in_progress);
-	major_collector.scan_card_table (TRUE, sgen_workers_get_job_gray_queue (worker_data));
+	major_collector.scan_card_table (TRUE, GPOINTER_TO_INT (job_data_untyped), sgen_memgov_get_num_numa_nodes (), sgen_workers_get_job_gray_queue (worker_data));
 }
 
 static void
 job_scan_los_mod_union_cardtable (WorkerData *worker_data, void *job_data_untyped)
 {
 	g_assert (concurrent_collection_in_progress);
-	sgen_los_scan_card_table (TRUE, sgen_workers_get_job_gray_queue (worker_data));
+	sgen_los_scan_card_table (TRUE, 0, 1, sgen_workers_get_job_gray_queue (worker_data));
 }
 
 static void
@@ -2197,7 +2226,7 @@ check_nursery_is_clean (void)
 static void
 init_gray_queue (void)
 {
-	if (sgen_collection_is_concurrent ())
+	if (sgen_collection_is_concurrent () || sgen_collection_is_parallel ())
 		sgen_workers_init_distribute_gray_queue ();
 	sgen_gray_object_queue_init (&gray_queue, NULL);
 }
@@ -2218,6 +2247,7 @@ collect_nursery (SgenGrayQueue *unpin_queue, gboolean finish_up_concurrent_mark)
 	ScanThreadDataJobData *stdjd;
 	mword fragment_total;
 	ScanCopyContext ctx;
+	int i, job_split_count;
 	TV_DECLARE (atv);
 	TV_DECLARE (btv);
 
@@ -2237,7 +2267,12 @@ collect_nursery (SgenGrayQueue *unpin_queue, gboolean finish_up_concurrent_mark)
 #endif
 
 	current_collection_generation = GENERATION_NURSERY;
-	current_object_ops = sgen_minor_collector.serial_ops;
+	/* The moved objects buffer for the profiler can only be filled by one thread. */
+	parallel_collection_in_progress = sgen_minor_collector.is_parallel && !(mono_profiler_events & MONO_PROFILE_GC_MOVES);
+	if (parallel_collection_in_progress)
+		current_object_ops = sgen_minor_collector.parallel_ops;
+	else
+		current_object_ops = sgen_minor_collector.serial_ops;
 
 	reset_pinned_from_failed_allocation ();
 
@@ -2310,10 +2345,28 @@ collect_nursery (SgenGrayQueue *unpin_queue, gboolean finish_up_concurrent_mark)
 
 	MONO_GC_CHECKPOINT_3 (GENERATION_NURSERY);
 
-	frssjd = sgen_alloc_internal_dynamic (sizeof (FinishRememberedSetScanJobData), INTERNAL_MEM_WORKER_JOB_DATA, TRUE);
-	frssjd->heap_start = sgen_get_nursery_start ();
-	frssjd->heap_end = nursery_next;
-	sgen_workers_enqueue_job (job_finish_remembered_set_scan, frssjd);
+	/*
+	 * In a parallel collection the workers do all the copying from
+	 * here on, starting with the objects we just pinned.  The remembered
+	 * set scan is split so that each worker gets a share of the heap.
+	 */
+	if (parallel_collection_in_progress) {
+		sgen_workers_start_all_workers ();
+		gray_queue_enable_redirect (WORKERS_DISTRIBUTE_GRAY_QUEUE);
+		job_split_count = sgen_workers_get_job_split_count ();
+	} else {
+		job_split_count = 1;
+	}
+
+	remset.begin_scan_remsets (sgen_get_nursery_start (), nursery_next);
+	for (i = 0; i < job_split_count; ++i) {
+		frssjd = sgen_alloc_internal_dynamic (sizeof (FinishRememberedSetScanJobData), INTERNAL_MEM_WORKER_JOB_DATA, TRUE);
+		frssjd->heap_start = sgen_get_nursery_start ();
+		frssjd->heap_end = nursery_next;
+		frssjd->job_index = i;
+		frssjd->job_split_count = job_split_count;
+		sgen_workers_enqueue_job (job_finish_remembered_set_scan, frssjd);
+	}
 
 	/* we don't have complete write barrier yet, so we scan all the old generation sections */
 	TV_GETTIME (btv);
@@ -2377,6 +2430,20 @@ collect_nursery (SgenGrayQueue *unpin_queue, gboolean finish_up_concurrent_mark)
 	sgen_workers_enqueue_job (job_scan_finalizer_entries, fin_ready_list);
 	sgen_workers_enqueue_job (job_scan_finalizer_entries, critical_fin_list);
 
+	if (parallel_collection_in_progress) {
+		sgen_workers_join ();
+
+		/*
+		 * Finalization and weak link processing are done by this
+		 * thread alone, so redirection must be turned off.
+		 */
+		sgen_gray_object_queue_disable_alloc_prepare (&gray_queue);
+		g_assert (sgen_section_gray_queue_is_empty (sgen_workers_get_distribute_section_gray_queue ()));
+
+		parallel_collection_in_progress = FALSE;
+		current_object_ops = sgen_minor_collector.serial_ops;
+	}
+
 	MONO_GC_CHECKPOINT_8 (GENERATION_NURSERY);
 
 	finish_gray_stack (GENERATION_NURSERY, &gray_queue);
@@ -2494,6 +2561,7 @@ major_copy_or_mark_from_roots (size_t *old_next_pin_slot, gboolean start_concurr
 	ScanFromRegisteredRootsJobData *scrrjd_normal, *scrrjd_wbarrier;
 	ScanThreadDataJobData *stdjd;
 	ScanCopyContext ctx;
+	int i;
 
 	if (concurrent_collection_in_progress) {
 		/*This cleans up unused fragments */
@@ -2724,7 +2792,8 @@ major_copy_or_mark_from_roots (size_t *old_next_pin_slot, gboolean start_concurr
 		g_assert (finish_up_concurrent_mark);
 
 		/* Mod union card table */
-		sgen_workers_enqueue_job (job_scan_major_mod_union_cardtable, NULL);
+		for (i = 0; i < sgen_memgov_get_num_numa_nodes (); ++i)
+			sgen_workers_enqueue_job_for_node (job_scan_major_mod_union_cardtable, GINT_TO_POINTER (i), i);
 		sgen_workers_enqueue_job (job_scan_los_mod_union_cardtable, NULL);
 	}
 
@@ -4686,6 +4755,7 @@ mono_gc_base_init (void)
 	mono_threads_init (&cb, sizeof (SgenThreadInfo));
 
 	LOCK_INIT (sgen_interruption_mutex);
+	LOCK_INIT (parallel_pin_mutex);
 
 	if ((env = g_getenv (MONO_GC_PARAMS_NAME))) {
 		opts = g_strsplit (env, ",", -1);
@@ -4744,11 +4814,13 @@ mono_gc_base_init (void)
 	mono_thread_info_attach (&dummy);
 
 	if (!minor_collector_opt) {
-		sgen_simple_nursery_init (&sgen_minor_collector);
+		sgen_simple_nursery_init (&sgen_minor_collector, FALSE);
 	} else {
 		if (!strcmp (minor_collector_opt, "simple")) {
 		use_simple_nursery:
-			sgen_simple_nursery_init (&sgen_minor_collector);
+			sgen_simple_nursery_init (&sgen_minor_collector, FALSE);
+		} else if (!strcmp (minor_collector_opt, "simple-par")) {
+			sgen_simple_nursery_init (&sgen_minor_collector, TRUE);
 		} else if (!strcmp (minor_collector_opt, "split")) {
 			sgen_split_nursery_init (&sgen_minor_collector);
 			have_split_nursery = TRUE;
@@ -4768,6 +4840,12 @@ mono_gc_base_init (void)
 		goto use_marksweep_major;
 	}
 
+	/* The workers can't do concurrent marking and nursery collections at the same time. */
+	if (sgen_minor_collector.is_parallel && (major_collector.is_concurrent || !major_collector.alloc_object_par)) {
+		sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using `simple` instead.", "The `simple-par` minor collector can't be used with the `%s' major collector.", major_collector_opt);
+		sgen_simple_nursery_init (&sgen_minor_collector, FALSE);
+	}
+
 	///* Keep this the default for now */
 	/* Precise marking is broken on all supported targets. Disable until fixed. */
 	conservative_stack_mark = TRUE;
@@ -4880,6 +4958,24 @@ mono_gc_base_init (void)
 				}
 				continue;
 			}
+			if (g_str_has_prefix (opt, "concurrent-mark-workers=")) {
+				char *endptr;
+				long val;
+
+				if (!major_collector.is_concurrent) {
+					sgen_env_var_error (MONO_GC_PARAMS_NAME, "Ignoring.", "`concurrent-mark-workers` is only valid for the concurrent major collector.");
+					continue;
+				}
+
+				opt = strchr (opt, '=') + 1;
+				val = strtol (opt, &endptr, 10);
+				if (!*opt || *endptr || val < 1 || val > SGEN_MAX_PARALLEL_WORKERS) {
+					sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using default value.", "`concurrent-mark-workers` must be an integer between 1 and %d.", SGEN_MAX_PARALLEL_WORKERS);
+					continue;
+				}
+				num_concurrent_mark_workers = val;
+				continue;
+			}
 			if (g_str_has_prefix (opt, "allow-synchronous-major=")) {
 				if (!major_collector.is_concurrent) {
 					sgen_env_var_error (MONO_GC_PARAMS_NAME, "Ignoring.", "`allow-synchronous-major` is only valid for the concurrent major collector.");
@@ -4923,12 +5019,14 @@ mono_gc_base_init (void)
 			fprintf (stderr, "  soft-heap-limit=n (where N is an integer, possibly with a k, m or a g suffix)\n");
 			fprintf (stderr, "  nursery-size=N (where N is an integer, possibly with a k, m or a g suffix)\n");
 			fprintf (stderr, "  major=COLLECTOR (where COLLECTOR is `marksweep', `marksweep-conc', `marksweep-par')\n");
-			fprintf (stderr, "  minor=COLLECTOR (where COLLECTOR is `simple' or `split')\n");
+			fprintf (stderr, "  minor=COLLECTOR (where COLLECTOR is `simple', `simple-par' or `split')\n");
 			fprintf (stderr, "  wbarrier=WBARRIER (where WBARRIER is `remset' or `cardtable')\n");
 			fprintf (stderr, "  stack-mark=MARK-METHOD (where MARK-METHOD is 'precise' or 'conservative')\n");
 			fprintf (stderr, "  [no-]cementing\n");
-			if (major_collector.is_concurrent)
+			if (major_collector.is_concurrent) {
 				fprintf (stderr, "  allow-synchronous-major=FLAG (where FLAG is `yes' or `no')\n");
+				fprintf (stderr, "  concurrent-mark-workers=N (where N is between 1 and %d, default one per NUMA node)\n", SGEN_MAX_PARALLEL_WORKERS);
+			}
 			if (major_collector.print_gc_param_usage)
 				major_collector.print_gc_param_usage ();
 			if (sgen_minor_collector.print_gc_param_usage)
@@ -4943,8 +5041,13 @@ mono_gc_base_init (void)
 		g_strfreev (opts);
 	}
 
-	if (major_collector.is_concurrent)
-		sgen_workers_init (1);
+	if (major_collector.is_concurrent) {
+		if (!num_concurrent_mark_workers)
+			num_concurrent_mark_workers = MIN (sgen_memgov_get_num_numa_nodes (), SGEN_MAX_PARALLEL_WORKERS);
+		sgen_workers_init (num_concurrent_mark_workers);
+	}
+	else if (sgen_minor_collector.is_parallel)
+		sgen_workers_init (MIN (mono_cpu_count (), SGEN_MAX_PARALLEL_WORKERS));
 
 	if (major_collector_opt)
 		g_free (major_collector_opt);
@@ -5384,9 +5487,9 @@ sgen_major_collector_iterate_live_block_ranges (sgen_cardtable_block_callback ca
 }
 
 void
-sgen_major_collector_scan_card_table (SgenGrayQueue *queue)
+sgen_major_collector_scan_card_table (int job_index, int job_split_count, SgenGrayQueue *queue)
 {
-	major_collector.scan_card_table (FALSE, queue);
+	major_collector.scan_card_table (FALSE, job_index, job_split_count, queue);
 }
 
 SgenMajorCollector*
@@ -505,6 +505,7 @@ void sgen_add_to_global_remset (gpointer ptr, gpointer obj) MONO_INTERNAL;
 int sgen_get_current_collection_generation (void) MONO_INTERNAL;
 gboolean sgen_collection_is_concurrent (void) MONO_INTERNAL;
 gboolean sgen_concurrent_collection_in_progress (void) MONO_INTERNAL;
+gboolean sgen_collection_is_parallel (void) MONO_INTERNAL;
 
 typedef struct {
 	CopyOrMarkObjectFunc copy_or_mark_object;
@@ -597,10 +598,12 @@ sgen_nursery_is_object_alive (char *obj)
 
 typedef struct {
 	gboolean is_split;
+	gboolean is_parallel;
 
 	char* (*alloc_for_promotion) (MonoVTable *vtable, char *obj, size_t objsize, gboolean has_references);
 
 	SgenObjectOperations serial_ops;
+	SgenObjectOperations parallel_ops;
 
 	void (*prepare_to_space) (char *to_space_bitmap, size_t space_bitmap_size);
 	void (*clear_fragments) (void);
@@ -615,7 +618,7 @@ typedef struct {
 
 extern SgenMinorCollector sgen_minor_collector;
 
-void sgen_simple_nursery_init (SgenMinorCollector *collector) MONO_INTERNAL;
+void sgen_simple_nursery_init (SgenMinorCollector *collector, gboolean parallel) MONO_INTERNAL;
 void sgen_split_nursery_init (SgenMinorCollector *collector) MONO_INTERNAL;
 
 /* Updating references */
@@ -626,7 +629,7 @@ sgen_update_reference (void **p, void *o, gboolean allow_null)
 {
 	if (!allow_null)
 		SGEN_ASSERT (0, o, "Cannot update a reference with a NULL pointer");
-	SGEN_ASSERT (0, !sgen_is_worker_thread (mono_native_thread_id_get ()), "Can't update a reference in the worker thread");
+	SGEN_ASSERT (0, !sgen_is_worker_thread (mono_native_thread_id_get ()) || sgen_collection_is_parallel (), "Can't update a reference in the worker thread");
 	*p = o;
 }
 
@@ -686,17 +689,36 @@ struct _SgenMajorCollector {
 	SgenObjectOperations major_concurrent_ops;
 
 	void* (*alloc_object) (MonoVTable *vtable, size_t size, gboolean has_references);
+	/*
+	 * Used by the parallel nursery collector to promote objects
+	 * from the worker threads.  The free function can only give
+	 * back the last object the calling thread allocated.
+	 */
+	void* (*alloc_object_par) (MonoVTable *vtable, size_t size, gboolean has_references);
+	void (*free_non_pinned_object_par) (char *obj, size_t size);
 	void (*free_pinned_object) (char *obj, size_t size);
 	void (*iterate_objects) (IterateObjectsFlags flags, IterateObjectCallbackFunc callback, void *data);
 	void (*free_non_pinned_object) (char *obj, size_t size);
 	void (*find_pin_queue_start_ends) (SgenGrayQueue *queue);
 	void (*pin_objects) (SgenGrayQueue *queue);
 	void (*pin_major_object) (char *obj, SgenGrayQueue *queue);
-	void (*scan_card_table) (gboolean mod_union, SgenGrayQueue *queue);
+	/*
+	 * Card table scans are split into JOB_SPLIT_COUNT jobs by block.
+	 * Mod-union scans are split by NUMA node instead: job JOB_INDEX
+	 * scans the blocks on that node.
+	 */
+	void (*scan_card_table) (gboolean mod_union, int job_index, int job_split_count, SgenGrayQueue *queue);
 	void (*iterate_live_block_ranges) (sgen_cardtable_block_callback callback);
 	void (*update_cardtable_mod_union) (void);
 	void (*init_to_space) (void);
 	void (*sweep) (void);
+	/*
+	 * A collector that sweeps in the background must stop touching
+	 * the heap between these two.  They're called when the world is
+	 * stopped and restarted, and can nest.
+	 */
+	void (*pause_concurrent_sweep) (void);
+	void (*resume_concurrent_sweep) (void);
 	void (*check_scan_starts) (void);
 	void (*dump_heap) (FILE *heap_dump_file);
 	gint64 (*get_used_size) (void);
@@ -743,7 +765,8 @@ typedef struct _SgenRemeberedSet {
 	void (*wbarrier_generic_nostore) (gpointer ptr);
 	void (*record_pointer) (gpointer ptr);
 
-	void (*finish_scan_remsets) (void *start_nursery, void *end_nursery, SgenGrayQueue *queue);
+	void (*begin_scan_remsets) (void *start_nursery, void *end_nursery);
+	void (*finish_scan_remsets) (void *start_nursery, void *end_nursery, int job_index, int job_split_count, SgenGrayQueue *queue);
 
 	void (*prepare_for_major_collection) (void);
 
@@ -994,15 +1017,16 @@ void sgen_los_sweep (void) MONO_INTERNAL;
 gboolean sgen_ptr_is_in_los (char *ptr, char **start) MONO_INTERNAL;
 void sgen_los_iterate_objects (IterateObjectCallbackFunc cb, void *user_data) MONO_INTERNAL;
 void sgen_los_iterate_live_block_ranges (sgen_cardtable_block_callback callback) MONO_INTERNAL;
-void sgen_los_scan_card_table (gboolean mod_union, SgenGrayQueue *queue) MONO_INTERNAL;
+void sgen_los_scan_card_table (gboolean mod_union, int job_index, int job_split_count, SgenGrayQueue *queue) MONO_INTERNAL;
 void sgen_los_update_cardtable_mod_union (void) MONO_INTERNAL;
 void sgen_los_count_cards (long long *num_total_cards, long long *num_marked_cards) MONO_INTERNAL;
-void sgen_major_collector_scan_card_table (SgenGrayQueue *queue) MONO_INTERNAL;
+void sgen_major_collector_scan_card_table (int job_index, int job_split_count, SgenGrayQueue *queue) MONO_INTERNAL;
 gboolean sgen_los_is_valid_object (char *object) MONO_INTERNAL;
 gboolean mono_sgen_los_describe_pointer (char *ptr) MONO_INTERNAL;
 LOSObject* sgen_los_header_for_object (char *data) MONO_INTERNAL;
 mword sgen_los_object_size (LOSObject *obj) MONO_INTERNAL;
 void sgen_los_pin_object (char *obj) MONO_INTERNAL;
+gboolean sgen_los_pin_object_par (char *obj) MONO_INTERNAL;
 void sgen_los_unpin_object (char *obj) MONO_INTERNAL;
 gboolean sgen_los_object_is_pinned (char *obj) MONO_INTERNAL;
 
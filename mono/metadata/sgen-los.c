@@ -545,13 +545,17 @@ sgen_los_iterate_live_block_ranges (sgen_cardtable_block_callback callback)
 }
 
 void
-sgen_los_scan_card_table (gboolean mod_union, SgenGrayQueue *queue)
+sgen_los_scan_card_table (gboolean mod_union, int job_index, int job_split_count, SgenGrayQueue *queue)
 {
 	LOSObject *obj;
+	int i = 0;
 
-	for (obj = los_object_list; obj; obj = obj->next) {
+	for (obj = los_object_list; obj; obj = obj->next, ++i) {
 		guint8 *cards;
 
+		if (i % job_split_count != job_index)
+			continue;
+
 		if (!SGEN_OBJECT_HAS_REFERENCES (obj->data))
 			continue;
 
@@ -630,6 +634,28 @@ sgen_los_pin_object (char *data)
 	binary_protocol_pin (data, (gpointer)SGEN_LOAD_VTABLE (data), sgen_safe_object_get_size ((MonoObject*)data));
 }
 
+/*
+ * sgen_los_pin_object_par:
+ *
+ *   Pin DATA atomically, for when several threads mark objects concurrently.
+ * Returns TRUE if DATA was pinned by this call, FALSE if it was pinned already.
+ */
+gboolean
+sgen_los_pin_object_par (char *data)
+{
+	LOSObject *obj = sgen_los_header_for_object (data);
+	mword old_size;
+
+	do {
+		old_size = obj->size;
+		if (old_size & 1)
+			return FALSE;
+	} while (SGEN_CAS_PTR ((gpointer*)&obj->size, (gpointer)(old_size | 1), (gpointer)old_size) != (gpointer)old_size);
+
+	binary_protocol_pin (data, (gpointer)SGEN_LOAD_VTABLE (data), sgen_safe_object_get_size ((MonoObject*)data));
+	return TRUE;
+}
+
 void
 sgen_los_unpin_object (char *data)
 {
@@ -179,11 +179,9 @@ COPY_OR_MARK_FUNCTION_NAME (void **ptr, void *obj, SgenGrayQueue *queue)
 		} else {
 			HEAVY_STAT (++stat_optimized_copy_major_large);
 
-			if (sgen_los_object_is_pinned (obj))
+			/* Other workers might be marking it at the same time */
+			if (!sgen_los_pin_object_par (obj))
 				return FALSE;
-			binary_protocol_pin (obj, (gpointer)SGEN_LOAD_VTABLE (obj), sgen_safe_object_get_size ((MonoObject*)obj));
-
-			sgen_los_pin_object (obj);
 			if (SGEN_OBJECT_HAS_REFERENCES (obj))
 				GRAY_OBJECT_ENQUEUE (queue, obj, sgen_obj_get_descriptor (obj));
 		}
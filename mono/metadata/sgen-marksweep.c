@@ -71,6 +71,18 @@
 
 #define MS_NUM_MARK_WORDS	((MS_BLOCK_SIZE / SGEN_ALLOC_ALIGN + sizeof (mword) * 8 - 1) / (sizeof (mword) * 8))
 
+/*
+ * After a major collection every block needs sweeping.  A block is
+ * swept by whoever gets to it first - the sweep thread, the allocator
+ * or the next collection - which claims it by moving it from
+ * NEED_SWEEPING to SWEEPING.
+ */
+enum {
+	BLOCK_STATE_SWEPT,
+	BLOCK_STATE_NEED_SWEEPING,
+	BLOCK_STATE_SWEEPING
+};
+
 typedef struct _MSBlockInfo MSBlockInfo;
 struct _MSBlockInfo {
 	int obj_size;
@@ -79,7 +91,9 @@ struct _MSBlockInfo {
 	unsigned int has_references : 1;
 	unsigned int has_pinned : 1;	/* means cannot evacuate */
 	unsigned int is_to_space : 1;
-	unsigned int swept : 1;
+	/* The NUMA node the block's memory is on */
+	guint8 numa_node;
+	volatile gint32 state;
 	void **free_list;
 	MSBlockInfo *next_free;
 	size_t pin_queue_first_entry;
@@ -117,6 +131,22 @@ typedef struct {
 
 #define MS_MARK_BIT(bl,w,b)	((bl)->mark_words [(w)] & (ONE_P << (b)))
 #define MS_SET_MARK_BIT(bl,w,b)	((bl)->mark_words [(w)] |= (ONE_P << (b)))
+/* Sets the mark bit atomically, with WAS_MARKED telling whether it was set already */
+#define MS_PAR_SET_MARK_BIT(was_marked,bl,w,b)	do {			\
+		mword __old = (bl)->mark_words [(w)];			\
+		mword __bitmask = ONE_P << (b);				\
+		if (__old & __bitmask) {				\
+			was_marked = TRUE;				\
+			break;						\
+		}							\
+		if (SGEN_CAS_PTR ((gpointer*)&(bl)->mark_words [(w)],	\
+						(gpointer)(__old | __bitmask),	\
+						(gpointer)__old) ==		\
+				(gpointer)__old) {			\
+			was_marked = FALSE;				\
+			break;						\
+		}							\
+	} while (1)
 
 #define MS_OBJ_ALLOCED(o,b)	(*(void**)(o) && (*(char**)(o) < MS_BLOCK_FOR_BLOCK_INFO (b) || *(char**)(o) >= MS_BLOCK_FOR_BLOCK_INFO (b) + MS_BLOCK_SIZE))
 
@@ -143,6 +173,7 @@ static float concurrent_evacuation_threshold = 0.666f;
 static gboolean want_evacuation = FALSE;
 
 static gboolean lazy_sweep = TRUE;
+static gboolean concurrent_sweep = TRUE;
 static gboolean have_swept;
 
 static gboolean concurrent_mark;
@@ -172,6 +203,8 @@ static MSBlockInfo **free_block_lists [MS_BLOCK_TYPE_MAX];
 static guint64 stat_major_blocks_alloced = 0;
 static guint64 stat_major_blocks_freed = 0;
 static guint64 stat_major_blocks_lazy_swept = 0;
+static guint64 stat_major_blocks_concurrently_swept = 0;
+static guint64 time_major_concurrent_sweep = 0;
 static guint64 stat_major_objects_evacuated = 0;
 
 #if SIZEOF_VOID_P != 8
@@ -204,9 +237,12 @@ add_scanned_object (void *ptr)
 }
 #endif
 
-static void
+static gboolean
 sweep_block (MSBlockInfo *block, gboolean during_major_collection);
 
+static void
+alloc_free_block_lists (MSBlockInfo ***lists);
+
 static int
 ms_find_block_obj_size_index (size_t size)
 {
@@ -337,7 +373,7 @@ check_block_free_list (MSBlockInfo *block, int size, gboolean pinned)
 
 		/* blocks in the free lists must have at least
 		   one free slot */
-		if (block->swept)
+		if (block->state == BLOCK_STATE_SWEPT)
 			g_assert (block->free_list);
 
 		/* the block must be in the allocated_blocks array */
@@ -385,7 +421,7 @@ consistency_check (void)
 		g_assert (num_free == 0);
 
 		/* check all mark words are zero */
-		if (block->swept) {
+		if (block->state == BLOCK_STATE_SWEPT) {
 			for (i = 0; i < MS_NUM_MARK_WORDS; ++i)
 				g_assert (block->mark_words [i] == 0);
 		}
@@ -402,18 +438,17 @@ consistency_check (void)
 }
 #endif
 
-static gboolean
-ms_alloc_block (int size_index, gboolean pinned, gboolean has_references)
+static MSBlockInfo*
+ms_init_block (int size_index, gboolean pinned, gboolean has_references)
 {
 	int size = block_obj_sizes [size_index];
 	int count = MS_BLOCK_FREE / size;
 	MSBlockInfo *info;
-	MSBlockInfo **free_blocks = FREE_BLOCKS (pinned, has_references);
 	char *obj_start;
 	int i;
 
 	if (!sgen_memgov_try_alloc_space (MS_BLOCK_SIZE, SPACE_MAJOR))
-		return FALSE;
+		return NULL;
 
 	info = (MSBlockInfo*)ms_get_empty_block ();
 
@@ -431,8 +466,9 @@ ms_alloc_block (int size_index, gboolean pinned, gboolean has_references)
 	 * want further evacuation.
 	 */
 	info->is_to_space = (sgen_get_current_collection_generation () == GENERATION_OLD);
-	info->swept = 1;
+	info->state = BLOCK_STATE_SWEPT;
 	info->cardtable_mod_union = NULL;
+	info->numa_node = sgen_memgov_get_numa_node (info);
 
 	update_heap_boundaries_for_block (info);
 
@@ -448,6 +484,18 @@ ms_alloc_block (int size_index, gboolean pinned, gboolean has_references)
 	/* the last one */
 	*(void**)obj_start = NULL;
 
+	return info;
+}
+
+static gboolean
+ms_alloc_block (int size_index, gboolean pinned, gboolean has_references)
+{
+	MSBlockInfo **free_blocks = FREE_BLOCKS (pinned, has_references);
+	MSBlockInfo *info = ms_init_block (size_index, pinned, has_references);
+
+	if (!info)
+		return FALSE;
+
 	info->next_free = free_blocks [size_index];
 	free_blocks [size_index] = info;
 
@@ -478,9 +526,9 @@ unlink_slot_from_free_list_uncontested (MSBlockInfo **free_blocks, int size_inde
 	block = free_blocks [size_index];
 	SGEN_ASSERT (9, block, "no free block to unlink from free_blocks %p size_index %d", free_blocks, size_index);
 
-	if (G_UNLIKELY (!block->swept)) {
-		stat_major_blocks_lazy_swept ++;
-		sweep_block (block, FALSE);
+	if (G_UNLIKELY (block->state != BLOCK_STATE_SWEPT)) {
+		if (sweep_block (block, FALSE))
+			stat_major_blocks_lazy_swept ++;
 	}
 
 	obj = block->free_list;
@@ -520,6 +568,126 @@ major_alloc_object (MonoVTable *vtable, size_t size, gboolean has_references)
 	return alloc_obj (vtable, size, FALSE, has_references);
 }
 
+/*
+ * Parallel nursery collections promote objects into blocks that
+ * belong to a single worker.  A worker only ever takes fresh blocks
+ * for itself, so no other worker - in particular none of the card
+ * table scanning jobs - looks at them while objects are being copied
+ * in.  The new blocks only become part of the heap proper when the
+ * workers are done, in major_reset_worker_data ().
+ */
+typedef struct {
+	/* The block each worker currently promotes into, per type and size. */
+	MSBlockInfo **blocks [MS_BLOCK_TYPE_MAX];
+} MSWorkerData;
+
+static MonoNativeTlsKey worker_data_key;
+
+static LOCK_DECLARE (par_alloc_mutex);
+/* Blocks allocated by workers that are not in `allocated_blocks` yet */
+static SgenPointerQueue par_allocated_blocks;
+
+static MSBlockInfo*
+ms_alloc_block_par (int size_index, gboolean has_references)
+{
+	MSBlockInfo *info = ms_init_block (size_index, FALSE, has_references);
+
+	if (!info)
+		return NULL;
+
+	mono_mutex_lock (&par_alloc_mutex);
+	sgen_pointer_queue_add (&par_allocated_blocks, BLOCK_TAG (info));
+	++num_major_sections;
+	mono_mutex_unlock (&par_alloc_mutex);
+
+	return info;
+}
+
+static void*
+major_alloc_object_par (MonoVTable *vtable, size_t size, gboolean has_references)
+{
+	MSWorkerData *data = mono_native_tls_get_value (worker_data_key);
+	int size_index = MS_BLOCK_OBJ_SIZE_INDEX (size);
+	MSBlockInfo **blocks = FREE_BLOCKS_FROM (data->blocks, FALSE, has_references);
+	MSBlockInfo *block = blocks [size_index];
+	void *obj;
+
+	/* A full block stays in the slot so that the last object can still be freed */
+	if (!block || !block->free_list) {
+		block = ms_alloc_block_par (size_index, has_references);
+		if (!block)
+			return NULL;
+		blocks [size_index] = block;
+	}
+
+	obj = block->free_list;
+	block->free_list = *(void**)obj;
+
+	*(MonoVTable**)obj = vtable;
+
+	return obj;
+}
+
+/*
+ * A worker that lost the race to copy an object gives its copy back
+ * with this.  Since it's the last object the worker allocated, its
+ * block is still the worker's current block.
+ */
+static void
+major_free_non_pinned_object_par (char *obj, size_t size)
+{
+	MSBlockInfo *block = MS_BLOCK_FOR_OBJ (obj);
+
+	memset (obj, 0, size);
+	*(void**)obj = block->free_list;
+	block->free_list = (void**)obj;
+}
+
+static void*
+major_alloc_worker_data (void)
+{
+	MSWorkerData *data = sgen_alloc_internal_dynamic (sizeof (MSWorkerData), INTERNAL_MEM_WORKER_DATA, TRUE);
+	alloc_free_block_lists (data->blocks);
+	return data;
+}
+
+static void
+major_init_worker_thread (void *data)
+{
+	mono_native_tls_set_value (worker_data_key, data);
+}
+
+/*
+ * Called when the workers have finished.  Blocks with free slots left
+ * go on the regular free lists and all the blocks the workers
+ * allocated are added to the heap.
+ */
+static void
+major_reset_worker_data (void *data_untyped)
+{
+	MSWorkerData *data = data_untyped;
+	size_t k;
+	int i, j;
+
+	for (j = 0; j < MS_BLOCK_TYPE_MAX; ++j) {
+		for (i = 0; i < num_block_obj_sizes; ++i) {
+			MSBlockInfo *block = data->blocks [j][i];
+			if (!block)
+				continue;
+			data->blocks [j][i] = NULL;
+			if (block->free_list) {
+				MSBlockInfo **free_blocks = free_block_lists [j];
+				block->next_free = free_blocks [i];
+				free_blocks [i] = block;
+			}
+		}
+	}
+
+	for (k = 0; k < par_allocated_blocks.next_slot; ++k)
+		sgen_pointer_queue_add (&allocated_blocks, par_allocated_blocks.data [k]);
+	sgen_pointer_queue_clear (&par_allocated_blocks);
+}
+
 /*
  * We're not freeing the block if it's empty.  We leave that work for
  * the next major collection.
@@ -533,8 +701,7 @@ free_object (char *obj, size_t size, gboolean pinned)
 	MSBlockInfo *block = MS_BLOCK_FOR_OBJ (obj);
 	int word, bit;
 
-	if (!block->swept)
-		sweep_block (block, FALSE);
+	sweep_block (block, FALSE);
 	SGEN_ASSERT (9, (pinned && block->pinned) || (!pinned && !block->pinned), "free-object pinning mixup object %p pinned %d block %p pinned %d", obj, pinned, block, block->pinned);
 	SGEN_ASSERT (9, MS_OBJ_ALLOCED (obj, block), "object %p is already free", obj);
 	MS_CALC_MARK_BIT (word, bit, obj);
@@ -652,6 +819,105 @@ major_ptr_is_in_non_pinned_space (char *ptr, char **start)
 	return FALSE;
 }
 
+/*
+ * The sweep thread sweeps the blocks left over from the last major
+ * collection while the world is running.  It works off its own copy
+ * of the block list, which is only changed while it is paused, so
+ * it never races with blocks being allocated or freed.
+ *
+ * It is paused whenever the world is stopped and when the heap is
+ * walked, because those expect unswept blocks to stay unswept.
+ * Pausing only waits for the sweep thread to finish the block it is
+ * on.
+ */
+static MonoNativeThreadId sweep_thread;
+static gboolean sweep_thread_started = FALSE;
+static MonoSemType sweep_thread_sem;
+static volatile gint32 sweep_pause_count = 0;
+static volatile gboolean sweep_thread_busy = FALSE;
+static SgenPointerQueue sweep_blocks;
+static size_t sweep_next_block = 0;
+
+static mono_native_thread_return_t
+sweep_thread_func (void *thread_data)
+{
+	for (;;) {
+		int num_swept = 0;
+		SGEN_TV_DECLARE (atv);
+		SGEN_TV_DECLARE (btv);
+
+		MONO_SEM_WAIT (&sweep_thread_sem);
+		if (sweep_pause_count || sweep_next_block >= sweep_blocks.next_slot)
+			continue;
+
+		SGEN_TV_GETTIME (atv);
+		binary_protocol_sweep_begin (TRUE, (int)(sweep_blocks.next_slot - sweep_next_block));
+
+		for (;;) {
+			MSBlockInfo *block;
+
+			sweep_thread_busy = TRUE;
+			mono_memory_barrier ();
+			if (sweep_pause_count || sweep_next_block >= sweep_blocks.next_slot)
+				break;
+
+			block = BLOCK_UNTAG_HAS_REFERENCES (sweep_blocks.data [sweep_next_block++]);
+			if (sweep_block (block, FALSE))
+				++num_swept;
+		}
+		sweep_thread_busy = FALSE;
+
+		binary_protocol_sweep_end (TRUE, num_swept);
+		SGEN_TV_GETTIME (btv);
+
+		stat_major_blocks_concurrently_swept += num_swept;
+		time_major_concurrent_sweep += SGEN_TV_ELAPSED (atv, btv);
+	}
+
+	return NULL;
+}
+
+static void
+pause_concurrent_sweep (void)
+{
+	InterlockedIncrement (&sweep_pause_count);
+	mono_memory_barrier ();
+	while (sweep_thread_busy)
+		mono_thread_info_yield ();
+	mono_memory_barrier ();
+}
+
+static void
+resume_concurrent_sweep (void)
+{
+	SGEN_ASSERT (0, sweep_pause_count > 0, "Resuming a sweep that's not paused");
+	if (InterlockedDecrement (&sweep_pause_count) == 0 && sweep_next_block < sweep_blocks.next_slot)
+		MONO_SEM_POST (&sweep_thread_sem);
+}
+
+/*
+ * Called at the end of the sweep, with the world stopped.  The sweep
+ * thread gets going when the world is restarted.
+ */
+static void
+start_concurrent_sweep (void)
+{
+	size_t i;
+
+	SGEN_ASSERT (0, sweep_pause_count > 0, "The sweep thread must be paused while we give it new blocks");
+
+	sgen_pointer_queue_clear (&sweep_blocks);
+	sweep_next_block = 0;
+	for (i = 0; i < allocated_blocks.next_slot; ++i)
+		sgen_pointer_queue_add (&sweep_blocks, allocated_blocks.data [i]);
+
+	if (!sweep_thread_started) {
+		MONO_SEM_INIT (&sweep_thread_sem, 0);
+		mono_native_thread_create (&sweep_thread, sweep_thread_func, NULL);
+		sweep_thread_started = TRUE;
+	}
+}
+
 static void
 major_iterate_objects (IterateObjectsFlags flags, IterateObjectCallbackFunc callback, void *data)
 {
@@ -660,6 +926,9 @@ major_iterate_objects (IterateObjectsFlags flags, IterateObjectCallbackFunc call
 	gboolean pinned = flags & ITERATE_OBJECTS_PINNED;
 	MSBlockInfo *block;
 
+	/* Blocks that aren't swept yet must stay that way while we look at their mark bits */
+	pause_concurrent_sweep ();
+
 	FOREACH_BLOCK (block) {
 		int count = MS_BLOCK_FREE / block->obj_size;
 		int i;
@@ -670,12 +939,12 @@ major_iterate_objects (IterateObjectsFlags flags, IterateObjectCallbackFunc call
 			continue;
 		if (sweep && lazy_sweep) {
 			sweep_block (block, FALSE);
-			SGEN_ASSERT (0, block->swept, "Block must be swept after sweeping");
+			SGEN_ASSERT (0, block->state == BLOCK_STATE_SWEPT, "Block must be swept after sweeping");
 		}
 
 		for (i = 0; i < count; ++i) {
 			void **obj = (void**) MS_BLOCK_OBJ (block, i);
-			if (!block->swept) {
+			if (block->state != BLOCK_STATE_SWEPT) {
 				int word, bit;
 				MS_CALC_MARK_BIT (word, bit, obj);
 				if (!MS_MARK_BIT (block, word, bit))
@@ -685,6 +954,8 @@ major_iterate_objects (IterateObjectsFlags flags, IterateObjectCallbackFunc call
 				callback ((char*)obj, block->obj_size, data);
 		}
 	} END_FOREACH_BLOCK;
+
+	resume_concurrent_sweep ();
 }
 
 static gboolean
@@ -828,6 +1099,20 @@ major_dump_heap (FILE *heap_dump_file)
 			INC_NUM_MAJOR_OBJECTS_MARKED ();		\
 		}							\
 	} while (0)
+/* For concurrent marking, where there can be more than one worker */
+#define MS_PAR_MARK_OBJECT_AND_ENQUEUE(obj,desc,block,queue) do {	\
+		int __word, __bit;					\
+		gboolean __was_marked;					\
+		MS_CALC_MARK_BIT (__word, __bit, (obj));		\
+		SGEN_ASSERT (9, MS_OBJ_ALLOCED ((obj), (block)), "object %p not allocated", obj); \
+		MS_PAR_SET_MARK_BIT (__was_marked, (block), __word, __bit); \
+		if (!__was_marked) {					\
+			if (sgen_gc_descr_has_references (desc))			\
+				GRAY_OBJECT_ENQUEUE ((queue), (obj), (desc)); \
+			binary_protocol_mark ((obj), (gpointer)LOAD_VTABLE ((obj)), sgen_safe_object_get_size ((MonoObject*)(obj))); \
+			INC_NUM_MAJOR_OBJECTS_MARKED ();		\
+		}							\
+	} while (0)
 #define MS_MARK_OBJECT_AND_ENQUEUE(obj,desc,block,queue) do {		\
 		int __word, __bit;					\
 		MS_CALC_MARK_BIT (__word, __bit, (obj));		\
@@ -871,7 +1156,7 @@ major_copy_or_mark_object_with_evacuation_concurrent (void **ptr, void *obj, Sge
 
 		if (objsize <= SGEN_MAX_SMALL_OBJ_SIZE) {
 			MSBlockInfo *block = MS_BLOCK_FOR_OBJ (obj);
-			MS_MARK_OBJECT_AND_ENQUEUE (obj, sgen_obj_get_descriptor (obj), block, queue);
+			MS_PAR_MARK_OBJECT_AND_ENQUEUE (obj, sgen_obj_get_descriptor (obj), block, queue);
 		} else {
 			if (sgen_los_object_is_pinned (obj))
 				return;
@@ -1032,9 +1317,11 @@ sweep_block_for_size (MSBlockInfo *block, int count, int obj_size)
 /*
  * sweep_block:
  *
- *   Traverse BLOCK, freeing and zeroing unused objects.
+ *   Traverse BLOCK, freeing and zeroing unused objects.  Returns
+ * whether this call did the sweeping.  If another thread is sweeping
+ * BLOCK we wait for it to finish.
  */
-static void
+static gboolean
 sweep_block (MSBlockInfo *block, gboolean during_major_collection)
 {
 	int count;
@@ -1043,8 +1330,22 @@ sweep_block (MSBlockInfo *block, gboolean during_major_collection)
 	if (!during_major_collection)
 		g_assert (!sgen_concurrent_collection_in_progress ());
 
-	if (block->swept)
-		return;
+ retry:
+	switch (block->state) {
+	case BLOCK_STATE_SWEPT:
+		return FALSE;
+	case BLOCK_STATE_SWEEPING:
+		while (block->state == BLOCK_STATE_SWEEPING)
+			mono_thread_info_yield ();
+		mono_memory_read_barrier ();
+		return FALSE;
+	case BLOCK_STATE_NEED_SWEEPING:
+		if (InterlockedCompareExchange (&block->state, BLOCK_STATE_SWEEPING, BLOCK_STATE_NEED_SWEEPING) != BLOCK_STATE_NEED_SWEEPING)
+			goto retry;
+		break;
+	default:
+		g_assert_not_reached ();
+	}
 
 	count = MS_BLOCK_FREE / block->obj_size;
 
@@ -1074,7 +1375,10 @@ sweep_block (MSBlockInfo *block, gboolean during_major_collection)
 	}
 	block->free_list = reversed;
 
-	block->swept = 1;
+	/* The free list must be visible before the block is */
+	mono_memory_write_barrier ();
+	block->state = BLOCK_STATE_SWEPT;
+	return TRUE;
 }
 
 static inline int
@@ -1136,7 +1440,7 @@ ms_sweep (void)
 		block->has_pinned = block->pinned;
 
 		block->is_to_space = FALSE;
-		block->swept = 0;
+		block->state = BLOCK_STATE_NEED_SWEEPING;
 
 		count = MS_BLOCK_FREE / block->obj_size;
 
@@ -1213,6 +1517,9 @@ ms_sweep (void)
 
 	want_evacuation = (float)total_evacuate_saved / (float)total_evacuate_heap > (1 - concurrent_evacuation_threshold);
 
+	if (lazy_sweep && concurrent_sweep)
+		start_concurrent_sweep ();
+
 	have_swept = TRUE;
 }
 
@@ -1333,13 +1640,21 @@ major_start_major_collection (void)
 	// Sweep all unswept blocks
 	if (lazy_sweep) {
 		MSBlockInfo *block;
+		int num_swept = 0;
 
 		MONO_GC_SWEEP_BEGIN (GENERATION_OLD, TRUE);
+		binary_protocol_sweep_begin (FALSE, (int)allocated_blocks.next_slot);
 
 		FOREACH_BLOCK (block) {
-			sweep_block (block, TRUE);
+			if (sweep_block (block, TRUE))
+				++num_swept;
 		} END_FOREACH_BLOCK;
 
+		/* Whatever the sweep thread didn't get to is done now */
+		sgen_pointer_queue_clear (&sweep_blocks);
+		sweep_next_block = 0;
+
+		binary_protocol_sweep_end (FALSE, num_swept);
 		MONO_GC_SWEEP_END (GENERATION_OLD, TRUE);
 	}
 }
@@ -1563,6 +1878,8 @@ major_get_used_size (void)
 	gint64 size = 0;
 	MSBlockInfo *block;
 
+	pause_concurrent_sweep ();
+
 	FOREACH_BLOCK (block) {
 		int count = MS_BLOCK_FREE / block->obj_size;
 		void **iter;
@@ -1571,6 +1888,8 @@ major_get_used_size (void)
 			size -= block->obj_size;
 	} END_FOREACH_BLOCK;
 
+	resume_concurrent_sweep ();
+
 	return size;
 }
 
@@ -1598,6 +1917,12 @@ major_handle_gc_param (const char *opt)
 	} else if (!strcmp (opt, "no-lazy-sweep")) {
 		lazy_sweep = FALSE;
 		return TRUE;
+	} else if (!strcmp (opt, "concurrent-sweep")) {
+		concurrent_sweep = TRUE;
+		return TRUE;
+	} else if (!strcmp (opt, "no-concurrent-sweep")) {
+		concurrent_sweep = FALSE;
+		return TRUE;
 	}
 
 	return FALSE;
@@ -1610,6 +1935,7 @@ major_print_gc_param_usage (void)
 			""
 			"  evacuation-threshold=P (where P is a percentage, an integer in 0-100)\n"
 			"  (no-)lazy-sweep\n"
+			"  (no-)concurrent-sweep (only with lazy-sweep)\n"
 			);
 }
 
@@ -1679,7 +2005,7 @@ card_offset (char *obj, char *base)
 }
 
 static void
-major_scan_card_table (gboolean mod_union, SgenGrayQueue *queue)
+major_scan_card_table (gboolean mod_union, int job_index, int job_split_count, SgenGrayQueue *queue)
 {
 	MSBlockInfo *block;
 	gboolean has_references;
@@ -1713,6 +2039,13 @@ major_scan_card_table (gboolean mod_union, SgenGrayQueue *queue)
 		if (!has_references)
 			continue;
 
+		/*
+		 * Parallel jobs take every JOB_SPLIT_COUNT-th block.  Mod-union
+		 * jobs take the blocks on their NUMA node.
+		 */
+		if ((mod_union ? block->numa_node : __index) % job_split_count != job_index)
+			continue;
+
 		block_obj_size = block->obj_size;
 		small_objects = block_obj_size < CARD_SIZE_IN_BYTES;
 
@@ -1764,7 +2097,7 @@ major_scan_card_table (gboolean mod_union, SgenGrayQueue *queue)
 			start = (char*)(block_start + card_index * CARD_SIZE_IN_BYTES);
 			end = start + CARD_SIZE_IN_BYTES;
 
-			if (!block->swept)
+			if (block->state != BLOCK_STATE_SWEPT)
 				sweep_block (block, FALSE);
 
 			HEAVY_STAT (++marked_cards);
@@ -1884,6 +2217,8 @@ static void
 post_param_init (SgenMajorCollector *collector)
 {
 	collector->sweeps_lazily = lazy_sweep;
+	if (!lazy_sweep)
+		concurrent_sweep = FALSE;
 }
 
 static void
@@ -1920,6 +2255,8 @@ sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurr
 	mono_counters_register ("# major blocks allocated", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_alloced);
 	mono_counters_register ("# major blocks freed", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_freed);
 	mono_counters_register ("# major blocks lazy swept", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_lazy_swept);
+	mono_counters_register ("# major blocks concurrently swept", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_concurrently_swept);
+	mono_counters_register ("Major concurrent sweep", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_major_concurrent_sweep);
 	mono_counters_register ("# major objects evacuated", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_objects_evacuated);
 #if SIZEOF_VOID_P != 8
 	mono_counters_register ("# major blocks freed ideally", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_freed_ideal);
@@ -1949,6 +2286,11 @@ sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurr
 	collector->alloc_degraded = major_alloc_degraded;
 
 	collector->alloc_object = major_alloc_object;
+	collector->alloc_object_par = major_alloc_object_par;
+	collector->free_non_pinned_object_par = major_free_non_pinned_object_par;
+	collector->alloc_worker_data = major_alloc_worker_data;
+	collector->init_worker_thread = major_init_worker_thread;
+	collector->reset_worker_data = major_reset_worker_data;
 	collector->free_pinned_object = free_pinned_object;
 	collector->iterate_objects = major_iterate_objects;
 	collector->free_non_pinned_object = major_free_non_pinned_object;
@@ -1963,6 +2305,8 @@ sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurr
 	}
 	collector->init_to_space = major_init_to_space;
 	collector->sweep = major_sweep;
+	collector->pause_concurrent_sweep = pause_concurrent_sweep;
+	collector->resume_concurrent_sweep = resume_concurrent_sweep;
 	collector->check_scan_starts = major_check_scan_starts;
 	collector->dump_heap = major_dump_heap;
 	collector->get_used_size = major_get_used_size;
@@ -2017,6 +2361,9 @@ sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurr
 	mono_mutex_init (&scanned_objects_list_lock);
 #endif
 
+	mono_native_tls_alloc (&worker_data_key, NULL);
+	LOCK_INIT (par_alloc_mutex);
+
 	SGEN_ASSERT (0, SGEN_MAX_SMALL_OBJ_SIZE <= MS_BLOCK_FREE / 2, "MAX_SMALL_OBJ_SIZE must be at most MS_BLOCK_FREE / 2");
 
 	/*cardtable requires major pages to be 8 cards aligned*/
@@ -33,9 +33,15 @@
 
 #include "utils/mono-counters.h"
 #include "utils/mono-mmap.h"
+#include "utils/mono-proclib.h"
 #include "utils/mono-logger-internal.h"
 #include "utils/dtrace.h"
 
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #define MIN_MINOR_COLLECTION_ALLOWANCE	((mword)(DEFAULT_NURSERY_SIZE * default_allowance_nursery_size_ratio))
 
 /*Heap limits and allocation knobs*/
@@ -327,6 +333,45 @@ sgen_free_os_memory (void *addr, size_t size, SgenAllocFlags flags)
 	total_alloc_max = MAX (total_alloc_max, total_alloc);
 }
 
+/*
+ * NUMA topology.  We don't bind heap memory to nodes ourselves: pages end up
+ * on the node of the thread that first touches them, and we ask the kernel
+ * where that was.  Node numbers are folded into [0, SGEN_MAX_NUMA_NODES).
+ */
+
+#define MPOL_F_NODE	(1 << 0)
+#define MPOL_F_ADDR	(1 << 1)
+
+static int num_numa_nodes;
+
+int
+sgen_memgov_get_num_numa_nodes (void)
+{
+	if (!num_numa_nodes)
+		num_numa_nodes = MIN (mono_numa_node_count (), SGEN_MAX_NUMA_NODES);
+	return num_numa_nodes;
+}
+
+/*
+ * Returns the NUMA node the page containing ADDR lives on, faulting it in
+ * if it isn't yet.
+ */
+int
+sgen_memgov_get_numa_node (void *addr)
+{
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+	int node = 0;
+
+	if (sgen_memgov_get_num_numa_nodes () == 1)
+		return 0;
+	if (syscall (SYS_get_mempolicy, &node, NULL, 0, addr, MPOL_F_NODE | MPOL_F_ADDR) != 0)
+		return 0;
+	return node % num_numa_nodes;
+#else
+	return 0;
+#endif
+}
+
 int64_t
 mono_gc_get_heap_size (void)
 {
@@ -356,7 +401,7 @@ gboolean
 sgen_memgov_try_alloc_space (mword size, int space)
 {
 	if (sgen_memgov_available_free_space () < size) {
-		SGEN_ASSERT (4, !sgen_is_worker_thread (mono_native_thread_id_get ()), "Memory shouldn't run out in worker thread");
+		SGEN_ASSERT (4, sgen_minor_collector.is_parallel || !sgen_is_worker_thread (mono_native_thread_id_get ()), "Memory shouldn't run out in worker thread");
 		return FALSE;
 	}
 
@@ -55,6 +55,10 @@ void* sgen_alloc_os_memory (size_t size, SgenAllocFlags flags, const char *asser
 void* sgen_alloc_os_memory_aligned (size_t size, mword alignment, SgenAllocFlags flags, const char *assert_description) MONO_INTERNAL;
 void sgen_free_os_memory (void *addr, size_t size, SgenAllocFlags flags) MONO_INTERNAL;
 
+/* NUMA topology */
+int sgen_memgov_get_num_numa_nodes (void) MONO_INTERNAL;
+int sgen_memgov_get_numa_node (void *addr) MONO_INTERNAL;
+
 /* Error handling */
 void sgen_assert_memory_alloc (void *ptr, size_t requested_size, const char *assert_description) MONO_INTERNAL;
 
@@ -21,6 +21,10 @@
 
 #define collector_pin_object(obj, queue) sgen_pin_object (obj, queue);
 #define COLLECTOR_SERIAL_ALLOC_FOR_PROMOTION alloc_for_promotion
+#ifdef PARALLEL_COPY_OBJECT
+#define COLLECTOR_PARALLEL_ALLOC_FOR_PROMOTION alloc_for_promotion_par
+#define COLLECTOR_PARALLEL_FREE_PROMOTED free_promoted_par
+#endif
 
 extern guint64 stat_nursery_copy_object_failed_to_space; /* from sgen-gc.c */
 
@@ -212,6 +216,79 @@ SERIAL_COPY_OBJECT_FROM_OBJ (void **obj_slot, SgenGrayQueue *queue)
 #endif
 }
 
+#ifdef PARALLEL_COPY_OBJECT
+#ifndef SGEN_SIMPLE_NURSERY
+#error "The parallel copy functions only support the simple nursery"
+#endif
+
+/*
+ * PARALLEL_COPY_OBJECT:
+ *
+ *   The version of SERIAL_COPY_OBJECT used by the worker threads in a
+ * parallel nursery collection.  Since everything that survives is
+ * promoted, there is no to-space in the nursery to deal with.
+ */
+static MONO_ALWAYS_INLINE void
+PARALLEL_COPY_OBJECT (void **obj_slot, SgenGrayQueue *queue)
+{
+	char *obj = *obj_slot;
+	void *copy;
+
+	SGEN_ASSERT (9, current_collection_generation == GENERATION_NURSERY, "calling minor-parallel-copy from a %d generation collection", current_collection_generation);
+
+	HEAVY_STAT (++stat_copy_object_called_nursery);
+
+	if (!sgen_ptr_in_nursery (obj)) {
+		HEAVY_STAT (++stat_nursery_copy_object_failed_from_space);
+		return;
+	}
+
+	SGEN_LOG (9, "Precise parallel copy of %p from %p", obj, obj_slot);
+
+	copy = copy_object_no_checks_par (obj, queue);
+	if (copy != obj)
+		SGEN_UPDATE_REFERENCE (obj_slot, copy);
+}
+
+/*
+ * PARALLEL_COPY_OBJECT_FROM_OBJ:
+ *
+ *   Similar to PARALLEL_COPY_OBJECT, but assumes that OBJ_SLOT is part of an object, so it handles global remsets as well.
+ */
+static MONO_ALWAYS_INLINE void
+PARALLEL_COPY_OBJECT_FROM_OBJ (void **obj_slot, SgenGrayQueue *queue)
+{
+	char *obj = *obj_slot;
+	void *copy;
+
+	SGEN_ASSERT (9, current_collection_generation == GENERATION_NURSERY, "calling minor-parallel-copy-from-obj from a %d generation collection", current_collection_generation);
+
+	HEAVY_STAT (++stat_copy_object_called_nursery);
+
+	if (!sgen_ptr_in_nursery (obj)) {
+		HEAVY_STAT (++stat_nursery_copy_object_failed_from_space);
+		return;
+	}
+
+	SGEN_LOG (9, "Precise parallel copy of %p from %p", obj, obj_slot);
+
+	copy = copy_object_no_checks_par (obj, queue);
+	if (copy != obj) {
+		SGEN_UPDATE_REFERENCE (obj_slot, copy);
+		return;
+	}
+
+	/* Pinned, either before the collection or because we ran out of memory */
+	if (!sgen_ptr_in_nursery (obj_slot) && !SGEN_OBJECT_IS_CEMENTED (obj))
+		sgen_add_to_global_remset (obj_slot, obj);
+}
+
+#define FILL_MINOR_COLLECTOR_COPY_OBJECT(collector)	do {			\
+		(collector)->serial_ops.copy_or_mark_object = SERIAL_COPY_OBJECT;			\
+		(collector)->parallel_ops.copy_or_mark_object = PARALLEL_COPY_OBJECT;		\
+	} while (0)
+#else
 #define FILL_MINOR_COLLECTOR_COPY_OBJECT(collector)	do {			\
 		(collector)->serial_ops.copy_or_mark_object = SERIAL_COPY_OBJECT;			\
 	} while (0)
+#endif
@@ -24,6 +24,8 @@ extern guint64 stat_scan_object_called_nursery;
 #if defined(SGEN_SIMPLE_NURSERY)
 #define SERIAL_SCAN_OBJECT simple_nursery_serial_scan_object
 #define SERIAL_SCAN_VTYPE simple_nursery_serial_scan_vtype
+#define PARALLEL_SCAN_OBJECT simple_nursery_parallel_scan_object
+#define PARALLEL_SCAN_VTYPE simple_nursery_parallel_scan_vtype
 
 #elif defined (SGEN_SPLIT_NURSERY)
 #define SERIAL_SCAN_OBJECT split_nursery_serial_scan_object
@@ -78,7 +80,61 @@ SERIAL_SCAN_VTYPE (char *start, mword desc, SgenGrayQueue *queue BINARY_PROTOCOL
 #include "sgen-scan-object.h"
 }
 
+#ifdef PARALLEL_COPY_OBJECT
+#undef HANDLE_PTR
+/* Global remsets are handled in PARALLEL_COPY_OBJECT_FROM_OBJ */
+#define HANDLE_PTR(ptr,obj)	do {	\
+		void *__old = *(ptr);	\
+		SGEN_OBJECT_LAYOUT_STATISTICS_MARK_BITMAP ((obj), (ptr)); \
+		binary_protocol_scan_process_reference ((obj), (ptr), __old); \
+		if (__old) {	\
+			PARALLEL_COPY_OBJECT_FROM_OBJ ((ptr), queue);	\
+			SGEN_COND_LOG (9, __old != *(ptr), "Overwrote field at %p with %p (was: %p)", (ptr), *(ptr), __old); \
+		}	\
+	} while (0)
+
+static void
+PARALLEL_SCAN_OBJECT (char *start, mword desc, SgenGrayQueue *queue)
+{
+	SGEN_OBJECT_LAYOUT_STATISTICS_DECLARE_BITMAP;
+
+#ifdef HEAVY_STATISTICS
+	sgen_descriptor_count_scanned_object (desc);
+#endif
+
+	SGEN_ASSERT (9, sgen_get_current_collection_generation () == GENERATION_NURSERY, "Must not use minor scan during major collection.");
+
+#define SCAN_OBJECT_PROTOCOL
+#include "sgen-scan-object.h"
+
+	SGEN_OBJECT_LAYOUT_STATISTICS_COMMIT_BITMAP;
+	HEAVY_STAT (++stat_scan_object_called_nursery);
+}
+
+static void
+PARALLEL_SCAN_VTYPE (char *start, mword desc, SgenGrayQueue *queue BINARY_PROTOCOL_ARG (size_t size))
+{
+	SGEN_OBJECT_LAYOUT_STATISTICS_DECLARE_BITMAP;
+
+	SGEN_ASSERT (9, sgen_get_current_collection_generation () == GENERATION_NURSERY, "Must not use minor scan during major collection.");
+
+	/* The descriptors include info about the MonoObject header as well */
+	start -= sizeof (MonoObject);
+
+#define SCAN_OBJECT_NOVTABLE
+#define SCAN_OBJECT_PROTOCOL
+#include "sgen-scan-object.h"
+}
+
 #define FILL_MINOR_COLLECTOR_SCAN_OBJECT(collector)	do {			\
 		(collector)->serial_ops.scan_object = SERIAL_SCAN_OBJECT;	\
 		(collector)->serial_ops.scan_vtype = SERIAL_SCAN_VTYPE; \
+		(collector)->parallel_ops.scan_object = PARALLEL_SCAN_OBJECT;	\
+		(collector)->parallel_ops.scan_vtype = PARALLEL_SCAN_VTYPE; \
 	} while (0)
+#else
+#define FILL_MINOR_COLLECTOR_SCAN_OBJECT(collector)	do {			\
+		(collector)->serial_ops.scan_object = SERIAL_SCAN_OBJECT;	\
+		(collector)->serial_ops.scan_vtype = SERIAL_SCAN_VTYPE; \
+	} while (0)
+#endif
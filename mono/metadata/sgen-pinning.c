@@ -281,18 +281,20 @@ sgen_cement_lookup_or_register (char *obj)
 
 	SGEN_ASSERT (5, sgen_ptr_in_nursery (obj), "Can only cement pointers to nursery objects");
 
-	if (!hash [i].obj) {
-		SGEN_ASSERT (5, !hash [i].count, "Cementing hash inconsistent");
-		hash [i].obj = obj;
-	} else if (hash [i].obj != obj) {
+	/*
+	 * Parallel nursery collections and concurrent marking with more than one
+	 * worker register from several threads, so claiming the slot and counting
+	 * must be atomic.  Exactly one thread sees the count reach the threshold.
+	 */
+	if (!hash [i].obj)
+		SGEN_CAS_PTR ((gpointer*)&hash [i].obj, obj, NULL);
+	if (hash [i].obj != obj)
 		return FALSE;
-	}
 
 	if (hash [i].count >= SGEN_CEMENT_THRESHOLD)
 		return TRUE;
 
-	++hash [i].count;
-	if (hash [i].count == SGEN_CEMENT_THRESHOLD) {
+	if (InterlockedIncrement ((volatile gint32*)&hash [i].count) == SGEN_CEMENT_THRESHOLD) {
 		SGEN_ASSERT (9, SGEN_OBJECT_IS_PINNED (obj), "Can only cement pinned objects");
 		SGEN_CEMENT_OBJECT (obj);
 
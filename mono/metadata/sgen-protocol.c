@@ -457,6 +457,20 @@ binary_protocol_domain_unload_end (gpointer domain)
 	protocol_entry (SGEN_PROTOCOL_DOMAIN_UNLOAD_END, &entry, sizeof (SGenProtocolDomainUnload));
 }
 
+void
+binary_protocol_sweep_begin (int concurrent, int num_blocks)
+{
+	SGenProtocolSweep entry = { concurrent, num_blocks };
+	protocol_entry (SGEN_PROTOCOL_SWEEP_BEGIN, &entry, sizeof (SGenProtocolSweep));
+}
+
+void
+binary_protocol_sweep_end (int concurrent, int num_blocks)
+{
+	SGenProtocolSweep entry = { concurrent, num_blocks };
+	protocol_entry (SGEN_PROTOCOL_SWEEP_END, &entry, sizeof (SGenProtocolSweep));
+}
+
 #ifdef SGEN_HEAVY_BINARY_PROTOCOL
 void
 binary_protocol_alloc (gpointer obj, gpointer vtable, int size)
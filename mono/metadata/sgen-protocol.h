@@ -66,6 +66,8 @@ enum {
 	SGEN_PROTOCOL_DOMAIN_UNLOAD_END,
 	SGEN_PROTOCOL_GRAY_ENQUEUE,
 	SGEN_PROTOCOL_GRAY_DEQUEUE,
+	SGEN_PROTOCOL_SWEEP_BEGIN,
+	SGEN_PROTOCOL_SWEEP_END,
 };
 
 typedef struct {
@@ -252,6 +254,11 @@ typedef struct {
 	gpointer value;
 } SGenProtocolGrayQueue;
 
+typedef struct {
+	int concurrent;
+	int num_blocks;
+} SGenProtocolSweep;
+
 /* missing: finalizers, roots, non-store wbarriers */
 
 void binary_protocol_init (const char *filename, long long limit) MONO_INTERNAL;
@@ -285,6 +292,9 @@ void binary_protocol_cement_reset (void) MONO_INTERNAL;
 void binary_protocol_domain_unload_begin (gpointer domain) MONO_INTERNAL;
 void binary_protocol_domain_unload_end (gpointer domain) MONO_INTERNAL;
 
+void binary_protocol_sweep_begin (int concurrent, int num_blocks) MONO_INTERNAL;
+void binary_protocol_sweep_end (int concurrent, int num_blocks) MONO_INTERNAL;
+
 #ifdef SGEN_HEAVY_BINARY_PROTOCOL
 
 #define binary_protocol_is_heavy_enabled()	binary_protocol_is_enabled ()
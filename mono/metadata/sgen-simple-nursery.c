@@ -35,6 +35,18 @@ alloc_for_promotion (MonoVTable *vtable, char *obj, size_t objsize, gboolean has
 	return major_collector.alloc_object (vtable, objsize, has_references);
 }
 
+static inline char*
+alloc_for_promotion_par (MonoVTable *vtable, char *obj, size_t objsize, gboolean has_references)
+{
+	return major_collector.alloc_object_par (vtable, objsize, has_references);
+}
+
+static inline void
+free_promoted_par (char *obj, size_t objsize)
+{
+	major_collector.free_non_pinned_object_par (obj, objsize);
+}
+
 static SgenFragment*
 build_fragments_get_exclude_head (void)
 {
@@ -74,14 +86,17 @@ init_nursery (SgenFragmentAllocator *allocator, char *start, char *end)
 
 #define SERIAL_COPY_OBJECT simple_nursery_serial_copy_object
 #define SERIAL_COPY_OBJECT_FROM_OBJ simple_nursery_serial_copy_object_from_obj
+#define PARALLEL_COPY_OBJECT simple_nursery_parallel_copy_object
+#define PARALLEL_COPY_OBJECT_FROM_OBJ simple_nursery_parallel_copy_object_from_obj
 
 #include "sgen-minor-copy-object.h"
 #include "sgen-minor-scan-object.h"
 
 void
-sgen_simple_nursery_init (SgenMinorCollector *collector)
+sgen_simple_nursery_init (SgenMinorCollector *collector, gboolean parallel)
 {
 	collector->is_split = FALSE;
+	collector->is_parallel = parallel;
 
 	collector->alloc_for_promotion = alloc_for_promotion;
 
@@ -216,6 +216,9 @@ sgen_stop_world (int generation)
 	binary_protocol_world_stopping (sgen_timestamp ());
 	acquire_gc_locks ();
 
+	if (sgen_get_major_collector ()->pause_concurrent_sweep)
+		sgen_get_major_collector ()->pause_concurrent_sweep ();
+
 	/* We start to scan after locks are taking, this ensures we won't be interrupted. */
 	sgen_process_togglerefs ();
 
@@ -306,6 +309,9 @@ sgen_restart_world (int generation, GGTimingInfo *timing)
 	 */
 	release_gc_locks ();
 
+	if (sgen_get_major_collector ()->resume_concurrent_sweep)
+		sgen_get_major_collector ()->resume_concurrent_sweep ();
+
 	sgen_try_free_some_memory = TRUE;
 
 	if (sgen_need_bridge_processing ())
@@ -24,10 +24,18 @@
 
 #include "metadata/sgen-gc.h"
 #include "metadata/sgen-workers.h"
+#include "metadata/sgen-memory-governor.h"
 #include "utils/mono-counters.h"
+#include "utils/mono-time.h"
+
+#if defined(__linux__) && defined(HAVE_SCHED_SETAFFINITY) && !defined(GLIBC_BEFORE_2_3_4_SCHED_SETAFFINITY)
+#include <sched.h>
+#define HAVE_NUMA_PINNING 1
+#endif
 
 static int workers_num;
 static WorkerData *workers_data;
+static int workers_num_numa_nodes = 1;
 static void *workers_gc_thread_major_collector_data = NULL;
 
 static SgenSectionGrayQueue workers_distribute_gray_queue;
@@ -76,8 +84,12 @@ static volatile int workers_num_jobs_finished = 0;
 static guint64 stat_workers_stolen_from_self_lock;
 static guint64 stat_workers_stolen_from_self_no_lock;
 static guint64 stat_workers_stolen_from_others;
+static guint64 stat_workers_stolen_from_other_nodes;
 static guint64 stat_workers_num_waited;
 
+static guint64 stat_node_objects_scanned [SGEN_MAX_NUMA_NODES];
+static guint64 time_node_scan [SGEN_MAX_NUMA_NODES];
+
 static gboolean
 set_state (State old_state, State new_state)
 {
@@ -219,11 +231,15 @@ workers_wait (void)
 static gboolean
 collection_needs_workers (void)
 {
-	return sgen_collection_is_concurrent ();
+	return sgen_collection_is_concurrent () || sgen_collection_is_parallel ();
 }
 
+/*
+ * Like sgen_workers_enqueue_job (), but workers on NUMA_NODE get to
+ * the job first.
+ */
 void
-sgen_workers_enqueue_job (JobFunc func, void *data)
+sgen_workers_enqueue_job_for_node (JobFunc func, void *data, int numa_node)
 {
 	int num_entries;
 	JobQueueEntry *entry;
@@ -236,6 +252,7 @@ sgen_workers_enqueue_job (JobFunc func, void *data)
 	entry = sgen_alloc_internal (INTERNAL_MEM_JOB_QUEUE_ENTRY);
 	entry->func = func;
 	entry->data = data;
+	entry->numa_node = numa_node;
 
 	mono_mutex_lock (&workers_job_queue_mutex);
 	entry->next = workers_job_queue;
@@ -248,6 +265,12 @@ sgen_workers_enqueue_job (JobFunc func, void *data)
 		workers_signal_enqueue_work_if_necessary (num_entries < workers_num ? num_entries : workers_num);
 }
 
+void
+sgen_workers_enqueue_job (JobFunc func, void *data)
+{
+	sgen_workers_enqueue_job_for_node (func, data, -1);
+}
+
 void
 sgen_workers_wait_for_jobs_finished (void)
 {
@@ -302,6 +325,7 @@ static gboolean
 workers_dequeue_and_do_job (WorkerData *data)
 {
 	JobQueueEntry *entry;
+	volatile JobQueueEntry * volatile *link;
 
 	/*
 	 * At this point the GC might not be running anymore.  We
@@ -315,9 +339,16 @@ workers_dequeue_and_do_job (WorkerData *data)
 		return FALSE;
 
 	mono_mutex_lock (&workers_job_queue_mutex);
-	entry = (JobQueueEntry*)workers_job_queue;
+	/* Jobs for other nodes are only taken if there are none for ours. */
+	for (link = &workers_job_queue; *link; link = &(*link)->next) {
+		if ((*link)->numa_node == -1 || (*link)->numa_node == data->numa_node)
+			break;
+	}
+	if (!*link)
+		link = &workers_job_queue;
+	entry = (JobQueueEntry*)*link;
 	if (entry) {
-		workers_job_queue = entry->next;
+		*link = entry->next;
 		--workers_job_queue_num_entries;
 	}
 	mono_mutex_unlock (&workers_job_queue_mutex);
@@ -385,6 +416,8 @@ workers_steal (WorkerData *data, WorkerData *victim_data, gboolean lock)
 			stat_workers_stolen_from_self_no_lock += num;
 	} else {
 		stat_workers_stolen_from_others += num;
+		if (victim_data->numa_node != data->numa_node)
+			stat_workers_stolen_from_other_nodes += num;
 	}
 
 	return num != 0;
@@ -402,10 +435,12 @@ workers_get_work (WorkerData *data)
 	if (workers_steal (data, data, TRUE))
 		return TRUE;
 
-	/* From another worker. */
+	/* From another worker on our node. */
 	for (i = data->index + 1; i < workers_num + data->index; ++i) {
 		WorkerData *victim_data = &workers_data [i % workers_num];
 		g_assert (data != victim_data);
+		if (victim_data->numa_node != data->numa_node)
+			continue;
 		if (workers_steal (data, victim_data, TRUE))
 			return TRUE;
 	}
@@ -415,7 +450,7 @@ workers_get_work (WorkerData *data)
 	 * distribute gray queue.
 	 */
 	major = sgen_get_major_collector ();
-	if (major->is_concurrent) {
+	if (major->is_concurrent || sgen_minor_collector.is_parallel) {
 		GrayQueueSection *section = sgen_section_gray_queue_dequeue (&workers_distribute_gray_queue);
 		if (section) {
 			sgen_gray_object_enqueue_section (&data->private_gray_queue, section);
@@ -423,6 +458,15 @@ workers_get_work (WorkerData *data)
 		}
 	}
 
+	/* Only once there's no local work left, from workers on other nodes. */
+	for (i = data->index + 1; i < workers_num + data->index; ++i) {
+		WorkerData *victim_data = &workers_data [i % workers_num];
+		if (victim_data->numa_node == data->numa_node)
+			continue;
+		if (workers_steal (data, victim_data, TRUE))
+			return TRUE;
+	}
+
 	/* Nobody to steal from */
 	g_assert (sgen_gray_object_queue_is_empty (&data->private_gray_queue));
 	return FALSE;
@@ -487,6 +531,70 @@ init_private_gray_queue (WorkerData *data)
 			workers_gray_queue_share_redirect, data);
 }
 
+/*
+ * Restricts the calling thread to the CPUs of NUMA_NODE, so that it
+ * allocates, and mostly touches, memory on that node.
+ */
+static void
+workers_pin_to_numa_node (int numa_node)
+{
+#ifdef HAVE_NUMA_PINNING
+	char path [64];
+	char *cpulist, *p;
+	cpu_set_t set;
+	gboolean have_cpus = FALSE;
+
+	g_snprintf (path, sizeof (path), "/sys/devices/system/node/node%d/cpulist", numa_node);
+	if (!g_file_get_contents (path, &cpulist, NULL, NULL))
+		return;
+
+	/* The list looks like "0-7,16-23". */
+	CPU_ZERO (&set);
+	p = cpulist;
+	while (g_ascii_isdigit (*p)) {
+		int first = strtol (p, &p, 10);
+		int last = first;
+		if (*p == '-')
+			last = strtol (p + 1, &p, 10);
+		for (; first <= last && first < CPU_SETSIZE; ++first) {
+			CPU_SET (first, &set);
+			have_cpus = TRUE;
+		}
+		if (*p == ',')
+			++p;
+	}
+	g_free (cpulist);
+
+	/* Memory-only nodes have no CPUs to run on. */
+	if (have_cpus)
+		sched_setaffinity (0, sizeof (set), &set);
+#endif
+}
+
+/*
+ * Like sgen_drain_gray_stack (), but counts the objects scanned for the
+ * per-node stats.  Workers never use the major collector's own drain
+ * function, which is only there for the non-concurrent collector.
+ */
+static gboolean
+workers_drain_gray_stack (WorkerData *data, int max_objs, ScanCopyContext ctx)
+{
+	int i;
+
+	for (i = 0; i < max_objs; ++i) {
+		char *obj;
+		mword desc;
+		GRAY_OBJECT_DEQUEUE (ctx.queue, &obj, &desc);
+		if (!obj) {
+			data->objects_scanned += i;
+			return TRUE;
+		}
+		ctx.scan_func (obj, desc, ctx.queue);
+	}
+	data->objects_scanned += max_objs;
+	return FALSE;
+}
+
 static mono_native_thread_return_t
 workers_thread_func (void *data_untyped)
 {
@@ -495,6 +603,9 @@ workers_thread_func (void *data_untyped)
 
 	mono_thread_info_register_small_id ();
 
+	if (workers_num_numa_nodes > 1)
+		workers_pin_to_numa_node (data->numa_node);
+
 	if (major->init_worker_thread)
 		major->init_worker_thread (data->major_collector_data);
 
@@ -503,7 +614,7 @@ workers_thread_func (void *data_untyped)
 	for (;;) {
 		gboolean did_work = FALSE;
 
-		SGEN_ASSERT (0, sgen_get_current_collection_generation () != GENERATION_NURSERY, "Why are we doing work while there's a nursery collection happening?");
+		SGEN_ASSERT (0, sgen_get_current_collection_generation () != GENERATION_NURSERY || sgen_minor_collector.is_parallel, "Why are we doing work while there's a nursery collection happening?");
 
 		while (workers_state.data.state == STATE_WORKING && workers_dequeue_and_do_job (data)) {
 			did_work = TRUE;
@@ -511,19 +622,38 @@ workers_thread_func (void *data_untyped)
 		}
 
 		if (!sgen_gray_object_queue_is_empty (&data->private_gray_queue) || workers_get_work (data)) {
-			SgenObjectOperations *ops = sgen_concurrent_collection_in_progress ()
-				? &major->major_concurrent_ops
-				: &major->major_ops;
-			ScanCopyContext ctx = { ops->scan_object, NULL, &data->private_gray_queue };
+			SgenObjectOperations *ops;
+			ScanCopyContext ctx;
+			SGEN_TV_DECLARE (atv);
+			SGEN_TV_DECLARE (btv);
+
+			if (sgen_get_current_collection_generation () == GENERATION_NURSERY)
+				ops = &sgen_minor_collector.parallel_ops;
+			else if (sgen_concurrent_collection_in_progress ())
+				ops = &major->major_concurrent_ops;
+			else
+				ops = &major->major_ops;
+
+			ctx.scan_func = ops->scan_object;
+			ctx.copy_func = NULL;
+			ctx.queue = &data->private_gray_queue;
 
 			g_assert (!sgen_gray_object_queue_is_empty (&data->private_gray_queue));
+			SGEN_ASSERT (0, sgen_get_current_collection_generation () != GENERATION_OLD || !major->drain_gray_stack, "Workers can't use the major collector's drain function");
 
-			while (!sgen_drain_gray_stack (32, ctx)) {
-				if (workers_state.data.state == STATE_NURSERY_COLLECTION)
+			SGEN_TV_GETTIME (atv);
+			while (!workers_drain_gray_stack (data, 32, ctx)) {
+				if (workers_state.data.state == STATE_NURSERY_COLLECTION) {
+					SGEN_TV_GETTIME (btv);
+					data->scan_time += SGEN_TV_ELAPSED (atv, btv);
 					workers_wait ();
+					SGEN_TV_GETTIME (atv);
+				}
 
 				workers_gray_queue_share_redirect (&data->private_gray_queue);
 			}
+			SGEN_TV_GETTIME (btv);
+			data->scan_time += SGEN_TV_ELAPSED (atv, btv);
 			g_assert (sgen_gray_object_queue_is_empty (&data->private_gray_queue));
 
 			init_private_gray_queue (data);
@@ -559,7 +689,7 @@ sgen_workers_init_distribute_gray_queue (void)
 	if (!collection_needs_workers ())
 		return;
 
-	init_distribute_gray_queue (sgen_get_major_collector ()->is_concurrent);
+	init_distribute_gray_queue (TRUE);
 }
 
 void
@@ -567,12 +697,13 @@ sgen_workers_init (int num_workers)
 {
 	int i;
 
-	if (!sgen_get_major_collector ()->is_concurrent)
+	if (!sgen_get_major_collector ()->is_concurrent && !sgen_minor_collector.is_parallel)
 		return;
 
 	//g_print ("initing %d workers\n", num_workers);
 
 	workers_num = num_workers;
+	workers_num_numa_nodes = MIN (sgen_memgov_get_num_numa_nodes (), num_workers);
 
 	workers_data = sgen_alloc_internal_dynamic (sizeof (WorkerData) * num_workers, INTERNAL_MEM_WORKER_DATA, TRUE);
 	memset (workers_data, 0, sizeof (WorkerData) * num_workers);
@@ -580,13 +711,14 @@ sgen_workers_init (int num_workers)
 	MONO_SEM_INIT (&workers_waiting_sem, 0);
 	MONO_SEM_INIT (&workers_done_sem, 0);
 
-	init_distribute_gray_queue (sgen_get_major_collector ()->is_concurrent);
+	init_distribute_gray_queue (TRUE);
 
 	if (sgen_get_major_collector ()->alloc_worker_data)
 		workers_gc_thread_major_collector_data = sgen_get_major_collector ()->alloc_worker_data ();
 
 	for (i = 0; i < workers_num; ++i) {
 		workers_data [i].index = i;
+		workers_data [i].numa_node = i % workers_num_numa_nodes;
 
 		/* private gray queue is inited by the thread itself */
 		mono_mutex_init (&workers_data [i].stealable_stack_mutex);
@@ -603,7 +735,14 @@ sgen_workers_init (int num_workers)
 	mono_counters_register ("Stolen from self lock", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_workers_stolen_from_self_lock);
 	mono_counters_register ("Stolen from self no lock", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_workers_stolen_from_self_no_lock);
 	mono_counters_register ("Stolen from others", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_workers_stolen_from_others);
+	mono_counters_register ("Stolen from other nodes", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_workers_stolen_from_other_nodes);
 	mono_counters_register ("# workers waited", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_workers_num_waited);
+
+	/* Per-node scan throughput is objects scanned over scan time. */
+	for (i = 0; i < workers_num_numa_nodes; ++i) {
+		mono_counters_register (g_strdup_printf ("# objects scanned on node %d", i), MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_node_objects_scanned [i]);
+		mono_counters_register (g_strdup_printf ("Scan time on node %d", i), MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_node_scan [i]);
+	}
 }
 
 /* only the GC thread is allowed to start and join workers */
@@ -709,8 +848,15 @@ sgen_workers_join (void)
 	g_assert (workers_job_queue_num_entries == 0);
 	g_assert (sgen_section_gray_queue_is_empty (&workers_distribute_gray_queue));
 	for (i = 0; i < workers_num; ++i) {
-		g_assert (!workers_data [i].stealable_stack_fill);
-		g_assert (sgen_gray_object_queue_is_empty (&workers_data [i].private_gray_queue));
+		WorkerData *data = &workers_data [i];
+
+		g_assert (!data->stealable_stack_fill);
+		g_assert (sgen_gray_object_queue_is_empty (&data->private_gray_queue));
+
+		stat_node_objects_scanned [data->numa_node] += data->objects_scanned;
+		time_node_scan [data->numa_node] += data->scan_time;
+		data->objects_scanned = 0;
+		data->scan_time = 0;
 	}
 }
 
@@ -742,6 +888,15 @@ sgen_is_worker_thread (MonoNativeThreadId thread)
 	return FALSE;
 }
 
+/*
+ * The number of pieces to split parallelizable jobs into.
+ */
+int
+sgen_workers_get_job_split_count (void)
+{
+	return workers_num;
+}
+
 SgenSectionGrayQueue*
 sgen_workers_get_distribute_section_gray_queue (void)
 {
@@ -27,9 +27,15 @@
 typedef struct _WorkerData WorkerData;
 struct _WorkerData {
 	int index;
+	/* The NUMA node the worker is pinned to */
+	int numa_node;
 	MonoNativeThreadId thread;
 	void *major_collector_data;
 
+	/* For the per-node stats, added up when the workers are joined */
+	guint64 objects_scanned;
+	guint64 scan_time;
+
 	SgenGrayQueue private_gray_queue; /* only read/written by worker thread */
 
 	mono_mutex_t stealable_stack_mutex;
@@ -43,6 +49,8 @@ typedef struct _JobQueueEntry JobQueueEntry;
 struct _JobQueueEntry {
 	JobFunc func;
 	void *data;
+	/* The NUMA node whose workers should preferably do the job, or -1 */
+	int numa_node;
 
 	volatile JobQueueEntry *next;
 };
@@ -53,12 +61,14 @@ gboolean sgen_workers_have_started (void) MONO_INTERNAL;
 void sgen_workers_ensure_awake (void) MONO_INTERNAL;
 void sgen_workers_init_distribute_gray_queue (void) MONO_INTERNAL;
 void sgen_workers_enqueue_job (JobFunc func, void *data) MONO_INTERNAL;
+void sgen_workers_enqueue_job_for_node (JobFunc func, void *data, int numa_node) MONO_INTERNAL;
 void sgen_workers_wait_for_jobs_finished (void) MONO_INTERNAL;
 void sgen_workers_distribute_gray_queue_sections (void) MONO_INTERNAL;
 void sgen_workers_reset_data (void) MONO_INTERNAL;
 void sgen_workers_join (void) MONO_INTERNAL;
 gboolean sgen_workers_all_done (void) MONO_INTERNAL;
 gboolean sgen_workers_are_working (void) MONO_INTERNAL;
+int sgen_workers_get_job_split_count (void) MONO_INTERNAL;
 SgenSectionGrayQueue* sgen_workers_get_distribute_section_gray_queue (void) MONO_INTERNAL;
 
 void sgen_workers_signal_start_nursery_collection_and_wait (void) MONO_INTERNAL;
@@ -28,6 +28,7 @@
 #include <mono/metadata/mono-ptr-array.h>
 #include <mono/io-layer/io-layer.h>
 #include <mono/utils/mono-time.h>
+#include <mono/utils/mono-counters.h>
 #include <mono/utils/mono-proclib.h>
 #include <mono/utils/mono-semaphore.h>
 #include <mono/utils/atomic.h>
@@ -83,17 +84,33 @@ enum {
 	MONITOR_STATE_SLEEPING
 };
 
+typedef struct _SocketIOData SocketIOData;
+
+/*
+ * Sockets are spread over the shards by fd, each shard having its own poller
+ * thread, its own lock and its own fd -> pending operations table. Only the
+ * epoll backend uses more than one shard.
+ */
 typedef struct {
+	SocketIOData *data;
 	mono_mutex_t io_lock; /* access to sock_to_state */
-	int inited; // 0 -> not initialized , 1->initializing, 2->initialized, 3->cleaned up
 	MonoGHashTable *sock_to_state;
+	gpointer event_data;
+} SocketIOShard;
+
+struct _SocketIOData {
+	mono_mutex_t io_lock; /* access to inited and shards */
+	int inited; // 0 -> not initialized , 1->initializing, 2->initialized, 3->cleaned up
+
+	gint nshards;
+	SocketIOShard *shards;
 
 	gint event_system;
-	gpointer event_data;
-	void (*modify) (gpointer p, int fd, int operation, int events, gboolean is_new);
-	void (*wait) (gpointer sock_data);
+	/* Called with the shard io_lock held, which it must release */
+	void (*modify) (SocketIOShard *shard, int fd, int operation, int events, gboolean is_new);
+	void (*wait) (gpointer shard);
 	void (*shutdown) (gpointer event_data);
-} SocketIOData;
+};
 
 static SocketIOData socket_io_data;
 
@@ -149,8 +166,9 @@ static gboolean threadpool_start_thread (ThreadPool *tp);
 static void threadpool_kill_thread (ThreadPool *tp);
 static void monitor_thread (gpointer data);
 static void socket_io_cleanup (SocketIOData *data);
-static MonoObject *get_io_event (MonoMList **list, gint event);
-static int get_events_from_list (MonoMList *list);
+static MonoObject *get_io_event (MonoArray *pending, gint event);
+static int get_events_from_pending (MonoArray *pending);
+static gboolean pending_is_empty (MonoArray *pending);
 static int get_event_from_state (MonoSocketAsyncResult *state);
 static void check_for_interruption_critical (void);
 
@@ -309,24 +327,26 @@ get_event_from_state (MonoSocketAsyncResult *state)
 	return -1;
 }
 
-static int
-get_events_from_list (MonoMList *list)
-{
-	return 0;
-}
-
 #else
 
 static void
 socket_io_cleanup (SocketIOData *data)
 {
+	int i;
+
 	mono_mutex_lock (&data->io_lock);
 	if (data->inited != 2) {
 		mono_mutex_unlock (&data->io_lock);
 		return;
 	}
 	data->inited = 3;
-	data->shutdown (data->event_data);
+	for (i = 0; i < data->nshards; i++) {
+		SocketIOShard *shard = &data->shards [i];
+
+		mono_mutex_lock (&shard->io_lock);
+		data->shutdown (shard->event_data);
+		mono_mutex_unlock (&shard->io_lock);
+	}
 	mono_mutex_unlock (&data->io_lock);
 }
 
@@ -355,20 +375,6 @@ get_event_from_state (MonoSocketAsyncResult *state)
 	}
 }
 
-static int
-get_events_from_list (MonoMList *list)
-{
-	MonoSocketAsyncResult *state;
-	int events = 0;
-
-	while (list && (state = (MonoSocketAsyncResult *)mono_mlist_get_data (list))) {
-		events |= get_event_from_state (state);
-		list = mono_mlist_next (list);
-	}
-
-	return events;
-}
-
 #define ICALL_RECV(x)	ves_icall_System_Net_Sockets_Socket_Receive_internal (\
 				(SOCKET)(gssize)x->handle, x->buffer, x->offset, x->size,\
 				 x->socket_flags, &x->error);
@@ -379,6 +385,67 @@ get_events_from_list (MonoMList *list)
 
 #endif /* !DISABLE_SOCKETS */
 
+/*
+ * The operations pending on a socket are kept in a small managed array, so
+ * the GC sees them, holding one FIFO list per direction with its head and its
+ * tail. Queuing an operation, taking the next one for an event and computing
+ * the events to wait for are all O(1).
+ */
+/* Each tail follows its head */
+enum {
+	PENDING_IN_HEAD,
+	PENDING_IN_TAIL,
+	PENDING_OUT_HEAD,
+	PENDING_OUT_TAIL,
+	PENDING_SIZE
+};
+
+static MonoArray *
+pending_new (void)
+{
+	return mono_array_new (mono_get_root_domain (), mono_defaults.object_class, PENDING_SIZE);
+}
+
+static void
+pending_add (MonoArray *pending, MonoSocketAsyncResult *state)
+{
+	MonoMList *node, *tail;
+	int head_idx;
+
+	head_idx = get_event_from_state (state) == MONO_POLLIN ? PENDING_IN_HEAD : PENDING_OUT_HEAD;
+	node = mono_mlist_alloc ((MonoObject *) state);
+	tail = mono_array_get (pending, MonoMList*, head_idx + 1);
+	if (tail)
+		mono_mlist_set_next (tail, node);
+	else
+		mono_array_setref (pending, head_idx, (MonoObject *) node);
+	mono_array_setref (pending, head_idx + 1, (MonoObject *) node);
+}
+
+static gboolean
+pending_is_empty (MonoArray *pending)
+{
+	return !mono_array_get (pending, MonoMList*, PENDING_IN_HEAD) && !mono_array_get (pending, MonoMList*, PENDING_OUT_HEAD);
+}
+
+static int
+get_events_from_pending (MonoArray *pending)
+{
+	int events = 0;
+
+	if (mono_array_get (pending, MonoMList*, PENDING_IN_HEAD))
+		events |= MONO_POLLIN;
+	if (mono_array_get (pending, MonoMList*, PENDING_OUT_HEAD))
+		events |= MONO_POLLOUT;
+	return events;
+}
+
+static SocketIOShard *
+socket_io_get_shard (SocketIOData *data, int fd)
+{
+	return &data->shards [(guint) fd % data->nshards];
+}
+
 static void
 threadpool_jobs_inc (MonoObject *obj)
 {
@@ -404,32 +471,24 @@ threadpool_jobs_dec (MonoObject *obj)
 	return FALSE;
 }
 
+/*
+ * Take the oldest operation waiting for @event off @pending. Entries that were
+ * cleared by a domain unload are skipped.
+ */
 static MonoObject *
-get_io_event (MonoMList **list, gint event)
-{
-	MonoObject *state;
-	MonoMList *current;
-	MonoMList *prev;
-
-	current = *list;
-	prev = NULL;
-	state = NULL;
-	while (current) {
-		state = mono_mlist_get_data (current);
-		if (get_event_from_state ((MonoSocketAsyncResult *) state) == event)
-			break;
-
-		state = NULL;
-		prev = current;
-		current = mono_mlist_next (current);
-	}
-
-	if (current) {
-		if (prev) {
-			mono_mlist_set_next (prev, mono_mlist_next (current));
-		} else {
-			*list = mono_mlist_next (*list);
-		}
+get_io_event (MonoArray *pending, gint event)
+{
+	MonoObject *state = NULL;
+	MonoMList *head;
+	int head_idx;
+
+	head_idx = event == MONO_POLLIN ? PENDING_IN_HEAD : PENDING_OUT_HEAD;
+	while (!state && (head = mono_array_get (pending, MonoMList*, head_idx))) {
+		state = mono_mlist_get_data (head);
+		head = mono_mlist_next (head);
+		mono_array_setref (pending, head_idx, (MonoObject *) head);
+		if (!head)
+			mono_array_setref (pending, head_idx + 1, NULL);
 	}
 
 	return state;
@@ -442,63 +501,100 @@ get_io_event (MonoMList **list, gint event)
 void
 mono_thread_pool_remove_socket (int sock)
 {
-	MonoMList *list;
+	SocketIOShard *shard;
+	MonoArray *pending;
 	MonoSocketAsyncResult *state;
-	MonoObject *ares;
+	int event;
 
-	if (socket_io_data.inited == 0)
+	if (socket_io_data.inited < 2)
 		return;
 
-	mono_mutex_lock (&socket_io_data.io_lock);
-	if (socket_io_data.sock_to_state == NULL) {
-		mono_mutex_unlock (&socket_io_data.io_lock);
+	shard = socket_io_get_shard (&socket_io_data, sock);
+	mono_mutex_lock (&shard->io_lock);
+	if (shard->sock_to_state == NULL) {
+		mono_mutex_unlock (&shard->io_lock);
 		return;
 	}
-	list = mono_g_hash_table_lookup (socket_io_data.sock_to_state, GINT_TO_POINTER (sock));
-	if (list)
-		mono_g_hash_table_remove (socket_io_data.sock_to_state, GINT_TO_POINTER (sock));
-	mono_mutex_unlock (&socket_io_data.io_lock);
-	
-	while (list) {
-		state = (MonoSocketAsyncResult *) mono_mlist_get_data (list);
-		if (state->operation == AIO_OP_RECEIVE)
-			state->operation = AIO_OP_RECV_JUST_CALLBACK;
-		else if (state->operation == AIO_OP_SEND)
-			state->operation = AIO_OP_SEND_JUST_CALLBACK;
-
-		ares = get_io_event (&list, MONO_POLLIN);
-		threadpool_append_job (&async_io_tp, ares);
-		if (list) {
-			ares = get_io_event (&list, MONO_POLLOUT);
-			threadpool_append_job (&async_io_tp, ares);
+	pending = mono_g_hash_table_lookup (shard->sock_to_state, GINT_TO_POINTER (sock));
+	if (pending)
+		mono_g_hash_table_remove (shard->sock_to_state, GINT_TO_POINTER (sock));
+	mono_mutex_unlock (&shard->io_lock);
+
+	if (!pending)
+		return;
+
+	for (event = MONO_POLLIN; event; event = event == MONO_POLLIN ? MONO_POLLOUT : 0) {
+		while ((state = (MonoSocketAsyncResult *) get_io_event (pending, event))) {
+			if (state->operation == AIO_OP_RECEIVE)
+				state->operation = AIO_OP_RECV_JUST_CALLBACK;
+			else if (state->operation == AIO_OP_SEND)
+				state->operation = AIO_OP_SEND_JUST_CALLBACK;
+
+			threadpool_append_job (&async_io_tp, (MonoObject *) state);
 		}
 	}
 }
 
+static void
+init_shards (SocketIOData *data, int nshards)
+{
+	int i;
+
+	data->nshards = nshards;
+	data->shards = g_new0 (SocketIOShard, nshards);
+	for (i = 0; i < nshards; i++) {
+		SocketIOShard *shard = &data->shards [i];
+
+		shard->data = data;
+		mono_mutex_init_recursive (&shard->io_lock);
+		MONO_GC_REGISTER_ROOT_FIXED (shard->sock_to_state);
+		shard->sock_to_state = mono_g_hash_table_new_type (g_direct_hash, g_direct_equal, MONO_HASH_VALUE_GC);
+	}
+}
+
 static void
 init_event_system (SocketIOData *data)
 {
+	int i;
+
 #ifdef HAVE_EPOLL
 	if (data->event_system == EPOLL_BACKEND) {
-		data->event_data = tp_epoll_init (data);
-		if (data->event_data == NULL) {
+		init_shards (data, tp_epoll_get_npollers ());
+		for (i = 0; i < data->nshards; i++) {
+			data->shards [i].event_data = tp_epoll_init (data);
+			if (data->shards [i].event_data == NULL)
+				break;
+		}
+		if (i < data->nshards) {
 			if (g_getenv ("MONO_DEBUG"))
 				g_message ("Falling back to poll()");
+			while (i-- > 0)
+				data->shutdown (data->shards [i].event_data);
+			for (i = 0; i < data->nshards; i++) {
+				MONO_GC_UNREGISTER_ROOT (data->shards [i].sock_to_state);
+				mono_g_hash_table_destroy (data->shards [i].sock_to_state);
+				mono_mutex_destroy (&data->shards [i].io_lock);
+			}
+			g_free (data->shards);
 			data->event_system = POLL_BACKEND;
 		}
 	}
 #elif defined(USE_KQUEUE_FOR_THREADPOOL)
-	if (data->event_system == KQUEUE_BACKEND)
-		data->event_data = tp_kqueue_init (data);
+	if (data->event_system == KQUEUE_BACKEND) {
+		init_shards (data, 1);
+		data->shards [0].event_data = tp_kqueue_init (data);
+	}
 #endif
-	if (data->event_system == POLL_BACKEND)
-		data->event_data = tp_poll_init (data);
+	if (data->event_system == POLL_BACKEND) {
+		init_shards (data, 1);
+		data->shards [0].event_data = tp_poll_init (data);
+	}
 }
 
 static void
 socket_io_init (SocketIOData *data)
 {
-	int inited;
+	int inited, i;
 
 	if (data->inited >= 2) // 2 -> initialized, 3-> cleaned up
 		return;
@@ -513,7 +609,6 @@ socket_io_init (SocketIOData *data)
 	}
 
 	mono_mutex_lock (&data->io_lock);
-	data->sock_to_state = mono_g_hash_table_new_type (g_direct_hash, g_direct_equal, MONO_HASH_VALUE_GC);
 #ifdef HAVE_EPOLL
 	data->event_system = EPOLL_BACKEND;
 #elif defined(USE_KQUEUE_FOR_THREADPOOL)
@@ -525,7 +620,8 @@ socket_io_init (SocketIOData *data)
 		data->event_system = POLL_BACKEND;
 
 	init_event_system (data);
-	mono_thread_create_internal (mono_get_root_domain (), data->wait, data, TRUE, SMALL_STACK);
+	for (i = 0; i < data->nshards; i++)
+		mono_thread_create_internal (mono_get_root_domain (), data->wait, &data->shards [i], TRUE, SMALL_STACK);
 	mono_mutex_unlock (&data->io_lock);
 	data->inited = 2;
 	threadpool_start_thread (&async_io_tp);
@@ -534,14 +630,15 @@ socket_io_init (SocketIOData *data)
 static void
 socket_io_add (MonoAsyncResult *ares, MonoSocketAsyncResult *state)
 {
-	MonoMList *list;
+	MonoArray *pending;
 	SocketIOData *data = &socket_io_data;
+	SocketIOShard *shard;
 	int fd;
 	gboolean is_new;
 	int ievt;
 
 	socket_io_init (&socket_io_data);
-	if (mono_runtime_is_shutting_down () || data->inited == 3 || data->sock_to_state == NULL)
+	if (mono_runtime_is_shutting_down () || data->inited == 3)
 		return;
 	if (async_tp.pool_status == 2)
 		return;
@@ -549,24 +646,25 @@ socket_io_add (MonoAsyncResult *ares, MonoSocketAsyncResult *state)
 	MONO_OBJECT_SETREF (state, ares, ares);
 
 	fd = GPOINTER_TO_INT (state->handle);
-	mono_mutex_lock (&data->io_lock);
-	if (data->sock_to_state == NULL) {
-		mono_mutex_unlock (&data->io_lock);
+	shard = socket_io_get_shard (data, fd);
+	mono_mutex_lock (&shard->io_lock);
+	if (shard->sock_to_state == NULL) {
+		mono_mutex_unlock (&shard->io_lock);
 		return;
 	}
-	list = mono_g_hash_table_lookup (data->sock_to_state, GINT_TO_POINTER (fd));
-	if (list == NULL) {
-		list = mono_mlist_alloc ((MonoObject*)state);
+	pending = mono_g_hash_table_lookup (shard->sock_to_state, GINT_TO_POINTER (fd));
+	if (pending == NULL) {
+		pending = pending_new ();
+		mono_g_hash_table_replace (shard->sock_to_state, state->handle, pending);
 		is_new = TRUE;
 	} else {
-		list = mono_mlist_append (list, (MonoObject*)state);
 		is_new = FALSE;
 	}
 
-	mono_g_hash_table_replace (data->sock_to_state, state->handle, list);
-	ievt = get_events_from_list (list);
+	pending_add (pending, state);
+	ievt = get_events_from_pending (pending);
 	/* The modify function leaves the io_lock critical section. */
-	data->modify (data, fd, state->operation, ievt, is_new);
+	data->modify (shard, fd, state->operation, ievt, is_new);
 }
 
 #ifndef DISABLE_SOCKETS
@@ -753,7 +851,10 @@ print_pool_info (ThreadPool *tp)
 		}
 		mono_mutex_unlock (&wsqs_lock);
 	} else {
-		g_print ("\tSockets: %d\n", mono_g_hash_table_size (socket_io_data.sock_to_state));
+		int i, nsockets = 0;
+		for (i = 0; i < socket_io_data.nshards; i++)
+			nsockets += mono_g_hash_table_size (socket_io_data.shards [i].sock_to_state);
+		g_print ("\tSockets: %d\n", nsockets);
 	}
 	g_print ("-------------\n");
 }
@@ -773,114 +874,403 @@ signal_handler (int signo)
 }
 #endif
 
-#define SAMPLES_PERIOD 500
-#define HISTORY_SIZE 10
-/* number of iteration without any jobs
+/* time in ms without any jobs
    in the queue before going to sleep */
-#define NUM_WAITING_ITERATIONS 10
+#define MONITOR_FALL_ASLEEP_DELAY 5000
+
+/*
+ * Hill climbing thread injection for the worker pool, modeled after the
+ * controller in CoreCLR (clr/src/vm/hillclimbing.cpp).
+ *
+ * The monitor thread takes a sample every few hundred milliseconds: the number
+ * of work items completed during the interval (tp->nexecuted) and the number
+ * of threads that did it. The thread count is made to oscillate with a small
+ * square wave of period WAVE_PERIOD samples around a control setting. Using a
+ * Goertzel filter we then extract, over the last SAMPLES_TO_MEASURE samples,
+ * the component of the throughput and of the thread count at the frequency of
+ * that wave. If throughput follows the thread count (positive ratio), adding
+ * threads pays off and the control setting moves up; if it goes the other way
+ * (negative ratio), the control setting moves down. Noise at the neighbouring
+ * frequencies gives us a confidence estimate that damps the moves.
+ *
+ * Starvation (every worker blocked in WaitSleepJoin) bypasses the controller
+ * and injects a thread right away; idle workers are retired one per sample so
+ * a burst does not leave the pool oversized.
+ */
+#define HC_WAVE_PERIOD 4
+#define HC_MAX_THREAD_WAVE_MAGNITUDE 20
+#define HC_THREAD_MAGNITUDE_MULTIPLIER 1.0
+#define HC_SAMPLES_TO_MEASURE (HC_WAVE_PERIOD * 8)
+#define HC_TARGET_THROUGHPUT_RATIO 0.15
+#define HC_TARGET_SIGNAL_TO_NOISE_RATIO 3.0
+#define HC_MAX_CHANGE_PER_SECOND 4.0
+#define HC_MAX_CHANGE_PER_SAMPLE 20.0
+#define HC_SAMPLE_INTERVAL_LOW 10
+#define HC_SAMPLE_INTERVAL_HIGH 200
+#define HC_THROUGHPUT_ERROR_SMOOTHING_FACTOR 0.01
+#define HC_GAIN_EXPONENT 2.0
+#define HC_MAX_SAMPLE_ERROR 0.15
+
+typedef enum {
+	TRANSITION_WARMUP,
+	TRANSITION_INITIALIZING,
+	TRANSITION_RANDOM_MOVE,
+	TRANSITION_CLIMBING_MOVE,
+	TRANSITION_CHANGE_POINT,
+	TRANSITION_STABILIZING,
+	TRANSITION_STARVATION,
+	TRANSITION_THREAD_TIMED_OUT,
+	TRANSITION_UNDEFINED,
+} HillClimbingStateTransition;
 
 typedef struct {
-	gint32 nexecuted;
-	gint32 nthreads;
-	gint8 nthreads_diff;
-} SamplesHistory;
+	gint64 total_samples;
+	gint last_thread_count;
+	gdouble elapsed_since_last_change; /* in seconds */
+	gdouble completions_since_last_change;
+	gdouble average_throughput_noise;
+	gdouble samples [HC_SAMPLES_TO_MEASURE];
+	gdouble thread_counts [HC_SAMPLES_TO_MEASURE];
+	guint32 current_sample_interval; /* in ms */
+	gint32 accumulated_completion_count;
+	gdouble accumulated_sample_duration;
+
+	gdouble current_control_setting;
+
+	/* Exported through mono-counters */
+	gint32 counter_completions;
+	gdouble counter_sample_duration;
+	gint32 counter_thread_count;
+	gint32 counter_new_thread_count;
+	gdouble counter_throughput;
+	gdouble counter_ratio;
+	gdouble counter_confidence;
+	gint32 counter_transition;
+	guint32 random_seed;
+} HillClimbing;
+
+static HillClimbing hill_climbing;
+
+static guint32
+hill_climbing_random_interval (HillClimbing *hc)
+{
+	hc->random_seed = hc->random_seed * 1103515245 + 12345;
+	return HC_SAMPLE_INTERVAL_LOW + (hc->random_seed >> 8) % (HC_SAMPLE_INTERVAL_HIGH - HC_SAMPLE_INTERVAL_LOW + 1);
+}
+
+static void
+hill_climbing_init (HillClimbing *hc)
+{
+	memset (hc, 0, sizeof (HillClimbing));
+	hc->random_seed = mono_msec_ticks ();
+	hc->current_sample_interval = hill_climbing_random_interval (hc);
+	hc->counter_transition = TRANSITION_UNDEFINED;
+
+	mono_counters_register ("Threadpool hill climbing completions", MONO_COUNTER_RUNTIME | MONO_COUNTER_INT | MONO_COUNTER_COUNT | MONO_COUNTER_VARIABLE, &hc->counter_completions);
+	mono_counters_register ("Threadpool hill climbing sample duration", MONO_COUNTER_RUNTIME | MONO_COUNTER_DOUBLE | MONO_COUNTER_VARIABLE, &hc->counter_sample_duration);
+	mono_counters_register ("Threadpool hill climbing thread count", MONO_COUNTER_RUNTIME | MONO_COUNTER_INT | MONO_COUNTER_COUNT | MONO_COUNTER_VARIABLE, &hc->counter_thread_count);
+	mono_counters_register ("Threadpool hill climbing new thread count", MONO_COUNTER_RUNTIME | MONO_COUNTER_INT | MONO_COUNTER_COUNT | MONO_COUNTER_VARIABLE, &hc->counter_new_thread_count);
+	mono_counters_register ("Threadpool hill climbing throughput", MONO_COUNTER_RUNTIME | MONO_COUNTER_DOUBLE | MONO_COUNTER_VARIABLE, &hc->counter_throughput);
+	mono_counters_register ("Threadpool hill climbing ratio", MONO_COUNTER_RUNTIME | MONO_COUNTER_DOUBLE | MONO_COUNTER_VARIABLE, &hc->counter_ratio);
+	mono_counters_register ("Threadpool hill climbing confidence", MONO_COUNTER_RUNTIME | MONO_COUNTER_DOUBLE | MONO_COUNTER_VARIABLE, &hc->counter_confidence);
+	mono_counters_register ("Threadpool hill climbing transition", MONO_COUNTER_RUNTIME | MONO_COUNTER_INT | MONO_COUNTER_VARIABLE, &hc->counter_transition);
+	mono_counters_register ("Threadpool hill climbing control setting", MONO_COUNTER_RUNTIME | MONO_COUNTER_DOUBLE | MONO_COUNTER_VARIABLE, &hc->current_control_setting);
+	mono_counters_register ("Threadpool hill climbing throughput noise", MONO_COUNTER_RUNTIME | MONO_COUNTER_DOUBLE | MONO_COUNTER_VARIABLE, &hc->average_throughput_noise);
+}
+
+static void
+hill_climbing_change_thread_count (HillClimbing *hc, gint new_thread_count, HillClimbingStateTransition transition)
+{
+	hc->last_thread_count = new_thread_count;
+	hc->current_sample_interval = hill_climbing_random_interval (hc);
+	hc->elapsed_since_last_change = 0;
+	hc->completions_since_last_change = 0;
+	hc->counter_transition = transition;
+}
+
+static void
+hill_climbing_force_change (HillClimbing *hc, gint new_thread_count, HillClimbingStateTransition transition)
+{
+	if (new_thread_count != hc->last_thread_count) {
+		hc->current_control_setting += new_thread_count - hc->last_thread_count;
+		hill_climbing_change_thread_count (hc, new_thread_count, transition);
+	}
+}
 
 /*
- * returns :
- *  -  1 if the number of threads should increase
- *  -  0 if it should not change
- *  - -1 if it should decrease
- *  - -2 in case of error
+ * Goertzel filter: the complex amplitude of the @period component of the last
+ * @sample_count @samples.
  */
-static gint8
-monitor_heuristic (gint16 *current, gint16 *history_size, SamplesHistory *history, ThreadPool *tp)
+static void
+hill_climbing_get_wave_component (HillClimbing *hc, gdouble *samples, gint sample_count, gdouble period, gdouble *re, gdouble *im)
 {
-	int i;
-	gint8 decision;
-	gint16 cur, max = 0;
-	gboolean all_waitsleepjoin;
-	MonoInternalThread *thread;
+	gdouble w, cosine, sine, coeff, q0, q1 = 0, q2 = 0;
+	gint i;
+
+	g_assert (sample_count >= period); /* can't measure a wave that doesn't fit */
+	g_assert (period >= 2); /* can't measure above the Nyquist frequency */
+
+	w = 2.0 * M_PI / period;
+	cosine = cos (w);
+	sine = sin (w);
+	coeff = 2.0 * cosine;
+
+	for (i = 0; i < sample_count; ++i) {
+		q0 = coeff * q1 - q2 + samples [(hc->total_samples - sample_count + i) % HC_SAMPLES_TO_MEASURE];
+		q2 = q1;
+		q1 = q0;
+	}
+
+	*re = (q1 - q2 * cosine) / sample_count;
+	*im = (q2 * sine) / sample_count;
+}
+
+/*
+ * Feed one sample to the controller: @completions work items were executed by
+ * @current_thread_count threads in @sample_duration seconds. Returns the
+ * thread count to aim for, and in @new_sample_interval the number of
+ * milliseconds to wait before the next sample.
+ */
+static gint
+hill_climbing_update (HillClimbing *hc, ThreadPool *tp, gint current_thread_count, gdouble sample_duration, gint32 completions, guint32 *new_sample_interval)
+{
+	HillClimbingStateTransition transition;
+	gdouble throughput, move, gain;
+	gdouble ratio_re = 0, ratio_im = 0, confidence = 0;
+	gint sample_index, sample_count, new_thread_wave_magnitude;
+	gint new_thread_count, min_threads, max_threads;
+
+	if (current_thread_count != hc->last_thread_count)
+		hill_climbing_force_change (hc, current_thread_count, TRANSITION_INITIALIZING);
+
+	hc->elapsed_since_last_change += sample_duration;
+	hc->completions_since_last_change += completions;
+
+	sample_duration += hc->accumulated_sample_duration;
+	completions += hc->accumulated_completion_count;
+
+	hc->counter_completions = completions;
+	hc->counter_sample_duration = sample_duration;
+	hc->counter_thread_count = current_thread_count;
 
 	/*
-	 * The following heuristic tries to approach the optimal number of threads to maximize jobs throughput. To
-	 * achieve this, it simply stores the number of jobs executed (nexecuted), the number of Threads (nthreads)
-	 * and the decision (nthreads_diff) for the past HISTORY_SIZE periods of time, each period being of
-	 * duration SAMPLES_PERIOD ms. This history gives us an insight into what happened, and to see if we should
-	 * increase or reduce the number of threads by comparing the last period (current) to the best one.
-	 *
-	 * The algorithm can be describe as following :
-	 *  - if we have a better throughput than the best period : we should either increase the number of threads
-	 *     in case we already have more threads, either reduce the number of threads if we have less threads; this
-	 *     is equivalent to move away from the number of threads of the best period, because we are currently better
-	 *  - if we have a worse throughput than the best period : we should either decrease the number of threads if
-	 *     we have more threads, either increase the number of threads if we have less threads;  this is equivalent
-	 *     to get closer to the number of threads of the best period, because we are currently worse
+	 * The count of completed items is off by up to (current_thread_count - 1)
+	 * since every thread may be halfway through an item at either end of the
+	 * interval. This error is not random, so the frequency analysis below
+	 * would not filter it out: wait until we have enough completions for it to
+	 * be negligible.
 	 */
+	if (hc->total_samples > 0 && (completions == 0 || (current_thread_count - 1.0) / completions >= HC_MAX_SAMPLE_ERROR)) {
+		hc->accumulated_sample_duration = sample_duration;
+		hc->accumulated_completion_count = completions;
+		*new_sample_interval = HC_SAMPLE_INTERVAL_LOW;
+		return current_thread_count;
+	}
 
-	*history_size = MIN (*history_size + 1, HISTORY_SIZE);
-	cur = *current = (*current + 1) % *history_size;
-
-	history [cur].nthreads = tp->nthreads;
-	history [cur].nexecuted = InterlockedExchange (&tp->nexecuted, 0);
-
-	if (tp->waiting) {
-		/* if we have waiting thread in the pool, then do not create a new one */
-		history [cur].nthreads_diff = tp->waiting > 1 ? -1 : 0;
-		decision = 0;
-	} else if (tp->nthreads < tp->min_threads) {
-		history [cur].nthreads_diff = 1;
-		decision = 1;
-	} else if (*history_size <= 1) {
-		/* first iteration, let's add a thread by default */
-		history [cur].nthreads_diff = 1;
-		decision = 2;
-	} else {
-		mono_mutex_lock (&threads_lock);
-		if (threads == NULL) {
-			mono_mutex_unlock (&threads_lock);
-			return -2;
-		}
-		all_waitsleepjoin = TRUE;
-		for (i = 0; i < threads->len; ++i) {
-			thread = g_ptr_array_index (threads, i);
-			if (!(thread->state & ThreadState_WaitSleepJoin)) {
-				all_waitsleepjoin = FALSE;
-				break;
-			}
+	hc->accumulated_sample_duration = 0;
+	hc->accumulated_completion_count = 0;
+
+	throughput = (gdouble) completions / sample_duration;
+	hc->counter_throughput = throughput;
+
+	sample_index = hc->total_samples % HC_SAMPLES_TO_MEASURE;
+	hc->samples [sample_index] = throughput;
+	hc->thread_counts [sample_index] = current_thread_count;
+	hc->total_samples ++;
+
+	transition = TRANSITION_WARMUP;
+
+	/* Only analyze a whole number of wave periods */
+	sample_count = ((gint) MIN (hc->total_samples - 1, HC_SAMPLES_TO_MEASURE)) / HC_WAVE_PERIOD * HC_WAVE_PERIOD;
+
+	if (sample_count > HC_WAVE_PERIOD) {
+		gdouble sample_sum = 0, thread_sum = 0, average_throughput, average_thread_count;
+		gint i;
+
+		for (i = 0; i < sample_count; ++i) {
+			sample_sum += hc->samples [(hc->total_samples - sample_count + i) % HC_SAMPLES_TO_MEASURE];
+			thread_sum += hc->thread_counts [(hc->total_samples - sample_count + i) % HC_SAMPLES_TO_MEASURE];
 		}
-		mono_mutex_unlock (&threads_lock);
 
-		if (all_waitsleepjoin) {
-			/* we might be in a condition of starvation/deadlock with tasks waiting for each others */
-			history [cur].nthreads_diff = 1;
-			decision = 5;
-		} else {
-			max = cur == 0 ? 1 : 0;
-			for (i = 0; i < *history_size; i++) {
-				if (i == cur)
-					continue;
-				if (history [i].nexecuted > history [max].nexecuted)
-					max = i;
+		average_throughput = sample_sum / sample_count;
+		average_thread_count = thread_sum / sample_count;
+
+		if (average_throughput > 0 && average_thread_count > 0) {
+			gdouble period1, period2, re, im;
+			gdouble throughput_re, throughput_im, thread_re, thread_im, thread_abs;
+			gdouble throughput_error_estimate, noise_for_confidence, denom;
+
+			/* The frequencies right above and below the wave tell us how noisy the throughput is */
+			period1 = sample_count / (((gdouble) sample_count / HC_WAVE_PERIOD) + 1);
+			period2 = sample_count / (((gdouble) sample_count / HC_WAVE_PERIOD) - 1);
+
+			hill_climbing_get_wave_component (hc, hc->samples, sample_count, HC_WAVE_PERIOD, &throughput_re, &throughput_im);
+			throughput_re /= average_throughput;
+			throughput_im /= average_throughput;
+
+			hill_climbing_get_wave_component (hc, hc->samples, sample_count, period1, &re, &im);
+			throughput_error_estimate = sqrt (re * re + im * im) / average_throughput;
+			if (period2 <= sample_count) {
+				hill_climbing_get_wave_component (hc, hc->samples, sample_count, period2, &re, &im);
+				throughput_error_estimate = MAX (throughput_error_estimate, sqrt (re * re + im * im) / average_throughput);
 			}
 
-			if (history [cur].nexecuted >= history [max].nexecuted) {
-				/* we improved the situation, let's continue ! */
-				history [cur].nthreads_diff = history [cur].nthreads >= history [max].nthreads ? 1 : -1;
-				decision = 3;
+			hill_climbing_get_wave_component (hc, hc->thread_counts, sample_count, HC_WAVE_PERIOD, &thread_re, &thread_im);
+			thread_re /= average_thread_count;
+			thread_im /= average_thread_count;
+			thread_abs = sqrt (thread_re * thread_re + thread_im * thread_im);
+
+			if (hc->average_throughput_noise == 0)
+				hc->average_throughput_noise = throughput_error_estimate;
+			else
+				hc->average_throughput_noise = (HC_THROUGHPUT_ERROR_SMOOTHING_FACTOR * throughput_error_estimate)
+					+ ((1.0 - HC_THROUGHPUT_ERROR_SMOOTHING_FACTOR) * hc->average_throughput_noise);
+
+			if (thread_abs > 0) {
+				/* ratio = (throughput - target * thread) / thread, in the complex plane */
+				re = throughput_re - HC_TARGET_THROUGHPUT_RATIO * thread_re;
+				im = throughput_im - HC_TARGET_THROUGHPUT_RATIO * thread_im;
+				denom = thread_re * thread_re + thread_im * thread_im;
+				ratio_re = (re * thread_re + im * thread_im) / denom;
+				ratio_im = (im * thread_re - re * thread_im) / denom;
+				transition = TRANSITION_CLIMBING_MOVE;
 			} else {
-				/* we made it worse, let's return to previous situation */
-				history [cur].nthreads_diff = history [cur].nthreads >= history [max].nthreads ? -1 : 1;
-				decision = 4;
+				transition = TRANSITION_STABILIZING;
 			}
+
+			noise_for_confidence = MAX (hc->average_throughput_noise, throughput_error_estimate);
+			if (noise_for_confidence > 0)
+				confidence = (thread_abs / noise_for_confidence) / HC_TARGET_SIGNAL_TO_NOISE_RATIO;
+			else
+				confidence = 1.0;
 		}
 	}
 
+	hc->counter_ratio = ratio_re;
+	hc->counter_confidence = confidence;
+
+	/* Move by the real part of the ratio, damped by how sure we are of it */
+	move = MIN (1.0, MAX (-1.0, ratio_re));
+	move *= MIN (1.0, MAX (0.0, confidence));
+
+	/* Small changes are less likely to be real, make them smaller still */
+	gain = HC_MAX_CHANGE_PER_SECOND * sample_duration;
+	move = pow (fabs (move), HC_GAIN_EXPONENT) * (move >= 0.0 ? 1 : -1) * gain;
+	move = MIN (move, HC_MAX_CHANGE_PER_SAMPLE);
+
+	hc->current_control_setting += move;
+
+	/* The wave has to stand out of the noise for us to measure anything */
+	new_thread_wave_magnitude = (gint)(0.5 + (hc->current_control_setting * hc->average_throughput_noise
+		* HC_TARGET_SIGNAL_TO_NOISE_RATIO * HC_THREAD_MAGNITUDE_MULTIPLIER * 2.0));
+	new_thread_wave_magnitude = MIN (new_thread_wave_magnitude, HC_MAX_THREAD_WAVE_MAGNITUDE);
+	new_thread_wave_magnitude = MAX (new_thread_wave_magnitude, 1);
+
+	max_threads = tp->max_threads;
+	min_threads = tp->min_threads;
+
+	hc->current_control_setting = MIN (max_threads - new_thread_wave_magnitude, hc->current_control_setting);
+	hc->current_control_setting = MAX (min_threads, hc->current_control_setting);
+
+	new_thread_count = (gint)(hc->current_control_setting + new_thread_wave_magnitude * ((hc->total_samples / (HC_WAVE_PERIOD / 2)) % 2));
+	new_thread_count = MIN (max_threads, new_thread_count);
+	new_thread_count = MAX (min_threads, new_thread_count);
+
+	hc->counter_new_thread_count = new_thread_count;
+
+	if (new_thread_count != current_thread_count)
+		hill_climbing_change_thread_count (hc, new_thread_count, transition);
+
+	/* If more threads hurt and we're already at the minimum, there is no point in sampling often */
+	if (ratio_re < 0.0 && new_thread_count == min_threads)
+		*new_sample_interval = (guint32)(0.5 + hc->current_sample_interval * (10.0 * MAX (-ratio_re, 1.0)));
+	else
+		*new_sample_interval = hc->current_sample_interval;
+
 #if DEBUG
-	printf ("monitor_thread: decision: %1d, history [current]: {nexecuted: %5d, nthreads: %3d, waiting: %2d, nthreads_diff: %2d}, history [max]: {nexecuted: %5d, nthreads: %3d}\n",
-			decision, history [cur].nexecuted, history [cur].nthreads, tp->waiting, history [cur].nthreads_diff, history [max].nexecuted, history [max].nthreads);
+	printf ("hill_climbing: transition: %d, completions: %5d, duration: %.3f, throughput: %8.1f, ratio: %5.2f, confidence: %5.2f, threads: %3d -> %3d\n",
+			transition, completions, sample_duration, throughput, ratio_re, confidence, current_thread_count, new_thread_count);
 #endif
-	
-	return history [cur].nthreads_diff;
+
+	return new_thread_count;
+}
+
+/*
+ * Returns TRUE if every worker thread is blocked: the queued work items might
+ * be waiting for each other, and we need a new thread to make progress.
+ */
+static gboolean
+monitor_workers_are_starving (void)
+{
+	MonoInternalThread *thread;
+	gboolean all_waitsleepjoin;
+	int i;
+
+	mono_mutex_lock (&threads_lock);
+	if (threads == NULL || threads->len == 0) {
+		mono_mutex_unlock (&threads_lock);
+		return FALSE;
+	}
+	all_waitsleepjoin = TRUE;
+	for (i = 0; i < threads->len; ++i) {
+		thread = g_ptr_array_index (threads, i);
+		if (!(thread->state & ThreadState_WaitSleepJoin)) {
+			all_waitsleepjoin = FALSE;
+			break;
+		}
+	}
+	mono_mutex_unlock (&threads_lock);
+
+	return all_waitsleepjoin;
+}
+
+/*
+ * Called by the monitor thread after each sample of @elapsed ms. Returns the
+ * number of ms to wait before the next one.
+ */
+static guint32
+monitor_worker_pool (ThreadPool *tp, guint32 elapsed)
+{
+	HillClimbing *hc = &hill_climbing;
+	gint nthreads, new_thread_count;
+	gint32 completions;
+	guint32 sample_interval;
+
+	completions = InterlockedExchange (&tp->nexecuted, 0);
+	nthreads = tp->nthreads;
+
+	if (nthreads < tp->min_threads) {
+		if (threadpool_start_thread (tp))
+			hill_climbing_force_change (hc, nthreads + 1, TRANSITION_INITIALIZING);
+		return hc->current_sample_interval;
+	}
+
+	if (monitor_workers_are_starving ()) {
+		if (threadpool_start_thread (tp))
+			hill_climbing_force_change (hc, nthreads + 1, TRANSITION_STARVATION);
+		return hc->current_sample_interval;
+	}
+
+	if (tp->waiting > 1) {
+		/* More than one idle worker: retire one instead of waiting for the controller to get there */
+		if (nthreads > tp->min_threads) {
+			threadpool_kill_thread (tp);
+			hill_climbing_force_change (hc, nthreads - 1, TRANSITION_THREAD_TIMED_OUT);
+		}
+		return hc->current_sample_interval;
+	}
+
+	new_thread_count = hill_climbing_update (hc, tp, nthreads, elapsed / 1000.0, completions, &sample_interval);
+
+	if (new_thread_count > nthreads) {
+		while (tp->nthreads < new_thread_count && threadpool_start_thread (tp))
+			;
+	} else if (new_thread_count < nthreads) {
+		/* Workers die one at a time, when they next look for work */
+		threadpool_kill_thread (tp);
+	}
+
+	return sample_interval;
 }
 
 static void
@@ -890,18 +1280,17 @@ monitor_thread (gpointer unused)
 	MonoInternalThread *thread;
 	int i;
 
-	guint32 ms;
-	gint8 num_waiting_iterations = 0;
-
-	gint16 history_size = 0, current = -1;
-	SamplesHistory *history = malloc (sizeof (SamplesHistory) * HISTORY_SIZE);
+	guint32 ms, sample_interval, last_sample;
+	guint32 time_waiting = 0;
 
 	pools [0] = &async_tp;
 	pools [1] = &async_io_tp;
 	thread = mono_thread_internal_current ();
 	ves_icall_System_Threading_Thread_SetName_internal (thread, mono_string_new (mono_domain_get (), "Threadpool monitor"));
+	sample_interval = hill_climbing.current_sample_interval;
+	last_sample = mono_msec_ticks ();
 	while (1) {
-		ms = SAMPLES_PERIOD;
+		ms = sample_interval;
 		i = 10; //number of spurious awakes we tolerate before doing a round of rebalancing.
 		do {
 			guint32 ts;
@@ -927,16 +1316,18 @@ monitor_thread (gpointer unused)
 
 		switch (monitor_state) {
 		case MONITOR_STATE_AWAKE:
-			num_waiting_iterations = 0;
+			time_waiting = 0;
 			break;
 		case MONITOR_STATE_FALLING_ASLEEP:
-			if (++num_waiting_iterations == NUM_WAITING_ITERATIONS) {
+			time_waiting += sample_interval;
+			if (time_waiting >= MONITOR_FALL_ASLEEP_DELAY) {
 				if (monitor_state == MONITOR_STATE_FALLING_ASLEEP && InterlockedCompareExchange (&monitor_state, MONITOR_STATE_SLEEPING, MONITOR_STATE_FALLING_ASLEEP) == MONITOR_STATE_FALLING_ASLEEP) {
 					MONO_SEM_WAIT (&monitor_sem);
 
-					num_waiting_iterations = 0;
-					current = -1;
-					history_size = 0;
+					time_waiting = 0;
+					/* Don't account the time we slept as a sample */
+					InterlockedExchange (&async_tp.nexecuted, 0);
+					last_sample = mono_msec_ticks ();
 				}
 			}
 			break;
@@ -952,12 +1343,10 @@ monitor_thread (gpointer unused)
 				if (!tp->waiting && mono_cq_count (tp->queue) > 0)
 					threadpool_start_thread (tp);
 			} else {
-				gint8 nthreads_diff = monitor_heuristic (&current, &history_size, history, tp);
+				guint32 now = mono_msec_ticks ();
 
-				if (nthreads_diff == 1)
-					threadpool_start_thread (tp);
-				else if (nthreads_diff == -1)
-					threadpool_kill_thread (tp);
+				sample_interval = monitor_worker_pool (tp, MAX (now - last_sample, 1));
+				last_sample = now;
 			}
 		}
 	}
@@ -989,7 +1378,6 @@ mono_thread_pool_init (void)
 		}
 	}
 
-	MONO_GC_REGISTER_ROOT_FIXED (socket_io_data.sock_to_state);
 	mono_mutex_init_recursive (&socket_io_data.io_lock);
 	if (g_getenv ("MONO_THREADS_PER_CPU") != NULL) {
 		threads_per_cpu = atoi (g_getenv ("MONO_THREADS_PER_CPU"));
@@ -1034,6 +1422,8 @@ mono_thread_pool_init (void)
 	MONO_SEM_INIT (&monitor_sem, 0);
 	monitor_state = MONITOR_STATE_AWAKE;
 	monitor_njobs = 0;
+
+	hill_climbing_init (&hill_climbing);
 }
 
 static MonoAsyncResult *
@@ -1318,15 +1708,21 @@ threadpool_clear_queue (ThreadPool *tp, MonoDomain *domain)
 static gboolean
 remove_sockstate_for_domain (gpointer key, gpointer value, gpointer user_data)
 {
-	MonoMList *list = value;
+	MonoArray *pending = value;
+	MonoMList *list;
 	gboolean remove = FALSE;
-	while (list) {
-		MonoObject *data = mono_mlist_get_data (list);
-		if (mono_object_domain (data) == user_data) {
-			remove = TRUE;
-			mono_mlist_set_data (list, NULL);
+	int head_idx;
+
+	for (head_idx = PENDING_IN_HEAD; head_idx < PENDING_SIZE; head_idx += 2) {
+		list = mono_array_get (pending, MonoMList*, head_idx);
+		while (list) {
+			MonoObject *data = mono_mlist_get_data (list);
+			if (data && mono_object_domain (data) == user_data) {
+				remove = TRUE;
+				mono_mlist_set_data (list, NULL);
+			}
+			list = mono_mlist_next (list);
 		}
-		list = mono_mlist_next (list);
 	}
 	//FIXME is there some sort of additional unregistration we need to perform here?
 	return remove;
@@ -1350,9 +1746,17 @@ mono_thread_pool_remove_domain_jobs (MonoDomain *domain, int timeout)
 	threadpool_clear_queue (&async_io_tp, domain);
 
 	mono_mutex_lock (&socket_io_data.io_lock);
-	if (socket_io_data.sock_to_state)
-		mono_g_hash_table_foreach_remove (socket_io_data.sock_to_state, remove_sockstate_for_domain, domain);
+	if (socket_io_data.inited == 2) {
+		int i;
 
+		for (i = 0; i < socket_io_data.nshards; i++) {
+			SocketIOShard *shard = &socket_io_data.shards [i];
+
+			mono_mutex_lock (&shard->io_lock);
+			mono_g_hash_table_foreach_remove (shard->sock_to_state, remove_sockstate_for_domain, domain);
+			mono_mutex_unlock (&shard->io_lock);
+		}
+	}
 	mono_mutex_unlock (&socket_io_data.io_lock);
 	
 	/*
@@ -10,15 +10,45 @@
  * Copyright 2011 Xamarin Inc (http://www.xamarin.com)
  */
 
+/*
+ * Each SocketIOShard gets its own epoll fd and its own poller thread. Sockets
+ * are registered with EPOLLONESHOT: once an event has been reported the socket
+ * is disarmed, and it is only rearmed, with the events its remaining pending
+ * operations wait for, if there are any left. A socket with nothing pending
+ * costs no epoll_ctl call at all.
+ */
 struct _tp_epoll_data {
 	int epollfd;
 };
 
 typedef struct _tp_epoll_data tp_epoll_data;
-static void tp_epoll_modify (gpointer p, int fd, int operation, int events, gboolean is_new);
+static void tp_epoll_modify (SocketIOShard *shard, int fd, int operation, int events, gboolean is_new);
 static void tp_epoll_shutdown (gpointer event_data);
 static void tp_epoll_wait (gpointer event_data);
 
+#define EPOLL_FLAGS (EPOLLONESHOT | EPOLLET)
+#define EPOLL_CORES_PER_POLLER 8
+
+/*
+ * The number of poller threads: MONO_THREADPOOL_POLLERS if set, otherwise one
+ * per NUMA node or per EPOLL_CORES_PER_POLLER cores, whichever gives more.
+ */
+static int
+tp_epoll_get_npollers (void)
+{
+	const char *env;
+	int npollers;
+
+	if ((env = g_getenv ("MONO_THREADPOOL_POLLERS")) != NULL) {
+		npollers = atoi (env);
+		if (npollers >= 1)
+			return npollers;
+	}
+
+	npollers = MAX (mono_numa_node_count (), mono_cpu_count () / EPOLL_CORES_PER_POLLER);
+	return MAX (npollers, 1);
+}
+
 static gpointer
 tp_epoll_init (SocketIOData *data)
 {
@@ -51,23 +81,23 @@ tp_epoll_init (SocketIOData *data)
 }
 
 static void
-tp_epoll_modify (gpointer p, int fd, int operation, int events, gboolean is_new)
+tp_epoll_modify (SocketIOShard *shard, int fd, int operation, int events, gboolean is_new)
 {
-	SocketIOData *socket_io_data;
 	tp_epoll_data *data;
 	struct epoll_event evt;
 	int epoll_op;
 
-	socket_io_data = p;
-	data = socket_io_data->event_data;
+	data = shard->event_data;
 
 	memset (&evt, 0, sizeof (evt));
 	evt.data.fd = fd;
+	evt.events = EPOLL_FLAGS;
 	if ((events & MONO_POLLIN) != 0)
 		evt.events |= EPOLLIN;
 	if ((events & MONO_POLLOUT) != 0)
 		evt.events |= EPOLLOUT;
 
+	/* A disarmed socket is still registered, so ADD can fail with EEXIST */
 	epoll_op = (is_new) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
 	if (epoll_ctl (data->epollfd, epoll_op, fd, &evt) == -1) {
 		int err = errno;
@@ -78,7 +108,7 @@ tp_epoll_modify (gpointer p, int fd, int operation, int events, gboolean is_new)
 			}
 		}
 	}
-	mono_mutex_unlock (&socket_io_data->io_lock);
+	mono_mutex_unlock (&shard->io_lock);
 }
 
 static void
@@ -95,6 +125,7 @@ tp_epoll_shutdown (gpointer event_data)
 static void
 tp_epoll_wait (gpointer p)
 {
+	SocketIOShard *shard;
 	SocketIOData *socket_io_data;
 	int epollfd;
 	struct epoll_event *events, *evt;
@@ -103,8 +134,9 @@ tp_epoll_wait (gpointer p)
 	gint nresults;
 	tp_epoll_data *data;
 
-	socket_io_data = p;
-	data = socket_io_data->event_data;
+	shard = p;
+	socket_io_data = shard->data;
+	data = shard->event_data;
 	epollfd = data->epollfd;
 	events = g_new0 (struct epoll_event, EPOLL_NEVENTS);
 
@@ -129,40 +161,41 @@ tp_epoll_wait (gpointer p)
 			return;
 		}
 
-		mono_mutex_lock (&socket_io_data->io_lock);
+		mono_mutex_lock (&shard->io_lock);
 		if (socket_io_data->inited == 3) {
 			g_free (events);
-			mono_mutex_unlock (&socket_io_data->io_lock);
+			mono_mutex_unlock (&shard->io_lock);
 			return; /* cleanup called */
 		}
 
 		nresults = 0;
 		for (i = 0; i < ready; i++) {
 			int fd;
-			MonoMList *list;
+			MonoArray *pending;
 			MonoObject *ares;
 
 			evt = &events [i];
 			fd = evt->data.fd;
-			list = mono_g_hash_table_lookup (socket_io_data->sock_to_state, GINT_TO_POINTER (fd));
-			if (list != NULL && (evt->events & (EPOLLIN | EPOLL_ERRORS)) != 0) {
-				ares = get_io_event (&list, MONO_POLLIN);
+			pending = mono_g_hash_table_lookup (shard->sock_to_state, GINT_TO_POINTER (fd));
+			if (pending != NULL && (evt->events & (EPOLLIN | EPOLL_ERRORS)) != 0) {
+				ares = get_io_event (pending, MONO_POLLIN);
 				if (ares != NULL)
 					async_results [nresults++] = ares;
 			}
 
-			if (list != NULL && (evt->events & (EPOLLOUT | EPOLL_ERRORS)) != 0) {
-				ares = get_io_event (&list, MONO_POLLOUT);
+			if (pending != NULL && (evt->events & (EPOLLOUT | EPOLL_ERRORS)) != 0) {
+				ares = get_io_event (pending, MONO_POLLOUT);
 				if (ares != NULL)
 					async_results [nresults++] = ares;
 			}
 
-			if (list != NULL) {
+			if (pending != NULL && !pending_is_empty (pending)) {
 				int p;
 
-				mono_g_hash_table_replace (socket_io_data->sock_to_state, GINT_TO_POINTER (fd), list);
-				p = get_events_from_list (list);
-				evt->events = (p & MONO_POLLOUT) ? EPOLLOUT : 0;
+				/* Rearm for what is still pending */
+				p = get_events_from_pending (pending);
+				evt->events = EPOLL_FLAGS;
+				evt->events |= (p & MONO_POLLOUT) ? EPOLLOUT : 0;
 				evt->events |= (p & MONO_POLLIN) ? EPOLLIN : 0;
 				if (epoll_ctl (epollfd, EPOLL_CTL_MOD, fd, evt) == -1) {
 					if (epoll_ctl (epollfd, EPOLL_CTL_ADD, fd, evt) == -1) {
@@ -171,14 +204,15 @@ tp_epoll_wait (gpointer p)
 					}
 				}
 			} else {
-				mono_g_hash_table_remove (socket_io_data->sock_to_state, GINT_TO_POINTER (fd));
-				epoll_ctl (epollfd, EPOLL_CTL_DEL, fd, evt);
+				/* Nothing pending, leave the socket disarmed */
+				mono_g_hash_table_remove (shard->sock_to_state, GINT_TO_POINTER (fd));
 			}
 		}
-		mono_mutex_unlock (&socket_io_data->io_lock);
+		mono_mutex_unlock (&shard->io_lock);
 		threadpool_append_jobs (&async_io_tp, (MonoObject **) async_results, nresults);
 		mono_gc_bzero_aligned (async_results, sizeof (gpointer) * nresults);
 	}
 }
 #undef EPOLL_NEVENTS
 #undef EPOLL_ERRORS
+#undef EPOLL_FLAGS
@@ -12,7 +12,7 @@ struct _tp_kqueue_data {
 };
 
 typedef struct _tp_kqueue_data tp_kqueue_data;
-static void tp_kqueue_modify (gpointer p, int fd, int operation, int events, gboolean is_new);
+static void tp_kqueue_modify (SocketIOShard *shard, int fd, int operation, int events, gboolean is_new);
 static void tp_kqueue_shutdown (gpointer event_data);
 static void tp_kqueue_wait (gpointer event_data);
 
@@ -42,11 +42,9 @@ kevent_change (int kfd, struct kevent *evt, const char *error_str)
 }
 
 static void
-tp_kqueue_modify (gpointer p, int fd, int operation, int events, gboolean is_new)
+tp_kqueue_modify (SocketIOShard *shard, int fd, int operation, int events, gboolean is_new)
 {
-	SocketIOData *socket_io_data;
-	socket_io_data = p;
-	tp_kqueue_data *data = socket_io_data->event_data;
+	tp_kqueue_data *data = shard->event_data;
 	struct kevent evt;
 
 	memset (&evt, 0, sizeof (evt));
@@ -59,7 +57,7 @@ tp_kqueue_modify (gpointer p, int fd, int operation, int events, gboolean is_new
 		EV_SET (&evt, fd, EVFILT_WRITE, EV_ADD | EV_ENABLE | EV_ONESHOT, 0, 0, 0);
 		kevent_change (data->fd, &evt, "ADD write");
 	}
-	mono_mutex_unlock (&socket_io_data->io_lock);
+	mono_mutex_unlock (&shard->io_lock);
 }
 
 static void
@@ -75,6 +73,7 @@ tp_kqueue_shutdown (gpointer event_data)
 static void
 tp_kqueue_wait (gpointer p)
 {
+	SocketIOShard *shard;
 	SocketIOData *socket_io_data;
 	int kfd;
 	struct kevent *events, *evt;
@@ -83,8 +82,9 @@ tp_kqueue_wait (gpointer p)
 	gint nresults;
 	tp_kqueue_data *data;
 
-	socket_io_data = p;
-	data = socket_io_data->event_data;
+	shard = p;
+	socket_io_data = shard->data;
+	data = shard->event_data;
 	kfd = data->fd;
 	events = g_new0 (struct kevent, KQUEUE_NEVENTS);
 
@@ -110,38 +110,37 @@ tp_kqueue_wait (gpointer p)
 			return;
 		}
 
-		mono_mutex_lock (&socket_io_data->io_lock);
+		mono_mutex_lock (&shard->io_lock);
 		if (socket_io_data->inited == 3) {
 			g_free (events);
-			mono_mutex_unlock (&socket_io_data->io_lock);
+			mono_mutex_unlock (&shard->io_lock);
 			return; /* cleanup called */
 		}
 
 		nresults = 0;
 		for (i = 0; i < ready; i++) {
 			int fd;
-			MonoMList *list;
+			MonoArray *pending;
 			MonoObject *ares;
 
 			evt = &events [i];
 			fd = evt->ident;
-			list = mono_g_hash_table_lookup (socket_io_data->sock_to_state, GINT_TO_POINTER (fd));
-			if (list != NULL && (evt->filter == EVFILT_READ || (evt->flags & EV_ERROR) != 0)) {
-				ares = get_io_event (&list, MONO_POLLIN);
+			pending = mono_g_hash_table_lookup (shard->sock_to_state, GINT_TO_POINTER (fd));
+			if (pending != NULL && (evt->filter == EVFILT_READ || (evt->flags & EV_ERROR) != 0)) {
+				ares = get_io_event (pending, MONO_POLLIN);
 				if (ares != NULL)
 					async_results [nresults++] = ares;
 			}
-			if (list != NULL && (evt->filter == EVFILT_WRITE || (evt->flags & EV_ERROR) != 0)) {
-				ares = get_io_event (&list, MONO_POLLOUT);
+			if (pending != NULL && (evt->filter == EVFILT_WRITE || (evt->flags & EV_ERROR) != 0)) {
+				ares = get_io_event (pending, MONO_POLLOUT);
 				if (ares != NULL)
 					async_results [nresults++] = ares;
 			}
 
-			if (list != NULL) {
+			if (pending != NULL && !pending_is_empty (pending)) {
 				int p;
 
-				mono_g_hash_table_replace (socket_io_data->sock_to_state, GINT_TO_POINTER (fd), list);
-				p = get_events_from_list (list);
+				p = get_events_from_pending (pending);
 				if (evt->filter == EVFILT_READ && (p & MONO_POLLIN) != 0) {
 					EV_SET (evt, fd, EVFILT_READ, EV_ADD | EV_ENABLE | EV_ONESHOT, 0, 0, 0);
 					kevent_change (kfd, evt, "READD read");
@@ -152,10 +151,10 @@ tp_kqueue_wait (gpointer p)
 					kevent_change (kfd, evt, "READD write");
 				}
 			} else {
-				mono_g_hash_table_remove (socket_io_data->sock_to_state, GINT_TO_POINTER (fd));
+				mono_g_hash_table_remove (shard->sock_to_state, GINT_TO_POINTER (fd));
 			}
 		}
-		mono_mutex_unlock (&socket_io_data->io_lock);
+		mono_mutex_unlock (&shard->io_lock);
 		threadpool_append_jobs (&async_io_tp, (MonoObject **) async_results, nresults);
 		mono_gc_bzero_aligned (async_results, sizeof (gpointer) * nresults);
 	}
@@ -19,7 +19,7 @@ struct _tp_poll_data {
 typedef struct _tp_poll_data tp_poll_data;
 
 static void tp_poll_shutdown (gpointer event_data);
-static void tp_poll_modify (gpointer p, int fd, int operation, int events, gboolean is_new);
+static void tp_poll_modify (SocketIOShard *shard, int fd, int operation, int events, gboolean is_new);
 static void tp_poll_wait (gpointer p);
 
 static gpointer
@@ -74,17 +74,15 @@ tp_poll_init (SocketIOData *data)
 }
 
 static void
-tp_poll_modify (gpointer p, int fd, int operation, int events, gboolean is_new)
+tp_poll_modify (SocketIOShard *shard, int fd, int operation, int events, gboolean is_new)
 {
-	SocketIOData *socket_io_data;
 	tp_poll_data *data;
 	char msg [1];
 	int unused;
 
-	socket_io_data = p;
-	data = socket_io_data->event_data;
+	data = shard->event_data;
 
-	mono_mutex_unlock (&socket_io_data->io_lock);
+	mono_mutex_unlock (&shard->io_lock);
 	
 	MONO_SEM_WAIT (&data->new_sem);
 	INIT_POLLFD (&data->newpfd, GPOINTER_TO_INT (fd), events);
@@ -157,11 +155,12 @@ tp_poll_wait (gpointer p)
 	gint allocated;
 	gint i;
 	tp_poll_data *data;
-	SocketIOData *socket_io_data = p;
+	SocketIOShard *shard = p;
+	SocketIOData *socket_io_data = shard->data;
 	MonoPtrArray async_results;
 	gint nresults;
 
-	data = socket_io_data->event_data;
+	data = shard->event_data;
 	allocated = INITIAL_POLLFD_SIZE;
 	pfds = g_new0 (mono_pollfd, allocated);
 	mono_ptr_array_init (async_results, allocated * 2);
@@ -173,7 +172,7 @@ tp_poll_wait (gpointer p)
 		int nsock = 0;
 		mono_pollfd *pfd;
 		char one [1];
-		MonoMList *list;
+		MonoArray *pending;
 		MonoObject *ares;
 
 		mono_gc_set_skip_thread (TRUE);
@@ -270,11 +269,11 @@ tp_poll_wait (gpointer p)
 		if (nsock == 0)
 			continue;
 
-		mono_mutex_lock (&socket_io_data->io_lock);
+		mono_mutex_lock (&shard->io_lock);
 		if (socket_io_data->inited == 3) {
 			g_free (pfds);
 			mono_ptr_array_destroy (async_results);
-			mono_mutex_unlock (&socket_io_data->io_lock);
+			mono_mutex_unlock (&shard->io_lock);
 			return; /* cleanup called */
 		}
 
@@ -287,34 +286,33 @@ tp_poll_wait (gpointer p)
 				continue;
 
 			nsock--;
-			list = mono_g_hash_table_lookup (socket_io_data->sock_to_state, GINT_TO_POINTER (pfd->fd));
-			if (list != NULL && (pfd->revents & (MONO_POLLIN | POLL_ERRORS)) != 0) {
-				ares = get_io_event (&list, MONO_POLLIN);
+			pending = mono_g_hash_table_lookup (shard->sock_to_state, GINT_TO_POINTER (pfd->fd));
+			if (pending != NULL && (pfd->revents & (MONO_POLLIN | POLL_ERRORS)) != 0) {
+				ares = get_io_event (pending, MONO_POLLIN);
 				if (ares != NULL) {
 					mono_ptr_array_append (async_results, ares);
 					++nresults;
 				}
 			}
 
-			if (list != NULL && (pfd->revents & (MONO_POLLOUT | POLL_ERRORS)) != 0) {
-				ares = get_io_event (&list, MONO_POLLOUT);
+			if (pending != NULL && (pfd->revents & (MONO_POLLOUT | POLL_ERRORS)) != 0) {
+				ares = get_io_event (pending, MONO_POLLOUT);
 				if (ares != NULL) {
 					mono_ptr_array_append (async_results, ares);
 					++nresults;
 				}
 			}
 
-			if (list != NULL) {
-				mono_g_hash_table_replace (socket_io_data->sock_to_state, GINT_TO_POINTER (pfd->fd), list);
-				pfd->events = get_events_from_list (list);
+			if (pending != NULL && !pending_is_empty (pending)) {
+				pfd->events = get_events_from_pending (pending);
 			} else {
-				mono_g_hash_table_remove (socket_io_data->sock_to_state, GINT_TO_POINTER (pfd->fd));
+				mono_g_hash_table_remove (shard->sock_to_state, GINT_TO_POINTER (pfd->fd));
 				pfd->fd = -1;
 				if (i == maxfd - 1)
 					maxfd--;
 			}
 		}
-		mono_mutex_unlock (&socket_io_data->io_lock);
+		mono_mutex_unlock (&shard->io_lock);
 		threadpool_append_jobs (&async_io_tp, (MonoObject **) async_results.data, nresults);
 		mono_ptr_array_clear (async_results);
 	}
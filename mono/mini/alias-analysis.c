@@ -9,6 +9,7 @@
 
 #include <config.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "mini.h"
 #include "ir-emit.h"
@@ -358,4 +359,172 @@ done:
 		mono_print_code (cfg, "AFTER ALIAS_ANALYSIS");
 }
 
+/*
+ * get_access_size:
+ *
+ *   Return the number of bytes accessed by the load or store OPCODE, or -1 if
+ * it is not known.
+ */
+static int
+get_access_size (int opcode)
+{
+	switch (opcode) {
+	case OP_LOADI1_MEMBASE:
+	case OP_LOADU1_MEMBASE:
+	case OP_STOREI1_MEMBASE_REG:
+	case OP_STOREI1_MEMBASE_IMM:
+		return 1;
+	case OP_LOADI2_MEMBASE:
+	case OP_LOADU2_MEMBASE:
+	case OP_STOREI2_MEMBASE_REG:
+	case OP_STOREI2_MEMBASE_IMM:
+		return 2;
+	case OP_LOADI4_MEMBASE:
+	case OP_LOADU4_MEMBASE:
+	case OP_LOADR4_MEMBASE:
+	case OP_STOREI4_MEMBASE_REG:
+	case OP_STOREI4_MEMBASE_IMM:
+	case OP_STORER4_MEMBASE_REG:
+		return 4;
+	case OP_LOADI8_MEMBASE:
+	case OP_LOADR8_MEMBASE:
+	case OP_STOREI8_MEMBASE_REG:
+	case OP_STOREI8_MEMBASE_IMM:
+	case OP_STORER8_MEMBASE_REG:
+		return 8;
+	case OP_LOAD_MEMBASE:
+	case OP_STORE_MEMBASE_REG:
+	case OP_STORE_MEMBASE_IMM:
+		return SIZEOF_REGISTER;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * get_local_address:
+ *
+ *   If VREG holds the address of a local variable at the point of INS, as
+ * computed by an OP_LDADDR earlier in the same bblock, return the variable,
+ * and add the offset from its start to *OFFSET.
+ */
+static MonoInst*
+get_local_address (MonoInst *ins, int vreg, int *offset)
+{
+	MonoInst *def;
+
+	for (def = ins->prev; def; def = def->prev) {
+		if (INS_INFO (def->opcode) [MONO_INST_DEST] == ' ' || MONO_IS_STORE_MEMBASE (def) || MONO_IS_STORE_MEMINDEX (def) || def->dreg != vreg)
+			continue;
+
+		switch (def->opcode) {
+		case OP_LDADDR:
+			return (MonoInst*)def->inst_p0;
+		case OP_MOVE:
+			vreg = def->sreg1;
+			break;
+		case OP_ADD_IMM:
+		case OP_IADD_IMM:
+		case OP_LADD_IMM:
+			*offset += def->inst_imm;
+			vreg = def->sreg1;
+			break;
+		default:
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+static void
+init_access (MonoCompile *cfg, MonoInst *ins, MonoMemoryAccess *acc, int basereg, int offset, int size)
+{
+	MonoInst *var;
+
+	memset (acc, 0, sizeof (MonoMemoryAccess));
+	acc->basereg = basereg;
+	acc->offset = offset;
+	acc->size = size;
+
+	acc->var = get_local_address (ins, basereg, &acc->offset);
+	if (acc->var) {
+		acc->basereg = -1;
+		return;
+	}
+
+	/* Object references always point into the GC heap, never to the stack */
+	var = get_vreg_to_inst (cfg, basereg);
+	acc->in_heap = var && var->type == STACK_OBJ;
+}
+
+/*
+ * mono_alias_analysis_get_store:
+ *
+ *   If INS is a store, or defines a variable which lives in memory, fill out
+ * ACC with the memory it writes and return TRUE. Other effects of INS, like
+ * the ones of a call, are not described by ACC.
+ */
+gboolean
+mono_alias_analysis_get_store (MonoCompile *cfg, MonoInst *ins, MonoMemoryAccess *acc)
+{
+	MonoInst *var;
+
+	if (MONO_IS_STORE_MEMBASE (ins)) {
+		init_access (cfg, ins, acc, ins->inst_destbasereg, ins->inst_offset, get_access_size (ins->opcode));
+		return TRUE;
+	}
+	if (MONO_IS_STORE_MEMINDEX (ins)) {
+		/* The offset is in a register */
+		init_access (cfg, ins, acc, ins->inst_destbasereg, 0, -1);
+		return TRUE;
+	}
+
+	if (INS_INFO (ins->opcode) [MONO_INST_DEST] == ' ')
+		return FALSE;
+	var = get_vreg_to_inst (cfg, ins->dreg);
+	if (!var || !(var->flags & (MONO_INST_VOLATILE|MONO_INST_INDIRECT)))
+		return FALSE;
+
+	memset (acc, 0, sizeof (MonoMemoryAccess));
+	acc->basereg = -1;
+	acc->var = var;
+	acc->size = -1;
+	return TRUE;
+}
+
+/*
+ * mono_alias_analysis_get_load:
+ *
+ *   If INS is a load, fill out ACC with the memory it reads and return TRUE.
+ */
+gboolean
+mono_alias_analysis_get_load (MonoCompile *cfg, MonoInst *ins, MonoMemoryAccess *acc)
+{
+	if (!MONO_IS_LOAD_MEMBASE (ins))
+		return FALSE;
+	init_access (cfg, ins, acc, ins->inst_basereg, ins->inst_offset, get_access_size (ins->opcode));
+	return TRUE;
+}
+
+/*
+ * mono_alias_analysis_may_alias:
+ *
+ *   Return whenever the memory accessed by A and B might overlap. The base
+ * registers of the two accesses are assumed to hold the same values, i.e.
+ * they are not redefined between them.
+ */
+gboolean
+mono_alias_analysis_may_alias (MonoMemoryAccess *a, MonoMemoryAccess *b)
+{
+	/* A local variable can't be reached from a reference to an object */
+	if ((a->var && b->in_heap) || (a->in_heap && b->var))
+		return FALSE;
+
+	/* Different parts of the same object or variable */
+	if (a->size != -1 && b->size != -1 && ((a->var && a->var == b->var) || (a->basereg != -1 && a->basereg == b->basereg)))
+		return a->offset < b->offset + b->size && b->offset < a->offset + a->size;
+
+	return TRUE;
+}
+
 #endif /* !DISABLE_JIT */
@@ -50,6 +50,7 @@
 #include <mono/utils/mono-compiler.h>
 #include <mono/utils/mono-time.h>
 #include <mono/utils/mono-mmap.h>
+#include <mono/utils/mono-tls.h>
 
 #include "mini.h"
 #include "seq-points.h"
@@ -127,6 +128,8 @@ typedef struct MonoAotOptions {
 	gboolean autoreg;
 	char *mtriple;
 	char *llvm_path;
+	char *pgo_file;
+	char *methods_file;
 	char *instances_logfile_path;
 	char *logfile;
 } MonoAotOptions;
@@ -136,9 +139,14 @@ typedef struct MonoAotStats {
 	int code_size, info_size, ex_info_size, unwind_info_size, got_size, class_info_size, got_info_size, plt_size;
 	int methods_without_got_slots, direct_calls, all_calls, llvm_count;
 	int got_slots, offsets_size;
+	int pgo_hot_inlined, pgo_hot_inlined_size, pgo_cold_not_inlined, pgo_cold_not_inlined_size;
 	int got_slot_types [MONO_PATCH_INFO_NONE];
 	int got_slot_info_sizes [MONO_PATCH_INFO_NONE];
 	int jit_time, gen_time, link_time;
+	/* Per-phase times, printed by the 'stats' option */
+	int llvm_bc_time, llvm_opt_time, llvm_llc_time, llvm_as_time, llvm_wait_time;
+	int emit_code_time, emit_info_time, emit_tables_time, emit_debug_time;
+	int writeout_time, as_time, ld_time;
 } MonoAotStats;
 
 typedef struct GotInfo {
@@ -168,6 +176,8 @@ typedef struct MonoAotCompile {
 	GPtrArray *image_table;
 	GPtrArray *globals;
 	GPtrArray *method_order;
+	/* The tokens of the methods listed in the methods-file, if given */
+	GHashTable *method_tokens;
 	GHashTable *export_names;
 	/* Maps MonoClass* -> blob offset */
 	GHashTable *klass_blob_hash;
@@ -202,10 +212,17 @@ typedef struct MonoAotCompile {
 	MonoImageWriter *w;
 	MonoDwarfWriter *dwarf;
 	FILE *fp;
+	/* Whenever the code is being emitted into fragments by several threads */
+	gboolean emit_fragments;
 	char *tmpbasename;
 	char *tmpfname;
 	char *llvm_sfile;
 	char *llvm_ofile;
+	/* The thread running the LLVM tools concurrently with the emit phase */
+	HANDLE llvm_thread;
+	gboolean llvm_res;
+	/* Whenever llvm_thread already assembled llvm_sfile */
+	gboolean llvm_assembled;
 	GSList *cie_program;
 	GHashTable *unwind_info_offsets;
 	GPtrArray *unwind_ops;
@@ -253,9 +270,22 @@ typedef struct {
 #define mono_acfg_lock(acfg) mono_mutex_lock (&((acfg)->mutex))
 #define mono_acfg_unlock(acfg) mono_mutex_unlock (&((acfg)->mutex))
 
+/*
+ * A part of the .s file, emitted by one of the threads in emit_code_fragments ().
+ */
+typedef struct {
+	/* The range of acfg->method_order emitted into this fragment */
+	int start, end;
+	FILE *fp;
+	MonoImageWriter *w;
+} EmitFragment;
+
 /* This points to the current acfg in LLVM mode */
 static MonoAotCompile *llvm_acfg;
 
+/* The EmitFragment the current thread emits into */
+static MonoNativeTlsKey emit_fragment_id;
+
 #ifdef HAVE_ARRAY_ELEM_INIT
 #define MSGSTRFIELD(line) MSGSTRFIELD1(line)
 #define MSGSTRFIELD1(line) str##line
@@ -331,69 +361,104 @@ aot_printerrf (MonoAotCompile *acfg, const gchar *format, ...)
 	va_end (args);
 }
 
+/*
+ * get_writer:
+ *
+ *   Return the image writer the current thread emits into. This is acfg->w,
+ * except on the threads emitting fragments in emit_code_fragments ().
+ */
+static inline MonoImageWriter*
+get_writer (MonoAotCompile *acfg)
+{
+	if (G_UNLIKELY (acfg->emit_fragments)) {
+		EmitFragment *frag = mono_native_tls_get_value (emit_fragment_id);
+
+		if (frag)
+			return frag->w;
+	}
+	return acfg->w;
+}
+
+/*
+ * get_fp:
+ *
+ *   Return the file the current thread emits into, see get_writer ().
+ */
+static inline FILE*
+get_fp (MonoAotCompile *acfg)
+{
+	if (G_UNLIKELY (acfg->emit_fragments)) {
+		EmitFragment *frag = mono_native_tls_get_value (emit_fragment_id);
+
+		if (frag)
+			return frag->fp;
+	}
+	return acfg->fp;
+}
+
 /* Wrappers around the image writer functions */
 
 static inline void
 emit_section_change (MonoAotCompile *acfg, const char *section_name, int subsection_index)
 {
-	img_writer_emit_section_change (acfg->w, section_name, subsection_index);
+	img_writer_emit_section_change (get_writer (acfg), section_name, subsection_index);
 }
 
 static inline void
 emit_push_section (MonoAotCompile *acfg, const char *section_name, int subsection)
 {
-	img_writer_emit_push_section (acfg->w, section_name, subsection);
+	img_writer_emit_push_section (get_writer (acfg), section_name, subsection);
 }
 
 static inline void
 emit_pop_section (MonoAotCompile *acfg)
 {
-	img_writer_emit_pop_section (acfg->w);
+	img_writer_emit_pop_section (get_writer (acfg));
 }
 
 static inline void
 emit_local_symbol (MonoAotCompile *acfg, const char *name, const char *end_label, gboolean func) 
 { 
-	img_writer_emit_local_symbol (acfg->w, name, end_label, func); 
+	img_writer_emit_local_symbol (get_writer (acfg), name, end_label, func); 
 }
 
 static inline void
 emit_label (MonoAotCompile *acfg, const char *name) 
 { 
-	img_writer_emit_label (acfg->w, name); 
+	img_writer_emit_label (get_writer (acfg), name); 
 }
 
 static inline void
 emit_bytes (MonoAotCompile *acfg, const guint8* buf, int size) 
 { 
-	img_writer_emit_bytes (acfg->w, buf, size); 
+	img_writer_emit_bytes (get_writer (acfg), buf, size); 
 }
 
 static inline void
 emit_string (MonoAotCompile *acfg, const char *value) 
 { 
-	img_writer_emit_string (acfg->w, value); 
+	img_writer_emit_string (get_writer (acfg), value); 
 }
 
 static inline void
 emit_line (MonoAotCompile *acfg) 
 { 
-	img_writer_emit_line (acfg->w); 
+	img_writer_emit_line (get_writer (acfg)); 
 }
 
 static inline void
 emit_alignment (MonoAotCompile *acfg, int size)
 { 
-	img_writer_emit_alignment (acfg->w, size);
+	img_writer_emit_alignment (get_writer (acfg), size);
 }
 
 static inline void
 emit_alignment_code (MonoAotCompile *acfg, int size)
 {
 	if (acfg->align_pad_value)
-		img_writer_emit_alignment_fill (acfg->w, size, acfg->align_pad_value);
+		img_writer_emit_alignment_fill (get_writer (acfg), size, acfg->align_pad_value);
 	else
-		img_writer_emit_alignment (acfg->w, size);
+		img_writer_emit_alignment (get_writer (acfg), size);
 }
 
 static inline void
@@ -420,13 +485,13 @@ emit_padding (MonoAotCompile *acfg, int size)
 static inline void
 emit_pointer_unaligned (MonoAotCompile *acfg, const char *target) 
 { 
-	img_writer_emit_pointer_unaligned (acfg->w, target); 
+	img_writer_emit_pointer_unaligned (get_writer (acfg), target); 
 }
 
 static inline void
 emit_pointer (MonoAotCompile *acfg, const char *target) 
 { 
-	img_writer_emit_pointer (acfg->w, target); 
+	img_writer_emit_pointer (get_writer (acfg), target); 
 }
 
 static inline void
@@ -434,55 +499,55 @@ emit_pointer_2 (MonoAotCompile *acfg, const char *prefix, const char *target)
 { 
 	if (prefix [0] != '\0') {
 		char *s = g_strdup_printf ("%s%s", prefix, target);
-		img_writer_emit_pointer (acfg->w, s);
+		img_writer_emit_pointer (get_writer (acfg), s);
 		g_free (s);
 	} else {
-		img_writer_emit_pointer (acfg->w, target);
+		img_writer_emit_pointer (get_writer (acfg), target);
 	}
 }
 
 static inline void
 emit_int16 (MonoAotCompile *acfg, int value) 
 { 
-	img_writer_emit_int16 (acfg->w, value); 
+	img_writer_emit_int16 (get_writer (acfg), value); 
 }
 
 static inline void
 emit_int32 (MonoAotCompile *acfg, int value) 
 { 
-	img_writer_emit_int32 (acfg->w, value); 
+	img_writer_emit_int32 (get_writer (acfg), value); 
 }
 
 static inline void
 emit_symbol_diff (MonoAotCompile *acfg, const char *end, const char* start, int offset) 
 { 
-	img_writer_emit_symbol_diff (acfg->w, end, start, offset); 
+	img_writer_emit_symbol_diff (get_writer (acfg), end, start, offset); 
 }
 
 static inline void
 emit_zero_bytes (MonoAotCompile *acfg, int num) 
 { 
-	img_writer_emit_zero_bytes (acfg->w, num); 
+	img_writer_emit_zero_bytes (get_writer (acfg), num); 
 }
 
 static inline void
 emit_byte (MonoAotCompile *acfg, guint8 val) 
 { 
-	img_writer_emit_byte (acfg->w, val); 
+	img_writer_emit_byte (get_writer (acfg), val); 
 }
 
 #ifdef __native_client_codegen__
 static inline void
 emit_nacl_call_alignment (MonoAotCompile *acfg)
 {
-	img_writer_emit_nacl_call_alignment (acfg->w);
+	img_writer_emit_nacl_call_alignment (get_writer (acfg));
 }
 #endif
 
 static G_GNUC_UNUSED void
 emit_global_inner (MonoAotCompile *acfg, const char *name, gboolean func)
 {
-	img_writer_emit_global (acfg->w, name, func);
+	img_writer_emit_global (get_writer (acfg), name, func);
 }
 
 static void
@@ -490,28 +555,28 @@ emit_global (MonoAotCompile *acfg, const char *name, gboolean func)
 {
 	if (acfg->aot_opts.no_dlsym) {
 		g_ptr_array_add (acfg->globals, g_strdup (name));
-		img_writer_emit_local_symbol (acfg->w, name, NULL, func);
+		img_writer_emit_local_symbol (get_writer (acfg), name, NULL, func);
 	} else {
-		img_writer_emit_global (acfg->w, name, func);
+		img_writer_emit_global (get_writer (acfg), name, func);
 	}
 }
 
 static void
 emit_symbol_size (MonoAotCompile *acfg, const char *name, const char *end_label)
 {
-	img_writer_emit_symbol_size (acfg->w, name, end_label);
+	img_writer_emit_symbol_size (get_writer (acfg), name, end_label);
 }
 
 static void
 emit_string_symbol (MonoAotCompile *acfg, const char *name, const char *value)
 {
-	img_writer_emit_section_change (acfg->w, RODATA_SECT, 1);
+	img_writer_emit_section_change (get_writer (acfg), RODATA_SECT, 1);
 #ifdef TARGET_MACH
 	/* On apple, all symbols need to be aligned to avoid warnings from ld */
 	emit_alignment (acfg, 4);
 #endif
-	img_writer_emit_label (acfg->w, name);
-	img_writer_emit_string (acfg->w, value);
+	img_writer_emit_label (get_writer (acfg), name);
+	img_writer_emit_string (get_writer (acfg), value);
 }
 
 static G_GNUC_UNUSED void
@@ -604,21 +669,21 @@ encode_sleb128 (gint32 value, guint8 *buf, guint8 **endbuf)
 static void
 emit_unset_mode (MonoAotCompile *acfg)
 {
-	img_writer_emit_unset_mode (acfg->w);
+	img_writer_emit_unset_mode (get_writer (acfg));
 }
 
 static G_GNUC_UNUSED void
 emit_set_thumb_mode (MonoAotCompile *acfg)
 {
 	emit_unset_mode (acfg);
-	fprintf (acfg->fp, ".code 16\n");
+	fprintf (get_fp (acfg), ".code 16\n");
 }
 
 static G_GNUC_UNUSED void
 emit_set_arm_mode (MonoAotCompile *acfg)
 {
 	emit_unset_mode (acfg);
-	fprintf (acfg->fp, ".code 32\n");
+	fprintf (get_fp (acfg), ".code 32\n");
 }
 
 static inline void
@@ -630,7 +695,7 @@ emit_code_bytes (MonoAotCompile *acfg, const guint8* buf, int size)
 	g_assert (size % 4 == 0);
 	emit_unset_mode (acfg);
 	for (i = 0; i < size; i += 4)
-		fprintf (acfg->fp, "%s 0x%x\n", acfg->inst_directive, *(guint32*)(buf + i));
+		fprintf (get_fp (acfg), "%s 0x%x\n", acfg->inst_directive, *(guint32*)(buf + i));
 #else
 	emit_bytes (acfg, buf, size);
 #endif
@@ -796,7 +861,7 @@ arch_emit_direct_call (MonoAotCompile *acfg, const char *target, gboolean extern
 	/* Need to make sure this is exactly 5 bytes long */
 	if (!acfg->use_bin_writer) {
 		emit_unset_mode (acfg);
-		fprintf (acfg->fp, "call %s\n", target);
+		fprintf (get_fp (acfg), "call %s\n", target);
 	} else {
 		emit_byte (acfg, '\xe8');
 		emit_symbol_diff (acfg, target, ".", -4);
@@ -810,14 +875,14 @@ arch_emit_direct_call (MonoAotCompile *acfg, const char *target, gboolean extern
 		code = buf;
 		ARM_BL (code, 0);
 
-		img_writer_emit_reloc (acfg->w, R_ARM_CALL, target, -8);
+		img_writer_emit_reloc (get_writer (acfg), R_ARM_CALL, target, -8);
 		emit_bytes (acfg, buf, 4);
 	} else {
 		emit_unset_mode (acfg);
 		if (thumb)
-			fprintf (acfg->fp, "blx %s\n", target);
+			fprintf (get_fp (acfg), "blx %s\n", target);
 		else
-			fprintf (acfg->fp, "bl %s\n", target);
+			fprintf (get_fp (acfg), "bl %s\n", target);
 	}
 	*call_size = 4;
 #elif defined(TARGET_ARM64)
@@ -827,7 +892,7 @@ arch_emit_direct_call (MonoAotCompile *acfg, const char *target, gboolean extern
 		g_assert_not_reached ();
 	} else {
 		emit_unset_mode (acfg);
-		fprintf (acfg->fp, "bl %s\n", target);
+		fprintf (get_fp (acfg), "bl %s\n", target);
 		*call_size = 4;
 	}
 #else
@@ -886,19 +951,19 @@ arch_emit_got_offset (MonoAotCompile *acfg, guint8 *code, int *code_size)
 	 * unsupported relocations. So we store the got address into the .Lgot_addr
 	 * symbol which is in the text segment, compute its address, and load it.
 	 */
-	fprintf (acfg->fp, ".L%d:\n", acfg->label_generator);
-	fprintf (acfg->fp, "lis 0, (.Lgot_addr + 4 - .L%d)@h\n", acfg->label_generator);
-	fprintf (acfg->fp, "ori 0, 0, (.Lgot_addr + 4 - .L%d)@l\n", acfg->label_generator);
-	fprintf (acfg->fp, "add 30, 30, 0\n");
-	fprintf (acfg->fp, "%s 30, 0(30)\n", PPC_LD_OP);
+	fprintf (get_fp (acfg), ".L%d:\n", acfg->label_generator);
+	fprintf (get_fp (acfg), "lis 0, (.Lgot_addr + 4 - .L%d)@h\n", acfg->label_generator);
+	fprintf (get_fp (acfg), "ori 0, 0, (.Lgot_addr + 4 - .L%d)@l\n", acfg->label_generator);
+	fprintf (get_fp (acfg), "add 30, 30, 0\n");
+	fprintf (get_fp (acfg), "%s 30, 0(30)\n", PPC_LD_OP);
 	acfg->label_generator ++;
 	*code_size = 16;
 #elif defined(TARGET_POWERPC)
 	g_assert (!acfg->use_bin_writer);
 	emit_unset_mode (acfg);
-	fprintf (acfg->fp, ".L%d:\n", acfg->label_generator);
-	fprintf (acfg->fp, "lis 0, (%s + 4 - .L%d)@h\n", acfg->got_symbol, acfg->label_generator);
-	fprintf (acfg->fp, "ori 0, 0, (%s + 4 - .L%d)@l\n", acfg->got_symbol, acfg->label_generator);
+	fprintf (get_fp (acfg), ".L%d:\n", acfg->label_generator);
+	fprintf (get_fp (acfg), "lis 0, (%s + 4 - .L%d)@h\n", acfg->got_symbol, acfg->label_generator);
+	fprintf (get_fp (acfg), "ori 0, 0, (%s + 4 - .L%d)@l\n", acfg->got_symbol, acfg->label_generator);
 	acfg->label_generator ++;
 	*code_size = 8;
 #else
@@ -936,7 +1001,7 @@ arch_emit_got_access (MonoAotCompile *acfg, guint8 *code, int got_slot, int *cod
 		dreg = ((code [2] >> 3) & 0x7) + (rex_r ? 8 : 0);
 
 		emit_unset_mode (acfg);
-		fprintf (acfg->fp, "mov %s+%d(%%rip), %s\n", acfg->got_symbol, (unsigned int) ((got_slot * sizeof (gpointer))), mono_arch_regname (dreg));
+		fprintf (get_fp (acfg), "mov %s+%d(%%rip), %s\n", acfg->got_symbol, (unsigned int) ((got_slot * sizeof (gpointer))), mono_arch_regname (dreg));
 		*code_size = 7;
 	} else {
 		emit_bytes (acfg, code, mono_arch_get_patch_offset (code));
@@ -994,8 +1059,8 @@ arch_emit_objc_selector_ref (MonoAotCompile *acfg, guint8 *code, int index, int
 	sprintf (symbol2, "L_OBJC_SELECTOR_REFERENCES_%d", index);
 
 	emit_label (acfg, symbol1);
-	img_writer_emit_unset_mode (acfg->w);
-	fprintf (acfg->fp, ".long %s-(%s+12)", symbol2, symbol1);
+	img_writer_emit_unset_mode (get_writer (acfg));
+	fprintf (get_fp (acfg), ".long %s-(%s+12)", symbol2, symbol1);
 
 	*code_size = 12;
 #elif defined(TARGET_ARM64)
@@ -1044,7 +1109,7 @@ arch_emit_plt_entry (MonoAotCompile *acfg, int index)
 			emit_symbol_diff (acfg, acfg->got_symbol, ".", ((acfg->plt_got_offset_base + index) * sizeof (gpointer)) -4);
 		} else {
 			emit_unset_mode (acfg);
-			fprintf (acfg->fp, "jmp *%s+%d(%%rip)\n", acfg->got_symbol, (int)((acfg->plt_got_offset_base + index) * sizeof (gpointer)));
+			fprintf (get_fp (acfg), "jmp *%s+%d(%%rip)\n", acfg->got_symbol, (int)((acfg->plt_got_offset_base + index) * sizeof (gpointer)));
 		}
 		/* Used by mono_aot_get_plt_info_offset */
 		emit_int32 (acfg, acfg->plt_got_info_offsets [index]);
@@ -1089,16 +1154,16 @@ arch_emit_plt_entry (MonoAotCompile *acfg, int index)
 		/* The GOT address is guaranteed to be in r30 by OP_LOAD_GOTADDR */
 		g_assert (!acfg->use_bin_writer);
 		emit_unset_mode (acfg);
-		fprintf (acfg->fp, "lis 11, %d@h\n", offset);
-		fprintf (acfg->fp, "ori 11, 11, %d@l\n", offset);
-		fprintf (acfg->fp, "add 11, 11, 30\n");
-		fprintf (acfg->fp, "%s 11, 0(11)\n", PPC_LD_OP);
+		fprintf (get_fp (acfg), "lis 11, %d@h\n", offset);
+		fprintf (get_fp (acfg), "ori 11, 11, %d@l\n", offset);
+		fprintf (get_fp (acfg), "add 11, 11, 30\n");
+		fprintf (get_fp (acfg), "%s 11, 0(11)\n", PPC_LD_OP);
 #ifdef PPC_USES_FUNCTION_DESCRIPTOR
-		fprintf (acfg->fp, "%s 2, %d(11)\n", PPC_LD_OP, (int)sizeof (gpointer));
-		fprintf (acfg->fp, "%s 11, 0(11)\n", PPC_LD_OP);
+		fprintf (get_fp (acfg), "%s 2, %d(11)\n", PPC_LD_OP, (int)sizeof (gpointer));
+		fprintf (get_fp (acfg), "%s 11, 0(11)\n", PPC_LD_OP);
 #endif
-		fprintf (acfg->fp, "mtctr 11\n");
-		fprintf (acfg->fp, "bctr\n");
+		fprintf (get_fp (acfg), "mtctr 11\n");
+		fprintf (get_fp (acfg), "bctr\n");
 		emit_int32 (acfg, acfg->plt_got_info_offsets [index]);
 #else
 		g_assert_not_reached ();
@@ -1112,27 +1177,27 @@ arch_emit_llvm_plt_entry (MonoAotCompile *acfg, int index)
 #if 0
 	/* LLVM calls the PLT entries using bl, so emit a stub */
 	/* FIXME: Too much overhead on every call */
-	fprintf (acfg->fp, ".thumb_func\n");
-	fprintf (acfg->fp, "bx pc\n");
-	fprintf (acfg->fp, "nop\n");
-	fprintf (acfg->fp, ".arm\n");
+	fprintf (get_fp (acfg), ".thumb_func\n");
+	fprintf (get_fp (acfg), "bx pc\n");
+	fprintf (get_fp (acfg), "nop\n");
+	fprintf (get_fp (acfg), ".arm\n");
 #endif
 	/* LLVM calls the PLT entries using bl, so these have to be thumb2 */
 	/* The caller already transitioned to thumb */
 	/* The code below should be 12 bytes long */
 	/* clang has trouble encoding these instructions, so emit the binary */
 #if 0
-	fprintf (acfg->fp, "ldr ip, [pc, #8]\n");
+	fprintf (get_fp (acfg), "ldr ip, [pc, #8]\n");
 	/* thumb can't encode ld pc, [pc, ip] */
-	fprintf (acfg->fp, "add ip, pc, ip\n");
-	fprintf (acfg->fp, "ldr ip, [ip, #0]\n");
-	fprintf (acfg->fp, "bx ip\n");
+	fprintf (get_fp (acfg), "add ip, pc, ip\n");
+	fprintf (get_fp (acfg), "ldr ip, [ip, #0]\n");
+	fprintf (get_fp (acfg), "bx ip\n");
 #endif
 	emit_set_thumb_mode (acfg);
-	fprintf (acfg->fp, ".4byte 0xc008f8df\n");
-	fprintf (acfg->fp, ".2byte 0x44fc\n");
-	fprintf (acfg->fp, ".4byte 0xc000f8dc\n");
-	fprintf (acfg->fp, ".2byte 0x4760\n");
+	fprintf (get_fp (acfg), ".4byte 0xc008f8df\n");
+	fprintf (get_fp (acfg), ".2byte 0x44fc\n");
+	fprintf (get_fp (acfg), ".4byte 0xc000f8dc\n");
+	fprintf (get_fp (acfg), ".2byte 0x4760\n");
 	emit_symbol_diff (acfg, acfg->got_symbol, ".", ((acfg->plt_got_offset_base + index) * sizeof (gpointer)) + 4);
 	emit_int32 (acfg, acfg->plt_got_info_offsets [index]);
 	emit_unset_mode (acfg);
@@ -1356,7 +1421,7 @@ arch_emit_specific_trampoline (MonoAotCompile *acfg, int offset, int *tramp_size
 	/* call *<offset>(%rip) */
 	if (acfg->llvm_separate) {
 		emit_unset_mode (acfg);
-		fprintf (acfg->fp, "call *%s+%d(%%rip)\n", acfg->got_symbol, (int)(offset * sizeof (gpointer)));
+		fprintf (get_fp (acfg), "call *%s+%d(%%rip)\n", acfg->got_symbol, (int)(offset * sizeof (gpointer)));
 		emit_zero_bytes (acfg, 2);
 	} else {
 		emit_byte (acfg, '\x41');
@@ -1461,22 +1526,22 @@ arch_emit_specific_trampoline (MonoAotCompile *acfg, int offset, int *tramp_size
 	 */
 	emit_unset_mode (acfg);
 	/* Load mscorlib got address */
-	fprintf (acfg->fp, "%s 0, %d(30)\n", PPC_LD_OP, (int)sizeof (gpointer));
+	fprintf (get_fp (acfg), "%s 0, %d(30)\n", PPC_LD_OP, (int)sizeof (gpointer));
 	/* Load generic trampoline address */
-	fprintf (acfg->fp, "lis 11, %d@h\n", (int)(offset * sizeof (gpointer)));
-	fprintf (acfg->fp, "ori 11, 11, %d@l\n", (int)(offset * sizeof (gpointer)));
-	fprintf (acfg->fp, "%s 11, 11, 0\n", PPC_LDX_OP);
+	fprintf (get_fp (acfg), "lis 11, %d@h\n", (int)(offset * sizeof (gpointer)));
+	fprintf (get_fp (acfg), "ori 11, 11, %d@l\n", (int)(offset * sizeof (gpointer)));
+	fprintf (get_fp (acfg), "%s 11, 11, 0\n", PPC_LDX_OP);
 #ifdef PPC_USES_FUNCTION_DESCRIPTOR
-	fprintf (acfg->fp, "%s 11, 0(11)\n", PPC_LD_OP);
+	fprintf (get_fp (acfg), "%s 11, 0(11)\n", PPC_LD_OP);
 #endif
-	fprintf (acfg->fp, "mtctr 11\n");
+	fprintf (get_fp (acfg), "mtctr 11\n");
 	/* Load trampoline argument */
 	/* On ppc, we pass it normally to the generic trampoline */
-	fprintf (acfg->fp, "lis 11, %d@h\n", (int)((offset + 1) * sizeof (gpointer)));
-	fprintf (acfg->fp, "ori 11, 11, %d@l\n", (int)((offset + 1) * sizeof (gpointer)));
-	fprintf (acfg->fp, "%s 0, 11, 0\n", PPC_LDX_OP);
+	fprintf (get_fp (acfg), "lis 11, %d@h\n", (int)((offset + 1) * sizeof (gpointer)));
+	fprintf (get_fp (acfg), "ori 11, 11, %d@l\n", (int)((offset + 1) * sizeof (gpointer)));
+	fprintf (get_fp (acfg), "%s 0, 11, 0\n", PPC_LDX_OP);
 	/* Branch to generic trampoline */
-	fprintf (acfg->fp, "bctr\n");
+	fprintf (get_fp (acfg), "bctr\n");
 
 #ifdef PPC_USES_FUNCTION_DESCRIPTOR
 	*tramp_size = 10 * 4;
@@ -1547,7 +1612,7 @@ arch_emit_unbox_trampoline (MonoAotCompile *acfg, MonoCompile *cfg, MonoMethod *
 	/* jump <method> */
 	if (acfg->llvm_separate) {
 		emit_unset_mode (acfg);
-		fprintf (acfg->fp, "jmp %s\n", call_target);
+		fprintf (get_fp (acfg), "jmp %s\n", call_target);
 	} else {
 		emit_byte (acfg, '\xe9');
 		emit_symbol_diff (acfg, call_target, ".", -4);
@@ -1571,10 +1636,10 @@ arch_emit_unbox_trampoline (MonoAotCompile *acfg, MonoCompile *cfg, MonoMethod *
 	guint8 *code;
 
 	if (acfg->thumb_mixed && cfg->compile_llvm) {
-		fprintf (acfg->fp, "add r0, r0, #%d\n", (int)sizeof (MonoObject));
-		fprintf (acfg->fp, "b %s\n", call_target);
-		fprintf (acfg->fp, ".arm\n");
-		fprintf (acfg->fp, ".align 2\n");
+		fprintf (get_fp (acfg), "add r0, r0, #%d\n", (int)sizeof (MonoObject));
+		fprintf (get_fp (acfg), "b %s\n", call_target);
+		fprintf (get_fp (acfg), ".arm\n");
+		fprintf (get_fp (acfg), ".align 2\n");
 		return;
 	}
 
@@ -1591,13 +1656,13 @@ arch_emit_unbox_trampoline (MonoAotCompile *acfg, MonoCompile *cfg, MonoMethod *
 		code = buf;
 		ARM_B (code, 0);
 
-		img_writer_emit_reloc (acfg->w, R_ARM_JUMP24, call_target, -8);
+		img_writer_emit_reloc (get_writer (acfg), R_ARM_JUMP24, call_target, -8);
 		emit_bytes (acfg, buf, 4);
 	} else {
 		if (acfg->thumb_mixed && cfg->compile_llvm)
-			fprintf (acfg->fp, "\n\tbx %s\n", call_target);
+			fprintf (get_fp (acfg), "\n\tbx %s\n", call_target);
 		else
-			fprintf (acfg->fp, "\n\tb %s\n", call_target);
+			fprintf (get_fp (acfg), "\n\tb %s\n", call_target);
 	}
 #elif defined(TARGET_ARM64)
 	arm64_emit_unbox_trampoline (acfg, cfg, method, call_target);
@@ -1606,8 +1671,8 @@ arch_emit_unbox_trampoline (MonoAotCompile *acfg, MonoCompile *cfg, MonoMethod *
 
 	g_assert (!acfg->use_bin_writer);
 
-	fprintf (acfg->fp, "\n\taddi %d, %d, %d\n", this_pos, this_pos, (int)sizeof (MonoObject));
-	fprintf (acfg->fp, "\n\tb %s\n", call_target);
+	fprintf (get_fp (acfg), "\n\taddi %d, %d, %d\n", this_pos, this_pos, (int)sizeof (MonoObject));
+	fprintf (get_fp (acfg), "\n\tb %s\n", call_target);
 #else
 	g_assert_not_reached ();
 #endif
@@ -1633,8 +1698,8 @@ arch_emit_static_rgctx_trampoline (MonoAotCompile *acfg, int offset, int *tramp_
 
 	if (acfg->llvm_separate) {
 		emit_unset_mode (acfg);
-		fprintf (acfg->fp, "mov %s+%d(%%rip), %%r10\n", acfg->got_symbol, (int)(offset * sizeof (gpointer)));
-		fprintf (acfg->fp, "jmp *%s+%d(%%rip)\n", acfg->got_symbol, (int)((offset + 1) * sizeof (gpointer)));
+		fprintf (get_fp (acfg), "mov %s+%d(%%rip), %%r10\n", acfg->got_symbol, (int)(offset * sizeof (gpointer)));
+		fprintf (get_fp (acfg), "jmp *%s+%d(%%rip)\n", acfg->got_symbol, (int)((offset + 1) * sizeof (gpointer)));
 	} else {
 		/* mov <OFFSET>(%rip), %r10 */
 		emit_byte (acfg, '\x4d');
@@ -1711,22 +1776,22 @@ arch_emit_static_rgctx_trampoline (MonoAotCompile *acfg, int offset, int *tramp_
 	 */
 	emit_unset_mode (acfg);
 	/* Load mscorlib got address */
-	fprintf (acfg->fp, "%s 0, %d(30)\n", PPC_LD_OP, (int)sizeof (gpointer));
+	fprintf (get_fp (acfg), "%s 0, %d(30)\n", PPC_LD_OP, (int)sizeof (gpointer));
 	/* Load rgctx */
-	fprintf (acfg->fp, "lis 11, %d@h\n", (int)(offset * sizeof (gpointer)));
-	fprintf (acfg->fp, "ori 11, 11, %d@l\n", (int)(offset * sizeof (gpointer)));
-	fprintf (acfg->fp, "%s %d, 11, 0\n", PPC_LDX_OP, MONO_ARCH_RGCTX_REG);
+	fprintf (get_fp (acfg), "lis 11, %d@h\n", (int)(offset * sizeof (gpointer)));
+	fprintf (get_fp (acfg), "ori 11, 11, %d@l\n", (int)(offset * sizeof (gpointer)));
+	fprintf (get_fp (acfg), "%s %d, 11, 0\n", PPC_LDX_OP, MONO_ARCH_RGCTX_REG);
 	/* Load target address */
-	fprintf (acfg->fp, "lis 11, %d@h\n", (int)((offset + 1) * sizeof (gpointer)));
-	fprintf (acfg->fp, "ori 11, 11, %d@l\n", (int)((offset + 1) * sizeof (gpointer)));
-	fprintf (acfg->fp, "%s 11, 11, 0\n", PPC_LDX_OP);
+	fprintf (get_fp (acfg), "lis 11, %d@h\n", (int)((offset + 1) * sizeof (gpointer)));
+	fprintf (get_fp (acfg), "ori 11, 11, %d@l\n", (int)((offset + 1) * sizeof (gpointer)));
+	fprintf (get_fp (acfg), "%s 11, 11, 0\n", PPC_LDX_OP);
 #ifdef PPC_USES_FUNCTION_DESCRIPTOR
-	fprintf (acfg->fp, "%s 2, %d(11)\n", PPC_LD_OP, (int)sizeof (gpointer));
-	fprintf (acfg->fp, "%s 11, 0(11)\n", PPC_LD_OP);
+	fprintf (get_fp (acfg), "%s 2, %d(11)\n", PPC_LD_OP, (int)sizeof (gpointer));
+	fprintf (get_fp (acfg), "%s 11, 0(11)\n", PPC_LD_OP);
 #endif
-	fprintf (acfg->fp, "mtctr 11\n");
+	fprintf (get_fp (acfg), "mtctr 11\n");
 	/* Branch to the target address */
-	fprintf (acfg->fp, "bctr\n");
+	fprintf (get_fp (acfg), "bctr\n");
 
 #ifdef PPC_USES_FUNCTION_DESCRIPTOR
 	*tramp_size = 11 * 4;
@@ -1808,7 +1873,7 @@ arch_emit_imt_thunk (MonoAotCompile *acfg, int offset, int *tramp_size)
 
 	if (acfg->llvm_separate) {
 		emit_unset_mode (acfg);
-		fprintf (acfg->fp, "mov %s+%d(%%rip), %s\n", acfg->got_symbol, (int)(offset * sizeof (gpointer)), mono_arch_regname (MONO_ARCH_IMT_SCRATCH_REG));
+		fprintf (get_fp (acfg), "mov %s+%d(%%rip), %s\n", acfg->got_symbol, (int)(offset * sizeof (gpointer)), mono_arch_regname (MONO_ARCH_IMT_SCRATCH_REG));
 	}
 
 	labels [0] = code;
@@ -2135,7 +2200,7 @@ arch_emit_autoreg (MonoAotCompile *acfg, char *symbol)
 	/* Based on code generated by gcc */
 	emit_unset_mode (acfg);
 
-	fprintf (acfg->fp,
+	fprintf (get_fp (acfg),
 #if defined(_MSC_VER) || defined(MONO_CROSS_COMPILE) 
 			 ".section	.ctors,\"aw\",@progbits\n"
 			 ".align 2\n"
@@ -2167,7 +2232,7 @@ arch_emit_autoreg (MonoAotCompile *acfg, char *symbol)
 #endif
 
 
-	fprintf (acfg->fp,
+	fprintf (get_fp (acfg),
 			 "stdu 1,-128(1)\n"
 			 "mflr 0\n"
 			 "std 31,120(1)\n"
@@ -2185,10 +2250,10 @@ arch_emit_autoreg (MonoAotCompile *acfg, char *symbol)
 			 "blr\n"
 			 );
 #if defined(_MSC_VER) || defined(MONO_CROSS_COMPILE) 
-		fprintf (acfg->fp,
+		fprintf (get_fp (acfg),
 			 ".size	.%s,.-.%s\n", symbol, symbol);
 #else
-	fprintf (acfg->fp,
+	fprintf (get_fp (acfg),
 			 ".size	.%1$s,.-.%1$s\n", symbol);
 #endif
 #else
@@ -4625,7 +4690,7 @@ get_file_index (MonoAotCompile *acfg, const char *source_file)
 		findex = g_hash_table_size (acfg->dwarf_ln_filenames) + 1;
 		g_hash_table_insert (acfg->dwarf_ln_filenames, g_strdup (source_file), GINT_TO_POINTER (findex));
 		emit_unset_mode (acfg);
-		fprintf (acfg->fp, ".file %d \"%s\"\n", findex, mono_dwarf_escape_path (source_file));
+		fprintf (get_fp (acfg), ".file %d \"%s\"\n", findex, mono_dwarf_escape_path (source_file));
 	}
 	return findex;
 }
@@ -4671,7 +4736,7 @@ emit_and_reloc_code (MonoAotCompile *acfg, MonoMethod *method, guint8 *code, gui
 		if (!locs) {
 			int findex = get_file_index (acfg, "<unknown>");
 			emit_unset_mode (acfg);
-			fprintf (acfg->fp, ".loc %d %d 0\n", findex, 1);
+			fprintf (get_fp (acfg), ".loc %d %d 0\n", findex, 1);
 		}
 	}
 
@@ -4696,7 +4761,7 @@ emit_and_reloc_code (MonoAotCompile *acfg, MonoMethod *method, guint8 *code, gui
 
 			findex = get_file_index (acfg, loc->source_file);
 			emit_unset_mode (acfg);
-			fprintf (acfg->fp, ".loc %d %d 0\n", findex, loc->row);
+			fprintf (get_fp (acfg), ".loc %d %d 0\n", findex, loc->row);
 			mono_debug_symfile_free_location (loc);
 		}
 
@@ -4705,6 +4770,8 @@ emit_and_reloc_code (MonoAotCompile *acfg, MonoMethod *method, guint8 *code, gui
 		if (patch_info && (patch_info->ip.i == i) && (pindex < patches->len)) {
 			start_index = pindex;
 
+			/* This can allocate GOT slots and PLT entries, see emit_code_fragments () */
+			mono_acfg_lock (acfg);
 			switch (patch_info->type) {
 			case MONO_PATCH_INFO_NONE:
 				break;
@@ -4827,6 +4894,7 @@ emit_and_reloc_code (MonoAotCompile *acfg, MonoMethod *method, guint8 *code, gui
 				skip = TRUE;
 			}
 			}
+			mono_acfg_unlock (acfg);
 		}
 #endif /* MONO_ARCH_AOT_SUPPORTED */
 
@@ -4983,7 +5051,7 @@ emit_method_code (MonoAotCompile *acfg, MonoCompile *cfg)
 	emit_alignment_code (acfg, func_alignment);
 	
 	if (acfg->global_symbols && acfg->need_no_dead_strip)
-		fprintf (acfg->fp, "	.no_dead_strip %s\n", cfg->asm_symbol);
+		fprintf (get_fp (acfg), "	.no_dead_strip %s\n", cfg->asm_symbol);
 	
 	emit_label (acfg, cfg->asm_symbol);
 
@@ -4994,10 +5062,12 @@ emit_method_code (MonoAotCompile *acfg, MonoCompile *cfg)
 		 *   yet supported.
 		 * - it allows the setting of breakpoints of aot-ed methods.
 		 */
+		mono_acfg_lock (acfg);
 		debug_sym = get_debug_sym (method, "", acfg->method_label_hash);
+		mono_acfg_unlock (acfg);
 
 		if (acfg->need_no_dead_strip)
-			fprintf (acfg->fp, "	.no_dead_strip %s\n", debug_sym);
+			fprintf (get_fp (acfg), "	.no_dead_strip %s\n", debug_sym);
 		emit_local_symbol (acfg, debug_sym, symbol, TRUE);
 		emit_label (acfg, debug_sym);
 	}
@@ -5012,7 +5082,7 @@ emit_method_code (MonoAotCompile *acfg, MonoCompile *cfg)
 	if (cfg->verbose_level > 0)
 		g_print ("Method %s emitted as %s\n", mono_method_full_name (method, TRUE), cfg->asm_symbol);
 
-	acfg->stats.code_size += cfg->code_len;
+	InterlockedAdd (&acfg->stats.code_size, cfg->code_len);
 
 	acfg->cfgs [method_index]->got_offset = acfg->got_offset;
 
@@ -5841,14 +5911,14 @@ emit_plt (MonoAotCompile *acfg)
 			emit_label (acfg, plt_entry->llvm_symbol);
 			if (acfg->llvm_separate) {
 				emit_global (acfg, plt_entry->llvm_symbol, TRUE);
-				fprintf (acfg->fp, ".private_extern %s\n", plt_entry->llvm_symbol);
+				fprintf (get_fp (acfg), ".private_extern %s\n", plt_entry->llvm_symbol);
 			}
 		}
 
 		if (debug_sym) {
 			if (acfg->need_no_dead_strip) {
 				emit_unset_mode (acfg);
-				fprintf (acfg->fp, "	.no_dead_strip %s\n", debug_sym);
+				fprintf (get_fp (acfg), "	.no_dead_strip %s\n", debug_sym);
 			}
 			emit_local_symbol (acfg, debug_sym, NULL, TRUE);
 			emit_label (acfg, debug_sym);
@@ -5892,13 +5962,13 @@ emit_plt (MonoAotCompile *acfg)
 
 			if (debug_sym) {
 #if defined(TARGET_MACH)
-				fprintf (acfg->fp, "	.thumb_func %s\n", debug_sym);
-				fprintf (acfg->fp, "	.no_dead_strip %s\n", debug_sym);
+				fprintf (get_fp (acfg), "	.thumb_func %s\n", debug_sym);
+				fprintf (get_fp (acfg), "	.no_dead_strip %s\n", debug_sym);
 #endif
 				emit_local_symbol (acfg, debug_sym, NULL, TRUE);
 				emit_label (acfg, debug_sym);
 			}
-			fprintf (acfg->fp, "\n.thumb_func\n");
+			fprintf (get_fp (acfg), "\n.thumb_func\n");
 
 			emit_label (acfg, plt_entry->llvm_symbol);
 
@@ -6440,6 +6510,10 @@ mono_aot_parse_options (const char *aot_options, MonoAotOptions *opts)
 			opts->mtriple = g_strdup (arg + strlen ("mtriple="));
 		} else if (str_begins_with (arg, "llvm-path=")) {
 			opts->llvm_path = g_strdup (arg + strlen ("llvm-path="));
+		} else if (str_begins_with (arg, "pgo=")) {
+			opts->pgo_file = g_strdup (arg + strlen ("pgo="));
+		} else if (str_begins_with (arg, "methods-file=")) {
+			opts->methods_file = g_strdup (arg + strlen ("methods-file="));
 		} else if (!strcmp (arg, "llvm")) {
 			opts->llvm = TRUE;
 		} else if (str_begins_with (arg, "readonly-value=")) {
@@ -6477,6 +6551,8 @@ mono_aot_parse_options (const char *aot_options, MonoAotOptions *opts)
 			printf ("    print-skipped\n");
 			printf ("    no-instances\n");
 			printf ("    stats\n");
+			printf ("    pgo=\n");
+			printf ("    methods-file=\n");
 			printf ("    info\n");
 			printf ("    help/?\n");
 			exit (0);
@@ -6617,6 +6693,26 @@ can_encode_patch (MonoAotCompile *acfg, MonoJumpInfo *patch_info)
 	return TRUE;
 }
 
+/*
+ * is_listed_method:
+ *
+ *   Return whenever METHOD, or the method it wraps, is listed in the
+ * methods-file. Wrappers which are not specific to a method are always
+ * compiled.
+ */
+static gboolean
+is_listed_method (MonoAotCompile *acfg, MonoMethod *method)
+{
+	if (method->wrapper_type != MONO_WRAPPER_NONE) {
+		method = mono_marshal_method_from_wrapper (method);
+		if (!method)
+			return TRUE;
+	}
+	if (method->klass->image != acfg->image)
+		return TRUE;
+	return g_hash_table_lookup (acfg->method_tokens, GUINT_TO_POINTER (mono_method_get_token (method))) != NULL;
+}
+
 /*
  * compile_method:
  *
@@ -6636,6 +6732,12 @@ compile_method (MonoAotCompile *acfg, MonoMethod *method)
 	if (acfg->aot_opts.metadata_only)
 		return;
 
+	if (acfg->method_tokens && !is_listed_method (acfg, method)) {
+		if (acfg->aot_opts.print_skipped_methods)
+			printf ("Skip (not in the methods file): %s\n", mono_method_full_name (method, TRUE));
+		return;
+	}
+
 	mono_acfg_lock (acfg);
 	index = get_method_index (acfg, method);
 	mono_acfg_unlock (acfg);
@@ -6848,6 +6950,13 @@ compile_method (MonoAotCompile *acfg, MonoMethod *method)
 	if (!cfg->has_got_slots)
 		InterlockedIncrement (&acfg->stats.methods_without_got_slots);
 
+	if (cfg->stat_pgo_hot_inlined || cfg->stat_pgo_cold_not_inlined) {
+		InterlockedAdd (&acfg->stats.pgo_hot_inlined, cfg->stat_pgo_hot_inlined);
+		InterlockedAdd (&acfg->stats.pgo_hot_inlined_size, cfg->stat_pgo_hot_inlined_size);
+		InterlockedAdd (&acfg->stats.pgo_cold_not_inlined, cfg->stat_pgo_cold_not_inlined);
+		InterlockedAdd (&acfg->stats.pgo_cold_not_inlined_size, cfg->stat_pgo_cold_not_inlined_size);
+	}
+
 	/* 
 	 * FIXME: Instead of this mess, allocate the patches from the aot mempool.
 	 */
@@ -6942,90 +7051,55 @@ compile_method (MonoAotCompile *acfg, MonoMethod *method)
 	InterlockedIncrement (&acfg->stats.ccount);
 }
  
+/*
+ * compile_thread_main:
+ *
+ *   Compile methods from a list shared by all compile threads until it is
+ * exhausted. Taking the methods one at a time balances the load between the
+ * threads much better than giving each of them a fixed range, since the time
+ * it takes to compile a method varies a lot.
+ */
 static void
 compile_thread_main (gpointer *user_data)
 {
 	MonoDomain *domain = user_data [0];
 	MonoAotCompile *acfg = user_data [1];
-	GPtrArray *methods = user_data [2];
+	MonoMethod **methods = user_data [2];
+	int methods_len = GPOINTER_TO_INT (user_data [3]);
+	volatile gint32 *next_method = user_data [4];
 	int i;
 
 	mono_thread_attach (domain);
 
-	for (i = 0; i < methods->len; ++i)
-		compile_method (acfg, g_ptr_array_index (methods, i));
+	while ((i = InterlockedIncrement (next_method) - 1) < methods_len)
+		compile_method (acfg, methods [i]);
 }
 
 static void
 load_profile_files (MonoAotCompile *acfg)
 {
-	FILE *infile;
-	char *tmp;
-	int file_index, res, method_index, i;
-	char ver [256];
+	GPtrArray *methods;
+	int method_index, i, j;
 	guint32 token;
 	GList *unordered, *l;
 	gboolean found;
 
-	file_index = 0;
-	while (TRUE) {
-		tmp = g_strdup_printf ("%s/.mono/aot-profile-data/%s-%d", g_get_home_dir (), acfg->image->assembly_name, file_index);
-
-		if (!g_file_test (tmp, G_FILE_TEST_IS_REGULAR)) {
-			g_free (tmp);
-			break;
-		}
-
-		infile = fopen (tmp, "r");
-		g_assert (infile);
-
-		printf ("Using profile data file '%s'\n", tmp);
-		g_free (tmp);
-
-		file_index ++;
-
-		res = fscanf (infile, "%32s\n", ver);
-		if ((res != 1) || strcmp (ver, "#VER:2") != 0) {
-			printf ("Profile file has wrong version or invalid.\n");
-			fclose (infile);
-			continue;
-		}
-
-		while (TRUE) {
-			char name [1024];
-			MonoMethodDesc *desc;
-			MonoMethod *method;
+	methods = mini_load_profile_methods (acfg->image, TRUE);
+	for (j = 0; j < methods->len; ++j) {
+		token = mono_method_get_token (g_ptr_array_index (methods, j));
+		method_index = mono_metadata_token_index (token) - 1;
 
-			if (fgets (name, 1023, infile) == NULL)
+		found = FALSE;
+		for (i = 0; i < acfg->method_order->len; ++i) {
+			if (g_ptr_array_index (acfg->method_order, i) == GUINT_TO_POINTER (method_index)) {
+				found = TRUE;
 				break;
-
-			/* Kill the newline */
-			if (strlen (name) > 0)
-				name [strlen (name) - 1] = '\0';
-
-			desc = mono_method_desc_new (name, TRUE);
-
-			method = mono_method_desc_search_in_image (desc, acfg->image);
-
-			if (method && mono_method_get_token (method)) {
-				token = mono_method_get_token (method);
-				method_index = mono_metadata_token_index (token) - 1;
-
-				found = FALSE;
-				for (i = 0; i < acfg->method_order->len; ++i) {
-					if (g_ptr_array_index (acfg->method_order, i) == GUINT_TO_POINTER (method_index)) {
-						found = TRUE;
-						break;
-					}
-				}
-				if (!found)
-					g_ptr_array_add (acfg->method_order, GUINT_TO_POINTER (method_index));
-			} else {
-				//printf ("No method found matching '%s'.\n", name);
 			}
 		}
-		fclose (infile);
+		if (!found)
+			g_ptr_array_add (acfg->method_order, GUINT_TO_POINTER (method_index));
 	}
+	g_ptr_array_free (methods, TRUE);
 
 	/* Add missing methods */
 	unordered = NULL;
@@ -7123,18 +7197,41 @@ mono_aot_patch_info_dup (MonoJumpInfo* ji)
 /*
  * emit_llvm_file:
  *
- *   Emit the LLVM code into an LLVM bytecode file, and compile it using the LLVM
- * tools.
+ *   Emit the LLVM code into an LLVM bytecode file.
  */
-static gboolean
+static void
 emit_llvm_file (MonoAotCompile *acfg)
 {
-	char *command, *opts, *tempbc, *output_fname;
+	char *tempbc;
+	TV_DECLARE (atv);
+	TV_DECLARE (btv);
+
+	TV_GETTIME (atv);
 
 	tempbc = g_strdup_printf ("%s.bc", acfg->tmpbasename);
 	mono_llvm_emit_aot_module (tempbc, g_path_get_basename (acfg->image->name));
 	g_free (tempbc);
 
+	TV_GETTIME (btv);
+	acfg->stats.llvm_bc_time = TV_ELAPSED (atv, btv);
+}
+
+/*
+ * compile_llvm_file:
+ *
+ *   Compile the bytecode file emitted by emit_llvm_file () using the LLVM tools.
+ * This only accesses the LLVM related fields of ACFG, so it can run concurrently
+ * with the emission of the mono code if the two are emitted into separate files.
+ */
+static gboolean
+compile_llvm_file (MonoAotCompile *acfg)
+{
+	char *command, *opts, *output_fname;
+	TV_DECLARE (atv);
+	TV_DECLARE (btv);
+
+	TV_GETTIME (atv);
+
 	/*
 	 * FIXME: Experiment with adding optimizations, the -std-compile-opts set takes
 	 * a lot of time, and doesn't seem to save much space.
@@ -7171,6 +7268,10 @@ emit_llvm_file (MonoAotCompile *acfg)
 		return FALSE;
 #endif
 	g_free (opts);
+	TV_GETTIME (btv);
+	acfg->stats.llvm_opt_time = TV_ELAPSED (atv, btv);
+
+	TV_GETTIME (atv);
 
 	if (!acfg->llc_args)
 		acfg->llc_args = g_string_new ("");
@@ -7195,7 +7296,6 @@ emit_llvm_file (MonoAotCompile *acfg)
 	else
 		g_string_append_printf (acfg->llc_args, " -relocation-model=pic");
 #endif
-	unlink (acfg->tmpfname);
 
 	if (acfg->llvm_separate) {
 		if (acfg->llvm_owriter) {
@@ -7206,6 +7306,8 @@ emit_llvm_file (MonoAotCompile *acfg)
 			output_fname = g_strdup_printf ("%s", acfg->llvm_sfile);
 		}
 	} else {
+		/* Only unlink this if llc writes it, it might be written concurrently otherwise */
+		unlink (acfg->tmpfname);
 		output_fname = g_strdup (acfg->tmpfname);
 	}
 	command = g_strdup_printf ("%sllc %s -o \"%s\" \"%s.opt.bc\"", acfg->aot_opts.llvm_path, acfg->llc_args->str, output_fname, acfg->tmpbasename);
@@ -7214,10 +7316,188 @@ emit_llvm_file (MonoAotCompile *acfg)
 
 	if (system (command) != 0)
 		return FALSE;
+	TV_GETTIME (btv);
+	acfg->stats.llvm_llc_time = TV_ELAPSED (atv, btv);
 	return TRUE;
 }
 #endif
 
+/*
+ * emit_method_order_entry:
+ *
+ *   Emit the code of the method at index OINDEX of acfg->method_order, along with its
+ * unbox trampoline.
+ */
+static void
+emit_method_order_entry (MonoAotCompile *acfg, int oindex)
+{
+	MonoCompile *cfg;
+	MonoMethod *method;
+	char symbol [256];
+	int i;
+
+	i = GPOINTER_TO_UINT (g_ptr_array_index (acfg->method_order, oindex));
+
+	cfg = acfg->cfgs [i];
+
+	if (!cfg)
+		return;
+
+	method = cfg->orig_method;
+
+	/* Emit unbox trampoline */
+	if (acfg->aot_opts.full_aot && cfg->orig_method->klass->valuetype) {
+		sprintf (symbol, "ut_%d", get_method_index (acfg, method));
+
+		emit_section_change (acfg, ".text", 0);
+#ifdef __native_client_codegen__
+		emit_alignment (acfg, AOT_FUNC_ALIGNMENT);
+#endif
+
+		if (acfg->thumb_mixed && cfg->compile_llvm) {
+			emit_set_thumb_mode (acfg);
+			fprintf (get_fp (acfg), "\n.thumb_func\n");
+		}
+
+		emit_label (acfg, symbol);
+
+		arch_emit_unbox_trampoline (acfg, cfg, cfg->orig_method, cfg->asm_symbol);
+
+		if (acfg->thumb_mixed && cfg->compile_llvm)
+			emit_set_arm_mode (acfg);
+	}
+
+	if (cfg->compile_llvm)
+		InterlockedIncrement (&acfg->stats.llvm_count);
+	else
+		emit_method_code (acfg, cfg);
+}
+
+/*
+ * use_emit_fragments:
+ *
+ *   Return whenever the code of the methods can be emitted by several threads.
+ * This requires the asm writer, since the fragments are concatenated textually.
+ * The .file directives emitted for line numbers have to precede their uses, and
+ * the arm64 backend emits its code outside of this file without going through
+ * get_fp (), so those don't use fragments either.
+ */
+static gboolean
+use_emit_fragments (MonoAotCompile *acfg)
+{
+#ifdef TARGET_ARM64
+	return FALSE;
+#else
+	return acfg->aot_opts.nthreads > 1 && !acfg->use_bin_writer && !acfg->gas_line_numbers;
+#endif
+}
+
+typedef struct {
+	MonoAotCompile *acfg;
+	MonoDomain *domain;
+	EmitFragment *frags;
+	int nfrags;
+	volatile gint32 next_frag;
+} EmitFragmentsData;
+
+/*
+ * emit_fragments_thread_main:
+ *
+ *   Emit fragments from the list shared by all emit threads until it is exhausted.
+ */
+static void
+emit_fragments_thread_main (EmitFragmentsData *data)
+{
+	MonoAotCompile *acfg = data->acfg;
+	EmitFragment *frag;
+	int i, oindex;
+
+	mono_thread_attach (data->domain);
+
+	while ((i = InterlockedIncrement (&data->next_frag) - 1) < data->nfrags) {
+		frag = &data->frags [i];
+
+		frag->fp = tmpfile ();
+		g_assert (frag->fp);
+		frag->w = img_writer_create (frag->fp, FALSE);
+		mono_native_tls_set_value (emit_fragment_id, frag);
+
+		for (oindex = frag->start; oindex < frag->end; ++oindex)
+			emit_method_order_entry (acfg, oindex);
+
+		img_writer_emit_unset_mode (frag->w);
+		img_writer_destroy (frag->w);
+		frag->w = NULL;
+		mono_native_tls_set_value (emit_fragment_id, NULL);
+	}
+}
+
+/*
+ * emit_code_fragments:
+ *
+ *   Emit the code of the methods using aot_opts.nthreads threads. The methods are split
+ * into fragments of consecutive entries of acfg->method_order, each one emitted into
+ * its own temporary file, which are appended to the .s file in order once all of them
+ * are done, so the result only differs from serial emission in the order GOT slots and
+ * PLT entries are allocated. The state shared between the threads is accessed under
+ * the acfg lock.
+ */
+static void
+emit_code_fragments (MonoAotCompile *acfg)
+{
+	static gboolean inited;
+	EmitFragmentsData data;
+	GPtrArray *threads;
+	HANDLE handle;
+	char buf [4096];
+	size_t n;
+	int i, len;
+
+	if (!inited) {
+		mono_native_tls_alloc (&emit_fragment_id, NULL);
+		inited = TRUE;
+	}
+
+	/* Use more fragments than threads to balance the load */
+	memset (&data, 0, sizeof (data));
+	data.acfg = acfg;
+	data.domain = mono_domain_get ();
+	data.nfrags = acfg->aot_opts.nthreads * 4;
+	data.frags = g_new0 (EmitFragment, data.nfrags);
+	len = (acfg->method_order->len + data.nfrags - 1) / data.nfrags;
+	for (i = 0; i < data.nfrags; ++i) {
+		data.frags [i].start = MIN (i * len, acfg->method_order->len);
+		data.frags [i].end = MIN ((i + 1) * len, acfg->method_order->len);
+	}
+
+	acfg->emit_fragments = TRUE;
+
+	/* The current thread is one of the emit threads */
+	threads = g_ptr_array_new ();
+	for (i = 0; i < acfg->aot_opts.nthreads - 1; ++i) {
+		handle = mono_threads_create_thread ((gpointer)emit_fragments_thread_main, &data, 0, 0, NULL);
+		if (handle)
+			g_ptr_array_add (threads, handle);
+	}
+	emit_fragments_thread_main (&data);
+	for (i = 0; i < threads->len; ++i)
+		WaitForSingleObjectEx (g_ptr_array_index (threads, i), INFINITE, FALSE);
+	g_ptr_array_free (threads, TRUE);
+
+	acfg->emit_fragments = FALSE;
+
+	emit_unset_mode (acfg);
+	for (i = 0; i < data.nfrags; ++i) {
+		FILE *fp = data.frags [i].fp;
+
+		rewind (fp);
+		while ((n = fread (buf, 1, sizeof (buf), fp)) > 0)
+			fwrite (buf, 1, n, acfg->fp);
+		fclose (fp);
+	}
+	g_free (data.frags);
+}
+
 static void
 emit_code (MonoAotCompile *acfg)
 {
@@ -7269,45 +7549,11 @@ emit_code (MonoAotCompile *acfg)
 	}
 #endif
 
-	for (oindex = 0; oindex < acfg->method_order->len; ++oindex) {
-		MonoCompile *cfg;
-		MonoMethod *method;
-
-		i = GPOINTER_TO_UINT (g_ptr_array_index (acfg->method_order, oindex));
-
-		cfg = acfg->cfgs [i];
-
-		if (!cfg)
-			continue;
-
-		method = cfg->orig_method;
-
-		/* Emit unbox trampoline */
-		if (acfg->aot_opts.full_aot && cfg->orig_method->klass->valuetype) {
-			sprintf (symbol, "ut_%d", get_method_index (acfg, method));
-
-			emit_section_change (acfg, ".text", 0);
-#ifdef __native_client_codegen__
-			emit_alignment (acfg, AOT_FUNC_ALIGNMENT);
-#endif
-
-			if (acfg->thumb_mixed && cfg->compile_llvm) {
-				emit_set_thumb_mode (acfg);
-				fprintf (acfg->fp, "\n.thumb_func\n");
-			}
-
-			emit_label (acfg, symbol);
-
-			arch_emit_unbox_trampoline (acfg, cfg, cfg->orig_method, cfg->asm_symbol);
-
-			if (acfg->thumb_mixed && cfg->compile_llvm)
-				emit_set_arm_mode (acfg);
-		}
-
-		if (cfg->compile_llvm)
-			acfg->stats.llvm_count ++;
-		else
-			emit_method_code (acfg, cfg);
+	if (use_emit_fragments (acfg)) {
+		emit_code_fragments (acfg);
+	} else {
+		for (oindex = 0; oindex < acfg->method_order->len; ++oindex)
+			emit_method_order_entry (acfg, oindex);
 	}
 
 	sprintf (symbol, "methods_end");
@@ -7328,10 +7574,10 @@ emit_code (MonoAotCompile *acfg)
 	 * FIXME: This is why write-symbols doesn't work on OSX ?
 	 */
 	if (acfg->llvm && acfg->need_no_dead_strip) {
-		fprintf (acfg->fp, "\n");
+		fprintf (get_fp (acfg), "\n");
 		for (i = 0; i < acfg->nmethods; ++i) {
 			if (acfg->cfgs [i] && acfg->cfgs [i]->compile_llvm)
-				fprintf (acfg->fp, ".no_dead_strip %s\n", acfg->cfgs [i]->asm_symbol);
+				fprintf (get_fp (acfg), ".no_dead_strip %s\n", acfg->cfgs [i]->asm_symbol);
 		}
 	}
 
@@ -7346,7 +7592,7 @@ emit_code (MonoAotCompile *acfg)
 	emit_local_symbol (acfg, symbol, "method_addresses_end", TRUE);
 	emit_unset_mode (acfg);
 	if (acfg->need_no_dead_strip)
-		fprintf (acfg->fp, "	.no_dead_strip %s\n", symbol);
+		fprintf (get_fp (acfg), "	.no_dead_strip %s\n", symbol);
 
 	for (i = 0; i < acfg->nmethods; ++i) {
 #ifdef MONO_ARCH_AOT_SUPPORTED
@@ -8418,25 +8664,25 @@ emit_objc_selectors (MonoAotCompile *acfg)
 	 * EOF
 	 */
 
-	img_writer_emit_unset_mode (acfg->w);
+	img_writer_emit_unset_mode (get_writer (acfg));
 	g_assert (acfg->fp);
-	fprintf (acfg->fp, ".section	__DATA,__objc_selrefs,literal_pointers,no_dead_strip\n");
-	fprintf (acfg->fp, ".align	3\n");
+	fprintf (get_fp (acfg), ".section	__DATA,__objc_selrefs,literal_pointers,no_dead_strip\n");
+	fprintf (get_fp (acfg), ".align	3\n");
 	for (i = 0; i < acfg->objc_selectors->len; ++i) {
-		fprintf (acfg->fp, "L_OBJC_SELECTOR_REFERENCES_%d:\n", i);
-		fprintf (acfg->fp, ".long	L_OBJC_METH_VAR_NAME_%d\n", i);
+		fprintf (get_fp (acfg), "L_OBJC_SELECTOR_REFERENCES_%d:\n", i);
+		fprintf (get_fp (acfg), ".long	L_OBJC_METH_VAR_NAME_%d\n", i);
 	}
-	fprintf (acfg->fp, ".section	__TEXT,__cstring,cstring_literals\n");
+	fprintf (get_fp (acfg), ".section	__TEXT,__cstring,cstring_literals\n");
 	for (i = 0; i < acfg->objc_selectors->len; ++i) {
-		fprintf (acfg->fp, "L_OBJC_METH_VAR_NAME_%d:\n", i);
-		fprintf (acfg->fp, ".asciz \"%s\"\n", (char*)g_ptr_array_index (acfg->objc_selectors, i));
+		fprintf (get_fp (acfg), "L_OBJC_METH_VAR_NAME_%d:\n", i);
+		fprintf (get_fp (acfg), ".asciz \"%s\"\n", (char*)g_ptr_array_index (acfg->objc_selectors, i));
 	}
 
-	fprintf (acfg->fp, ".section	__DATA,__objc_imageinfo,regular,no_dead_strip\n");
-	fprintf (acfg->fp, ".align	3\n");
-	fprintf (acfg->fp, "L_OBJC_IMAGE_INFO:\n");
-	fprintf (acfg->fp, ".long	0\n");
-	fprintf (acfg->fp, ".long	16\n");
+	fprintf (get_fp (acfg), ".section	__DATA,__objc_imageinfo,regular,no_dead_strip\n");
+	fprintf (get_fp (acfg), ".align	3\n");
+	fprintf (get_fp (acfg), "L_OBJC_IMAGE_INFO:\n");
+	fprintf (get_fp (acfg), ".long	0\n");
+	fprintf (get_fp (acfg), ".long	16\n");
 }
 
 static void
@@ -8553,50 +8799,38 @@ compile_methods (MonoAotCompile *acfg)
 	int i, methods_len;
 
 	if (acfg->aot_opts.nthreads > 0) {
-		GPtrArray *frag;
-		int len, j;
 		GPtrArray *threads;
 		HANDLE handle;
 		gpointer *user_data;
 		MonoMethod **methods;
+		volatile gint32 next_method = 0;
 
 		methods_len = acfg->methods->len;
 
-		len = acfg->methods->len / acfg->aot_opts.nthreads;
-		g_assert (len > 0);
-		/* 
-		 * Partition the list of methods into fragments, and hand it to threads to
-		 * process.
-		 */
-		threads = g_ptr_array_new ();
 		/* Make a copy since acfg->methods is modified by compile_method () */
 		methods = g_new0 (MonoMethod*, methods_len);
-		//memcpy (methods, g_ptr_array_index (acfg->methods, 0), sizeof (MonoMethod*) * methods_len);
 		for (i = 0; i < methods_len; ++i)
 			methods [i] = g_ptr_array_index (acfg->methods, i);
-		i = 0;
-		while (i < methods_len) {
-			frag = g_ptr_array_new ();
-			for (j = 0; j < len; ++j) {
-				if (i < methods_len) {
-					g_ptr_array_add (frag, methods [i]);
-					i ++;
-				}
-			}
 
-			user_data = g_new0 (gpointer, 3);
-			user_data [0] = mono_domain_get ();
-			user_data [1] = acfg;
-			user_data [2] = frag;
-			
+		user_data = g_new0 (gpointer, 5);
+		user_data [0] = mono_domain_get ();
+		user_data [1] = acfg;
+		user_data [2] = methods;
+		user_data [3] = GINT_TO_POINTER (methods_len);
+		user_data [4] = (gpointer)&next_method;
+
+		threads = g_ptr_array_new ();
+		for (i = 0; i < acfg->aot_opts.nthreads; ++i) {
 			handle = mono_threads_create_thread ((gpointer)compile_thread_main, user_data, 0, 0, NULL);
 			g_ptr_array_add (threads, handle);
 		}
-		g_free (methods);
 
 		for (i = 0; i < threads->len; ++i) {
 			WaitForSingleObjectEx (g_ptr_array_index (threads, i), INFINITE, FALSE);
 		}
+		g_ptr_array_free (threads, TRUE);
+		g_free (user_data);
+		g_free (methods);
 	} else {
 		methods_len = 0;
 	}
@@ -8608,13 +8842,6 @@ compile_methods (MonoAotCompile *acfg)
 	}
 }
 
-static int
-compile_asm (MonoAotCompile *acfg)
-{
-	char *command, *objfile;
-	char *outfile_name, *tmp_outfile_name, *llvm_ofile;
-	const char *tool_prefix = acfg->aot_opts.tool_prefix ? acfg->aot_opts.tool_prefix : "";
-
 #if defined(TARGET_AMD64) && !defined(TARGET_MACH)
 #define AS_OPTIONS "--64"
 #elif defined(TARGET_POWERPC64)
@@ -8656,6 +8883,34 @@ compile_asm (MonoAotCompile *acfg)
 #define LD_NAME "clang -m32 -dynamiclib"
 #endif
 
+/*
+ * assemble_file:
+ *
+ *   Run the native assembler on SFILE, producing OBJFILE. Return 0 on success.
+ */
+static int
+assemble_file (MonoAotCompile *acfg, const char *objfile, const char *sfile)
+{
+	char *command;
+	const char *tool_prefix = acfg->aot_opts.tool_prefix ? acfg->aot_opts.tool_prefix : "";
+	int res;
+
+	command = g_strdup_printf ("%s%s %s %s -o %s %s", tool_prefix, AS_NAME, AS_OPTIONS, acfg->as_args ? acfg->as_args->str : "", objfile, sfile);
+	aot_printf (acfg, "Executing the native assembler: %s\n", command);
+	res = system (command) != 0 ? 1 : 0;
+	g_free (command);
+	return res;
+}
+
+static int
+compile_asm (MonoAotCompile *acfg)
+{
+	char *command, *objfile;
+	char *outfile_name, *tmp_outfile_name, *llvm_ofile;
+	const char *tool_prefix = acfg->aot_opts.tool_prefix ? acfg->aot_opts.tool_prefix : "";
+	TV_DECLARE (atv);
+	TV_DECLARE (btv);
+
 	if (acfg->aot_opts.asm_only) {
 		aot_printf (acfg, "Output file: '%s'.\n", acfg->tmpfname);
 		if (acfg->aot_opts.static_link)
@@ -8673,25 +8928,20 @@ compile_asm (MonoAotCompile *acfg)
 	} else {
 		objfile = g_strdup_printf ("%s.o", acfg->tmpfname);
 	}
-	command = g_strdup_printf ("%s%s %s %s -o %s %s", tool_prefix, AS_NAME, AS_OPTIONS, acfg->as_args ? acfg->as_args->str : "", objfile, acfg->tmpfname);
-	aot_printf (acfg, "Executing the native assembler: %s\n", command);
-	if (system (command) != 0) {
-		g_free (command);
+	TV_GETTIME (atv);
+	if (assemble_file (acfg, objfile, acfg->tmpfname) != 0) {
 		g_free (objfile);
 		return 1;
 	}
 
-	if (acfg->llvm_separate && !acfg->llvm_owriter) {
-		command = g_strdup_printf ("%s%s %s %s -o %s %s", tool_prefix, AS_NAME, AS_OPTIONS, acfg->as_args ? acfg->as_args->str : "", acfg->llvm_ofile, acfg->llvm_sfile);
-		aot_printf (acfg, "Executing the native assembler: %s\n", command);
-		if (system (command) != 0) {
-			g_free (command);
+	if (acfg->llvm_separate && !acfg->llvm_owriter && !acfg->llvm_assembled) {
+		if (assemble_file (acfg, acfg->llvm_ofile, acfg->llvm_sfile) != 0) {
 			g_free (objfile);
 			return 1;
 		}
 	}
-
-	g_free (command);
+	TV_GETTIME (btv);
+	acfg->stats.as_time = TV_ELAPSED (atv, btv);
 
 	if (acfg->aot_opts.static_link) {
 		aot_printf (acfg, "Output file: '%s'.\n", objfile);
@@ -8719,6 +8969,7 @@ compile_asm (MonoAotCompile *acfg)
 	command = g_strdup_printf ("%sld %s -shared -o %s %s %s.o", tool_prefix, LD_OPTIONS, tmp_outfile_name, llvm_ofile, acfg->tmpfname);
 #endif
 	aot_printf (acfg, "Executing the native linker: %s\n", command);
+	TV_GETTIME (atv);
 	if (system (command) != 0) {
 		g_free (tmp_outfile_name);
 		g_free (outfile_name);
@@ -8726,6 +8977,8 @@ compile_asm (MonoAotCompile *acfg)
 		g_free (objfile);
 		return 1;
 	}
+	TV_GETTIME (btv);
+	acfg->stats.ld_time = TV_ELAPSED (atv, btv);
 
 	g_free (command);
 
@@ -8775,6 +9028,71 @@ compile_asm (MonoAotCompile *acfg)
 	return 0;
 }
 
+#ifdef ENABLE_LLVM
+
+static void
+llvm_thread_main (MonoAotCompile *acfg)
+{
+	TV_DECLARE (atv);
+	TV_DECLARE (btv);
+
+	acfg->llvm_res = compile_llvm_file (acfg);
+	if (acfg->llvm_res && !acfg->aot_opts.asm_only && !acfg->llvm_owriter) {
+		TV_GETTIME (atv);
+		acfg->llvm_res = assemble_file (acfg, acfg->llvm_ofile, acfg->llvm_sfile) == 0;
+		TV_GETTIME (btv);
+		acfg->stats.llvm_as_time = TV_ELAPSED (atv, btv);
+		acfg->llvm_assembled = TRUE;
+	}
+}
+
+/*
+ * start_llvm_thread:
+ *
+ *   Run the LLVM tools, and the assembler on their output, on a separate
+ * thread, while the mono code is emitted by the current thread. This is only
+ * possible if the LLVM code is emitted into a separate file. Return FALSE if
+ * the thread couldn't be created, and running the tools on the current thread
+ * failed.
+ */
+static gboolean
+start_llvm_thread (MonoAotCompile *acfg)
+{
+	g_assert (acfg->llvm_separate);
+
+	acfg->llvm_thread = mono_threads_create_thread ((gpointer)llvm_thread_main, acfg, 0, 0, NULL);
+	if (!acfg->llvm_thread)
+		return compile_llvm_file (acfg);
+	return TRUE;
+}
+
+#endif
+
+/*
+ * wait_for_llvm_thread:
+ *
+ *   Wait for the thread started by start_llvm_thread () to finish, if any.
+ * Return FALSE if it failed to compile the LLVM code.
+ */
+static gboolean
+wait_for_llvm_thread (MonoAotCompile *acfg)
+{
+	TV_DECLARE (atv);
+	TV_DECLARE (btv);
+
+	if (!acfg->llvm_thread)
+		return TRUE;
+
+	TV_GETTIME (atv);
+	WaitForSingleObjectEx (acfg->llvm_thread, INFINITE, FALSE);
+	CloseHandle (acfg->llvm_thread);
+	acfg->llvm_thread = NULL;
+	TV_GETTIME (btv);
+	acfg->stats.llvm_wait_time = TV_ELAPSED (atv, btv);
+
+	return acfg->llvm_res;
+}
+
 static void init_got_info (GotInfo *info)
 {
 	int i;
@@ -8843,6 +9161,7 @@ acfg_free (MonoAotCompile *acfg)
 {
 	int i;
 
+	wait_for_llvm_thread (acfg);
 	img_writer_destroy (acfg->w);
 	for (i = 0; i < acfg->nmethods; ++i)
 		if (acfg->cfgs [i])
@@ -8870,6 +9189,8 @@ acfg_free (MonoAotCompile *acfg)
 	g_hash_table_destroy (acfg->unwind_info_offsets);
 	g_hash_table_destroy (acfg->method_label_hash);
 	g_hash_table_destroy (acfg->export_names);
+	if (acfg->method_tokens)
+		g_hash_table_destroy (acfg->method_tokens);
 	g_hash_table_destroy (acfg->plt_entry_debug_sym_cache);
 	g_hash_table_destroy (acfg->klass_blob_hash);
 	g_hash_table_destroy (acfg->method_blob_hash);
@@ -8879,6 +9200,21 @@ acfg_free (MonoAotCompile *acfg)
 	g_free (acfg);
 }
 
+/*
+ * phase_time:
+ *
+ *   Store the time elapsed since *START into *TIME, and restart *START.
+ */
+static void
+phase_time (gint64 *start, int *time)
+{
+	TV_DECLARE (now);
+
+	TV_GETTIME (now);
+	*time = TV_ELAPSED (*start, now);
+	*start = now;
+}
+
 int
 mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 {
@@ -8889,6 +9225,7 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 	char llvm_stats_msg [256];
 	TV_DECLARE (atv);
 	TV_DECLARE (btv);
+	TV_DECLARE (ptv);
 
 	acfg = acfg_create (ass, opts);
 
@@ -8994,6 +9331,17 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 
 	load_profile_files (acfg);
 
+	if (acfg->aot_opts.pgo_file && !mini_pgo_load (acfg->aot_opts.pgo_file, TRUE))
+		return 1;
+
+	if (acfg->aot_opts.methods_file) {
+		acfg->method_tokens = mini_jit_cache_load_methods (acfg->aot_opts.methods_file);
+		if (!acfg->method_tokens) {
+			aot_printerrf (acfg, "Unable to load the methods file '%s'.\n", acfg->aot_opts.methods_file);
+			return 1;
+		}
+	}
+
 	acfg->num_trampolines [MONO_AOT_TRAMP_SPECIFIC] = acfg->aot_opts.full_aot ? acfg->aot_opts.ntrampolines : 0;
 #ifdef MONO_ARCH_GSHARED_SUPPORTED
 	acfg->num_trampolines [MONO_AOT_TRAMP_STATIC_RGCTX] = acfg->aot_opts.full_aot ? acfg->aot_opts.nrgctx_trampolines : 0;
@@ -9115,7 +9463,13 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 			acfg->llvm_ofile = g_strdup ("temp-llvm.o");
 		}
 
-		res = emit_llvm_file (acfg);
+		emit_llvm_file (acfg);
+		if (acfg->llvm_separate && acfg->aot_opts.nthreads > 0) {
+			/* The mono code doesn't depend on the output of the LLVM tools */
+			res = start_llvm_thread (acfg);
+		} else {
+			res = compile_llvm_file (acfg);
+		}
 		if (!res)
 			return 1;
 	}
@@ -9200,7 +9554,7 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 		acfg->dwarf = mono_dwarf_writer_create (acfg->w, NULL, 0, FALSE, !acfg->gas_line_numbers);
 	}
 
-	img_writer_emit_start (acfg->w);
+	img_writer_emit_start (get_writer (acfg));
 
 	if (acfg->dwarf)
 		mono_dwarf_writer_emit_base_info (acfg->dwarf, g_path_get_basename (acfg->image->name), mono_unwind_get_cie_program ());
@@ -9217,11 +9571,15 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 		emit_label (acfg, symbol);
 		emit_zero_bytes (acfg, 16);
 
-		fprintf (acfg->fp, ".arm\n");
+		fprintf (get_fp (acfg), ".arm\n");
 	}
 
+	TV_GETTIME (ptv);
+
 	emit_code (acfg);
 
+	phase_time (&ptv, &acfg->stats.emit_code_time);
+
 	emit_info (acfg);
 
 	emit_extra_methods (acfg);
@@ -9240,6 +9598,8 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 
 	emit_class_info (acfg);
 
+	phase_time (&ptv, &acfg->stats.emit_info_time);
+
 	emit_plt (acfg);
 
 	emit_image_table (acfg);
@@ -9256,6 +9616,8 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 
 	emit_autoreg (acfg);
 
+	phase_time (&ptv, &acfg->stats.emit_tables_time);
+
 	if (acfg->dwarf) {
 		emit_dwarf_info (acfg);
 		mono_dwarf_writer_close (acfg->dwarf);
@@ -9263,11 +9625,13 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 
 	emit_mem_end (acfg);
 
+	phase_time (&ptv, &acfg->stats.emit_debug_time);
+
 	if (acfg->need_pt_gnu_stack) {
 		/* This is required so the .so doesn't have an executable stack */
 		/* The bin writer already emits this */
 		if (!acfg->use_bin_writer)
-			fprintf (acfg->fp, "\n.section	.note.GNU-stack,\"\",@progbits\n");
+			fprintf (get_fp (acfg), "\n.section	.note.GNU-stack,\"\",@progbits\n");
 	}
 
 	TV_GETTIME (btv);
@@ -9304,13 +9668,23 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 		aot_printf (acfg, "%d methods contain lmf pointers (%d%%)\n", acfg->stats.lmfcount, acfg->stats.mcount ? (acfg->stats.lmfcount * 100) / acfg->stats.mcount : 100);
 	if (acfg->stats.ocount)
 		aot_printf (acfg, "%d methods have other problems (%d%%)\n", acfg->stats.ocount, acfg->stats.mcount ? (acfg->stats.ocount * 100) / acfg->stats.mcount : 100);
+	if (acfg->aot_opts.pgo_file)
+		aot_printf (acfg, "PGO: %d hot calls inlined (+%d bytes of IL), %d cold calls not inlined (-%d bytes of IL)\n",
+				acfg->stats.pgo_hot_inlined, acfg->stats.pgo_hot_inlined_size,
+				acfg->stats.pgo_cold_not_inlined, acfg->stats.pgo_cold_not_inlined_size);
 
 	TV_GETTIME (atv);
-	res = img_writer_emit_writeout (acfg->w);
+	res = img_writer_emit_writeout (get_writer (acfg));
 	if (res != 0) {
 		acfg_free (acfg);
 		return res;
 	}
+	TV_GETTIME (ptv);
+	acfg->stats.writeout_time = TV_ELAPSED (atv, ptv);
+	if (!wait_for_llvm_thread (acfg)) {
+		acfg_free (acfg);
+		return 1;
+	}
 	if (acfg->use_bin_writer) {
 		int err = rename (tmp_outfile_name, outfile_name);
 
@@ -9335,6 +9709,23 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 		for (i = 0; i < MONO_PATCH_INFO_NONE; ++i)
 			if (acfg->stats.got_slot_types [i])
 				aot_printf (acfg, "\t%s: %d (%d)\n", get_patch_name (i), acfg->stats.got_slot_types [i], acfg->stats.got_slot_info_sizes [i]);
+
+		aot_printf (acfg, "Phase times:\n");
+		aot_printf (acfg, "\tJIT (%d threads): %d ms\n", acfg->aot_opts.nthreads, acfg->stats.jit_time / 1000);
+		if (acfg->llvm) {
+			aot_printf (acfg, "\tLLVM bitcode: %d ms\n", acfg->stats.llvm_bc_time / 1000);
+			aot_printf (acfg, "\tLLVM opt: %d ms\n", acfg->stats.llvm_opt_time / 1000);
+			aot_printf (acfg, "\tLLVM llc: %d ms\n", acfg->stats.llvm_llc_time / 1000);
+			if (acfg->llvm_assembled)
+				aot_printf (acfg, "\tLLVM assembler: %d ms (concurrent with emit, waited %d ms)\n", acfg->stats.llvm_as_time / 1000, acfg->stats.llvm_wait_time / 1000);
+		}
+		aot_printf (acfg, "\tEmit code: %d ms\n", acfg->stats.emit_code_time / 1000);
+		aot_printf (acfg, "\tEmit info: %d ms\n", acfg->stats.emit_info_time / 1000);
+		aot_printf (acfg, "\tEmit tables: %d ms\n", acfg->stats.emit_tables_time / 1000);
+		aot_printf (acfg, "\tEmit debug info: %d ms\n", acfg->stats.emit_debug_time / 1000);
+		aot_printf (acfg, "\tWriteout: %d ms\n", acfg->stats.writeout_time / 1000);
+		aot_printf (acfg, "\tAssembler: %d ms\n", acfg->stats.as_time / 1000);
+		aot_printf (acfg, "\tLinker: %d ms\n", acfg->stats.ld_time / 1000);
 	}
 
 	aot_printf (acfg, "JIT time: %d ms, Generation time: %d ms, Assembly+Link time: %d ms.\n", acfg->stats.jit_time / 1000, acfg->stats.gen_time / 1000, acfg->stats.link_time / 1000);
@@ -1801,6 +1801,15 @@ load_aot_module (MonoAssembly *assembly, gpointer user_data)
 
 			}
 		}
+		if (!sofile && mono_jit_cache_dir) {
+			char *cache_name;
+
+			sofile = mini_jit_cache_load_module (assembly, &cache_name);
+			if (cache_name) {
+				g_free (aot_name);
+				aot_name = cache_name;
+			}
+		}
 	}
 
 	if (!sofile && !globals) {
@@ -806,6 +806,102 @@ class Tests
 			arr [i] = 1;
 		return llvm_ldlen_licm (arr);
 	}
+
+	static int sum_to (int[] arr, int limit, ref int count) {
+		int sum = 0;
+		for (int i = 0; i < limit; ++i) {
+			count ++;
+			sum += arr [i];
+		}
+		return sum;
+	}
+
+	public static int test_0_loop_versioning () {
+		int[] arr = new int [10];
+		for (int i = 0; i < arr.Length; ++i)
+			arr [i] = i;
+		int count = 0;
+		if (sum_to (arr, 10, ref count) != 45 || count != 10)
+			return 1;
+		/* The exception has to be thrown after the side effects of the valid iterations */
+		count = 0;
+		try {
+			sum_to (arr, 11, ref count);
+			return 2;
+		} catch (IndexOutOfRangeException) {
+		}
+		if (count != 11)
+			return 3;
+		count = 0;
+		if (sum_to (null, 0, ref count) != 0)
+			return 4;
+		count = 0;
+		try {
+			sum_to (null, 1, ref count);
+			return 5;
+		} catch (NullReferenceException) {
+		}
+		if (count != 1)
+			return 6;
+		return 0;
+	}
+
+	static int sum_from (int[] arr, int start) {
+		int sum = 0;
+		for (int i = start; i < arr.Length; ++i)
+			sum += arr [i];
+		return sum;
+	}
+
+	public static int test_0_loop_versioning_negative_start () {
+		int[] arr = new int [] { 1, 2, 3 };
+		if (sum_from (arr, 1) != 5)
+			return 1;
+		try {
+			sum_from (arr, -1);
+			return 2;
+		} catch (IndexOutOfRangeException) {
+		}
+		return 0;
+	}
+
+	class LicmHolder {
+		public int val;
+	}
+
+	static int licm_field_load (LicmHolder h, int n) {
+		int sum = 0;
+		/* The load of h.val can't be executed before the loop if it doesn't run */
+		for (int i = 0; i < n; ++i)
+			sum += h.val;
+		return sum;
+	}
+
+	public static int test_0_licm_null_zero_trip () {
+		LicmHolder h = new LicmHolder ();
+		h.val = 3;
+		if (licm_field_load (h, 5) != 15)
+			return 1;
+		if (licm_field_load (null, 0) != 0)
+			return 2;
+		return 0;
+	}
+
+	struct LicmPoint {
+		public int x, y, z;
+	}
+
+	public static int test_36_iv_strength_reduction () {
+		LicmPoint[] arr = new LicmPoint [8];
+		for (int i = 0; i < arr.Length; ++i) {
+			arr [i].x = i;
+			arr [i].z = 1;
+		}
+		int sum = 0;
+		for (int i = 0; i < arr.Length; ++i)
+			sum += arr [i].x + arr [i].y + arr [i].z;
+		return sum;
+	}
 }
 
 
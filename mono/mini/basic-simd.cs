@@ -3304,6 +3304,165 @@ public class SimdTests {
 		return 0;
 	}
 
+	public static int test_0_vector_t_count () {
+		if (Vector<float>.Count != 4)
+			return 1;
+		if (Vector<double>.Count != 2)
+			return 2;
+		if (Vector<byte>.Count != 16)
+			return 3;
+		if (Vector<short>.Count != 8)
+			return 4;
+		if (Vector<ulong>.Count != 2)
+			return 5;
+		return 0;
+	}
+
+	public static int test_0_vector_t_float_ops () {
+		float[] arr = new float [] { 0, 1, 2, 3, 4, 5, 6, 7 };
+		float[] res = new float [8];
+		var a = new Vector<float> (arr, 4);
+		var b = new Vector<float> (2.0f);
+
+		((a + b) * b - b / b).CopyTo (res, 1);
+		if (res [0] != 0 || res [1] != 11 || res [2] != 13 || res [3] != 15 || res [4] != 17 || res [5] != 0)
+			return 1;
+		if (a [2] != 6)
+			return 2;
+		return 0;
+	}
+
+	public static int test_0_vector_t_int_ops () {
+		int[] arr = new int [] { 1, -2, 3, -4 };
+		var a = new Vector<int> (arr);
+		var b = new Vector<int> (3);
+
+		var c = (a - b) & new Vector<int> (0xff);
+		if (c [0] != 0xfe || c [1] != 0xfb || c [2] != 0 || c [3] != 0xf9)
+			return 1;
+		c = a ^ b | new Vector<int> (0x100);
+		if (c [0] != 0x102 || c [2] != 0x100)
+			return 2;
+		return 0;
+	}
+
+	public static int test_0_vector_t_byte_wraps () {
+		var a = new Vector<byte> (200);
+		var b = new Vector<byte> (100);
+
+		var c = a + b;
+		for (int i = 0; i < Vector<byte>.Count; ++i)
+			if (c [i] != 44)
+				return 1;
+		c = b * b;
+		if (c [15] != 16)
+			return 2;
+		return 0;
+	}
+
+	public static int test_0_vector_t_min_max () {
+		var a = new Vector<int> (new int [] { 1, -5, 3, 10 });
+		var b = new Vector<int> (new int [] { 2, -6, 3, 9 });
+
+		var min = Vector<int>.Min (a, b);
+		var max = Vector<int>.Max (a, b);
+		if (min [0] != 1 || min [1] != -6 || min [2] != 3 || min [3] != 9)
+			return 1;
+		if (max [0] != 2 || max [1] != -5 || max [2] != 3 || max [3] != 10)
+			return 2;
+
+		var fmin = Vector<float>.Min (new Vector<float> (1.5f), new Vector<float> (-1.5f));
+		if (fmin [3] != -1.5f)
+			return 3;
+		var umax = Vector<ulong>.Max (new Vector<ulong> (ulong.MaxValue), new Vector<ulong> (1));
+		if (umax [1] != ulong.MaxValue)
+			return 4;
+		return 0;
+	}
+
+	public static int test_0_vector_t_compare () {
+		var a = new Vector<float> (new float [] { 1, 2, 3, 4 });
+		var b = new Vector<float> (2.5f);
+
+		var gt = Vector<float>.CompareGreaterThan (a, b);
+		var lt = Vector<float>.CompareLessThan (a, b);
+		if (gt [0] != 0 || !float.IsNaN (gt [2]))
+			return 1;
+		if (!float.IsNaN (lt [1]) || lt [3] != 0)
+			return 6;
+		var igt = Vector<int>.CompareGreaterThan (new Vector<int> (new int [] { 1, 2, 3, 4 }), new Vector<int> (2));
+		if (igt [0] != 0 || igt [1] != 0 || igt [2] != -1 || igt [3] != -1)
+			return 2;
+		var ilt = Vector<int>.CompareLessThan (new Vector<int> (new int [] { 1, 2, 3, 4 }), new Vector<int> (2));
+		if (ilt [0] != -1 || ilt [1] != 0 || ilt [2] != 0)
+			return 3;
+		var ugt = Vector<uint>.CompareGreaterThan (new Vector<uint> (uint.MaxValue), new Vector<uint> (1));
+		if (ugt [0] != uint.MaxValue)
+			return 4;
+		var eq = Vector<short>.CompareEqual (new Vector<short> (5), new Vector<short> (5));
+		if (eq [7] != -1)
+			return 5;
+		return 0;
+	}
+	public static int test_0_vector_t_dot () {
+		var f = new Vector<float> (new float [] { 1, 2, 3, 4 });
+		if (Vector<float>.Dot (f, f) != 30)
+			return 1;
+		var d = new Vector<double> (new double [] { 1.5, -2 });
+		if (Vector<double>.Dot (d, new Vector<double> (2)) != -1)
+			return 2;
+		var i = new Vector<int> (new int [] { 1, 2, 3, 4 });
+		if (Vector<int>.Dot (i, new Vector<int> (-1)) != -10)
+			return 3;
+		return 0;
+	}
+
+	public static int test_0_vector_t_equality () {
+		var a = new Vector<long> (new long [] { 1, 2 });
+		var b = new Vector<long> (new long [] { 1, 2 });
+
+		if (!(a == b) || a != b || !a.Equals (b))
+			return 1;
+		if (a == Vector<long>.Zero)
+			return 2;
+		if (new Vector<double> (0.0) != Vector<double>.Zero)
+			return 3;
+		return 0;
+	}
+
+	public static int test_0_vector_t_out_of_range () {
+		float[] arr = new float [6];
+		try {
+			new Vector<float> (arr, 3);
+			return 1;
+		} catch (IndexOutOfRangeException) {
+		}
+		try {
+			new Vector<float> (1).CopyTo (arr, 4);
+			return 2;
+		} catch (IndexOutOfRangeException) {
+		}
+		return 0;
+	}
+
+	public static int test_0_vector_t_sum_loop () {
+		int[] arr = new int [37];
+		int expected = 0;
+		for (int i = 0; i < arr.Length; ++i) {
+			arr [i] = i * 3 - 7;
+			expected += arr [i];
+		}
+
+		var acc = Vector<int>.Zero;
+		int j = 0;
+		for (; j <= arr.Length - Vector<int>.Count; j += Vector<int>.Count)
+			acc += new Vector<int> (arr, j);
+		int sum = Vector<int>.Dot (acc, new Vector<int> (1));
+		for (; j < arr.Length; ++j)
+			sum += arr [j];
+		return sum == expected ? 0 : 1;
+	}
+
 	public static int Main (String[] args) {
 		return TestDriver.RunTests (typeof (SimdTests), args);
 	}
@@ -86,6 +86,37 @@ sealed public class SealedFinal : Middle {
 }
 
 
+public interface IShape {
+	int Sides ();
+}
+
+public class Triangle : IShape {
+	public int Sides () {
+		return 3;
+	}
+}
+
+public class Square : IShape {
+	public virtual int Sides () {
+		return 4;
+	}
+}
+
+public class Pentagon : IShape {
+	int IShape.Sides () {
+		return 5;
+	}
+}
+
+public class Rectangle : Square {
+}
+
+public class Hexagon : Square {
+	public override int Sides () {
+		return 6;
+	}
+}
+
 class Tests {
 
 	static int Main  (string[] args) {
@@ -193,4 +224,78 @@ class Tests {
 		
 		return 0;
 	}
-}
\ No newline at end of file
+
+	/*
+	 * The call sites below see a few receiver classes each, so with --tiered
+	 * or --pgo they get guarded devirtualization, check that the guards call
+	 * the right method for every class.
+	 */
+	static int call_sides (IShape s) {
+		return s.Sides ();
+	}
+
+	static int call_square_sides (Square s) {
+		return s.Sides ();
+	}
+
+	static public int test_0_monomorphic_interface_call () {
+		IShape s = new Triangle ();
+		int sum = 0;
+
+		for (int i = 0; i < 1000; ++i)
+			sum += call_sides (s);
+		return sum == 3000 ? 0 : 1;
+	}
+
+	static public int test_0_polymorphic_interface_call () {
+		IShape[] shapes = new IShape [] { new Triangle (), new Square (), new Pentagon (), new Rectangle (), new Hexagon () };
+		int sum = 0;
+
+		for (int i = 0; i < 1000; ++i)
+			sum += call_sides (shapes [i % 2]);
+		if (sum != 3500)
+			return 1;
+		/* Receivers which were not seen before */
+		for (int i = 0; i < shapes.Length; ++i)
+			sum += call_sides (shapes [i]);
+		if (sum != 3500 + 3 + 4 + 5 + 4 + 6)
+			return 2;
+		return 0;
+	}
+
+	static public int test_0_polymorphic_virtual_call () {
+		Square[] squares = new Square [] { new Square (), new Rectangle (), new Hexagon () };
+		int sum = 0;
+
+		for (int i = 0; i < 3000; ++i)
+			sum += call_square_sides (squares [i % 3]);
+		return sum == 14000 ? 0 : 1;
+	}
+
+	static public int test_0_megamorphic_interface_call () {
+		IShape[] shapes = new IShape [] { new Triangle (), new Square (), new Pentagon (), new Rectangle (), new Hexagon () };
+		int sum = 0;
+
+		for (int i = 0; i < 5000; ++i)
+			sum += call_sides (shapes [i % shapes.Length]);
+		return sum == 22000 ? 0 : 1;
+	}
+
+	static public int test_0_guarded_call_npe () {
+		IShape[] shapes = new IShape [] { new Triangle (), new Square () };
+
+		for (int i = 0; i < 1000; ++i)
+			call_sides (shapes [i % 2]);
+		try {
+			call_sides (null);
+			return 1;
+		} catch (NullReferenceException) {
+		}
+		try {
+			call_square_sides (null);
+			return 2;
+		} catch (NullReferenceException) {
+		}
+		return 0;
+	}
+}
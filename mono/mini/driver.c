@@ -335,6 +335,8 @@ opt_sets [] = {
        MONO_OPT_BRANCH | MONO_OPT_PEEPHOLE | MONO_OPT_LINEARS | MONO_OPT_COPYPROP | MONO_OPT_CONSPROP | MONO_OPT_DEADCE | MONO_OPT_LOOP | MONO_OPT_INLINE | MONO_OPT_INTRINS | MONO_OPT_ABCREM,
        MONO_OPT_BRANCH | MONO_OPT_PEEPHOLE | MONO_OPT_LINEARS | MONO_OPT_COPYPROP | MONO_OPT_CONSPROP | MONO_OPT_DEADCE | MONO_OPT_LOOP | MONO_OPT_INLINE | MONO_OPT_INTRINS | MONO_OPT_SSAPRE,
        MONO_OPT_BRANCH | MONO_OPT_PEEPHOLE | MONO_OPT_LINEARS | MONO_OPT_COPYPROP | MONO_OPT_CONSPROP | MONO_OPT_DEADCE | MONO_OPT_LOOP | MONO_OPT_INLINE | MONO_OPT_INTRINS | MONO_OPT_ABCREM | MONO_OPT_SHARED,
+       MONO_OPT_BRANCH | MONO_OPT_PEEPHOLE | MONO_OPT_LINEARS | MONO_OPT_COPYPROP | MONO_OPT_CONSPROP | MONO_OPT_DEADCE | MONO_OPT_LOOP | MONO_OPT_INLINE | MONO_OPT_INTRINS | MONO_OPT_EXCEPTION | MONO_OPT_ABCREM | MONO_OPT_LICM,
+       MONO_OPT_BRANCH | MONO_OPT_PEEPHOLE | MONO_OPT_LINEARS | MONO_OPT_COPYPROP | MONO_OPT_CONSPROP | MONO_OPT_DEADCE | MONO_OPT_LOOP | MONO_OPT_INLINE | MONO_OPT_INTRINS | MONO_OPT_EXCEPTION | MONO_OPT_ESCAPE,
        DEFAULT_OPTIMIZATIONS, 
 };
 
@@ -1060,7 +1062,7 @@ static void main_thread_handler (gpointer user_data)
 		 * This must be done in a thread managed by mono since it can invoke
 		 * managed code.
 		 */
-		if (main_args->opts & MONO_OPT_PRECOMP)
+		if ((main_args->opts & MONO_OPT_PRECOMP) || mono_precompile_threads)
 			mono_precompile_assemblies ();
 
 		mono_jit_exec (main_args->domain, assembly, main_args->argc, main_args->argv);
@@ -1208,6 +1210,17 @@ mini_usage (void)
 		"    --attach=OPTIONS       Pass OPTIONS to the attach agent in the runtime.\n"
 		"                           Currently the only supported option is 'disable'.\n"
 		"    --llvm, --nollvm       Controls whenever the runtime uses LLVM to compile code.\n"
+		"    --tiered[=CALLS]       Compile methods quickly first, and optimize them in the\n"
+		"                           background once they were called CALLS times\n"
+		"    --jit-speculative      Compile methods in the background before their first call\n"
+		"    --jit-threads=N        Use up to N threads for background compilation\n"
+		"    --pgo=FILE             Guide inlining with the call counts in FILE, written by\n"
+		"                           --profile=log:pgo=FILE\n"
+		"    --jit-cache=DIR        Keep the JIT code of assemblies without an AOT image in\n"
+		"                           DIR, and reuse it in later runs\n"
+		"    --precompile-parallel[=N]\n"
+		"                           Compile all the methods of the program and of the\n"
+		"                           assemblies it references on N threads at startup\n"
 	        "    --gc=[sgen,boehm]      Select SGen or Boehm GC (runs mono or mono-sgen)\n"
 #ifdef HOST_WIN32
 	        "    --mixed-mode           Enable mixed-mode image support.\n"
@@ -1671,6 +1684,28 @@ mono_main (int argc, char* argv[])
 			forced_version = &argv [i][10];
 		} else if (strcmp (argv [i], "--jitmap") == 0) {
 			mono_enable_jit_map ();
+		} else if (strcmp (argv [i], "--tiered") == 0) {
+			mono_tiered_compilation = TRUE;
+		} else if (strncmp (argv [i], "--tiered=", 9) == 0) {
+			mono_tiered_compilation = TRUE;
+			mono_tiered_threshold = atoi (argv [i] + 9);
+		} else if (strncmp (argv [i], "--jit-threads=", 14) == 0) {
+			mono_jit_pool_threads = atoi (argv [i] + 14);
+		} else if (strcmp (argv [i], "--jit-speculative") == 0) {
+			mono_jit_speculative = TRUE;
+		} else if (strncmp (argv [i], "--jit-cache=", 12) == 0) {
+			mono_jit_cache_dir = argv [i] + 12;
+			mono_jit_cache_runtime = argv [0];
+		} else if (strcmp (argv [i], "--precompile-parallel") == 0) {
+			mono_precompile_threads = -1;
+		} else if (strncmp (argv [i], "--precompile-parallel=", 22) == 0) {
+			mono_precompile_threads = atoi (argv [i] + 22);
+			if (mono_precompile_threads <= 0) {
+				fprintf (stderr, "Invalid number of threads for --precompile-parallel: %s\n", argv [i] + 22);
+				return 1;
+			}
+		} else if (strncmp (argv [i], "--pgo=", 6) == 0) {
+			mini_pgo_load (argv [i] + 6, mini_verbose > 0);
 		} else if (strcmp (argv [i], "--profile") == 0) {
 			enable_profile = TRUE;
 			profile_options = NULL;
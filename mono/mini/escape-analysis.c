@@ -0,0 +1,958 @@
+/*
+ * escape-analysis.c: Escape analysis and scalar replacement of objects
+ *
+ * Objects allocated by newobj which are only used to load and store their
+ * own fields inside the method, including inside inlined constructors and
+ * accessors, don't need to live on the GC heap. This pass removes their
+ * allocation and replaces each field by a local variable, so the GC maps
+ * describe them like any other local.
+ *
+ * To keep the analysis simple and sound, an allocation is only replaced if:
+ * - it is executed at most once per invocation, i.e. it is not in a loop and
+ *   the method has no exception clauses,
+ * - every use of a variable holding the object is dominated by a copy of the
+ *   object into the variable, so the variable is never null when it is used,
+ * - the object is never stored, passed to a call, returned, compared or
+ *   converted, and its header is never accessed.
+ *
+ * Copyright 2014 Xamarin, Inc (http://www.xamarin.com)
+ */
+
+#include <config.h>
+#include <string.h>
+
+#include <mono/metadata/gc-internal.h>
+#include <mono/metadata/mempool-internals.h>
+
+#include "mini.h"
+#include "ir-emit.h"
+
+#ifndef DISABLE_JIT
+
+/* Max number of instance fields of a replaced object */
+#define MAX_FIELDS 16
+/* Max number of allocations considered in one method */
+#define MAX_ALLOC_SITES 16
+
+enum {
+	/* Holds the object */
+	VREG_OBJ = 1,
+	/* Holds the address of a field, used by a write barrier */
+	VREG_WBARRIER_ADDR,
+	/* Holds the card of a field address, computed by an inline card table write barrier */
+	VREG_CARD_ADDR,
+	/* Defined by the argument setup of the allocation call */
+	VREG_ALLOC_ARG
+};
+
+enum {
+	ACTION_NULLIFY,
+	ACTION_LOAD,
+	ACTION_STORE
+};
+
+typedef struct {
+	MonoClassField *field;
+	MonoType *type;
+	int load_op, store_op;
+	/* The local variable replacing the field */
+	MonoInst *var;
+} ReplacedField;
+
+typedef struct {
+	MonoInst *ins;
+	int action, field;
+} Action;
+
+typedef struct {
+	MonoCompile *cfg;
+	MonoAllocSite *site;
+	MonoBasicBlock *bb;
+	ReplacedField fields [MAX_FIELDS];
+	int nfields;
+	int nvregs;
+	/* Indexed by vreg */
+	guint8 *kind;
+	/* For variables holding the object, the bblocks copying the object into them */
+	GSList **def_bbs;
+	/* For variables holding the object, block_num + 1 of the bblock which defined them last */
+	int *def_mark;
+	GArray *actions;
+} EscapeContext;
+
+static const double r8_0 = 0.0;
+
+static int
+normalize_mem_opcode (int opcode)
+{
+	switch (opcode) {
+#if SIZEOF_REGISTER == 8
+	case OP_LOADI8_MEMBASE:
+		return OP_LOAD_MEMBASE;
+	case OP_STOREI8_MEMBASE_REG:
+		return OP_STORE_MEMBASE_REG;
+	case OP_STOREI8_MEMBASE_IMM:
+		return OP_STORE_MEMBASE_IMM;
+#else
+	case OP_LOADI4_MEMBASE:
+		return OP_LOAD_MEMBASE;
+	case OP_STOREI4_MEMBASE_REG:
+		return OP_STORE_MEMBASE_REG;
+	case OP_STOREI4_MEMBASE_IMM:
+		return OP_STORE_MEMBASE_IMM;
+#endif
+	default:
+		return opcode;
+	}
+}
+
+static int
+store_reg_to_imm (int opcode)
+{
+	switch (opcode) {
+	case OP_STOREI1_MEMBASE_REG:
+		return OP_STOREI1_MEMBASE_IMM;
+	case OP_STOREI2_MEMBASE_REG:
+		return OP_STOREI2_MEMBASE_IMM;
+	case OP_STOREI4_MEMBASE_REG:
+		return OP_STOREI4_MEMBASE_IMM;
+	case OP_STOREI8_MEMBASE_REG:
+		return OP_STOREI8_MEMBASE_IMM;
+	case OP_STORE_MEMBASE_REG:
+		return OP_STORE_MEMBASE_IMM;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * collect_fields:
+ *
+ *   Collect the instance fields of KLASS, return FALSE if objects of KLASS can't
+ * be replaced by local variables.
+ */
+static gboolean
+collect_fields (EscapeContext *ctx, MonoClass *klass)
+{
+	MonoClass *k;
+
+	if (klass->valuetype || klass->rank || klass == mono_defaults.string_class || mono_class_has_finalizer (klass) ||
+		mono_class_is_marshalbyref (klass) || mono_class_is_contextbound (klass) ||
+		(klass->flags & TYPE_ATTRIBUTE_LAYOUT_MASK) == TYPE_ATTRIBUTE_EXPLICIT_LAYOUT ||
+		mono_class_has_parent (klass, mono_defaults.multicastdelegate_class))
+		return FALSE;
+
+	for (k = klass; k; k = k->parent) {
+		MonoClassField *field;
+		gpointer iter = NULL;
+
+		while ((field = mono_class_get_fields (k, &iter))) {
+			ReplacedField *rf;
+			MonoType *type;
+			int load_op;
+
+			if (field->type->attrs & FIELD_ATTRIBUTE_STATIC)
+				continue;
+			if (ctx->nfields == MAX_FIELDS)
+				return FALSE;
+
+			type = mono_type_get_underlying_type (field->type);
+			load_op = mono_type_to_load_membase (ctx->cfg, type);
+			switch (load_op) {
+			case OP_LOADI1_MEMBASE:
+			case OP_LOADU1_MEMBASE:
+			case OP_LOADI2_MEMBASE:
+			case OP_LOADU2_MEMBASE:
+			case OP_LOADI4_MEMBASE:
+			case OP_LOADU4_MEMBASE:
+			case OP_LOAD_MEMBASE:
+				break;
+#if SIZEOF_REGISTER == 8
+			case OP_LOADI8_MEMBASE:
+				break;
+#endif
+			case OP_LOADR8_MEMBASE:
+				if (mono_arch_is_soft_float ())
+					return FALSE;
+				break;
+			default:
+				/* Valuetypes, floats, and longs on 32 bit platforms */
+				return FALSE;
+			}
+
+			rf = &ctx->fields [ctx->nfields ++];
+			rf->field = field;
+			rf->type = type;
+			rf->load_op = normalize_mem_opcode (load_op);
+			rf->store_op = normalize_mem_opcode (mono_type_to_store_membase (ctx->cfg, type));
+		}
+	}
+
+	return TRUE;
+}
+
+static int
+find_field (EscapeContext *ctx, int offset, int opcode)
+{
+	int i;
+
+	opcode = normalize_mem_opcode (opcode);
+	for (i = 0; i < ctx->nfields; ++i) {
+		ReplacedField *rf = &ctx->fields [i];
+
+		if (rf->field->offset != offset)
+			continue;
+		if (opcode == rf->load_op || opcode == rf->store_op || opcode == normalize_mem_opcode (store_reg_to_imm (rf->store_op)))
+			return i;
+		return -1;
+	}
+	return -1;
+}
+
+/*
+ * is_alloc_arg_ins:
+ *
+ *   Return whenever INS can be part of the argument setup of the allocation call.
+ */
+static gboolean
+is_alloc_arg_ins (MonoInst *ins)
+{
+	switch (ins->opcode) {
+	case OP_NOP:
+	case OP_MOVE:
+	case OP_ICONST:
+	case OP_I8CONST:
+	case OP_AOTCONST:
+	case OP_GOT_ENTRY:
+	case OP_GC_PARAM_SLOT_LIVENESS_DEF:
+#if defined(TARGET_X86) || defined(TARGET_AMD64)
+	case OP_X86_PUSH:
+	case OP_X86_PUSH_IMM:
+#endif
+		return TRUE;
+	default:
+		/* Stores into the outgoing argument area */
+		return (MONO_IS_STORE_MEMBASE (ins) && ins->inst_destbasereg < MONO_MAX_IREGS);
+	}
+}
+
+/*
+ * check_alloc_seq:
+ *
+ *   Check that the instructions between the start of the allocation sequence
+ * and the call only compute the arguments of the call.
+ */
+static gboolean
+check_alloc_seq (EscapeContext *ctx)
+{
+	MonoAllocSite *site = ctx->site;
+	MonoInst *ins;
+
+	for (ins = ctx->bb->code; ins && ins != site->first; ins = ins->next)
+		;
+	if (!ins)
+		return FALSE;
+
+	for (; ins != site->call; ins = ins->next) {
+		if (!ins || !is_alloc_arg_ins (ins))
+			return FALSE;
+		if (INS_INFO (ins->opcode) [MONO_INST_DEST] != ' ' && !MONO_IS_STORE_MEMBASE (ins) && ins->dreg >= MONO_MAX_IREGS) {
+			/* These are only used by the call */
+			if (get_vreg_to_inst (ctx->cfg, ins->dreg))
+				return FALSE;
+			ctx->kind [ins->dreg] = VREG_ALLOC_ARG;
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * is_in_cycle:
+ *
+ *   Return whenever BB can be executed more than once.
+ */
+static gboolean
+is_in_cycle (MonoCompile *cfg, MonoBasicBlock *bb)
+{
+	MonoBasicBlock **stack;
+	guint8 *visited;
+	int i, sp = 0;
+	gboolean res = FALSE;
+
+	visited = g_new0 (guint8, cfg->max_block_num + 1);
+	stack = g_new0 (MonoBasicBlock*, cfg->max_block_num + 1);
+
+	for (i = 0; i < bb->out_count; ++i) {
+		if (!visited [bb->out_bb [i]->block_num]) {
+			visited [bb->out_bb [i]->block_num] = TRUE;
+			stack [sp ++] = bb->out_bb [i];
+		}
+	}
+	while (sp > 0 && !res) {
+		MonoBasicBlock *cur = stack [-- sp];
+
+		if (cur == bb) {
+			res = TRUE;
+			break;
+		}
+		for (i = 0; i < cur->out_count; ++i) {
+			MonoBasicBlock *next = cur->out_bb [i];
+
+			if (!visited [next->block_num]) {
+				visited [next->block_num] = TRUE;
+				stack [sp ++] = next;
+			}
+		}
+	}
+
+	g_free (visited);
+	g_free (stack);
+	return res;
+}
+
+static gboolean
+is_tracked_var (MonoCompile *cfg, MonoInst *var)
+{
+	return var->opcode == OP_LOCAL && var != cfg->ret && !(var->flags & (MONO_INST_VOLATILE|MONO_INST_INDIRECT));
+}
+
+static MonoInst*
+next_ins (MonoInst *ins)
+{
+	for (ins = ins->next; ins && ins->opcode == OP_NOP; ins = ins->next)
+		;
+	return ins;
+}
+
+static gboolean
+is_card_table_const (MonoInst *ins, guint8 *card_table)
+{
+	switch (ins->opcode) {
+	case OP_PCONST:
+		return ins->inst_p0 == card_table;
+	case OP_AOTCONST:
+		return ins->inst_c1 == MONO_PATCH_INFO_GC_CARD_TABLE_ADDR;
+#ifdef MONO_ARCH_NEED_GOT_VAR
+	case OP_GOT_ENTRY:
+		return ((MonoInst*)ins->inst_p1)->inst_right == (gpointer)MONO_PATCH_INFO_GC_CARD_TABLE_ADDR;
+#endif
+	default:
+		return FALSE;
+	}
+}
+
+/*
+ * is_card_mark_seq:
+ *
+ *   Return whenever SHR starts the inline card table write barrier emitted by
+ * emit_write_barrier (), i.e.
+ *
+ *   shr_un_imm R <- ADDR [shift]
+ *   pand_imm R <- R [mask]         (if the card table has a mask)
+ *   pconst/aotconst C <- card table
+ *   padd R <- R C
+ *   storei1_membase_imm [R + 0] <- 1
+ */
+static gboolean
+is_card_mark_seq (MonoInst *shr)
+{
+	guint8 *card_table;
+	int shift_bits;
+	gpointer mask;
+	MonoInst *ins, *card;
+	int reg = shr->dreg;
+
+	card_table = mono_gc_get_card_table (&shift_bits, &mask);
+	if (!card_table || shr->opcode != OP_SHR_UN_IMM || shr->inst_imm != shift_bits)
+		return FALSE;
+	ins = next_ins (shr);
+	if (mask) {
+		if (!ins || ins->opcode != OP_PAND_IMM || ins->dreg != reg || ins->sreg1 != reg || ins->inst_imm != (gssize)mask)
+			return FALSE;
+		ins = next_ins (ins);
+	}
+	card = ins;
+	if (!card || !is_card_table_const (card, card_table))
+		return FALSE;
+	ins = next_ins (card);
+	if (!ins || ins->opcode != OP_PADD || ins->dreg != reg || ins->sreg1 != reg || ins->sreg2 != card->dreg)
+		return FALSE;
+	ins = next_ins (ins);
+	return ins && ins->opcode == OP_STOREI1_MEMBASE_IMM && ins->inst_destbasereg == reg && ins->inst_offset == 0 && ins->inst_imm == 1;
+}
+
+/*
+ * mark_vregs:
+ *
+ *   Compute the set of vregs which hold the object, or the address of one of its
+ * fields for write barriers. Return FALSE if the object is copied into
+ * something which can't be tracked.
+ */
+static gboolean
+mark_vregs (EscapeContext *ctx)
+{
+	MonoCompile *cfg = ctx->cfg;
+	MonoBasicBlock *bb;
+	MonoInst *ins, *var;
+	gboolean changed = TRUE;
+
+	ctx->kind [ctx->site->call->dreg] = VREG_OBJ;
+	var = get_vreg_to_inst (cfg, ctx->site->call->dreg);
+	if (var && !is_tracked_var (cfg, var))
+		return FALSE;
+
+	while (changed) {
+		changed = FALSE;
+		for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+			MONO_BB_FOR_EACH_INS (bb, ins) {
+				int kind = 0;
+
+				if (ins->dreg < MONO_MAX_IREGS || ins->dreg >= ctx->nvregs || ctx->kind [ins->dreg] || ins->sreg1 == -1 || ins->sreg1 >= ctx->nvregs)
+					continue;
+
+				switch (ins->opcode) {
+				case OP_MOVE:
+					if (ctx->kind [ins->sreg1] == VREG_OBJ)
+						kind = VREG_OBJ;
+					break;
+				case OP_PADD_IMM:
+					if (ctx->kind [ins->sreg1] == VREG_OBJ)
+						kind = VREG_WBARRIER_ADDR;
+					else if (ctx->kind [ins->sreg1] == VREG_WBARRIER_ADDR)
+						return FALSE;
+					break;
+				case OP_SHR_UN_IMM:
+					/* Other uses of the field address make the object escape */
+					if (ctx->kind [ins->sreg1] == VREG_WBARRIER_ADDR && is_card_mark_seq (ins))
+						kind = VREG_CARD_ADDR;
+					break;
+				default:
+					break;
+				}
+				if (!kind)
+					continue;
+
+				var = get_vreg_to_inst (cfg, ins->dreg);
+				if (var && (kind != VREG_OBJ || !is_tracked_var (cfg, var)))
+					return FALSE;
+				ctx->kind [ins->dreg] = kind;
+				changed = TRUE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static void
+add_action (EscapeContext *ctx, MonoInst *ins, int action, int field)
+{
+	Action a;
+
+	a.ins = ins;
+	a.action = action;
+	a.field = field;
+	g_array_append_val (ctx->actions, a);
+}
+
+static inline int
+get_kind (EscapeContext *ctx, int vreg)
+{
+	return (vreg >= MONO_MAX_IREGS && vreg < ctx->nvregs) ? ctx->kind [vreg] : 0;
+}
+
+/*
+ * is_defined:
+ *
+ *   Return whenever the object is always copied into VREG before its use in BB.
+ */
+static gboolean
+is_defined (EscapeContext *ctx, MonoBasicBlock *bb, int vreg)
+{
+	MonoCompile *cfg = ctx->cfg;
+	GSList *l;
+
+	/* Temporaries are only used after their definition in the same bblock */
+	if (!get_vreg_to_inst (cfg, vreg))
+		return TRUE;
+	if (ctx->def_mark [vreg] == bb->block_num + 1)
+		return TRUE;
+	if (!bb->dominators)
+		return FALSE;
+	for (l = ctx->def_bbs [vreg]; l; l = l->next) {
+		MonoBasicBlock *def_bb = l->data;
+
+		if (def_bb != bb && (def_bb == cfg->bb_entry || def_bb->dfn) && mono_bitset_test_fast (bb->dominators, def_bb->dfn))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static gboolean
+call_uses_object (EscapeContext *ctx, MonoCallInst *call)
+{
+	GSList *l;
+	int i;
+
+	/* The arguments are not visible as sregs of the call */
+	if (call->args && call->signature) {
+		for (i = 0; i < call->signature->param_count + call->signature->hasthis; ++i) {
+			if (call->args [i] && get_kind (ctx, call->args [i]->dreg))
+				return TRUE;
+		}
+	}
+	for (l = call->out_ireg_args; l; l = l->next) {
+		guint32 regpair = (guint32)(gssize)(l->data);
+
+		if (get_kind (ctx, regpair & 0xffffff))
+			return TRUE;
+	}
+	for (l = call->out_freg_args; l; l = l->next) {
+		guint32 regpair = (guint32)(gssize)(l->data);
+
+		if (get_kind (ctx, regpair & 0xffffff))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * check_def:
+ *
+ *   Check a definition of a vreg tracked by the analysis.
+ */
+static gboolean
+check_def (EscapeContext *ctx, MonoBasicBlock *bb, MonoInst *ins, gboolean collect)
+{
+	MonoCompile *cfg = ctx->cfg;
+
+	switch (ctx->kind [ins->dreg]) {
+	case VREG_OBJ:
+		if (ins->opcode == OP_MOVE && get_kind (ctx, ins->sreg1) == VREG_OBJ) {
+			if (collect) {
+				if (!g_slist_find (ctx->def_bbs [ins->dreg], bb))
+					ctx->def_bbs [ins->dreg] = g_slist_prepend_mempool (cfg->mempool, ctx->def_bbs [ins->dreg], bb);
+			} else {
+				ctx->def_mark [ins->dreg] = bb->block_num + 1;
+				add_action (ctx, ins, ACTION_NULLIFY, -1);
+			}
+			return TRUE;
+		}
+		/* The initialization of locals */
+		if (bb == cfg->bb_init && ((ins->opcode == OP_ICONST && ins->inst_c0 == 0) || (ins->opcode == OP_I8CONST && ins->inst_l == 0)))
+			return TRUE;
+		return FALSE;
+	case VREG_WBARRIER_ADDR:
+		if (ins->opcode != OP_PADD_IMM)
+			return FALSE;
+		if (!collect)
+			add_action (ctx, ins, ACTION_NULLIFY, -1);
+		return TRUE;
+	case VREG_CARD_ADDR:
+		/* The sequence matched by is_card_mark_seq () */
+		switch (ins->opcode) {
+		case OP_SHR_UN_IMM:
+		case OP_PAND_IMM:
+			break;
+		case OP_PADD:
+			if (get_kind (ctx, ins->sreg2))
+				return FALSE;
+			break;
+		default:
+			return FALSE;
+		}
+		if (!collect)
+			add_action (ctx, ins, ACTION_NULLIFY, -1);
+		return TRUE;
+	default:
+		/* The argument setup of the allocation is only used by the allocation call */
+		return FALSE;
+	}
+}
+
+/*
+ * check_ins:
+ *
+ *   Check that INS doesn't make the object escape, and compute how it has to be
+ * changed when the object is replaced by local variables.
+ */
+static gboolean
+check_ins (EscapeContext *ctx, MonoBasicBlock *bb, MonoInst *ins)
+{
+	int i, num_sregs, sregs [MONO_MAX_SRC_REGS];
+
+	if (MONO_IS_LOAD_MEMBASE (ins) && get_kind (ctx, ins->inst_basereg) == VREG_OBJ) {
+		int field = find_field (ctx, ins->inst_offset, ins->opcode);
+
+		if (field == -1 || !is_defined (ctx, bb, ins->inst_basereg) || get_kind (ctx, ins->dreg))
+			return FALSE;
+		add_action (ctx, ins, ACTION_LOAD, field);
+		return TRUE;
+	}
+
+	if (MONO_IS_STORE_MEMBASE (ins) && get_kind (ctx, ins->inst_destbasereg) == VREG_OBJ) {
+		int field = find_field (ctx, ins->inst_offset, ins->opcode);
+
+		/* Storing the object into itself */
+		if (field == -1 || !is_defined (ctx, bb, ins->inst_destbasereg) || (ins->sreg1 != -1 && get_kind (ctx, ins->sreg1)))
+			return FALSE;
+		add_action (ctx, ins, ACTION_STORE, field);
+		return TRUE;
+	}
+
+	if (MONO_IS_STORE_MEMBASE (ins) && get_kind (ctx, ins->inst_destbasereg) == VREG_CARD_ADDR) {
+		/* Card marking */
+		if (ins->opcode != OP_STOREI1_MEMBASE_IMM || ins->inst_offset != 0 || ins->inst_imm != 1)
+			return FALSE;
+		add_action (ctx, ins, ACTION_NULLIFY, -1);
+		return TRUE;
+	}
+
+	if (MONO_IS_STORE_MEMBASE (ins) && get_kind (ctx, ins->inst_destbasereg))
+		return FALSE;
+
+	if (MONO_IS_CALL (ins) && call_uses_object (ctx, (MonoCallInst*)ins))
+		return FALSE;
+
+	num_sregs = mono_inst_get_src_registers (ins, sregs);
+	for (i = 0; i < num_sregs; ++i) {
+		int sreg = sregs [i];
+
+		switch (get_kind (ctx, sreg)) {
+		case 0:
+			break;
+		case VREG_OBJ:
+			if (!is_defined (ctx, bb, sreg))
+				return FALSE;
+			switch (ins->opcode) {
+			case OP_MOVE:
+			case OP_PADD_IMM:
+				/* Handled by check_def () */
+				if (!get_kind (ctx, ins->dreg))
+					return FALSE;
+				break;
+			case OP_NOT_NULL:
+			case OP_CHECK_THIS:
+			case OP_DUMMY_USE:
+				add_action (ctx, ins, ACTION_NULLIFY, -1);
+				break;
+			case OP_COMPARE_IMM:
+			case OP_ICOMPARE_IMM:
+			case OP_LCOMPARE_IMM:
+				/* Explicit null checks */
+				if (ins->inst_imm != 0 || !ins->next || (ins->next->opcode != OP_COND_EXC_EQ && ins->next->opcode != OP_COND_EXC_IEQ))
+					return FALSE;
+				add_action (ctx, ins, ACTION_NULLIFY, -1);
+				add_action (ctx, ins->next, ACTION_NULLIFY, -1);
+				break;
+			default:
+				return FALSE;
+			}
+			break;
+		case VREG_WBARRIER_ADDR:
+			switch (ins->opcode) {
+			case OP_CARD_TABLE_WBARRIER:
+				if (i != 0)
+					return FALSE;
+				add_action (ctx, ins, ACTION_NULLIFY, -1);
+				break;
+			case OP_SHR_UN_IMM:
+				/* Handled by check_def () */
+				if (get_kind (ctx, ins->dreg) != VREG_CARD_ADDR)
+					return FALSE;
+				break;
+			default:
+				return FALSE;
+			}
+			break;
+		case VREG_CARD_ADDR:
+			switch (ins->opcode) {
+			case OP_PAND_IMM:
+			case OP_PADD:
+				/* Handled by check_def () */
+				if (i != 0 || get_kind (ctx, ins->dreg) != VREG_CARD_ADDR)
+					return FALSE;
+				break;
+			default:
+				return FALSE;
+			}
+			break;
+		default:
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * check_uses:
+ *
+ *   Check every instruction outside the allocation sequence. If COLLECT is
+ * TRUE, only collect the bblocks copying the object into variables.
+ */
+static gboolean
+check_uses (EscapeContext *ctx, gboolean collect)
+{
+	MonoCompile *cfg = ctx->cfg;
+	MonoBasicBlock *bb;
+	MonoInst *ins;
+
+	for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+		gboolean in_alloc_seq = FALSE;
+
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			if (ins == ctx->site->first)
+				in_alloc_seq = TRUE;
+			if (in_alloc_seq) {
+				if (ins == ctx->site->call) {
+					in_alloc_seq = FALSE;
+					if (get_vreg_to_inst (cfg, ins->dreg)) {
+						if (collect)
+							ctx->def_bbs [ins->dreg] = g_slist_prepend_mempool (cfg->mempool, ctx->def_bbs [ins->dreg], bb);
+						else
+							ctx->def_mark [ins->dreg] = bb->block_num + 1;
+					}
+				}
+				continue;
+			}
+
+			if (ins->opcode == OP_NOP)
+				continue;
+
+			/* Uses come before the definitions of the same instruction */
+			if (!collect && !check_ins (ctx, bb, ins))
+				return FALSE;
+			if (INS_INFO (ins->opcode) [MONO_INST_DEST] != ' ' && !MONO_IS_STORE_MEMBASE (ins) && !MONO_IS_STORE_MEMINDEX (ins) && get_kind (ctx, ins->dreg)) {
+				if (!check_def (ctx, bb, ins, collect))
+					return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static void
+emit_zero_init (EscapeContext *ctx, ReplacedField *rf)
+{
+	MonoCompile *cfg = ctx->cfg;
+	MonoInst *ins;
+
+	if (rf->load_op == OP_LOADR8_MEMBASE) {
+		MONO_INST_NEW (cfg, ins, OP_R8CONST);
+		ins->inst_p0 = (gpointer)&r8_0;
+#if SIZEOF_REGISTER == 8
+	} else if (rf->load_op == OP_LOAD_MEMBASE) {
+		MONO_INST_NEW (cfg, ins, OP_I8CONST);
+		ins->inst_l = 0;
+#endif
+	} else {
+		MONO_INST_NEW (cfg, ins, OP_ICONST);
+		ins->inst_c0 = 0;
+	}
+	ins->dreg = rf->var->dreg;
+	mono_bblock_insert_before_ins (ctx->bb, ctx->site->call, ins);
+}
+
+/*
+ * get_store_opcode:
+ *
+ *   Return the opcode which stores a value into the variable replacing RF.
+ */
+static int
+get_store_opcode (ReplacedField *rf)
+{
+	switch (rf->type->type) {
+	case MONO_TYPE_I1:
+		return OP_ICONV_TO_I1;
+	case MONO_TYPE_U1:
+	case MONO_TYPE_BOOLEAN:
+		return OP_ICONV_TO_U1;
+	case MONO_TYPE_I2:
+		return OP_ICONV_TO_I2;
+	case MONO_TYPE_U2:
+	case MONO_TYPE_CHAR:
+		return OP_ICONV_TO_U2;
+	case MONO_TYPE_R8:
+		return OP_FMOVE;
+	default:
+		return OP_MOVE;
+	}
+}
+
+static void
+store_imm (ReplacedField *rf, MonoInst *ins)
+{
+	gint64 val = ins->inst_imm;
+
+	switch (rf->type->type) {
+	case MONO_TYPE_I1:
+		val = (gint8)val;
+		break;
+	case MONO_TYPE_U1:
+	case MONO_TYPE_BOOLEAN:
+		val = (guint8)val;
+		break;
+	case MONO_TYPE_I2:
+		val = (gint16)val;
+		break;
+	case MONO_TYPE_U2:
+	case MONO_TYPE_CHAR:
+		val = (guint16)val;
+		break;
+	default:
+		break;
+	}
+
+#if SIZEOF_REGISTER == 8
+	if (rf->load_op == OP_LOAD_MEMBASE) {
+		ins->opcode = OP_I8CONST;
+		ins->inst_l = val;
+		return;
+	}
+#endif
+	ins->opcode = OP_ICONST;
+	ins->inst_c0 = (gint32)val;
+}
+
+static void
+replace_object (EscapeContext *ctx)
+{
+	MonoCompile *cfg = ctx->cfg;
+	MonoInst *ins, *next;
+	int i;
+
+	if (cfg->verbose_level > 1)
+		printf ("ESCAPE ANALYSIS: replacing object of class %s in BB%d by local variables.\n", mono_type_full_name (&ctx->site->klass->byval_arg), ctx->bb->block_num);
+
+	/* Objects are allocated zeroed */
+	for (i = 0; i < ctx->actions->len; ++i) {
+		Action *a = &g_array_index (ctx->actions, Action, i);
+		ReplacedField *rf;
+
+		if (a->action == ACTION_NULLIFY)
+			continue;
+		rf = &ctx->fields [a->field];
+		if (!rf->var) {
+			rf->var = mono_compile_create_var (cfg, rf->type, OP_LOCAL);
+			emit_zero_init (ctx, rf);
+		}
+	}
+
+	for (ins = ctx->site->first; ins != ctx->site->call; ins = next) {
+		next = ins->next;
+		NULLIFY_INS (ins);
+	}
+	NULLIFY_INS (ctx->site->call);
+
+	for (i = 0; i < ctx->actions->len; ++i) {
+		Action *a = &g_array_index (ctx->actions, Action, i);
+		ReplacedField *rf = a->field != -1 ? &ctx->fields [a->field] : NULL;
+
+		ins = a->ins;
+		switch (a->action) {
+		case ACTION_NULLIFY:
+			NULLIFY_INS (ins);
+			break;
+		case ACTION_LOAD:
+			ins->opcode = rf->load_op == OP_LOADR8_MEMBASE ? OP_FMOVE : OP_MOVE;
+			ins->sreg1 = rf->var->dreg;
+			ins->flags &= ~MONO_INST_FAULT;
+			break;
+		case ACTION_STORE:
+			if (store_reg_to_imm (ins->opcode) == -1)
+				/* A _MEMBASE_IMM store */
+				store_imm (rf, ins);
+			else
+				ins->opcode = get_store_opcode (rf);
+			ins->dreg = rf->var->dreg;
+			ins->flags &= ~MONO_INST_FAULT;
+			break;
+		default:
+			g_assert_not_reached ();
+		}
+	}
+
+	cfg->stat_scalar_replaced_objects ++;
+}
+
+static gboolean
+try_replace (MonoCompile *cfg, MonoAllocSite *site, MonoBasicBlock *bb)
+{
+	EscapeContext ctx;
+	gboolean res = FALSE;
+
+	memset (&ctx, 0, sizeof (ctx));
+	ctx.cfg = cfg;
+	ctx.site = site;
+	ctx.bb = bb;
+	ctx.nvregs = cfg->next_vreg;
+
+	if (!collect_fields (&ctx, site->klass) || is_in_cycle (cfg, bb))
+		return FALSE;
+
+	ctx.kind = g_new0 (guint8, ctx.nvregs);
+	ctx.def_bbs = g_new0 (GSList*, ctx.nvregs);
+	ctx.def_mark = g_new0 (int, ctx.nvregs);
+	ctx.actions = g_array_new (FALSE, FALSE, sizeof (Action));
+
+	if (check_alloc_seq (&ctx) && mark_vregs (&ctx) && check_uses (&ctx, TRUE) && check_uses (&ctx, FALSE)) {
+		replace_object (&ctx);
+		res = TRUE;
+	}
+
+	g_free (ctx.kind);
+	g_free (ctx.def_bbs);
+	g_free (ctx.def_mark);
+	g_array_free (ctx.actions, TRUE);
+	return res;
+}
+
+/*
+ * mono_escape_analysis:
+ *
+ *   Replace the objects allocated by the method which don't escape it by local
+ * variables. This runs after the depth-first order of the bblocks is computed,
+ * before the conversion to SSA form.
+ */
+void
+mono_escape_analysis (MonoCompile *cfg)
+{
+	GHashTable *calls;
+	MonoBasicBlock *bb;
+	MonoInst *ins;
+	GSList *l;
+	int nsites = 0;
+
+	if (!cfg->alloc_sites || cfg->header->num_clauses || cfg->gen_seq_points)
+		return;
+
+	calls = g_hash_table_new (NULL, NULL);
+	for (l = cfg->alloc_sites; l && nsites < MAX_ALLOC_SITES; l = l->next, nsites ++) {
+		MonoAllocSite *site = l->data;
+
+		g_hash_table_insert (calls, site->call, site);
+	}
+
+	mono_compile_dominator_info (cfg, MONO_COMP_DOM | MONO_COMP_IDOM);
+
+	for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+		MonoInst *next;
+
+		MONO_BB_FOR_EACH_INS_SAFE (bb, next, ins) {
+			MonoAllocSite *site;
+
+			if (!MONO_IS_CALL (ins))
+				continue;
+			site = g_hash_table_lookup (calls, ins);
+			if (site && ins->dreg != -1)
+				try_replace (cfg, site, bb);
+		}
+	}
+
+	g_hash_table_destroy (calls);
+}
+
+#endif /* !DISABLE_JIT */
@@ -0,0 +1,1565 @@
+/*
+ * loop-opts.c: Loop optimizations
+ *
+ * The passes in this file are enabled by -O=licm:
+ *
+ * - mono_loop_versioning () runs before the IR is converted to SSA form. It
+ *   looks for small innermost loops of the form
+ *
+ *     for (i = start; i < limit; i++) ... a [i] ...
+ *
+ *   where a and limit are loop invariant, and checks 'start >= 0',
+ *   'a != null' and 'a.Length >= limit' in the preheader. If the checks
+ *   pass, the loop runs without the bounds checks of a [i], otherwise a copy
+ *   of the loop which still contains them runs. The copy is needed because
+ *   throwing the IndexOutOfRangeException from the preheader would lose the
+ *   side effects of the iterations before the failing one.
+ *
+ * - mono_ssa_loop_optimizations () runs on SSA form. It moves loop invariant
+ *   computations, loads and checks into the preheader, and replaces the
+ *   multiplications and shifts of induction variables, like the 'i * size'
+ *   in the address computation of a [i] when the element size is not 1, 2,
+ *   4 or 8, by a variable which is incremented together with the induction
+ *   variable. A load is only moved if alias-analysis.c shows that none of
+ *   the stores in the loop can change the loaded value.
+ *
+ * - mono_ssa_loop_invariant_code_motion () is the variant used by the LLVM
+ *   backend, which does its own loop optimizations. It only moves the checks,
+ *   class initialization calls etc. at the start of loop headers, which
+ *   LLVM can't move because they can fault.
+ *
+ * Copyright 2014 Xamarin, Inc (http://www.xamarin.com)
+ */
+
+#include <config.h>
+#include <string.h>
+
+#include <mono/metadata/abi-details.h>
+
+#include "mini.h"
+#include "ir-emit.h"
+
+#ifndef DISABLE_JIT
+
+/* Loops larger than this are not versioned */
+#define MAX_VERSIONED_BBLOCKS 16
+#define MAX_VERSIONED_INS 256
+/* Max number of loops versioned in one method */
+#define MAX_VERSIONED_LOOPS 4
+/* Max number of arrays whose length is checked in the preheader of one loop */
+#define MAX_CHECKED_ARRAYS 4
+/* Max number of variables created by strength reduction in one loop */
+#define MAX_REDUCED_IVS 8
+
+/*
+ * is_temp:
+ *
+ *   Return whenever VREG is a temporary, i.e. a vreg which is not a variable.
+ * These are local to one bblock before SSA removal.
+ */
+static inline gboolean
+is_temp (MonoCompile *cfg, int vreg)
+{
+	return vreg >= MONO_MAX_IREGS && vreg >= MONO_MAX_FREGS && !get_vreg_to_inst (cfg, vreg);
+}
+
+static inline gboolean
+ins_defines (MonoInst *ins, int vreg)
+{
+	return INS_INFO (ins->opcode) [MONO_INST_DEST] != ' ' && !MONO_IS_STORE_MEMBASE (ins) && !MONO_IS_STORE_MEMINDEX (ins) && ins->dreg == vreg;
+}
+
+/*
+ * has_unsupported_regs:
+ *
+ *   Return whenever the instruction with SPEC uses registers which are made up
+ * of more than one vreg, the passes in this file don't handle those.
+ */
+static gboolean
+has_unsupported_regs (const char *spec)
+{
+	const char regs [] = { spec [MONO_INST_DEST], spec [MONO_INST_SRC1], spec [MONO_INST_SRC2], spec [MONO_INST_SRC3] };
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (regs); ++i) {
+#if SIZEOF_REGISTER == 4
+		if (regs [i] == 'l')
+			return TRUE;
+#endif
+		if (regs [i] == 'f' && mono_arch_is_soft_float ())
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * find_def_before:
+ *
+ *   Return the last instruction before INS in its bblock which defines VREG.
+ */
+static MonoInst*
+find_def_before (MonoInst *ins, int vreg)
+{
+	MonoInst *def;
+
+	for (def = ins->prev; def; def = def->prev) {
+		if (ins_defines (def, vreg))
+			return def;
+	}
+	return NULL;
+}
+
+/*
+ * resolve_copy:
+ *
+ *   Follow the moves which define the temporary VREG before INS back to the
+ * variable they copy.
+ */
+static int
+resolve_copy (MonoCompile *cfg, MonoInst *ins, int vreg)
+{
+	while (is_temp (cfg, vreg)) {
+		MonoInst *def = find_def_before (ins, vreg);
+
+		if (!def || def->opcode != OP_MOVE)
+			break;
+		vreg = def->sreg1;
+		ins = def;
+	}
+	return vreg;
+}
+
+static gboolean
+ins_is_before (MonoInst *ins, MonoInst *other)
+{
+	for (; ins; ins = ins->next) {
+		if (ins == other)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * get_stay_opcode:
+ *
+ *   Return the condition, as a branch opcode, under which execution stays
+ * inside the loop when the conditional branch BR at the end of the loop
+ * header H is taken, or -1 if one of the targets of BR is not outside the
+ * loop. IN_LOOP returns whenever a bblock belongs to the loop.
+ */
+static int
+get_stay_opcode (MonoBasicBlock *h, MonoInst *br, gboolean (*in_loop) (MonoBasicBlock *bb, gpointer data), gpointer data)
+{
+	gboolean true_in, false_in;
+
+	if (!br || !MONO_IS_COND_BRANCH_OP (br))
+		return -1;
+	true_in = in_loop (br->inst_true_bb, data);
+	false_in = in_loop (br->inst_false_bb ? br->inst_false_bb : h->next_bb, data);
+	if (true_in == false_in)
+		return -1;
+	return true_in ? br->opcode : mono_reverse_branch_op (br->opcode);
+}
+
+/*
+ * Loop versioning
+ */
+
+typedef struct {
+	MonoBasicBlock **blocks;
+	int nblocks;
+} LoopBlocks;
+
+static gboolean
+in_loop_blocks (MonoBasicBlock *bb, gpointer data)
+{
+	LoopBlocks *lb = data;
+	int i;
+
+	for (i = 0; i < lb->nblocks; ++i) {
+		if (lb->blocks [i] == bb)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * map_bb:
+ *
+ *   Return the copy of BB if it is part of the loop, BB otherwise.
+ */
+static MonoBasicBlock*
+map_bb (LoopBlocks *lb, MonoBasicBlock **clones, MonoBasicBlock *bb)
+{
+	int i;
+
+	for (i = 0; i < lb->nblocks; ++i) {
+		if (lb->blocks [i] == bb)
+			return clones [i];
+	}
+	return bb;
+}
+
+static gboolean
+can_clone_ins (MonoInst *ins)
+{
+	if (MONO_IS_CALL (ins) || MONO_IS_JUMP_TABLE (ins) || MONO_IS_PHI (ins))
+		return FALSE;
+
+	switch (ins->opcode) {
+	case OP_BR_REG:
+	case OP_DYN_CALL:
+	case OP_OUTARG_VT:
+	case OP_OUTARG_VTRETADDR:
+	case OP_CALL_HANDLER:
+	case OP_START_HANDLER:
+	case OP_ENDFINALLY:
+	case OP_ENDFILTER:
+	case OP_LOCALLOC:
+	case OP_LOCALLOC_IMM:
+	case OP_JMP:
+	case OP_ARGLIST:
+	case OP_SEQ_POINT:
+	case OP_IL_SEQ_POINT:
+	case OP_LIVERANGE_START:
+	case OP_LIVERANGE_END:
+	case OP_GC_LIVENESS_DEF:
+	case OP_GC_LIVENESS_USE:
+	case OP_GC_SPILL_SLOT_LIVENESS_DEF:
+	case OP_GC_PARAM_SLOT_LIVENESS_DEF:
+		return FALSE;
+	default:
+		return TRUE;
+	}
+}
+
+static MonoBasicBlock*
+new_bblock (MonoCompile *cfg, MonoBasicBlock *like)
+{
+	MonoBasicBlock *bb = mono_mempool_alloc0 (cfg->mempool, sizeof (MonoBasicBlock));
+
+	/* cfg->num_bblocks only counts the bblocks in cfg->bblocks, which is not updated here */
+	bb->block_num = cfg->max_block_num ++;
+	bb->region = like->region;
+	bb->real_offset = like->real_offset;
+	bb->cil_code = like->cil_code;
+	return bb;
+}
+
+/*
+ * clone_ins:
+ *
+ *   Return a copy of INS, with the temporaries it uses renamed according to
+ * VREG_MAP. The temporaries it defines are assigned new vregs.
+ */
+static MonoInst*
+clone_ins (MonoCompile *cfg, MonoInst *ins, int *vreg_map)
+{
+	const char *spec = INS_INFO (ins->opcode);
+	MonoInst *copy;
+	int i, num_sregs, sregs [MONO_MAX_SRC_REGS];
+
+	copy = mono_mempool_alloc (cfg->mempool, sizeof (MonoInst));
+	memcpy (copy, ins, sizeof (MonoInst));
+	copy->next = copy->prev = NULL;
+
+	num_sregs = mono_inst_get_src_registers (copy, sregs);
+	for (i = 0; i < num_sregs; ++i) {
+		if (is_temp (cfg, sregs [i]))
+			sregs [i] = vreg_map [sregs [i]];
+	}
+	mono_inst_set_src_registers (copy, sregs);
+
+	if (spec [MONO_INST_DEST] != ' ' && is_temp (cfg, ins->dreg)) {
+		if (!MONO_IS_STORE_MEMBASE (ins) && !MONO_IS_STORE_MEMINDEX (ins) && !vreg_map [ins->dreg]) {
+			if (spec [MONO_INST_DEST] == 'f')
+				vreg_map [ins->dreg] = mono_alloc_freg (cfg);
+			else
+				vreg_map [ins->dreg] = mono_alloc_ireg_copy (cfg, ins->dreg);
+		}
+		copy->dreg = vreg_map [ins->dreg];
+	}
+
+	return copy;
+}
+
+/*
+ * emit_guard_branch:
+ *
+ *   End BB with a conditional branch to SLOW_BB, and return a new bblock
+ * which is executed when the branch is not taken.
+ */
+static MonoBasicBlock*
+emit_guard_branch (MonoCompile *cfg, MonoBasicBlock *bb, int opcode, MonoBasicBlock *slow_bb)
+{
+	MonoBasicBlock *next;
+	MonoInst *ins;
+
+	next = new_bblock (cfg, bb);
+	next->next_bb = bb->next_bb;
+	bb->next_bb = next;
+
+	MONO_INST_NEW (cfg, ins, opcode);
+	ins->inst_many_bb = mono_mempool_alloc (cfg->mempool, sizeof (gpointer) * 2);
+	ins->inst_true_bb = slow_bb;
+	ins->inst_false_bb = next;
+	MONO_ADD_INS (bb, ins);
+	mono_link_bblock (cfg, bb, slow_bb);
+	mono_link_bblock (cfg, bb, next);
+
+	cfg->cbb = next;
+	return next;
+}
+
+/*
+ * get_limit_array:
+ *
+ *   If the temporary VREG holds the length of an array when INS is executed,
+ * return the variable holding the array, otherwise return -1.
+ */
+static int
+get_limit_array (MonoCompile *cfg, MonoInst *ins, int vreg)
+{
+	while (is_temp (cfg, vreg)) {
+		MonoInst *def = find_def_before (ins, vreg);
+
+		if (!def)
+			return -1;
+		switch (def->opcode) {
+		case OP_LDLEN:
+			return resolve_copy (cfg, def, def->sreg1);
+		case OP_MOVE:
+		case OP_SEXT_I4:
+		case OP_LCONV_TO_I4:
+		case OP_ICONV_TO_I4:
+			vreg = def->sreg1;
+			ins = def;
+			break;
+		default:
+			return -1;
+		}
+	}
+	return -1;
+}
+
+static gboolean
+is_invariant_var (MonoCompile *cfg, int vreg, guint8 *defs)
+{
+	MonoInst *var = get_vreg_to_inst (cfg, vreg);
+
+	return var && !(var->flags & (MONO_INST_VOLATILE|MONO_INST_INDIRECT)) && !defs [vreg];
+}
+
+/*
+ * is_nonnegative_start:
+ *
+ *   Return whenever IV is set to a non-negative constant at the end of PRE.
+ */
+static gboolean
+is_nonnegative_start (MonoCompile *cfg, MonoBasicBlock *pre, int iv)
+{
+	MonoInst *def = find_def_before (pre->last_ins, iv);
+
+	if (def && def->opcode == OP_MOVE && is_temp (cfg, def->sreg1))
+		def = find_def_before (def, def->sreg1);
+	return def && def->opcode == OP_ICONST && def->inst_c0 >= 0;
+}
+
+typedef struct {
+	int array_reg;
+	int offset;
+} CheckedArray;
+
+static gboolean
+version_loop (MonoCompile *cfg, MonoBasicBlock *h)
+{
+	LoopBlocks lb;
+	MonoBasicBlock *pre, *latch, *bb, *slow_h, *cur, *next, **clones;
+	MonoInst *ins, *cmp, *def, *iv_def, *var;
+	CheckedArray arrays [MAX_CHECKED_ARRAYS];
+	GPtrArray *checks, *proven;
+	MonoBasicBlock **temp_bb;
+	guint8 *defs;
+	int *vreg_map;
+	int i, j, nins, narrays, nvregs, stay_op, iv_reg, limit_reg, limit_array;
+	gint32 limit_imm = 0;
+	gboolean res = FALSE;
+	GList *l;
+
+	/* Only innermost loops */
+	if (g_list_length (h->loop_blocks) > MAX_VERSIONED_BBLOCKS)
+		return FALSE;
+	for (l = h->loop_blocks; l; l = l->next) {
+		bb = l->data;
+		if (bb != h && bb->loop_blocks)
+			return FALSE;
+	}
+
+	/* Collect the bblocks in emission order */
+	lb.blocks = g_new0 (MonoBasicBlock*, MAX_VERSIONED_BBLOCKS);
+	lb.nblocks = 0;
+	for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+		if (g_list_find (h->loop_blocks, bb))
+			lb.blocks [lb.nblocks ++] = bb;
+	}
+
+	/* The loop needs a preheader which branches to the header */
+	pre = NULL;
+	for (i = 0; i < h->in_count; ++i) {
+		if (!in_loop_blocks (h->in_bb [i], &lb)) {
+			if (pre) {
+				g_free (lb.blocks);
+				return FALSE;
+			}
+			pre = h->in_bb [i];
+		}
+	}
+	if (!pre || pre == cfg->bb_entry || pre->region != -1 || !pre->last_ins || pre->last_ins->opcode != OP_BR || pre->last_ins->inst_target_bb != h) {
+		g_free (lb.blocks);
+		return FALSE;
+	}
+
+	nvregs = cfg->next_vreg;
+	defs = g_new0 (guint8, nvregs);
+	temp_bb = g_new0 (MonoBasicBlock*, nvregs);
+	vreg_map = NULL;
+	clones = NULL;
+	checks = g_ptr_array_new ();
+	proven = g_ptr_array_new ();
+
+	/*
+	 * Check that the loop can be copied: no calls or exception handling, and
+	 * every temporary is defined before it is used in the same bblock.
+	 */
+	nins = 0;
+	for (i = 0; i < lb.nblocks; ++i) {
+		bb = lb.blocks [i];
+
+		if (bb->region != -1 || (bb->flags & BB_EXCEPTION_HANDLER) || bb->extended || bb->has_jump_table || bb->has_call_handler || bb->try_start)
+			goto done;
+
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			const char *spec = INS_INFO (ins->opcode);
+			int num_sregs, sregs [MONO_MAX_SRC_REGS];
+
+			if (!can_clone_ins (ins) || has_unsupported_regs (spec) || (MONO_IS_BRANCH_OP (ins) && ins != bb->last_ins))
+				goto done;
+
+			num_sregs = mono_inst_get_src_registers (ins, sregs);
+			for (j = 0; j < num_sregs; ++j) {
+				if (is_temp (cfg, sregs [j]) && temp_bb [sregs [j]] != bb)
+					goto done;
+			}
+			if (spec [MONO_INST_DEST] != ' ' && ins->dreg != -1) {
+				if (MONO_IS_STORE_MEMBASE (ins) || MONO_IS_STORE_MEMINDEX (ins)) {
+					if (is_temp (cfg, ins->dreg) && temp_bb [ins->dreg] != bb)
+						goto done;
+				} else if (is_temp (cfg, ins->dreg)) {
+					temp_bb [ins->dreg] = bb;
+				} else if (defs [ins->dreg] < 2) {
+					defs [ins->dreg] ++;
+				}
+			}
+
+			if (ins->opcode == OP_BOUNDS_CHECK) {
+				g_ptr_array_add (checks, bb);
+				g_ptr_array_add (checks, ins);
+			}
+			nins ++;
+		}
+	}
+	if (nins > MAX_VERSIONED_INS || !checks->len)
+		goto done;
+
+	/*
+	 * The header has to exit the loop unless iv < limit, where limit is a
+	 * constant, an invariant variable or the length of an invariant array.
+	 */
+	stay_op = get_stay_opcode (h, h->last_ins, in_loop_blocks, &lb);
+	cmp = h->last_ins->prev;
+	if (!cmp || (cmp->opcode != OP_ICOMPARE && cmp->opcode != OP_ICOMPARE_IMM))
+		goto done;
+	limit_reg = -1;
+	limit_array = -1;
+	if (cmp->opcode == OP_ICOMPARE_IMM) {
+		if (stay_op != OP_IBLT)
+			goto done;
+		iv_reg = resolve_copy (cfg, cmp, cmp->sreg1);
+		limit_imm = cmp->inst_imm;
+	} else {
+		int limit_sreg;
+
+		if (stay_op == OP_IBLT) {
+			iv_reg = resolve_copy (cfg, cmp, cmp->sreg1);
+			limit_sreg = cmp->sreg2;
+		} else if (stay_op == OP_IBGT) {
+			iv_reg = resolve_copy (cfg, cmp, cmp->sreg2);
+			limit_sreg = cmp->sreg1;
+		} else {
+			goto done;
+		}
+		limit_reg = resolve_copy (cfg, cmp, limit_sreg);
+		if (is_temp (cfg, limit_reg)) {
+			limit_array = get_limit_array (cfg, cmp, limit_reg);
+			if (limit_array == -1 || !is_invariant_var (cfg, limit_array, defs) || get_vreg_to_inst (cfg, limit_array)->type != STACK_OBJ)
+				goto done;
+			limit_reg = -1;
+		} else if (!is_invariant_var (cfg, limit_reg, defs)) {
+			goto done;
+		}
+	}
+
+	/* The induction variable is only changed by one 'iv = iv + 1' on the back edge */
+	var = get_vreg_to_inst (cfg, iv_reg);
+	if (!var || var->type != STACK_I4 || (var->flags & (MONO_INST_VOLATILE|MONO_INST_INDIRECT)) || defs [iv_reg] != 1)
+		goto done;
+	iv_def = NULL;
+	latch = NULL;
+	for (i = 0; i < lb.nblocks && !iv_def; ++i) {
+		MONO_BB_FOR_EACH_INS (lb.blocks [i], ins) {
+			if (ins_defines (ins, iv_reg)) {
+				iv_def = ins;
+				latch = lb.blocks [i];
+				break;
+			}
+		}
+	}
+	if (!iv_def || latch == h || latch->out_count != 1 || latch->out_bb [0] != h)
+		goto done;
+	def = iv_def;
+	if (def->opcode == OP_MOVE && is_temp (cfg, def->sreg1))
+		def = find_def_before (def, def->sreg1);
+	if (!def || def->opcode != OP_IADD_IMM || def->inst_imm != 1 || resolve_copy (cfg, def, def->sreg1) != iv_reg)
+		goto done;
+
+	/*
+	 * Find the bounds checks of invariant arrays indexed by iv. These are
+	 * only executed after the header found iv < limit, and before iv is
+	 * incremented.
+	 */
+	narrays = 0;
+	for (i = 0; i < checks->len; i += 2) {
+		MonoInst *from;
+		int array_reg, index_reg;
+
+		bb = g_ptr_array_index (checks, i);
+		ins = g_ptr_array_index (checks, i + 1);
+		if (bb == h || (bb == latch && !ins_is_before (ins, iv_def)))
+			continue;
+
+		array_reg = resolve_copy (cfg, ins, ins->sreg1);
+		if (!is_invariant_var (cfg, array_reg, defs) || get_vreg_to_inst (cfg, array_reg)->type != STACK_OBJ)
+			continue;
+
+		/* 64 bit targets sign extend the index before the check */
+		index_reg = ins->sreg2;
+		from = ins;
+		if (is_temp (cfg, index_reg)) {
+			def = find_def_before (ins, index_reg);
+			if (def && def->opcode == OP_SEXT_I4) {
+				index_reg = def->sreg1;
+				from = def;
+			}
+		}
+		if (resolve_copy (cfg, from, index_reg) != iv_reg)
+			continue;
+
+		for (j = 0; j < narrays; ++j) {
+			if (arrays [j].array_reg == array_reg && arrays [j].offset == ins->inst_imm)
+				break;
+		}
+		if (j == narrays) {
+			if (narrays == MAX_CHECKED_ARRAYS)
+				continue;
+			arrays [narrays].array_reg = array_reg;
+			arrays [narrays].offset = ins->inst_imm;
+			narrays ++;
+		}
+		g_ptr_array_add (proven, ins);
+	}
+	if (!proven->len)
+		goto done;
+
+	if (cfg->verbose_level > 1)
+		printf ("LOOP VERSIONING: BB%d in %s, removing %d bounds checks\n", h->block_num, mono_method_full_name (cfg->method, TRUE), proven->len);
+
+	/* Make the slow copy of the loop, which keeps all the checks */
+	clones = g_new0 (MonoBasicBlock*, lb.nblocks);
+	for (i = 0; i < lb.nblocks; ++i) {
+		bb = lb.blocks [i];
+		clones [i] = new_bblock (cfg, bb);
+		clones [i]->cil_length = bb->cil_length;
+		clones [i]->flags = bb->flags & ~BB_VISITED;
+		clones [i]->has_array_access = bb->has_array_access;
+		clones [i]->out_of_line = bb->out_of_line;
+	}
+	vreg_map = g_new0 (int, nvregs);
+	for (i = 0; i < lb.nblocks; ++i) {
+		MonoBasicBlock *clone = clones [i];
+
+		bb = lb.blocks [i];
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			MonoInst *copy = clone_ins (cfg, ins, vreg_map);
+
+			if (MONO_IS_COND_BRANCH_OP (ins)) {
+				copy->inst_many_bb = mono_mempool_alloc (cfg->mempool, sizeof (gpointer) * 2);
+				copy->inst_true_bb = map_bb (&lb, clones, ins->inst_true_bb);
+				copy->inst_false_bb = map_bb (&lb, clones, ins->inst_false_bb ? ins->inst_false_bb : bb->next_bb);
+			} else if (ins->opcode == OP_BR) {
+				copy->inst_target_bb = map_bb (&lb, clones, ins->inst_target_bb);
+			}
+			MONO_ADD_INS (clone, copy);
+		}
+		if (bb->out_count && !(bb->last_ins && MONO_IS_BRANCH_OP (bb->last_ins))) {
+			/* The copy is not placed after the copy of the fall through bblock */
+			MONO_INST_NEW (cfg, ins, OP_BR);
+			ins->inst_target_bb = map_bb (&lb, clones, bb->next_bb);
+			MONO_ADD_INS (clone, ins);
+		}
+		for (j = 0; j < bb->out_count; ++j)
+			mono_link_bblock (cfg, clone, map_bb (&lb, clones, bb->out_bb [j]));
+	}
+	slow_h = map_bb (&lb, clones, h);
+
+	/* The original loop becomes the fast one */
+	for (i = 0; i < proven->len; ++i) {
+		ins = g_ptr_array_index (proven, i);
+		NULLIFY_INS (ins);
+	}
+
+	/* Replace the branch into the loop by the checks selecting the copy to run */
+	ins = pre->last_ins;
+	MONO_REMOVE_INS (pre, ins);
+	mono_unlink_bblock (cfg, pre, h);
+	cur = cfg->cbb = pre;
+
+	if (!is_nonnegative_start (cfg, pre, iv_reg)) {
+		MONO_EMIT_NEW_BIALU_IMM (cfg, OP_ICOMPARE_IMM, -1, iv_reg, 0);
+		cur = emit_guard_branch (cfg, cur, OP_IBLT, slow_h);
+	}
+	if (limit_array != -1) {
+		MonoInst *limit_var;
+
+		MONO_EMIT_NEW_BIALU_IMM (cfg, OP_COMPARE_IMM, -1, limit_array, 0);
+		cur = emit_guard_branch (cfg, cur, OP_PBEQ, slow_h);
+		/* Used in the following bblocks, so it has to be a variable */
+		limit_var = mono_compile_create_var (cfg, &mono_defaults.int32_class->byval_arg, OP_LOCAL);
+		MONO_EMIT_NEW_LOAD_MEMBASE_OP (cfg, OP_LOADI4_MEMBASE, limit_var->dreg, limit_array, MONO_STRUCT_OFFSET (MonoArray, max_length));
+		limit_reg = limit_var->dreg;
+	}
+	for (i = 0; i < narrays; ++i) {
+		int len_reg;
+
+		if (arrays [i].array_reg == limit_array && arrays [i].offset == MONO_STRUCT_OFFSET (MonoArray, max_length))
+			continue;
+
+		MONO_EMIT_NEW_BIALU_IMM (cfg, OP_COMPARE_IMM, -1, arrays [i].array_reg, 0);
+		cur = emit_guard_branch (cfg, cur, OP_PBEQ, slow_h);
+		len_reg = alloc_ireg (cfg);
+		MONO_EMIT_NEW_LOAD_MEMBASE_OP (cfg, OP_LOADI4_MEMBASE, len_reg, arrays [i].array_reg, arrays [i].offset);
+		if (limit_reg == -1)
+			MONO_EMIT_NEW_BIALU_IMM (cfg, OP_ICOMPARE_IMM, -1, len_reg, limit_imm);
+		else
+			MONO_EMIT_NEW_BIALU (cfg, OP_ICOMPARE, -1, len_reg, limit_reg);
+		cur = emit_guard_branch (cfg, cur, OP_IBLT, slow_h);
+	}
+	MONO_INST_NEW (cfg, ins, OP_BR);
+	ins->inst_target_bb = h;
+	MONO_ADD_INS (cur, ins);
+	mono_link_bblock (cfg, cur, h);
+
+	/* Every copied bblock ends with a branch, so they can be placed anywhere */
+	next = cur->next_bb;
+	for (i = 0; i < lb.nblocks; ++i) {
+		cur->next_bb = clones [i];
+		cur = clones [i];
+	}
+	cur->next_bb = next;
+
+	res = TRUE;
+
+ done:
+	g_free (lb.blocks);
+	g_free (defs);
+	g_free (temp_bb);
+	g_free (vreg_map);
+	g_free (clones);
+	g_ptr_array_free (checks, TRUE);
+	g_ptr_array_free (proven, TRUE);
+	return res;
+}
+
+/*
+ * mono_loop_versioning:
+ *
+ *   Version the loops whose bounds checks can be removed, see the comment at the
+ * top of this file. This runs after the loop info is computed, and returns
+ * whenever it added bblocks, in which case the caller has to recompute the
+ * depth-first order, the dominators and the loop info.
+ */
+gboolean
+mono_loop_versioning (MonoCompile *cfg)
+{
+	MonoBasicBlock **headers;
+	int i, nheaders, nversioned;
+
+	if (!(cfg->comp_done & MONO_COMP_LOOPS) || !(cfg->flags & MONO_CFG_HAS_ARRAY_ACCESS) || cfg->gen_seq_points || COMPILE_LLVM (cfg))
+		return FALSE;
+
+	/* Versioning adds bblocks, but it doesn't update cfg->bblocks or the loop info */
+	headers = g_new0 (MonoBasicBlock*, cfg->num_bblocks);
+	nheaders = 0;
+	for (i = 0; i < cfg->num_bblocks; ++i) {
+		if (cfg->bblocks [i]->loop_blocks)
+			headers [nheaders ++] = cfg->bblocks [i];
+	}
+
+	nversioned = 0;
+	for (i = 0; i < nheaders && nversioned < MAX_VERSIONED_LOOPS; ++i) {
+		if (version_loop (cfg, headers [i]))
+			nversioned ++;
+	}
+	g_free (headers);
+
+	return nversioned > 0;
+}
+
+/*
+ * SSA based loop invariant code motion and strength reduction
+ */
+
+typedef struct {
+	MonoBasicBlock *header, *preheader;
+	/* Indexed by dfn */
+	MonoBitSet *blocks;
+	int nvregs;
+	/* The following are indexed by vreg */
+	/* Number of definitions inside the loop, up to 2 */
+	guint8 *defs;
+	/* The definition of single def temporaries and its bblock */
+	MonoInst **temp_def;
+	MonoBasicBlock **temp_def_bb;
+	/* Temporaries computed in the preheader */
+	guint8 *hoisted;
+	/* Object references which are known to be non-null in the preheader */
+	guint8 *nonnull;
+	/* The MonoMemoryAccess'es of the stores in the loop */
+	GPtrArray *writes;
+	/* Whenever something in the loop might write memory not described by WRITES */
+	gboolean writes_unknown;
+	/* Only move instructions from the start of the header */
+	gboolean header_only;
+} LoopState;
+
+static gboolean
+in_loop_dfn (MonoBasicBlock *bb, gpointer data)
+{
+	LoopState *ls = data;
+
+	return (bb->dfn || bb == ls->header) && bb->dfn < mono_bitset_size (ls->blocks) && mono_bitset_test_fast (ls->blocks, bb->dfn);
+}
+
+static gboolean
+is_const_op (int opcode)
+{
+	switch (opcode) {
+	case OP_ICONST:
+	case OP_I8CONST:
+	case OP_R4CONST:
+	case OP_R8CONST:
+	case OP_AOTCONST:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static gboolean
+is_class_init (MonoInst *ins)
+{
+	MonoCallInst *call = (MonoCallInst*)ins;
+
+	return ins->opcode == OP_VOIDCALL && call->fptr_is_patch && ((MonoJumpInfo*)call->fptr)->type == MONO_PATCH_INFO_CLASS_INIT;
+}
+
+/*
+ * is_pure_op:
+ *
+ *   Return whenever OPCODE has no side effects and cannot fault.
+ */
+static gboolean
+is_pure_op (int opcode)
+{
+	switch (opcode) {
+	case OP_MOVE:
+	case OP_LMOVE:
+	case OP_XMOVE:
+	case OP_IADD:
+	case OP_ISUB:
+	case OP_IMUL:
+	case OP_IAND:
+	case OP_IOR:
+	case OP_IXOR:
+	case OP_ISHL:
+	case OP_ISHR:
+	case OP_ISHR_UN:
+	case OP_INEG:
+	case OP_INOT:
+	case OP_IADD_IMM:
+	case OP_ISUB_IMM:
+	case OP_IMUL_IMM:
+	case OP_IAND_IMM:
+	case OP_IOR_IMM:
+	case OP_IXOR_IMM:
+	case OP_ISHL_IMM:
+	case OP_ISHR_IMM:
+	case OP_ISHR_UN_IMM:
+	case OP_LADD:
+	case OP_LSUB:
+	case OP_LMUL:
+	case OP_LAND:
+	case OP_LOR:
+	case OP_LXOR:
+	case OP_LSHL:
+	case OP_LSHR:
+	case OP_LSHR_UN:
+	case OP_LNEG:
+	case OP_LNOT:
+	case OP_LADD_IMM:
+	case OP_LSUB_IMM:
+	case OP_LMUL_IMM:
+	case OP_LAND_IMM:
+	case OP_LOR_IMM:
+	case OP_LXOR_IMM:
+	case OP_LSHL_IMM:
+	case OP_LSHR_IMM:
+	case OP_LSHR_UN_IMM:
+	case OP_ADD_IMM:
+	case OP_SUB_IMM:
+	case OP_MUL_IMM:
+	case OP_AND_IMM:
+	case OP_OR_IMM:
+	case OP_XOR_IMM:
+	case OP_SHL_IMM:
+	case OP_SHR_IMM:
+	case OP_SHR_UN_IMM:
+	case OP_SEXT_I4:
+	case OP_ZEXT_I4:
+	case OP_ICONV_TO_I1:
+	case OP_ICONV_TO_U1:
+	case OP_ICONV_TO_I2:
+	case OP_ICONV_TO_U2:
+	case OP_ICONV_TO_I4:
+	case OP_ICONV_TO_I8:
+	case OP_ICONV_TO_U8:
+	case OP_LCONV_TO_I4:
+#if defined(TARGET_X86) || defined(TARGET_AMD64)
+	case OP_X86_LEA:
+#endif
+		return TRUE;
+#ifndef MONO_ARCH_USE_FPSTACK
+	/* The fp stack can't hold values across bblocks */
+	case OP_FMOVE:
+	case OP_FADD:
+	case OP_FSUB:
+	case OP_FMUL:
+	case OP_FDIV:
+	case OP_FNEG:
+	case OP_ICONV_TO_R8:
+		return TRUE;
+#endif
+	default:
+		return FALSE;
+	}
+}
+
+static gboolean
+is_load_op (int opcode)
+{
+	switch (opcode) {
+	case OP_LOAD_MEMBASE:
+	case OP_LOADI1_MEMBASE:
+	case OP_LOADU1_MEMBASE:
+	case OP_LOADI2_MEMBASE:
+	case OP_LOADU2_MEMBASE:
+	case OP_LOADI4_MEMBASE:
+	case OP_LOADU4_MEMBASE:
+	case OP_LOADI8_MEMBASE:
+		return TRUE;
+#ifndef MONO_ARCH_USE_FPSTACK
+	case OP_LOADR4_MEMBASE:
+	case OP_LOADR8_MEMBASE:
+		return TRUE;
+#endif
+	default:
+		return FALSE;
+	}
+}
+
+/*
+ * get_deref_reg:
+ *
+ *   If INS faults when one of its sregs is null, return that sreg, otherwise
+ * return -1.
+ */
+static int
+get_deref_reg (MonoInst *ins)
+{
+	if (MONO_IS_LOAD_MEMBASE (ins))
+		return ins->inst_basereg;
+	if (MONO_IS_STORE_MEMBASE (ins))
+		return ins->inst_destbasereg;
+	switch (ins->opcode) {
+	case OP_LDLEN:
+	case OP_STRLEN:
+	case OP_CHECK_THIS:
+	case OP_NOT_NULL:
+	case OP_BOUNDS_CHECK:
+		return ins->sreg1;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * op_may_write_memory:
+ *
+ *   Return whenever the opcode of INS might change the value of a memory
+ * location, not counting its destination register.
+ */
+static gboolean
+op_may_write_memory (MonoInst *ins)
+{
+	if (is_pure_op (ins->opcode) || is_const_op (ins->opcode) || is_load_op (ins->opcode) || MONO_IS_PHI (ins) || MONO_IS_MOVE (ins) ||
+		MONO_IS_COND_BRANCH_OP (ins) || MONO_IS_COND_EXC (ins) || MONO_IS_SETCC (ins))
+		return FALSE;
+
+	switch (ins->opcode) {
+	case OP_NOP:
+	case OP_BR:
+	case OP_COMPARE:
+	case OP_COMPARE_IMM:
+	case OP_ICOMPARE:
+	case OP_ICOMPARE_IMM:
+	case OP_LCOMPARE:
+	case OP_LCOMPARE_IMM:
+	case OP_FCOMPARE:
+	case OP_IDIV:
+	case OP_IDIV_UN:
+	case OP_IREM:
+	case OP_IREM_UN:
+	case OP_LDADDR:
+	case OP_LDLEN:
+	case OP_STRLEN:
+	case OP_CHECK_THIS:
+	case OP_NOT_NULL:
+	case OP_BOUNDS_CHECK:
+	case OP_DUMMY_USE:
+		return FALSE;
+	default:
+		return TRUE;
+	}
+}
+
+/*
+ * may_write_memory:
+ *
+ *   Return whenever INS might change the value of a memory location. Variables
+ * which are not volatile or indirect can only be accessed directly, so they
+ * are not memory in this sense, see alias-analysis.c.
+ */
+static gboolean
+may_write_memory (MonoCompile *cfg, MonoInst *ins)
+{
+	if (INS_INFO (ins->opcode) [MONO_INST_DEST] != ' ' && !MONO_IS_STORE_MEMBASE (ins) && !MONO_IS_STORE_MEMINDEX (ins)) {
+		MonoInst *var = get_vreg_to_inst (cfg, ins->dreg);
+
+		if (var && (var->flags & (MONO_INST_VOLATILE|MONO_INST_INDIRECT)))
+			return TRUE;
+	}
+
+	return op_may_write_memory (ins);
+}
+
+/*
+ * add_write:
+ *
+ *   Add the memory written by INS to the memory written by the loop.
+ */
+static void
+add_write (MonoCompile *cfg, LoopState *ls, MonoInst *ins)
+{
+	MonoMemoryAccess *acc = mono_mempool_alloc (cfg->mempool, sizeof (MonoMemoryAccess));
+
+	/* Alias analysis only describes the stores themselves, not the effects of calls etc. */
+	if ((MONO_IS_STORE_MEMBASE (ins) || MONO_IS_STORE_MEMINDEX (ins) || !op_may_write_memory (ins)) && mono_alias_analysis_get_store (cfg, ins, acc))
+		g_ptr_array_add (ls->writes, acc);
+	else
+		ls->writes_unknown = TRUE;
+}
+
+/*
+ * load_is_invariant:
+ *
+ *   Return whenever none of the stores in the loop can change the value loaded
+ * by INS, whose base register is invariant.
+ */
+static gboolean
+load_is_invariant (MonoCompile *cfg, LoopState *ls, MonoInst *ins)
+{
+	MonoMemoryAccess load;
+	int i;
+
+	if (ls->writes_unknown || (ins->flags & MONO_INST_VOLATILE))
+		return FALSE;
+	if (!ls->writes->len)
+		return TRUE;
+
+	if (!mono_alias_analysis_get_load (cfg, ins, &load))
+		return FALSE;
+	for (i = 0; i < ls->writes->len; ++i) {
+		if (mono_alias_analysis_may_alias (&load, g_ptr_array_index (ls->writes, i)))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean
+is_invariant (MonoCompile *cfg, LoopState *ls, int vreg)
+{
+	MonoInst *var, *def;
+
+	if (vreg < MONO_MAX_IREGS || vreg < MONO_MAX_FREGS || vreg >= ls->nvregs)
+		return FALSE;
+
+	var = get_vreg_to_inst (cfg, vreg);
+	if (var)
+		return !(var->flags & (MONO_INST_VOLATILE|MONO_INST_INDIRECT)) && !ls->defs [vreg];
+
+	if (!ls->defs [vreg] || ls->hoisted [vreg])
+		return TRUE;
+	/* Constants are moved out together with their users */
+	def = ls->temp_def [vreg];
+	return def && is_const_op (def->opcode);
+}
+
+/*
+ * can_hoist:
+ *
+ *   Return whenever INS can be moved into the preheader. IN_PREFIX is TRUE if
+ * INS is at the start of the loop header, so it runs whenever the loop is
+ * entered, before anything with a visible effect.
+ */
+static gboolean
+can_hoist (MonoCompile *cfg, LoopState *ls, MonoInst *ins, gboolean in_prefix)
+{
+	const char *spec = INS_INFO (ins->opcode);
+	gboolean faulting, is_load = FALSE;
+	int i, num_sregs, sregs [MONO_MAX_SRC_REGS];
+
+	if (has_unsupported_regs (spec))
+		return FALSE;
+	if (ls->header_only && !in_prefix)
+		return FALSE;
+
+	if (is_pure_op (ins->opcode)) {
+		faulting = FALSE;
+	} else if (is_load_op (ins->opcode)) {
+		is_load = TRUE;
+		faulting = TRUE;
+	} else if (ins->opcode == OP_LDLEN || ins->opcode == OP_STRLEN) {
+		faulting = TRUE;
+	} else if (ins->opcode == OP_CHECK_THIS || ins->opcode == OP_BOUNDS_CHECK || is_class_init (ins)) {
+		/* These are only executed for their side effects */
+		if (!in_prefix)
+			return FALSE;
+		faulting = TRUE;
+	} else {
+		return FALSE;
+	}
+
+	/* The result has to go to a temporary which is not defined anywhere else */
+	if (spec [MONO_INST_DEST] != ' ') {
+		if (!is_temp (cfg, ins->dreg) || ins->dreg >= ls->nvregs || ls->defs [ins->dreg] != 1)
+			return FALSE;
+	}
+
+	num_sregs = mono_inst_get_src_registers (ins, sregs);
+	for (i = 0; i < num_sregs; ++i) {
+		if (!is_invariant (cfg, ls, sregs [i]))
+			return FALSE;
+	}
+
+	if (is_load && !load_is_invariant (cfg, ls, ins))
+		return FALSE;
+
+	if (faulting && !in_prefix) {
+		/*
+		 * The loop might not execute INS at all, so it can only be executed
+		 * speculatively if it cannot fault.
+		 */
+		int reg = get_deref_reg (ins);
+		MonoInst *var = get_vreg_to_inst (cfg, reg);
+
+		if (!var || var->type != STACK_OBJ || !ls->nonnull [reg])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+hoist_ins (MonoCompile *cfg, LoopState *ls, MonoBasicBlock *bb, MonoInst *ins)
+{
+	MonoBasicBlock *pre = ls->preheader;
+	MonoInst *var;
+	int i, reg, num_sregs, sregs [MONO_MAX_SRC_REGS];
+
+	num_sregs = mono_inst_get_src_registers (ins, sregs);
+	for (i = 0; i < num_sregs; ++i) {
+		int vreg = sregs [i];
+
+		if (!get_vreg_to_inst (cfg, vreg) && ls->defs [vreg] && !ls->hoisted [vreg]) {
+			MonoInst *def = ls->temp_def [vreg];
+
+			MONO_REMOVE_INS (ls->temp_def_bb [vreg], def);
+			mono_bblock_insert_before_ins (pre, pre->last_ins, def);
+			ls->hoisted [vreg] = TRUE;
+		}
+	}
+
+	if (cfg->verbose_level > 1) {
+		printf ("LICM: BB%d -> BB%d: ", bb->block_num, pre->block_num);
+		mono_print_ins (ins);
+	}
+
+	MONO_REMOVE_INS (bb, ins);
+	mono_bblock_insert_before_ins (pre, pre->last_ins, ins);
+	if (INS_INFO (ins->opcode) [MONO_INST_DEST] != ' ')
+		ls->hoisted [ins->dreg] = TRUE;
+	if (ins->opcode == OP_LDLEN || ins->opcode == OP_STRLEN || ins->opcode == OP_BOUNDS_CHECK)
+		pre->has_array_access = TRUE;
+
+	/* Execution only continues past a dereference if the reference is not null */
+	reg = get_deref_reg (ins);
+	var = reg != -1 ? get_vreg_to_inst (cfg, reg) : NULL;
+	if (var && var->type == STACK_OBJ)
+		ls->nonnull [reg] = TRUE;
+}
+
+static gboolean
+hoist_invariants (MonoCompile *cfg, LoopState *ls)
+{
+	MonoBasicBlock *bb, *dom;
+	MonoInst *ins, *n;
+	gboolean changed = FALSE;
+	int i, depth;
+
+	/*
+	 * The dereferences done before the loop tell which references are non-null.
+	 * Handlers are only linked from the start of their try block, so a dominator
+	 * in another region doesn't guarantee its dereferences succeeded: the loop
+	 * might be reached from a handler after one of them threw.
+	 */
+	for (dom = ls->preheader, depth = 0; dom && depth < 8; dom = dom->idom, depth ++) {
+		if (dom->region != ls->preheader->region)
+			break;
+		MONO_BB_FOR_EACH_INS (dom, ins) {
+			int reg = get_deref_reg (ins);
+
+			if (reg != -1 && reg < ls->nvregs)
+				ls->nonnull [reg] = TRUE;
+		}
+	}
+
+	/* In depth-first order, so definitions are visited before their uses */
+	for (i = 0; i < cfg->num_bblocks; ++i) {
+		gboolean in_prefix;
+
+		bb = cfg->bblocks [i];
+		if (!mono_bitset_test_fast (ls->blocks, bb->dfn))
+			continue;
+
+		in_prefix = bb == ls->header;
+		MONO_BB_FOR_EACH_INS_SAFE (bb, n, ins) {
+			if (ins->opcode == OP_NOP)
+				continue;
+			if (can_hoist (cfg, ls, ins, in_prefix)) {
+				hoist_ins (cfg, ls, bb, ins);
+				changed = TRUE;
+				continue;
+			}
+			if (!MONO_INS_HAS_NO_SIDE_EFFECT (ins))
+				in_prefix = FALSE;
+		}
+	}
+
+	return changed;
+}
+
+typedef struct {
+	int opcode, imm;
+	MonoInst *var;
+} ReducedIV;
+
+/*
+ * reduce_iv:
+ *
+ *   Replace 'iv * c' and 'iv << c' inside the loop by a new variable which is
+ * set to 'iv0 * c' in the preheader and incremented by 'step * c' after STEP_INS,
+ * which computes the value of IV for the next iteration. BOUNDED is TRUE
+ * if the loop is only entered when 'iv < x', so 'iv + 1' doesn't overflow.
+ */
+static gboolean
+reduce_iv (MonoCompile *cfg, LoopState *ls, int iv, int iv0, gint32 step, MonoBasicBlock *latch, MonoInst *step_ins, gboolean bounded)
+{
+	MonoBasicBlock *bb, *pre = ls->preheader;
+	ReducedIV reduced [MAX_REDUCED_IVS];
+	MonoInst *ins, *tins, *def;
+	int i, j, nreduced = 0;
+
+	for (i = 0; i < cfg->num_bblocks; ++i) {
+		bb = cfg->bblocks [i];
+		if (!mono_bitset_test_fast (ls->blocks, bb->dfn))
+			continue;
+
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			MonoInst *var;
+			gboolean sext;
+			gint64 mult, stride;
+			int add_op;
+
+			/* The latch computes the next value of iv */
+			if (ins == step_ins)
+				break;
+
+			switch (ins->opcode) {
+			case OP_IMUL_IMM:
+			case OP_ISHL_IMM:
+#if SIZEOF_REGISTER == 4
+			case OP_MUL_IMM:
+			case OP_SHL_IMM:
+#endif
+				if (ins->sreg1 != iv)
+					continue;
+				sext = FALSE;
+				add_op = (ins->opcode == OP_IMUL_IMM || ins->opcode == OP_ISHL_IMM) ? OP_IADD_IMM : OP_ADD_IMM;
+				break;
+#if SIZEOF_REGISTER == 8
+			case OP_MUL_IMM:
+			case OP_SHL_IMM:
+			case OP_LMUL_IMM:
+			case OP_LSHL_IMM:
+				/*
+				 * The address computation of a [i] uses the sign extended index,
+				 * 'sext (iv) * c' can only be incremented by 'c' if iv doesn't
+				 * overflow.
+				 */
+				if (step != 1 || !bounded || !is_temp (cfg, ins->sreg1))
+					continue;
+				def = find_def_before (ins, ins->sreg1);
+				if (!def || def->opcode != OP_SEXT_I4 || def->sreg1 != iv)
+					continue;
+				sext = TRUE;
+				add_op = (ins->opcode == OP_LMUL_IMM || ins->opcode == OP_LSHL_IMM) ? OP_LADD_IMM : OP_ADD_IMM;
+				break;
+#endif
+			default:
+				continue;
+			}
+
+			if (ins->opcode == OP_IMUL_IMM || ins->opcode == OP_MUL_IMM || ins->opcode == OP_LMUL_IMM) {
+				mult = ins->inst_imm;
+			} else {
+				if (ins->inst_imm < 0 || ins->inst_imm > 16)
+					continue;
+				mult = (gint64)1 << ins->inst_imm;
+			}
+			stride = mult * step;
+			if (stride < G_MININT32 || stride > G_MAXINT32)
+				continue;
+
+			var = NULL;
+			for (j = 0; j < nreduced; ++j) {
+				if (reduced [j].opcode == ins->opcode && reduced [j].imm == ins->inst_imm)
+					var = reduced [j].var;
+			}
+			if (!var) {
+				int src;
+
+				if (nreduced == MAX_REDUCED_IVS)
+					continue;
+
+				/* This has two definitions, so it is not renamed by mono_ssa_remove () */
+				if (add_op == OP_IADD_IMM)
+					var = mono_compile_create_var (cfg, &mono_defaults.int32_class->byval_arg, OP_LOCAL);
+				else
+					var = mono_compile_create_var (cfg, &mono_defaults.int_class->byval_arg, OP_LOCAL);
+
+				src = iv0;
+				if (sext) {
+					MONO_INST_NEW (cfg, tins, OP_SEXT_I4);
+					tins->dreg = alloc_preg (cfg);
+					tins->sreg1 = iv0;
+					mono_bblock_insert_before_ins (pre, pre->last_ins, tins);
+					src = tins->dreg;
+				}
+				MONO_INST_NEW (cfg, tins, ins->opcode);
+				tins->dreg = var->dreg;
+				tins->sreg1 = src;
+				tins->inst_imm = ins->inst_imm;
+				mono_bblock_insert_before_ins (pre, pre->last_ins, tins);
+
+				MONO_INST_NEW (cfg, tins, add_op);
+				tins->dreg = var->dreg;
+				tins->sreg1 = var->dreg;
+				tins->inst_imm = stride;
+				mono_bblock_insert_after_ins (latch, step_ins, tins);
+
+				reduced [nreduced].opcode = ins->opcode;
+				reduced [nreduced].imm = ins->inst_imm;
+				reduced [nreduced].var = var;
+				nreduced ++;
+			}
+
+			if (cfg->verbose_level > 1) {
+				printf ("IV STRENGTH REDUCTION: BB%d: ", bb->block_num);
+				mono_print_ins (ins);
+			}
+
+			ins->opcode = OP_MOVE;
+			ins->sreg1 = var->dreg;
+			ins->inst_imm = 0;
+		}
+	}
+
+	return nreduced > 0;
+}
+
+static gboolean
+strength_reduce (MonoCompile *cfg, LoopState *ls)
+{
+	MonoBasicBlock *h = ls->header, *latch;
+	MonoInst *phi, *step_ins, *ins, *cmp;
+	gboolean changed = FALSE;
+	int pre_index, stay_op, bounded_iv;
+
+	/* A single back edge, coming from a bblock which only branches back */
+	if (h->in_count != 2)
+		return FALSE;
+	pre_index = h->in_bb [0] == ls->preheader ? 0 : 1;
+	latch = h->in_bb [1 - pre_index];
+	if (latch == h || latch->out_count != 1 || !in_loop_dfn (latch, ls))
+		return FALSE;
+
+	/* The variable the header checks to be smaller than something to stay in the loop */
+	bounded_iv = -1;
+	stay_op = get_stay_opcode (h, h->last_ins, in_loop_dfn, ls);
+	cmp = h->last_ins ? h->last_ins->prev : NULL;
+	if (cmp && (cmp->opcode == OP_ICOMPARE || cmp->opcode == OP_ICOMPARE_IMM)) {
+		if (stay_op == OP_IBLT)
+			bounded_iv = cmp->sreg1;
+		else if (stay_op == OP_IBGT && cmp->opcode == OP_ICOMPARE)
+			bounded_iv = cmp->sreg2;
+	}
+
+	MONO_BB_FOR_EACH_INS (h, phi) {
+		MonoInst *var;
+		int iv0, iv2;
+		gint32 step;
+
+		if (phi->opcode != OP_PHI)
+			continue;
+		var = get_vreg_to_inst (cfg, phi->dreg);
+		if (!var || var->type != STACK_I4 || phi->inst_phi_args [0] != 2)
+			continue;
+		iv0 = phi->inst_phi_args [pre_index + 1];
+		iv2 = phi->inst_phi_args [2 - pre_index];
+
+		/* iv2 = iv + step */
+		step_ins = NULL;
+		MONO_BB_FOR_EACH_INS (latch, ins) {
+			if (ins_defines (ins, iv2)) {
+				step_ins = ins;
+				break;
+			}
+		}
+		if (!step_ins)
+			continue;
+		ins = step_ins;
+		if (ins->opcode == OP_MOVE && is_temp (cfg, ins->sreg1))
+			ins = find_def_before (ins, ins->sreg1);
+		if (!ins || ins->opcode != OP_IADD_IMM || ins->sreg1 != phi->dreg)
+			continue;
+		step = ins->inst_imm;
+
+		if (reduce_iv (cfg, ls, phi->dreg, iv0, step, latch, step_ins, bounded_iv == phi->dreg))
+			changed = TRUE;
+	}
+
+	return changed;
+}
+
+/*
+ * init_loop_state:
+ *
+ *   Fill out LS for the loop headed by H. Return FALSE if the loop has no
+ * suitable preheader.
+ */
+static gboolean
+init_loop_state (MonoCompile *cfg, LoopState *ls, MonoBasicBlock *h, gboolean header_only)
+{
+	MonoBasicBlock *pre, *bb;
+	MonoInst *ins;
+	GList *l;
+	int i;
+
+	memset (ls, 0, sizeof (LoopState));
+	ls->header = h;
+	ls->header_only = header_only;
+	ls->blocks = mono_bitset_new (cfg->num_bblocks, 0);
+	for (l = h->loop_blocks; l; l = l->next) {
+		bb = l->data;
+		mono_bitset_set_fast (ls->blocks, bb->dfn);
+	}
+
+	pre = NULL;
+	for (i = 0; i < h->in_count; ++i) {
+		if (!in_loop_dfn (h->in_bb [i], ls)) {
+			if (pre)
+				return FALSE;
+			pre = h->in_bb [i];
+		}
+	}
+	if (!pre || pre == cfg->bb_entry || !pre->last_ins || pre->last_ins->opcode != OP_BR || pre->last_ins->inst_target_bb != h)
+		return FALSE;
+	ls->preheader = pre;
+
+	/* Exceptions thrown by the hoisted code have to go to the same handler */
+	for (l = h->loop_blocks; l; l = l->next) {
+		bb = l->data;
+		if (bb->region != pre->region || (bb->flags & BB_EXCEPTION_HANDLER))
+			return FALSE;
+	}
+
+	ls->nvregs = cfg->next_vreg;
+	ls->defs = g_new0 (guint8, ls->nvregs);
+	ls->temp_def = g_new0 (MonoInst*, ls->nvregs);
+	ls->temp_def_bb = g_new0 (MonoBasicBlock*, ls->nvregs);
+	ls->hoisted = g_new0 (guint8, ls->nvregs);
+	ls->nonnull = g_new0 (guint8, ls->nvregs);
+	ls->writes = g_ptr_array_new ();
+
+	for (l = h->loop_blocks; l; l = l->next) {
+		bb = l->data;
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			if (ins->opcode == OP_NOP)
+				continue;
+			if (!ls->writes_unknown && may_write_memory (cfg, ins))
+				add_write (cfg, ls, ins);
+			if (INS_INFO (ins->opcode) [MONO_INST_DEST] != ' ' && !MONO_IS_STORE_MEMBASE (ins) && !MONO_IS_STORE_MEMINDEX (ins) && ins->dreg >= 0) {
+				if (ls->defs [ins->dreg] < 2)
+					ls->defs [ins->dreg] ++;
+				ls->temp_def [ins->dreg] = ins;
+				ls->temp_def_bb [ins->dreg] = bb;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static void
+free_loop_state (LoopState *ls)
+{
+	if (ls->blocks)
+		mono_bitset_free (ls->blocks);
+	g_free (ls->defs);
+	g_free (ls->temp_def);
+	g_free (ls->temp_def_bb);
+	g_free (ls->hoisted);
+	g_free (ls->nonnull);
+	if (ls->writes)
+		g_ptr_array_free (ls->writes, TRUE);
+}
+
+static void
+optimize_loops (MonoCompile *cfg, gboolean llvm)
+{
+	MonoBasicBlock *bb;
+	gboolean changed = FALSE;
+	int i, nesting, max_nesting;
+
+	g_assert (cfg->comp_done & MONO_COMP_SSA);
+	if (!(cfg->comp_done & MONO_COMP_LOOPS))
+		return;
+
+	max_nesting = 0;
+	for (i = 0; i < cfg->num_bblocks; ++i) {
+		bb = cfg->bblocks [i];
+		if (bb->loop_blocks)
+			max_nesting = MAX (max_nesting, bb->nesting);
+	}
+	/*
+	 * Moving code out of nested loops triggers:
+	 * http://llvm.org/bugs/show_bug.cgi?id=17868
+	 */
+	if (llvm)
+		max_nesting = MIN (max_nesting, 1);
+
+	for (nesting = max_nesting; nesting > 0; --nesting) {
+		for (i = 0; i < cfg->num_bblocks; ++i) {
+			LoopState ls;
+
+			bb = cfg->bblocks [i];
+			if (!bb->loop_blocks || bb->nesting != nesting)
+				continue;
+
+			if (init_loop_state (cfg, &ls, bb, llvm)) {
+				if (hoist_invariants (cfg, &ls))
+					changed = TRUE;
+				if (!llvm && strength_reduce (cfg, &ls))
+					changed = TRUE;
+			}
+			free_loop_state (&ls);
+		}
+	}
+
+	if (changed) {
+		/* The def/use info is no longer valid */
+		cfg->comp_done &= ~MONO_COMP_SSA_DEF_USE;
+		for (i = 0; i < cfg->num_varinfo; i++) {
+			MonoMethodVar *info = MONO_VARINFO (cfg, i);
+			info->def = NULL;
+			info->uses = NULL;
+		}
+	}
+}
+
+/*
+ * mono_ssa_loop_optimizations:
+ *
+ *   Perform loop invariant code motion and strength reduction of induction
+ * variables. Inner loops are processed first, so the code moved into their
+ * preheaders can be moved further out.
+ */
+void
+mono_ssa_loop_optimizations (MonoCompile *cfg)
+{
+	optimize_loops (cfg, FALSE);
+}
+
+/*
+ * mono_ssa_loop_invariant_code_motion:
+ *
+ *   Move the invariant instructions at the start of loop headers into the
+ * preheaders. This is used instead of mono_ssa_loop_optimizations () by the
+ * LLVM backend.
+ */
+void
+mono_ssa_loop_invariant_code_motion (MonoCompile *cfg)
+{
+	optimize_loops (cfg, TRUE);
+}
+
+#endif /* !DISABLE_JIT */
@@ -72,6 +72,15 @@
 
 #define BRANCH_COST 10
 #define INLINE_LENGTH_LIMIT 20
+/* Call sites found hot/cold in the inlining profile, see mini-pgo.c */
+#define PGO_HOT_INLINE_FACTOR 5
+#define PGO_COLD_INLINE_LENGTH_LIMIT 8
+/* Guarded devirtualization of virtual calls, see emit_guarded_virtual_call () */
+#define DEVIRT_MAX_TARGETS 3
+/* Receiver classes seen in less than 1/DEVIRT_MIN_FRACTION of the calls are not worth a guard */
+#define DEVIRT_MIN_FRACTION 10
+/* Sites where the guarded classes cover less than this percentage of the calls are megamorphic */
+#define DEVIRT_MIN_COVERAGE 80
 
 /* These have 'cfg' as an implicit argument */
 #define INLINE_FAILURE(msg) do {									\
@@ -3924,6 +3933,7 @@ handle_alloc (MonoCompile *cfg, MonoClass *klass, gboolean for_box, int context_
 	} else {
 		MonoVTable *vtable = mono_class_vtable (cfg->domain, klass);
 		MonoMethod *managed_alloc = NULL;
+		MonoInst *last, *alloc;
 		gboolean pass_lw;
 
 		if (!vtable) {
@@ -3936,20 +3946,34 @@ handle_alloc (MonoCompile *cfg, MonoClass *klass, gboolean for_box, int context_
 		managed_alloc = mono_gc_get_managed_allocator (klass, for_box);
 #endif
 
+		last = cfg->cbb->last_ins;
 		if (managed_alloc) {
 			EMIT_NEW_VTABLECONST (cfg, iargs [0], vtable);
-			return mono_emit_method_call (cfg, managed_alloc, iargs, NULL);
-		}
-		alloc_ftn = mono_class_get_allocation_ftn (vtable, for_box, &pass_lw);
-		if (pass_lw) {
-			guint32 lw = vtable->klass->instance_size;
-			lw = ((lw + (sizeof (gpointer) - 1)) & ~(sizeof (gpointer) - 1)) / sizeof (gpointer);
-			EMIT_NEW_ICONST (cfg, iargs [0], lw);
-			EMIT_NEW_VTABLECONST (cfg, iargs [1], vtable);
+			alloc = mono_emit_method_call (cfg, managed_alloc, iargs, NULL);
+		} else {
+			alloc_ftn = mono_class_get_allocation_ftn (vtable, for_box, &pass_lw);
+			if (pass_lw) {
+				guint32 lw = vtable->klass->instance_size;
+				lw = ((lw + (sizeof (gpointer) - 1)) & ~(sizeof (gpointer) - 1)) / sizeof (gpointer);
+				EMIT_NEW_ICONST (cfg, iargs [0], lw);
+				EMIT_NEW_VTABLECONST (cfg, iargs [1], vtable);
+			}
+			else {
+				EMIT_NEW_VTABLECONST (cfg, iargs [0], vtable);
+			}
+			alloc = mono_emit_jit_icall (cfg, alloc_ftn, iargs);
 		}
-		else {
-			EMIT_NEW_VTABLECONST (cfg, iargs [0], vtable);
+
+		if (!for_box && (cfg->opt & MONO_OPT_ESCAPE)) {
+			/* Remember the allocation sequence, so escape analysis can remove it */
+			MonoAllocSite *site = mono_mempool_alloc0 (cfg->mempool, sizeof (MonoAllocSite));
+
+			site->klass = klass;
+			site->first = last ? last->next : cfg->cbb->code;
+			site->call = alloc;
+			cfg->alloc_sites = g_slist_prepend_mempool (cfg->mempool, cfg->alloc_sites, site);
 		}
+		return alloc;
 	}
 
 	return mono_emit_jit_icall (cfg, alloc_ftn, iargs);
@@ -4782,6 +4806,7 @@ mono_method_check_inlining (MonoCompile *cfg, MonoMethod *method)
 {
 	MonoMethodHeaderSummary header;
 	MonoVTable *vtable;
+	int limit;
 #ifdef MONO_ARCH_SOFT_FLOAT_FALLBACK
 	MonoMethodSignature *sig = mono_method_signature (method);
 	int i;
@@ -4822,8 +4847,30 @@ mono_method_check_inlining (MonoCompile *cfg, MonoMethod *method)
 			inline_limit = INLINE_LENGTH_LIMIT;
 		inline_limit_inited = TRUE;
 	}
-	if (header.code_size >= inline_limit && !(method->iflags & METHOD_IMPL_ATTRIBUTE_AGGRESSIVE_INLINING))
-		return FALSE;
+	/* Hot methods recompiled by tiered compilation can afford to inline more */
+	limit = cfg->tier1 ? inline_limit * 2 : inline_limit;
+	if (!(method->iflags & METHOD_IMPL_ATTRIBUTE_AGGRESSIVE_INLINING)) {
+		switch (mini_pgo_get_call_hint (cfg->current_method, method)) {
+		case MINI_PGO_HOT:
+			if (header.code_size >= limit && header.code_size < inline_limit * PGO_HOT_INLINE_FACTOR) {
+				limit = inline_limit * PGO_HOT_INLINE_FACTOR;
+				cfg->pgo_hot_inline = method;
+			}
+			break;
+		case MINI_PGO_COLD:
+			/* Trivial callees make the caller smaller, so they are still worth it */
+			if (header.code_size >= PGO_COLD_INLINE_LENGTH_LIMIT && header.code_size < limit) {
+				cfg->stat_pgo_cold_not_inlined++;
+				cfg->stat_pgo_cold_not_inlined_size += header.code_size;
+				return FALSE;
+			}
+			break;
+		default:
+			break;
+		}
+		if (header.code_size >= limit)
+			return FALSE;
+	}
 
 	/*
 	 * if we can initialize the class of the method right away, we do,
@@ -4837,8 +4884,12 @@ mono_method_check_inlining (MonoCompile *cfg, MonoMethod *method)
 			vtable = mono_class_vtable (cfg->domain, method->klass);
 			if (!vtable)
 				return FALSE;
-			if (!cfg->compile_aot)
+			if (cfg->no_cctors) {
+				if (!vtable->initialized)
+					return FALSE;
+			} else if (!cfg->compile_aot) {
 				mono_runtime_class_init (vtable);
+			}
 		} else if (method->klass->flags & TYPE_ATTRIBUTE_BEFORE_FIELD_INIT) {
 			if (cfg->run_cctors && method->klass->has_cctor) {
 				/*FIXME it would easier and lazier to just use mono_class_try_get_vtable */
@@ -6114,9 +6165,14 @@ inline_method (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig,
 	MonoMethod *prev_current_method;
 	MonoGenericContext *prev_generic_context;
 	gboolean ret_var_set, prev_ret_var_set, prev_disable_inline, virtual = FALSE;
+	gboolean pgo_hot;
 
 	g_assert (cfg->exception_type == MONO_EXCEPTION_NONE);
 
+	/* Only allowed by the inlining profile, count it if it succeeds */
+	pgo_hot = cfg->pgo_hot_inline == cmethod;
+	cfg->pgo_hot_inline = NULL;
+
 #if (MONO_INLINE_CALLED_LIMITED_METHODS)
 	if ((! inline_always) && ! check_inline_called_method_name_limit (cmethod))
 		return 0;
@@ -6218,6 +6274,10 @@ inline_method (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig,
 			printf ("INLINE END %s -> %s\n", mono_method_full_name (cfg->method, TRUE), mono_method_full_name (cmethod, TRUE));
 		
 		cfg->stat_inlined_methods++;
+		if (pgo_hot) {
+			cfg->stat_pgo_hot_inlined++;
+			cfg->stat_pgo_hot_inlined_size += cheader->code_size;
+		}
 
 		/* always add some code to avoid block split failures */
 		MONO_INST_NEW (cfg, ins, OP_NOP);
@@ -6328,6 +6388,219 @@ inline_method (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig,
 /* offset from br.s -> br like opcodes */
 #define BIG_BRANCH_OFFSET 13
 
+/*
+ * get_virtual_method_for_class:
+ *
+ *   Return the method a virtual call to METHOD would call on an instance of
+ * KLASS, or NULL if it can't be called directly.
+ */
+static MonoMethod*
+get_virtual_method_for_class (MonoClass *klass, MonoMethod *method)
+{
+	MonoMethod *res;
+	int slot, offset;
+
+	/* Transparent proxies have the vtable of the class they stand for */
+	if (klass->valuetype || klass->rank || klass->generic_container || mono_class_is_marshalbyref (klass))
+		return NULL;
+	if (!mono_class_is_assignable_from (method->klass, klass))
+		return NULL;
+
+	mono_class_setup_vtable (klass);
+	if (klass->exception_type)
+		return NULL;
+	slot = mono_method_get_vtable_slot (method);
+	if (slot < 0)
+		return NULL;
+	if (MONO_CLASS_IS_INTERFACE (method->klass)) {
+		offset = mono_class_interface_offset (klass, method->klass);
+		if (offset < 0)
+			return NULL;
+		slot += offset;
+	}
+	if (slot >= klass->vtable_size)
+		return NULL;
+
+	res = mono_class_get_vtable_entry (klass, slot);
+	if (!res || (res->flags & METHOD_ATTRIBUTE_ABSTRACT) || res->wrapper_type != MONO_WRAPPER_NONE)
+		return NULL;
+	return res;
+}
+
+/*
+ * get_guarded_devirt_targets:
+ *
+ *   Choose the receiver classes to check for before the virtual call to
+ * CMETHOD at IP, using the receiver classes recorded by the tier 0 code of
+ * the method, or the inlining profile. Return the number of classes stored
+ * into CLASSES, with the methods to call for them in TARGETS.
+ */
+static int
+get_guarded_devirt_targets (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig, guint32 il_offset,
+							MonoClass **classes, MonoMethod **targets)
+{
+	MiniReceiverProfile profile, *site;
+	guint64 total, covered;
+	gboolean used [MINI_MAX_RECEIVER_CLASSES];
+	int i, n;
+
+	if (!(cmethod->flags & METHOD_ATTRIBUTE_VIRTUAL) || MONO_METHOD_IS_FINAL (cmethod))
+		return 0;
+	if (cfg->generic_sharing_context || cmethod->wrapper_type != MONO_WRAPPER_NONE)
+		return 0;
+	if (mono_method_signature (cmethod)->generic_param_count || MONO_TYPE_ISSTRUCT (fsig->ret))
+		return 0;
+	if (cmethod->klass->valuetype || cmethod->klass->rank || mono_class_is_marshalbyref (cmethod->klass))
+		return 0;
+	if (cmethod->klass->parent == mono_defaults.multicastdelegate_class && !strcmp (cmethod->name, "Invoke"))
+		return 0;
+
+	site = cfg->tier1 ? mini_tiered_get_call_site (cfg->method, il_offset, FALSE) : NULL;
+	if (site) {
+		/* Tier 0 code might still be updating it */
+		memcpy (&profile, site, sizeof (MiniReceiverProfile));
+	} else if (!mini_pgo_get_receiver_profile (cfg->method, cmethod, &profile)) {
+		return 0;
+	}
+
+	total = profile.other;
+	for (i = 0; i < MINI_MAX_RECEIVER_CLASSES; ++i) {
+		total += profile.counts [i];
+		used [i] = FALSE;
+	}
+	if (!total)
+		return 0;
+
+	/* Pick the most frequent classes first */
+	n = 0;
+	covered = 0;
+	while (n < DEVIRT_MAX_TARGETS) {
+		MonoMethod *target;
+		gboolean pass_vtable, pass_mrgctx;
+		int best = -1;
+
+		for (i = 0; i < MINI_MAX_RECEIVER_CLASSES; ++i) {
+			if (!used [i] && profile.classes [i] && (best == -1 || profile.counts [i] > profile.counts [best]))
+				best = i;
+		}
+		if (best == -1 || (guint64)profile.counts [best] * DEVIRT_MIN_FRACTION < total)
+			break;
+		used [best] = TRUE;
+
+		target = get_virtual_method_for_class (profile.classes [best], cmethod);
+		/* The inlining profile only knows the method which was called */
+		if (!target || (profile.methods [best] && profile.methods [best] != target))
+			continue;
+		check_method_sharing (cfg, target, &pass_vtable, &pass_mrgctx);
+		if (pass_vtable || pass_mrgctx)
+			continue;
+
+		classes [n] = profile.classes [best];
+		targets [n] = target;
+		covered += profile.counts [best];
+		n ++;
+	}
+
+	if (covered * 100 < total * DEVIRT_MIN_COVERAGE) {
+		cfg->stat_megamorphic_virtual_calls++;
+		return 0;
+	}
+	return n;
+}
+
+/*
+ * emit_guarded_virtual_call:
+ *
+ *   Emit a virtual call to CMETHOD which checks the class of the receiver
+ * against CLASSES first, calling or inlining the matching method in TARGETS
+ * directly. Other receivers go through the vtable or the IMT as usual.
+ * Return the result of the call, if any.
+ */
+static MonoInst*
+emit_guarded_virtual_call (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig, MonoInst **sp, guchar *ip,
+						   MonoClass **classes, MonoMethod **targets, int ntargets, int *inline_costs)
+{
+	MonoBasicBlock *next_bb, *end_bb, *cbb;
+	MonoInst *ins, *store, *ret_var = NULL, **args;
+	int vtable_reg, klass_reg, i, costs;
+	int nargs = fsig->param_count + 1;
+	gboolean has_ret = !MONO_TYPE_IS_VOID (fsig->ret);
+
+	if (has_ret)
+		ret_var = mono_compile_create_var (cfg, fsig->ret, OP_LOCAL);
+	NEW_BBLOCK (cfg, end_bb);
+
+	vtable_reg = alloc_preg (cfg);
+	klass_reg = alloc_preg (cfg);
+	MONO_EMIT_NEW_LOAD_MEMBASE_FAULT (cfg, vtable_reg, sp [0]->dreg, MONO_STRUCT_OFFSET (MonoObject, vtable));
+	MONO_EMIT_NEW_LOAD_MEMBASE (cfg, klass_reg, vtable_reg, MONO_STRUCT_OFFSET (MonoVTable, klass));
+
+	for (i = 0; i < ntargets; ++i) {
+		NEW_BBLOCK (cfg, next_bb);
+		mini_emit_class_check_branch (cfg, klass_reg, classes [i], OP_PBNE_UN, next_bb);
+
+		/* inline_method () stores its result into args [0] */
+		args = mono_mempool_alloc (cfg->mempool, sizeof (MonoInst*) * nargs);
+		memcpy (args, sp, sizeof (MonoInst*) * nargs);
+
+		costs = 0;
+		if ((cfg->opt & MONO_OPT_INLINE) && mono_method_check_inlining (cfg, targets [i]))
+			costs = inline_method (cfg, targets [i], mono_method_signature (targets [i]), args, ip, cfg->real_offset, FALSE, &cbb);
+		if (costs) {
+			*inline_costs += costs;
+			ins = args [0];
+		} else {
+			ins = mono_emit_method_call_full (cfg, targets [i], mono_method_signature (targets [i]), FALSE, args, NULL, NULL, NULL);
+			if (has_ret)
+				ins = mono_emit_widen_call_res (cfg, ins, fsig);
+		}
+		if (has_ret)
+			EMIT_NEW_TEMPSTORE (cfg, store, ret_var->inst_c0, ins);
+		MONO_EMIT_NEW_BRANCH_BLOCK (cfg, OP_BR, end_bb);
+
+		MONO_START_BB (cfg, next_bb);
+	}
+
+	ins = mono_emit_method_call_full (cfg, cmethod, fsig, FALSE, sp, sp [0], NULL, NULL);
+	if (has_ret) {
+		ins = mono_emit_widen_call_res (cfg, ins, fsig);
+		EMIT_NEW_TEMPSTORE (cfg, store, ret_var->inst_c0, ins);
+	}
+
+	MONO_START_BB (cfg, end_bb);
+	cfg->stat_guarded_virtual_calls++;
+
+	if (has_ret) {
+		EMIT_NEW_TEMPLOAD (cfg, ins, ret_var->inst_c0);
+		return ins;
+	}
+	return NULL;
+}
+
+/*
+ * emit_record_receiver:
+ *
+ *   Emit a call which records the class of the receiver of the virtual call
+ * at IL_OFFSET, so it can be devirtualized when the method is recompiled at
+ * tier 1.
+ */
+static void
+emit_record_receiver (MonoCompile *cfg, MonoMethod *cmethod, MonoInst *this, guint32 il_offset)
+{
+	MiniReceiverProfile *site;
+	MonoInst *iargs [2];
+
+	if (!(cmethod->flags & METHOD_ATTRIBUTE_VIRTUAL) || MONO_METHOD_IS_FINAL (cmethod))
+		return;
+
+	site = mini_tiered_get_call_site (cfg->method, il_offset, TRUE);
+	if (!site)
+		return;
+	EMIT_NEW_PCONST (cfg, iargs [0], site);
+	iargs [1] = this;
+	mono_emit_jit_icall (cfg, mini_tiered_record_receiver, iargs);
+}
+
 static gboolean
 ip_in_bb (MonoCompile *cfg, MonoBasicBlock *bb, const guint8* ip)
 {
@@ -8862,6 +9135,22 @@ mono_method_to_ir (MonoCompile *cfg, MonoMethod *method, MonoBasicBlock *start_b
 
 			/* Common call */
 			INLINE_FAILURE ("call");
+			if (virtual && !tail_call && !imt_arg && !vtable_arg) {
+				MonoClass *devirt_classes [DEVIRT_MAX_TARGETS];
+				MonoMethod *devirt_targets [DEVIRT_MAX_TARGETS];
+				int ndevirt;
+
+				if (cfg->tier0 && !cfg->compile_aot)
+					emit_record_receiver (cfg, cmethod, sp [0], ip - header->code);
+
+				ndevirt = get_guarded_devirt_targets (cfg, cmethod, fsig, ip - header->code, devirt_classes, devirt_targets);
+				if (ndevirt) {
+					ins = emit_guarded_virtual_call (cfg, cmethod, fsig, sp, ip, devirt_classes, devirt_targets, ndevirt, &inline_costs);
+					bblock = cfg->cbb;
+					emit_widen = FALSE;
+					goto call_end;
+				}
+			}
 			ins = mono_emit_method_call_full (cfg, cmethod, fsig, tail_call, sp, virtual ? sp [0] : NULL,
 											  imt_arg, vtable_arg);
 
@@ -10516,7 +10805,9 @@ mono_method_to_ir (MonoCompile *cfg, MonoMethod *method, MonoBasicBlock *start_b
 				CHECK_TYPELOAD (klass);
 
 				if (!addr) {
-					if (mini_field_access_needs_cctor_run (cfg, method, klass, vtable)) {
+					/* With no_cctors, the cctor can't be run now, so the code has to run it */
+					if (mini_field_access_needs_cctor_run (cfg, method, klass, vtable) ||
+						(cfg->no_cctors && !vtable->initialized)) {
 						if (!(g_slist_find (class_inits, klass))) {
 							mono_emit_abs_call (cfg, MONO_PATCH_INFO_CLASS_INIT, klass, helper_sig_class_init_trampoline, NULL);
 							if (cfg->verbose_level > 2)
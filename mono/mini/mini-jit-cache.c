@@ -0,0 +1,400 @@
+/*
+ * mini-jit-cache.c: Persistent JIT code cache
+ *
+ * With --jit-cache=DIR, the code the JIT generates for assemblies without an
+ * AOT image is kept in DIR across runs. The code is stored as AOT images, so
+ * it is relocatable, and it is loaded by aot-runtime.c with the usual checks
+ * of the file format version, the runtime build and the GUIDs of the
+ * assembly and of the assemblies it references.
+ *
+ * For each assembly, DIR contains:
+ *
+ *   <name>-<hash>.methods   the tokens of the methods the JIT compiled in earlier runs
+ *   <name>-<hash>.so        an AOT image containing these methods
+ *
+ * where <hash> depends on the GUID of the assembly and on the runtime build.
+ * The JIT records the methods it compiles, and the ones which are not in the
+ * .methods file yet are added to it at shutdown. When the assembly is loaded
+ * by a later run, and its .methods file is newer than its image, a separate
+ * 'mono --aot' process is started in the background to compile the image
+ * again with the methods-file AOT option. The current image, if any, is used
+ * meanwhile, and the new one is picked up by the next run. Compiling in
+ * another process keeps the AOT compiler, the assembler and the linker out
+ * of the assembly load hook, and the AOT compiler can exit on errors.
+ *
+ * Copyright 2014 Xamarin, Inc (http://www.xamarin.com)
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <mono/metadata/assembly.h>
+#include <mono/metadata/metadata-internals.h>
+#include <mono/metadata/tokentype.h>
+#include <mono/utils/mono-counters.h>
+#include <mono/utils/mono-digest.h>
+#include <mono/utils/mono-dl.h>
+#include <mono/utils/mono-logger-internal.h>
+#include <mono/utils/mono-mutex.h>
+
+#include "mini.h"
+#include "version.h"
+
+#define JIT_CACHE_FILE_VERSION "#JITCACHE:1"
+
+/* How long a compilation is assumed to be running, in seconds */
+#define JIT_CACHE_LOCK_TIMEOUT (60 * 60)
+
+typedef struct {
+	/* <dir>/<name>-<hash>, without an extension */
+	char *base_name;
+	/* The tokens in the .methods file */
+	GHashTable *tokens;
+	/* The tokens of the methods JITted by this run which are not in TOKENS */
+	GHashTable *new_tokens;
+} JitCacheImage;
+
+char *mono_jit_cache_dir;
+/* The runtime executable used to compile the images */
+char *mono_jit_cache_runtime;
+
+/* Protects the fields below */
+static mono_mutex_t jit_cache_mutex;
+/* Maps MonoImage's to JitCacheImage's */
+static GHashTable *cache_images;
+
+static int images_scheduled;
+static int methods_recorded;
+
+void
+mini_jit_cache_init (void)
+{
+	mono_mutex_init (&jit_cache_mutex);
+
+	if (!mono_jit_cache_dir)
+		return;
+
+	if (!mono_jit_cache_runtime)
+		mono_jit_cache_runtime = g_strdup ("mono");
+
+	if (!g_file_test (mono_jit_cache_dir, G_FILE_TEST_IS_DIR) && g_mkdir_with_parents (mono_jit_cache_dir, 0777) != 0) {
+		g_warning ("Unable to create the JIT cache directory '%s': %s.", mono_jit_cache_dir, g_strerror (errno));
+		mono_jit_cache_dir = NULL;
+		return;
+	}
+
+	cache_images = g_hash_table_new (NULL, NULL);
+
+	mono_counters_register ("JIT cache images scheduled", MONO_COUNTER_JIT | MONO_COUNTER_INT, &images_scheduled);
+	mono_counters_register ("JIT cache methods recorded", MONO_COUNTER_JIT | MONO_COUNTER_INT, &methods_recorded);
+}
+
+/*
+ * mini_jit_cache_load_methods:
+ *
+ *   Return a hash table containing the method tokens in the .methods file
+ * FILENAME, or NULL if it can't be read.
+ */
+GHashTable*
+mini_jit_cache_load_methods (const char *filename)
+{
+	GHashTable *tokens;
+	FILE *infile;
+	char line [256];
+	guint32 token;
+
+	infile = fopen (filename, "r");
+	if (!infile)
+		return NULL;
+
+	if (!fgets (line, sizeof (line), infile) || strncmp (line, JIT_CACHE_FILE_VERSION "\n", strlen (JIT_CACHE_FILE_VERSION) + 1) != 0) {
+		fclose (infile);
+		return NULL;
+	}
+
+	tokens = g_hash_table_new (NULL, NULL);
+	while (fgets (line, sizeof (line), infile)) {
+		if (sscanf (line, "%x", &token) == 1 && mono_metadata_token_table (token) == MONO_TABLE_METHOD)
+			g_hash_table_insert (tokens, GUINT_TO_POINTER (token), GUINT_TO_POINTER (token));
+	}
+	fclose (infile);
+
+	return tokens;
+}
+
+static char*
+get_base_name (MonoAssembly *assembly)
+{
+	guint8 digest [20];
+	char digest_str [41];
+	char *build_info, *key, *name, *res;
+	int i;
+
+	build_info = mono_get_runtime_build_info ();
+	key = g_strdup_printf ("%s_%s", build_info, assembly->image->guid);
+	mono_sha1_get_digest ((guint8*)key, strlen (key), digest);
+	for (i = 0; i < 20; ++i)
+		sprintf (digest_str + (i * 2), "%02x", digest [i]);
+	g_free (key);
+	g_free (build_info);
+
+	name = g_strdup_printf ("%s-%s", assembly->image->assembly_name, digest_str);
+	res = g_build_filename (mono_jit_cache_dir, name, NULL);
+	g_free (name);
+	return res;
+}
+
+/* Return whenever the file A was modified after the file B, or B doesn't exist */
+static gboolean
+is_newer (const char *a, const char *b)
+{
+	struct stat a_stat, b_stat;
+
+	if (stat (a, &a_stat) != 0)
+		return FALSE;
+	if (stat (b, &b_stat) != 0)
+		return TRUE;
+	return a_stat.st_mtime > b_stat.st_mtime;
+}
+
+/*
+ * try_lock:
+ *
+ *   Create the lock file LOCK_NAME, so only one process compiles a given
+ * image. A lock older than JIT_CACHE_LOCK_TIMEOUT belongs to a compilation
+ * which died, and is taken over.
+ */
+static gboolean
+try_lock (const char *lock_name)
+{
+	struct stat lock_stat;
+	int fd;
+
+	fd = open (lock_name, O_WRONLY | O_CREAT | O_EXCL, 0666);
+	if (fd == -1 && errno == EEXIST && stat (lock_name, &lock_stat) == 0 && time (NULL) - lock_stat.st_mtime > JIT_CACHE_LOCK_TIMEOUT) {
+		unlink (lock_name);
+		fd = open (lock_name, O_WRONLY | O_CREAT | O_EXCL, 0666);
+	}
+	if (fd == -1)
+		return FALSE;
+	close (fd);
+	return TRUE;
+}
+
+/*
+ * start_compile:
+ *
+ *   Start AOT compiling the methods listed in the .methods file of ASSEMBLY
+ * into AOT_NAME in a background process, if the image is out of date. The
+ * AOT compiler writes the image to a temporary file and renames it, so
+ * other processes never load a partial image. A failure is remembered until
+ * the .methods file changes again.
+ */
+static void
+start_compile (MonoAssembly *assembly, JitCacheImage *cimage, const char *aot_name)
+{
+	char *methods_name, *failure_name, *lock_name, *aot_options;
+	const char *argv [16];
+	GError *error = NULL;
+	int i = 0;
+
+	methods_name = g_strdup_printf ("%s.methods", cimage->base_name);
+	failure_name = g_strdup_printf ("%s.failure", aot_name);
+	lock_name = g_strdup_printf ("%s.lock", aot_name);
+
+	if (is_newer (methods_name, aot_name) && is_newer (methods_name, failure_name) && try_lock (lock_name)) {
+		mono_trace (G_LOG_LEVEL_MESSAGE, MONO_TRACE_AOT, "JIT cache: compiling %d methods of '%s' into '%s' in the background.",
+					g_hash_table_size (cimage->tokens), assembly->image->name, aot_name);
+
+		aot_options = g_strdup_printf ("--aot=outfile=%s,methods-file=%s,internal-logfile=%s.log", aot_name, methods_name, aot_name);
+#ifdef HOST_WIN32
+		/* No shell to record failures, the lock times out instead */
+		argv [i++] = mono_jit_cache_runtime;
+		argv [i++] = aot_options;
+		argv [i++] = assembly->image->name;
+#else
+		/* The shell records failures and removes the lock, the paths are passed as $0..$4 */
+		argv [i++] = "/bin/sh";
+		argv [i++] = "-c";
+		argv [i++] = "\"$0\" \"$1\" \"$2\" || : > \"$3\"; rm -f \"$4\"";
+		argv [i++] = mono_jit_cache_runtime;
+		argv [i++] = aot_options;
+		argv [i++] = assembly->image->name;
+		argv [i++] = failure_name;
+		argv [i++] = lock_name;
+#endif
+		argv [i++] = NULL;
+
+		/* Without G_SPAWN_DO_NOT_REAP_CHILD, the process is detached from this one */
+		if (g_spawn_async_with_pipes (NULL, (char**)argv, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL, NULL, NULL, NULL, NULL, NULL, NULL, &error)) {
+			InterlockedIncrement (&images_scheduled);
+		} else {
+			mono_trace (G_LOG_LEVEL_MESSAGE, MONO_TRACE_AOT, "JIT cache: unable to start '%s': %s", mono_jit_cache_runtime, error ? error->message : "");
+			if (error)
+				g_error_free (error);
+			unlink (lock_name);
+		}
+		g_free (aot_options);
+	}
+
+	g_free (methods_name);
+	g_free (failure_name);
+	g_free (lock_name);
+}
+
+/*
+ * mini_jit_cache_load_module:
+ *
+ *   Called by the AOT runtime when ASSEMBLY has no AOT image. Start
+ * recording the methods the JIT compiles for it, and return its cached
+ * image, starting a new compilation if it is out of date. Return NULL if
+ * there is none.
+ */
+MonoDl*
+mini_jit_cache_load_module (MonoAssembly *assembly, char **aot_name)
+{
+	JitCacheImage *cimage;
+	MonoImage *image = assembly->image;
+	MonoDl *module;
+	gboolean compile;
+	char *methods_name, *err;
+
+	*aot_name = NULL;
+
+	if (!mono_jit_cache_dir || image_is_dynamic (image) || !image->assembly_name || !image->guid)
+		return NULL;
+	/* Loaded before the cache can be compiled, and usually AOT compiled anyway */
+	if (!strcmp (image->assembly_name, "mscorlib"))
+		return NULL;
+
+	mono_mutex_lock (&jit_cache_mutex);
+	cimage = g_hash_table_lookup (cache_images, image);
+	if (!cimage) {
+		cimage = g_new0 (JitCacheImage, 1);
+		cimage->base_name = get_base_name (assembly);
+		methods_name = g_strdup_printf ("%s.methods", cimage->base_name);
+		cimage->tokens = mini_jit_cache_load_methods (methods_name);
+		if (!cimage->tokens)
+			cimage->tokens = g_hash_table_new (NULL, NULL);
+		cimage->new_tokens = g_hash_table_new (NULL, NULL);
+		g_free (methods_name);
+		g_hash_table_insert (cache_images, image, cimage);
+	}
+	compile = g_hash_table_size (cimage->tokens) > 0;
+	mono_mutex_unlock (&jit_cache_mutex);
+
+	*aot_name = g_strdup_printf ("%s%s", cimage->base_name, MONO_SOLIB_EXT);
+
+	if (compile)
+		start_compile (assembly, cimage, *aot_name);
+
+	module = mono_dl_open (*aot_name, MONO_DL_LAZY, &err);
+	if (module) {
+		mono_trace (G_LOG_LEVEL_INFO, MONO_TRACE_AOT, "JIT cache: found '%s'.", *aot_name);
+	} else {
+		mono_trace (G_LOG_LEVEL_INFO, MONO_TRACE_AOT, "JIT cache: '%s' not found: %s", *aot_name, err);
+		g_free (err);
+	}
+	return module;
+}
+
+/*
+ * mini_jit_cache_add_method:
+ *
+ *   Called after the JIT compiled METHOD, so it is included in the cached
+ * image of its assembly next time.
+ */
+void
+mini_jit_cache_add_method (MonoMethod *method)
+{
+	JitCacheImage *cimage;
+	gpointer token;
+
+	if (method->wrapper_type != MONO_WRAPPER_NONE || method->dynamic || method->is_inflated)
+		return;
+	if (mono_metadata_token_table (method->token) != MONO_TABLE_METHOD)
+		return;
+
+	token = GUINT_TO_POINTER (method->token);
+
+	mono_mutex_lock (&jit_cache_mutex);
+	cimage = g_hash_table_lookup (cache_images, method->klass->image);
+	if (cimage && !g_hash_table_lookup (cimage->tokens, token) && !g_hash_table_lookup (cimage->new_tokens, token)) {
+		g_hash_table_insert (cimage->new_tokens, token, token);
+		methods_recorded++;
+	}
+	mono_mutex_unlock (&jit_cache_mutex);
+}
+
+static void
+add_token (gpointer key, gpointer value, gpointer user_data)
+{
+	g_hash_table_insert ((GHashTable*)user_data, key, value);
+}
+
+static void
+write_token (gpointer key, gpointer value, gpointer user_data)
+{
+	fprintf ((FILE*)user_data, "%08x\n", GPOINTER_TO_UINT (key));
+}
+
+/*
+ * mini_jit_cache_save:
+ *
+ *   Add the methods JITted by this run to the .methods files of their
+ * assemblies. Called at shutdown.
+ */
+void
+mini_jit_cache_save (void)
+{
+	GHashTableIter iter;
+	JitCacheImage *cimage;
+	GHashTable *current;
+	char *methods_name, *tmp_name;
+	FILE *outfile;
+
+	if (!mono_jit_cache_dir)
+		return;
+
+	mono_mutex_lock (&jit_cache_mutex);
+	g_hash_table_iter_init (&iter, cache_images);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer*)&cimage)) {
+		if (!g_hash_table_size (cimage->new_tokens))
+			continue;
+
+		methods_name = g_strdup_printf ("%s.methods", cimage->base_name);
+
+		/* Keep the methods added by other processes since it was loaded */
+		current = mini_jit_cache_load_methods (methods_name);
+		if (current) {
+			g_hash_table_foreach (current, add_token, cimage->tokens);
+			g_hash_table_destroy (current);
+		}
+		g_hash_table_foreach (cimage->new_tokens, add_token, cimage->tokens);
+		g_hash_table_remove_all (cimage->new_tokens);
+
+		/* Other processes might be reading it, so write a new file and rename it */
+		tmp_name = g_strdup_printf ("%s.%d.tmp", methods_name, getpid ());
+		outfile = fopen (tmp_name, "w");
+		if (outfile) {
+			fprintf (outfile, "%s\n", JIT_CACHE_FILE_VERSION);
+			g_hash_table_foreach (cimage->tokens, write_token, outfile);
+			if (fclose (outfile) == 0)
+				rename (tmp_name, methods_name);
+			else
+				unlink (tmp_name);
+		}
+		g_free (tmp_name);
+		g_free (methods_name);
+	}
+	mono_mutex_unlock (&jit_cache_mutex);
+}
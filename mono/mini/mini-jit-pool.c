@@ -0,0 +1,583 @@
+/*
+ * mini-jit-pool.c: Background compilation thread pool for the JIT
+ *
+ * Methods can be queued for compilation on a small pool of worker threads,
+ * either speculatively (the methods of a class after its cctor ran, or the
+ * methods listed in the AOT profile files of an assembly), or to recompile
+ * hot tier 0 methods. Speculatively queued methods are tracked in a hash
+ * table, so each method is only queued once, and a thread which needs a
+ * method which is being compiled in the background waits for that method
+ * instead of compiling it again.
+ *
+ * Workers compile with JIT_FLAG_NO_CCTORS: the code is patched and published
+ * like normal JIT code, but cctors are left to the generated code and to the
+ * callers, so workers never run managed code. Workers do take the loader
+ * lock while compiling, so a thread which owns it compiles the method itself
+ * instead of waiting. The domain locks are never held across calls into the
+ * JIT, so waiting can't deadlock on those.
+ *
+ * Copyright 2014 Xamarin, Inc (http://www.xamarin.com)
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <mono/metadata/appdomain.h>
+#include <mono/metadata/assembly.h>
+#include <mono/metadata/debug-helpers.h>
+#include <mono/metadata/tabledefs.h>
+#include <mono/metadata/threads-types.h>
+#include <mono/utils/mono-counters.h>
+#include <mono/utils/mono-mutex.h>
+#include <mono/utils/mono-proclib.h>
+#include <mono/utils/mono-time.h>
+#include <mono/utils/mono-tls.h>
+
+#include "mini.h"
+
+/* The pool is small since it only competes with the application for cpus */
+#define JIT_POOL_MAX_DEFAULT_THREADS 4
+
+int mono_jit_pool_threads;
+gboolean mono_jit_speculative;
+
+/*
+ * mini_load_profile_methods:
+ *
+ *   Return the methods of IMAGE listed in the profile files in
+ * ~/.mono/aot-profile-data, in the order they were first called.
+ */
+GPtrArray*
+mini_load_profile_methods (MonoImage *image, gboolean verbose)
+{
+	GPtrArray *methods = g_ptr_array_new ();
+	FILE *infile;
+	char *tmp;
+	int file_index, res;
+	char ver [256];
+
+	file_index = 0;
+	while (TRUE) {
+		tmp = g_strdup_printf ("%s/.mono/aot-profile-data/%s-%d", g_get_home_dir (), image->assembly_name, file_index);
+
+		if (!g_file_test (tmp, G_FILE_TEST_IS_REGULAR)) {
+			g_free (tmp);
+			break;
+		}
+
+		infile = fopen (tmp, "r");
+		g_assert (infile);
+
+		if (verbose)
+			printf ("Using profile data file '%s'\n", tmp);
+		g_free (tmp);
+
+		file_index ++;
+
+		res = fscanf (infile, "%32s\n", ver);
+		if ((res != 1) || strcmp (ver, "#VER:2") != 0) {
+			if (verbose)
+				printf ("Profile file has wrong version or invalid.\n");
+			fclose (infile);
+			continue;
+		}
+
+		while (TRUE) {
+			char name [1024];
+			MonoMethodDesc *desc;
+			MonoMethod *method;
+
+			if (fgets (name, 1023, infile) == NULL)
+				break;
+
+			/* Kill the newline */
+			if (strlen (name) > 0)
+				name [strlen (name) - 1] = '\0';
+
+			desc = mono_method_desc_new (name, TRUE);
+
+			method = mono_method_desc_search_in_image (desc, image);
+			mono_method_desc_free (desc);
+
+			if (method && mono_method_get_token (method))
+				g_ptr_array_add (methods, method);
+		}
+		fclose (infile);
+	}
+
+	return methods;
+}
+
+#ifndef DISABLE_JIT
+
+typedef enum {
+	/* Compile the method like mono_jit_compile_method () would, without running cctors */
+	JIT_JOB_COMPILE,
+	/* Recompile a hot tier 0 method */
+	JIT_JOB_TIER_UP
+} JitJobKind;
+
+typedef enum {
+	JIT_JOB_QUEUED,
+	JIT_JOB_RUNNING,
+	JIT_JOB_DONE,
+	/* Claimed by a thread which compiles the method itself, or the domain is unloading */
+	JIT_JOB_CANCELLED
+} JitJobState;
+
+typedef struct {
+	JitJobKind kind;
+	JitJobState state;
+	MonoMethod *method;
+	MonoDomain *domain;
+	MonoJitInfo *tier0_ji;
+	/* Number of threads waiting for this job, the last one frees it */
+	int waiters;
+	gint64 queued_time;
+} JitJob;
+
+/* Protects the fields below */
+static mono_mutex_t pool_mutex;
+/* Signalled when a job is queued */
+static mono_cond_t pool_cond;
+/* Broadcast when a job is done */
+static mono_cond_t job_done_cond;
+static GQueue *pool_queue;
+static GSList *running_jobs;
+/* Maps (domain, method) pairs to their queued or running JIT_JOB_COMPILE job */
+static GHashTable *pending_methods;
+/* The MonoVTable's whose methods were queued already */
+static GHashTable *queued_vtables;
+static int num_workers, idle_workers, max_workers;
+
+static MonoNativeTlsKey worker_tls_id;
+
+static int queue_length;
+static int jobs_done;
+static int jobs_claimed;
+static int jobs_duplicate;
+static int waits;
+static int waits_skipped;
+static gint64 compile_time;
+static gint64 compile_latency;
+static gint64 wait_time;
+
+/* The keys of pending_methods are the jobs themselves */
+static guint
+job_hash (gconstpointer data)
+{
+	const JitJob *job = data;
+
+	return mono_aligned_addr_hash (job->method) ^ mono_aligned_addr_hash (job->domain);
+}
+
+static gboolean
+job_equal (gconstpointer a, gconstpointer b)
+{
+	const JitJob *job1 = a;
+	const JitJob *job2 = b;
+
+	return job1->method == job2->method && job1->domain == job2->domain;
+}
+
+void
+mini_jit_pool_init (void)
+{
+	mono_mutex_init (&pool_mutex);
+	mono_cond_init (&pool_cond, NULL);
+	mono_cond_init (&job_done_cond, NULL);
+	mono_native_tls_alloc (&worker_tls_id, NULL);
+
+	pool_queue = g_queue_new ();
+	pending_methods = g_hash_table_new (job_hash, job_equal);
+	queued_vtables = g_hash_table_new (NULL, NULL);
+
+	if (mono_jit_pool_threads > 0)
+		max_workers = mono_jit_pool_threads;
+	else
+		max_workers = MAX (1, MIN (mono_cpu_count (), JIT_POOL_MAX_DEFAULT_THREADS));
+
+	mono_counters_register ("JIT pool queue length", MONO_COUNTER_JIT | MONO_COUNTER_INT | MONO_COUNTER_VARIABLE, &queue_length);
+	mono_counters_register ("JIT pool threads", MONO_COUNTER_JIT | MONO_COUNTER_INT | MONO_COUNTER_VARIABLE, &num_workers);
+	mono_counters_register ("JIT pool jobs done", MONO_COUNTER_JIT | MONO_COUNTER_INT, &jobs_done);
+	mono_counters_register ("JIT pool jobs claimed by callers", MONO_COUNTER_JIT | MONO_COUNTER_INT, &jobs_claimed);
+	mono_counters_register ("JIT pool duplicate jobs", MONO_COUNTER_JIT | MONO_COUNTER_INT, &jobs_duplicate);
+	mono_counters_register ("JIT pool waits", MONO_COUNTER_JIT | MONO_COUNTER_INT, &waits);
+	mono_counters_register ("JIT pool waits skipped", MONO_COUNTER_JIT | MONO_COUNTER_INT, &waits_skipped);
+	mono_counters_register ("JIT pool compile time", MONO_COUNTER_JIT | MONO_COUNTER_LONG | MONO_COUNTER_TIME, &compile_time);
+	mono_counters_register ("JIT pool compile latency", MONO_COUNTER_JIT | MONO_COUNTER_LONG | MONO_COUNTER_TIME, &compile_latency);
+	mono_counters_register ("JIT pool wait time", MONO_COUNTER_JIT | MONO_COUNTER_LONG | MONO_COUNTER_TIME, &wait_time);
+
+	if (mono_jit_speculative) {
+		mono_install_assembly_load_hook (mini_jit_pool_queue_profile_methods, NULL);
+		/* Needed by mini_jit_pool_wait_for_method () */
+		mono_loader_lock_track_ownership (TRUE);
+	}
+}
+
+static gboolean
+run_job (JitJob *job)
+{
+	switch (job->kind) {
+	case JIT_JOB_COMPILE:
+		return mono_jit_compile_method_speculative (job->method);
+	case JIT_JOB_TIER_UP:
+		return mono_jit_tier_up_method (job->domain, job->method, job->tier0_ji);
+	default:
+		g_assert_not_reached ();
+		return FALSE;
+	}
+}
+
+/* LOCKING: Assumes the pool lock is held */
+static void
+job_finished (JitJob *job)
+{
+	if (job->kind == JIT_JOB_COMPILE && g_hash_table_lookup (pending_methods, job) == job)
+		g_hash_table_remove (pending_methods, job);
+	job->state = JIT_JOB_DONE;
+	if (!job->waiters)
+		g_free (job);
+	mono_cond_broadcast (&job_done_cond);
+}
+
+static void
+worker_thread (gpointer unused)
+{
+	MonoDomain *root_domain = mono_get_root_domain ();
+	JitJob *job;
+	gint64 start, end;
+	gboolean res;
+
+	mono_native_tls_set_value (worker_tls_id, GUINT_TO_POINTER (1));
+
+	mono_mutex_lock (&pool_mutex);
+	while (TRUE) {
+		while (g_queue_is_empty (pool_queue)) {
+			idle_workers++;
+			mono_cond_wait (&pool_cond, &pool_mutex);
+			idle_workers--;
+		}
+
+		job = g_queue_pop_head (pool_queue);
+		queue_length--;
+		if (job->state == JIT_JOB_CANCELLED) {
+			g_free (job);
+			continue;
+		}
+		if (job->domain->state != MONO_APPDOMAIN_CREATED) {
+			job_finished (job);
+			continue;
+		}
+
+		job->state = JIT_JOB_RUNNING;
+		running_jobs = g_slist_prepend (running_jobs, job);
+		mono_mutex_unlock (&pool_mutex);
+
+		start = mono_100ns_ticks ();
+		res = FALSE;
+		if (mono_domain_set (job->domain, FALSE)) {
+			res = run_job (job);
+			mono_domain_set (root_domain, TRUE);
+		}
+		end = mono_100ns_ticks ();
+
+		if (job->kind == JIT_JOB_TIER_UP)
+			mini_tiered_tier_up_done (job->tier0_ji, res);
+
+		mono_mutex_lock (&pool_mutex);
+		jobs_done++;
+		compile_time += end - start;
+		compile_latency += end - job->queued_time;
+		running_jobs = g_slist_remove (running_jobs, job);
+		job_finished (job);
+	}
+}
+
+/* LOCKING: Assumes the pool lock is held */
+static void
+queue_job (JitJob *job)
+{
+	MonoInternalThread *thread;
+
+	job->state = JIT_JOB_QUEUED;
+	job->queued_time = mono_100ns_ticks ();
+	g_queue_push_tail (pool_queue, job);
+	queue_length++;
+
+	if (!idle_workers && num_workers < max_workers) {
+		thread = mono_thread_create_internal (mono_get_root_domain (), worker_thread, NULL, TRUE, 0);
+		if (thread) {
+			thread->flags |= MONO_THREAD_FLAG_DONT_MANAGE;
+			num_workers++;
+		}
+	}
+	mono_cond_signal (&pool_cond);
+}
+
+static gboolean
+method_can_be_queued (MonoMethod *method)
+{
+	if (method->wrapper_type != MONO_WRAPPER_NONE || method->dynamic)
+		return FALSE;
+	if ((method->flags & (METHOD_ATTRIBUTE_ABSTRACT | METHOD_ATTRIBUTE_PINVOKE_IMPL)) ||
+		(method->iflags & (METHOD_IMPL_ATTRIBUTE_INTERNAL_CALL | METHOD_IMPL_ATTRIBUTE_RUNTIME)))
+		return FALSE;
+	if (method->is_generic || method->klass->generic_container)
+		return FALSE;
+	/* Already ran */
+	if ((method->flags & METHOD_ATTRIBUTE_SPECIAL_NAME) && !strcmp (method->name, ".cctor"))
+		return FALSE;
+	/* Loading AOT code is cheaper than compiling it */
+	if (method->klass->image->aot_module)
+		return FALSE;
+	return TRUE;
+}
+
+/*
+ * mini_jit_pool_queue_method:
+ *
+ *   Queue METHOD for compilation in DOMAIN on the background pool, unless it
+ * is queued or compiled already.
+ */
+void
+mini_jit_pool_queue_method (MonoDomain *domain, MonoMethod *method)
+{
+	JitJob *job, key;
+
+	if (!method_can_be_queued (method) || mono_jit_find_compiled_method (domain, method))
+		return;
+
+	key.domain = domain;
+	key.method = method;
+
+	mono_mutex_lock (&pool_mutex);
+	if (g_hash_table_lookup (pending_methods, &key)) {
+		jobs_duplicate++;
+		mono_mutex_unlock (&pool_mutex);
+		return;
+	}
+
+	job = g_new0 (JitJob, 1);
+	job->kind = JIT_JOB_COMPILE;
+	job->method = method;
+	job->domain = domain;
+	g_hash_table_insert (pending_methods, job, job);
+	queue_job (job);
+	mono_mutex_unlock (&pool_mutex);
+}
+
+/*
+ * mini_jit_pool_queue_class:
+ *
+ *   Queue the methods of the class of VTABLE for compilation, once its cctor
+ * has run.
+ */
+void
+mini_jit_pool_queue_class (MonoVTable *vtable)
+{
+	MonoMethod *method;
+	gpointer iter = NULL;
+
+	if (vtable->klass->generic_container || vtable->klass->image->aot_module)
+		return;
+
+	mono_mutex_lock (&pool_mutex);
+	if (g_hash_table_lookup (queued_vtables, vtable)) {
+		mono_mutex_unlock (&pool_mutex);
+		return;
+	}
+	g_hash_table_insert (queued_vtables, vtable, vtable);
+	mono_mutex_unlock (&pool_mutex);
+
+	while ((method = mono_class_get_methods (vtable->klass, &iter)))
+		mini_jit_pool_queue_method (vtable->domain, method);
+}
+
+/*
+ * mini_jit_pool_queue_profile_methods:
+ *
+ *   Assembly load hook which queues the methods listed in the AOT profile
+ * files of ASSEMBLY.
+ */
+void
+mini_jit_pool_queue_profile_methods (MonoAssembly *assembly, gpointer user_data)
+{
+	MonoDomain *domain = mono_domain_get ();
+	GPtrArray *methods;
+	int i;
+
+	if (!domain || !assembly->image || assembly->image->aot_module)
+		return;
+
+	methods = mini_load_profile_methods (assembly->image, FALSE);
+	for (i = 0; i < methods->len; ++i)
+		mini_jit_pool_queue_method (domain, g_ptr_array_index (methods, i));
+	g_ptr_array_free (methods, TRUE);
+}
+
+/*
+ * mini_jit_pool_queue_tier_up:
+ *
+ *   Queue METHOD, whose tier 0 code is described by TIER0_JI, for
+ * recompilation with all optimizations.
+ */
+void
+mini_jit_pool_queue_tier_up (MonoDomain *domain, MonoMethod *method, MonoJitInfo *tier0_ji)
+{
+	JitJob *job;
+
+	job = g_new0 (JitJob, 1);
+	job->kind = JIT_JOB_TIER_UP;
+	job->method = method;
+	job->domain = domain;
+	job->tier0_ji = tier0_ji;
+
+	mono_mutex_lock (&pool_mutex);
+	queue_job (job);
+	mono_mutex_unlock (&pool_mutex);
+}
+
+/*
+ * mini_jit_pool_wait_for_method:
+ *
+ *   Called before METHOD is compiled for DOMAIN on the current thread. If a
+ * worker is compiling it, wait for it and return TRUE. If it is only queued,
+ * take it off the queue, so the caller compiles it.
+ * If the current thread owns the loader lock, the worker might be blocked on
+ * it, so don't wait and let the caller compile the method too. The JIT keeps
+ * whichever copy is registered first.
+ */
+gboolean
+mini_jit_pool_wait_for_method (MonoDomain *domain, MonoMethod *method)
+{
+	JitJob *job, key;
+	gint64 start;
+
+	/* Workers don't wait for each other, so they can't deadlock */
+	if (mono_native_tls_get_value (worker_tls_id))
+		return FALSE;
+
+	key.domain = domain;
+	key.method = method;
+
+	mono_mutex_lock (&pool_mutex);
+	job = g_hash_table_lookup (pending_methods, &key);
+	if (!job) {
+		mono_mutex_unlock (&pool_mutex);
+		return FALSE;
+	}
+
+	if (job->state == JIT_JOB_QUEUED) {
+		job->state = JIT_JOB_CANCELLED;
+		g_hash_table_remove (pending_methods, job);
+		jobs_claimed++;
+		mono_mutex_unlock (&pool_mutex);
+		return FALSE;
+	}
+
+	if (mono_loader_lock_is_owned_by_self ()) {
+		waits_skipped++;
+		mono_mutex_unlock (&pool_mutex);
+		return FALSE;
+	}
+
+	start = mono_100ns_ticks ();
+	job->waiters++;
+	while (job->state != JIT_JOB_DONE)
+		mono_cond_wait (&job_done_cond, &pool_mutex);
+	if (--job->waiters == 0)
+		g_free (job);
+	waits++;
+	wait_time += mono_100ns_ticks () - start;
+	mono_mutex_unlock (&pool_mutex);
+
+	return TRUE;
+}
+
+static gboolean
+remove_domain_vtable (gpointer key, gpointer value, gpointer user_data)
+{
+	return ((MonoVTable*)key)->domain == user_data;
+}
+
+static gboolean
+domain_has_running_jobs (MonoDomain *domain)
+{
+	GSList *l;
+
+	for (l = running_jobs; l; l = l->next) {
+		if (((JitJob*)l->data)->domain == domain)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * mini_jit_pool_remove_domain_jobs:
+ *
+ *   Cancel the queued jobs of DOMAIN, and wait for its running ones.
+ */
+void
+mini_jit_pool_remove_domain_jobs (MonoDomain *domain)
+{
+	GList *l;
+	JitJob *job;
+
+	mono_mutex_lock (&pool_mutex);
+	for (l = pool_queue->head; l; l = l->next) {
+		job = l->data;
+		if (job->domain != domain || job->state != JIT_JOB_QUEUED)
+			continue;
+		if (job->kind == JIT_JOB_COMPILE)
+			g_hash_table_remove (pending_methods, job);
+		job->state = JIT_JOB_CANCELLED;
+	}
+	g_hash_table_foreach_remove (queued_vtables, remove_domain_vtable, domain);
+
+	while (domain_has_running_jobs (domain))
+		mono_cond_wait (&job_done_cond, &pool_mutex);
+	mono_mutex_unlock (&pool_mutex);
+}
+
+#else
+
+void
+mini_jit_pool_init (void)
+{
+}
+
+void
+mini_jit_pool_queue_method (MonoDomain *domain, MonoMethod *method)
+{
+}
+
+void
+mini_jit_pool_queue_class (MonoVTable *vtable)
+{
+}
+
+void
+mini_jit_pool_queue_profile_methods (MonoAssembly *assembly, gpointer user_data)
+{
+}
+
+void
+mini_jit_pool_queue_tier_up (MonoDomain *domain, MonoMethod *method, MonoJitInfo *tier0_ji)
+{
+}
+
+gboolean
+mini_jit_pool_wait_for_method (MonoDomain *domain, MonoMethod *method)
+{
+	return FALSE;
+}
+
+void
+mini_jit_pool_remove_domain_jobs (MonoDomain *domain)
+{
+}
+
+#endif /* DISABLE_JIT */
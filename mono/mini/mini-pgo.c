@@ -0,0 +1,372 @@
+/*
+ * mini-pgo.c: Profile guided inlining
+ *
+ * When it is run with --profile=log:pgo=FILE, the log profiler writes how many
+ * times each method was entered, and how many of those calls came from each
+ * caller. The file has one record per line:
+ *
+ *   #PGO:1
+ *   M <entries> <IL size> <image name> <token>	<method name>
+ *   C <calls> <caller image name> <caller token> <callee image name> <callee token>	<caller name> -> <callee name>
+ *
+ * Methods are identified by the name of their image and their token, so a
+ * profile stays valid until the assemblies are rebuilt. The instances of a
+ * generic method share the counts of its definition.
+ *
+ * Once a profile is loaded with --pgo=FILE or the pgo=FILE AOT option, the
+ * inliner uses it to inline callees above the size limit at hot call sites,
+ * and to inline only trivial callees at cold ones, see
+ * mono_method_check_inlining (). The calls a virtual call site made to the
+ * overrides of its target also tell which receiver classes it saw, so they
+ * are used for guarded devirtualization, see mini_pgo_get_receiver_profile ().
+ *
+ * Copyright 2014 Xamarin, Inc (http://www.xamarin.com)
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <mono/metadata/loader.h>
+
+#include "mini.h"
+
+/* Call sites called less often than this are never hot */
+#define PGO_MIN_HOT_CALLS 100
+/* A call site is hot if it accounts for at least 1/PGO_HOT_FRACTION of all calls */
+#define PGO_HOT_FRACTION 1000
+/* A call site is cold if it is reached by less than 1/PGO_COLD_FRACTION of the calls to its caller */
+#define PGO_COLD_FRACTION 10
+/* Callers entered less often than this don't tell enough to call anything cold */
+#define PGO_MIN_CALLER_ENTRIES 10
+
+typedef struct {
+	const char *image;
+	guint32 token;
+} PgoMethodKey;
+
+typedef struct {
+	PgoMethodKey key;
+	guint64 entries;
+	guint32 il_size;
+} PgoMethod;
+
+typedef struct {
+	PgoMethodKey caller;
+	PgoMethodKey callee;
+	guint64 calls;
+} PgoCall;
+
+/* These are only written by mini_pgo_load (), before any method is compiled */
+static GHashTable *pgo_files;
+static GHashTable *pgo_image_names;
+static GHashTable *pgo_methods;
+static GHashTable *pgo_calls;
+/* Maps the PgoMethodKey of callers to a GSList of their PgoCall's */
+static GHashTable *pgo_caller_calls;
+static guint64 pgo_total_calls;
+static guint64 pgo_hot_calls;
+
+static guint
+pgo_method_key_hash (gconstpointer key)
+{
+	const PgoMethodKey *k = key;
+
+	return g_str_hash (k->image) ^ k->token;
+}
+
+static gboolean
+pgo_method_key_equal (gconstpointer a, gconstpointer b)
+{
+	const PgoMethodKey *ka = a;
+	const PgoMethodKey *kb = b;
+
+	return ka->token == kb->token && !strcmp (ka->image, kb->image);
+}
+
+static guint
+pgo_call_hash (gconstpointer key)
+{
+	const PgoCall *call = key;
+
+	return pgo_method_key_hash (&call->caller) * 31 + pgo_method_key_hash (&call->callee);
+}
+
+static gboolean
+pgo_call_equal (gconstpointer a, gconstpointer b)
+{
+	const PgoCall *ca = a;
+	const PgoCall *cb = b;
+
+	return pgo_method_key_equal (&ca->caller, &cb->caller) && pgo_method_key_equal (&ca->callee, &cb->callee);
+}
+
+static const char*
+intern_image_name (const char *name)
+{
+	char *res = g_hash_table_lookup (pgo_image_names, name);
+
+	if (!res) {
+		res = g_strdup (name);
+		g_hash_table_insert (pgo_image_names, res, res);
+	}
+	return res;
+}
+
+/*
+ * mini_pgo_load:
+ *
+ *   Load the inlining profile in FILENAME, written by the log profiler.
+ * Return FALSE if it can't be read. Loading several profiles adds up their
+ * counts, loading the same one again does nothing.
+ */
+gboolean
+mini_pgo_load (const char *filename, gboolean verbose)
+{
+	FILE *infile;
+	char line [4096];
+	char caller_image [256], callee_image [256];
+	unsigned long long count;
+	guint32 caller_token, callee_token, il_size;
+	int nmethods, ncalls, nhot, hot_il_size;
+	GHashTableIter iter;
+	PgoCall *call;
+	PgoMethod *callee;
+
+	if (pgo_files && g_hash_table_lookup (pgo_files, filename))
+		return TRUE;
+
+	infile = fopen (filename, "r");
+	if (!infile) {
+		g_warning ("Unable to open inlining profile '%s'.", filename);
+		return FALSE;
+	}
+
+	if (!fgets (line, sizeof (line), infile) || strcmp (line, "#PGO:1\n") != 0) {
+		g_warning ("Inlining profile '%s' has the wrong version or is invalid.", filename);
+		fclose (infile);
+		return FALSE;
+	}
+
+	if (!pgo_methods) {
+		pgo_files = g_hash_table_new (g_str_hash, g_str_equal);
+		pgo_image_names = g_hash_table_new (g_str_hash, g_str_equal);
+		pgo_methods = g_hash_table_new (pgo_method_key_hash, pgo_method_key_equal);
+		pgo_calls = g_hash_table_new (pgo_call_hash, pgo_call_equal);
+	}
+
+	nmethods = ncalls = 0;
+	while (fgets (line, sizeof (line), infile)) {
+		if (line [0] == 'M' && sscanf (line, "M %llu %u %255s %x", &count, &il_size, callee_image, &callee_token) == 4) {
+			PgoMethod *method;
+			PgoMethodKey key;
+
+			key.image = callee_image;
+			key.token = callee_token;
+			method = g_hash_table_lookup (pgo_methods, &key);
+			if (!method) {
+				method = g_new0 (PgoMethod, 1);
+				method->key.image = intern_image_name (callee_image);
+				method->key.token = callee_token;
+				g_hash_table_insert (pgo_methods, &method->key, method);
+			}
+			method->entries += count;
+			method->il_size = il_size;
+			pgo_total_calls += count;
+			nmethods ++;
+		} else if (line [0] == 'C' && sscanf (line, "C %llu %255s %x %255s %x", &count, caller_image, &caller_token, callee_image, &callee_token) == 5) {
+			PgoCall key;
+
+			key.caller.image = caller_image;
+			key.caller.token = caller_token;
+			key.callee.image = callee_image;
+			key.callee.token = callee_token;
+			call = g_hash_table_lookup (pgo_calls, &key);
+			if (!call) {
+				call = g_new0 (PgoCall, 1);
+				call->caller.image = intern_image_name (caller_image);
+				call->caller.token = caller_token;
+				call->callee.image = intern_image_name (callee_image);
+				call->callee.token = callee_token;
+				g_hash_table_insert (pgo_calls, call, call);
+			}
+			call->calls += count;
+			ncalls ++;
+		}
+		/* Skip the rest of lines with very long method names */
+		while (strlen (line) == sizeof (line) - 1 && line [sizeof (line) - 2] != '\n') {
+			if (!fgets (line, sizeof (line), infile))
+				break;
+		}
+	}
+	fclose (infile);
+	g_hash_table_insert (pgo_files, g_strdup (filename), GINT_TO_POINTER (1));
+
+	pgo_hot_calls = MAX (PGO_MIN_HOT_CALLS, pgo_total_calls / PGO_HOT_FRACTION);
+
+	if (pgo_caller_calls) {
+		GSList *list;
+
+		g_hash_table_iter_init (&iter, pgo_caller_calls);
+		while (g_hash_table_iter_next (&iter, NULL, (gpointer*)&list))
+			g_slist_free (list);
+		g_hash_table_destroy (pgo_caller_calls);
+	}
+	pgo_caller_calls = g_hash_table_new (pgo_method_key_hash, pgo_method_key_equal);
+	g_hash_table_iter_init (&iter, pgo_calls);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer*)&call)) {
+		GSList *list = g_hash_table_lookup (pgo_caller_calls, &call->caller);
+
+		g_hash_table_insert (pgo_caller_calls, &call->caller, g_slist_prepend (list, call));
+	}
+
+	if (verbose) {
+		nhot = hot_il_size = 0;
+		g_hash_table_iter_init (&iter, pgo_calls);
+		while (g_hash_table_iter_next (&iter, NULL, (gpointer*)&call)) {
+			if (call->calls < pgo_hot_calls)
+				continue;
+			nhot ++;
+			callee = g_hash_table_lookup (pgo_methods, &call->callee);
+			if (callee)
+				hot_il_size += callee->il_size;
+		}
+		printf ("Loaded inlining profile '%s': %d methods, %d call sites, %d of them hot, calling %d bytes of IL.\n",
+				filename, nmethods, ncalls, nhot, hot_il_size);
+	}
+
+	return TRUE;
+}
+
+static gboolean
+get_method_key (MonoMethod *method, PgoMethodKey *key)
+{
+	key->image = method->klass->image->assembly_name;
+	key->token = method->token;
+
+	/* Wrappers and dynamic methods can't be matched with the profile */
+	return key->image && key->token && method->wrapper_type == MONO_WRAPPER_NONE && !method->dynamic;
+}
+
+/*
+ * mini_pgo_get_call_hint:
+ *
+ *   Return whenever the calls from CALLER to CALLEE were hot or cold in the
+ * inlining profile. Callers which are not in the profile have no cold calls,
+ * since the profiled run might not have exercised them at all.
+ */
+MiniPgoHint
+mini_pgo_get_call_hint (MonoMethod *caller, MonoMethod *callee)
+{
+	PgoMethod *caller_info;
+	PgoCall key, *call;
+	guint64 calls;
+
+	if (!pgo_methods)
+		return MINI_PGO_UNKNOWN;
+	if (!get_method_key (caller, &key.caller) || !get_method_key (callee, &key.callee))
+		return MINI_PGO_UNKNOWN;
+
+	call = g_hash_table_lookup (pgo_calls, &key);
+	calls = call ? call->calls : 0;
+	if (calls >= pgo_hot_calls)
+		return MINI_PGO_HOT;
+
+	caller_info = g_hash_table_lookup (pgo_methods, &key.caller);
+	if (caller_info && caller_info->entries >= PGO_MIN_CALLER_ENTRIES && calls * PGO_COLD_FRACTION < caller_info->entries)
+		return MINI_PGO_COLD;
+
+	return MINI_PGO_UNKNOWN;
+}
+
+/* Explicit interface implementations are named <interface name>.<method name> */
+static gboolean
+same_method_name (const char *impl_name, const char *name)
+{
+	size_t impl_len = strlen (impl_name), len = strlen (name);
+
+	if (impl_len == len)
+		return !strcmp (impl_name, name);
+	return impl_len > len && impl_name [impl_len - len - 1] == '.' && !strcmp (impl_name + impl_len - len, name);
+}
+
+static MonoMethod*
+lookup_method (PgoMethodKey *key)
+{
+	MonoImage *image;
+	MonoMethod *method;
+
+	/* Don't load assemblies just to devirtualize a call, they would be loaded already if they were used */
+	image = mono_image_loaded (key->image);
+	if (!image)
+		return NULL;
+	method = mono_get_method (image, key->token, NULL);
+	if (!method)
+		mono_loader_clear_error ();
+	return method;
+}
+
+/*
+ * mini_pgo_get_receiver_profile:
+ *
+ *   Fill out PROFILE with the overrides of the virtual method CMETHOD which
+ * CALLER called in the inlining profile, along with the classes declaring
+ * them. Return FALSE if nothing is known about these calls. Since the log
+ * profiler records method entries, calls to an inherited override are
+ * attributed to the class declaring it, not to the receiver class.
+ */
+gboolean
+mini_pgo_get_receiver_profile (MonoMethod *caller, MonoMethod *cmethod, MiniReceiverProfile *profile)
+{
+	PgoMethodKey key;
+	GSList *l;
+	int i, n;
+
+	memset (profile, 0, sizeof (MiniReceiverProfile));
+
+	if (!pgo_caller_calls)
+		return FALSE;
+	if (!get_method_key (caller, &key))
+		return FALSE;
+
+	n = 0;
+	for (l = g_hash_table_lookup (pgo_caller_calls, &key); l; l = l->next) {
+		PgoCall *call = l->data;
+		MonoMethod *callee;
+		guint32 calls;
+
+		callee = lookup_method (&call->callee);
+		if (!callee || !(callee->flags & METHOD_ATTRIBUTE_VIRTUAL))
+			continue;
+		/* Skip calls to other virtual methods made by the same caller */
+		if (!same_method_name (callee->name, cmethod->name) || mono_method_signature (callee)->param_count != mono_method_signature (cmethod)->param_count)
+			continue;
+		if (!mono_class_is_assignable_from (cmethod->klass, callee->klass))
+			continue;
+
+		calls = MIN (call->calls, G_MAXUINT32);
+		/* Keep the most frequent ones */
+		if (n < MINI_MAX_RECEIVER_CLASSES) {
+			i = n++;
+		} else {
+			int min = 0;
+
+			for (i = 1; i < n; ++i) {
+				if (profile->counts [i] < profile->counts [min])
+					min = i;
+			}
+			i = min;
+			if (profile->counts [i] >= calls) {
+				profile->other += calls;
+				continue;
+			}
+			profile->other += profile->counts [i];
+		}
+		profile->classes [i] = callee->klass;
+		profile->methods [i] = callee;
+		profile->counts [i] = calls;
+	}
+
+	return n > 0;
+}
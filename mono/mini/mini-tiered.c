@@ -0,0 +1,418 @@
+/*
+ * mini-tiered.c: Tiered compilation support
+ *
+ * With tiered compilation enabled, methods are first compiled quickly with a
+ * minimal set of optimizations (tier 0). Calls to tier 0 code always go
+ * through the JIT trampolines, which count them instead of patching the
+ * call site. Once a method has been called often enough, it is recompiled
+ * with all optimizations (tier 1) by the JIT thread pool, and the new code
+ * replaces the tier 0 code in the jit code hash, so the next call through a
+ * trampoline patches the call site to it.
+ *
+ * Tier 0 code also records the receiver classes seen by its virtual calls,
+ * so tier 1 code can call the common targets directly behind a class check,
+ * see emit_guarded_virtual_call () in method-to-ir.c.
+ *
+ * Copyright 2014 Xamarin, Inc (http://www.xamarin.com)
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <string.h>
+
+#include <mono/metadata/appdomain.h>
+#include <mono/metadata/mono-endian.h>
+#include <mono/metadata/opcodes.h>
+#include <mono/utils/mono-counters.h>
+#include <mono/utils/mono-mutex.h>
+
+#include "mini.h"
+
+#define TIERED_DEFAULT_THRESHOLD 30
+
+gboolean mono_tiered_compilation;
+int mono_tiered_threshold = TIERED_DEFAULT_THRESHOLD;
+
+#ifndef DISABLE_JIT
+
+/* These don't change the generated code much, or are needed for correctness */
+#define TIER0_OPTS (MONO_OPT_PEEPHOLE | MONO_OPT_CFOLD | MONO_OPT_INTRINS | MONO_OPT_CMOV | MONO_OPT_FCMOV | \
+					MONO_OPT_TAILC | MONO_OPT_SHARED | MONO_OPT_AOT | MONO_OPT_SSE2 | MONO_OPT_GSHARED | \
+					MONO_OPT_GSHAREDVT | MONO_OPT_UNSAFE)
+
+/* Too expensive to run on every method, but these pay off for hot ones */
+#define TIER1_EXTRA_OPTS (MONO_OPT_SSA | MONO_OPT_ABCREM)
+
+typedef struct {
+	MonoJitInfo *ji;
+	MonoDomain *domain;
+	int calls;
+	gboolean queued;
+} TierInfo;
+
+typedef struct {
+	MonoMethod *method;
+	guint32 il_offset;
+} CallSiteKey;
+
+typedef struct {
+	CallSiteKey key;
+	MiniReceiverProfile profile;
+} CallSite;
+
+/* Protects the fields below */
+static mono_mutex_t tiered_mutex;
+/* Maps tier 0 MonoJitInfo's to TierInfo's */
+static GHashTable *tier0_methods;
+/*
+ * Maps CallSiteKey's to CallSite's. These are never freed, since tier 0 code
+ * might still be running with pointers to them.
+ */
+static GHashTable *call_sites;
+
+static int tier0_methods_compiled;
+static int tier1_methods_compiled;
+static int tier1_methods_failed;
+
+static guint
+call_site_hash (gconstpointer key)
+{
+	const CallSiteKey *k = key;
+
+	return mono_aligned_addr_hash (k->method) ^ k->il_offset;
+}
+
+static gboolean
+call_site_equal (gconstpointer a, gconstpointer b)
+{
+	const CallSiteKey *ka = a;
+	const CallSiteKey *kb = b;
+
+	return ka->method == kb->method && ka->il_offset == kb->il_offset;
+}
+
+void
+mini_tiered_init (void)
+{
+	mono_mutex_init (&tiered_mutex);
+
+	if (!mono_tiered_compilation)
+		return;
+
+	if (mono_tiered_threshold <= 0)
+		mono_tiered_threshold = TIERED_DEFAULT_THRESHOLD;
+
+	tier0_methods = g_hash_table_new (NULL, NULL);
+	call_sites = g_hash_table_new (call_site_hash, call_site_equal);
+
+	mono_counters_register ("Tier 0 methods", MONO_COUNTER_JIT | MONO_COUNTER_INT, &tier0_methods_compiled);
+	mono_counters_register ("Tier 1 methods", MONO_COUNTER_JIT | MONO_COUNTER_INT, &tier1_methods_compiled);
+	mono_counters_register ("Tier 1 failures", MONO_COUNTER_JIT | MONO_COUNTER_INT, &tier1_methods_failed);
+}
+
+/*
+ * method_has_loops:
+ *
+ *   Return whenever the IL of a method contains a backward branch. Such
+ * methods might be called once and spend all of their time in a loop, so
+ * without on-stack replacement it is not safe to start them at tier 0.
+ */
+static gboolean
+method_has_loops (MonoMethodHeader *header)
+{
+	const unsigned char *ip = header->code;
+	const unsigned char *end = ip + header->code_size;
+	guint32 i, n;
+	int op;
+
+	while (ip < end) {
+		op = mono_opcode_value (&ip, end);
+		if (op < 0)
+			return TRUE;
+		ip++;
+
+		switch (mono_opcodes [op].argument) {
+		case MonoInlineNone:
+			break;
+		case MonoShortInlineVar:
+		case MonoShortInlineI:
+			ip += 1;
+			break;
+		case MonoInlineVar:
+			ip += 2;
+			break;
+		case MonoShortInlineBrTarget:
+			if ((gint8)*ip < 0)
+				return TRUE;
+			ip += 1;
+			break;
+		case MonoInlineBrTarget:
+			if ((gint32)read32 (ip) < 0)
+				return TRUE;
+			ip += 4;
+			break;
+		case MonoInlineSwitch:
+			n = read32 (ip);
+			ip += 4;
+			for (i = 0; i < n && ip + 4 <= end; ++i) {
+				if ((gint32)read32 (ip) < 0)
+					return TRUE;
+				ip += 4;
+			}
+			break;
+		case MonoInlineI8:
+		case MonoInlineR:
+			ip += 8;
+			break;
+		default:
+			ip += 4;
+			break;
+		}
+	}
+	return FALSE;
+}
+
+/*
+ * mini_tiered_get_tier0_opts:
+ *
+ *   Return the optimizations to compile METHOD with at tier 0, or OPTS if
+ * METHOD should be compiled with OPTS right away.
+ */
+guint32
+mini_tiered_get_tier0_opts (MonoMethod *method, guint32 opts)
+{
+	MonoMethodHeader *header;
+	gboolean has_loops;
+
+	if (!mono_tiered_compilation)
+		return opts;
+	if ((opts & TIER0_OPTS) == opts)
+		return opts;
+	/* Wrappers are small and are not called through trampolines */
+	if (method->wrapper_type != MONO_WRAPPER_NONE || method->dynamic)
+		return opts;
+	if (mono_do_single_method_regression || mini_get_debug_options ()->mdb_optimizations)
+		return opts;
+
+	header = mono_method_get_header (method);
+	if (!header)
+		return opts;
+	has_loops = method_has_loops (header);
+	mono_metadata_free_mh (header);
+	if (has_loops)
+		return opts;
+
+	InterlockedIncrement (&tier0_methods_compiled);
+	return opts & TIER0_OPTS;
+}
+
+guint32
+mini_tiered_get_tier1_opts (guint32 opts)
+{
+	return opts | TIER1_EXTRA_OPTS;
+}
+
+/*
+ * mini_tiered_tier_up_done:
+ *
+ *   Called by the JIT thread pool when it finished recompiling the tier 0
+ * method described by TIER0_JI.
+ */
+void
+mini_tiered_tier_up_done (MonoJitInfo *tier0_ji, gboolean success)
+{
+	TierInfo *info;
+
+	mono_mutex_lock (&tiered_mutex);
+	if (success)
+		tier1_methods_compiled++;
+	else
+		tier1_methods_failed++;
+	/* Not found if the domain is being unloaded */
+	info = g_hash_table_lookup (tier0_methods, tier0_ji);
+	if (info) {
+		g_hash_table_remove (tier0_methods, tier0_ji);
+		g_free (info);
+	}
+	mono_mutex_unlock (&tiered_mutex);
+}
+
+/*
+ * mini_tiered_count_call:
+ *
+ *   Called by the JIT trampolines when METHOD was resolved to CODE. Return
+ * whenever CODE is tier 0 code, in which case the caller should not be
+ * patched, so the next call is counted too.
+ */
+gboolean
+mini_tiered_count_call (MonoMethod *method, gpointer code)
+{
+	MonoDomain *domain;
+	MonoJitInfo *ji;
+	TierInfo *info;
+
+	ji = mini_jit_info_table_find (mono_domain_get (), code, &domain);
+	if (!ji || !ji->tier0)
+		return FALSE;
+
+	mono_mutex_lock (&tiered_mutex);
+	info = g_hash_table_lookup (tier0_methods, ji);
+	if (!info) {
+		info = g_new0 (TierInfo, 1);
+		info->ji = ji;
+		info->domain = domain;
+		g_hash_table_insert (tier0_methods, ji, info);
+	}
+
+	if (++info->calls >= mono_tiered_threshold && !info->queued) {
+		info->queued = TRUE;
+		mini_jit_pool_queue_tier_up (domain, method, ji);
+	}
+	mono_mutex_unlock (&tiered_mutex);
+
+	return TRUE;
+}
+
+static gboolean
+remove_domain_methods (gpointer key, gpointer value, gpointer user_data)
+{
+	TierInfo *info = value;
+
+	if (info->domain != user_data)
+		return FALSE;
+	g_free (info);
+	return TRUE;
+}
+
+static void
+clear_call_site (gpointer key, gpointer value, gpointer user_data)
+{
+	CallSite *site = value;
+
+	memset (&site->profile, 0, sizeof (site->profile));
+}
+
+/*
+ * mini_tiered_free_domain:
+ *
+ *   Forget about the tier 0 methods of DOMAIN. Their queued recompilations
+ * are removed by mini_jit_pool_remove_domain_jobs ().
+ */
+void
+mini_tiered_free_domain (MonoDomain *domain)
+{
+	if (!mono_tiered_compilation)
+		return;
+
+	mono_mutex_lock (&tiered_mutex);
+	g_hash_table_foreach_remove (tier0_methods, remove_domain_methods, domain);
+	/* The receiver profiles might reference the classes of DOMAIN, so start over */
+	g_hash_table_foreach (call_sites, clear_call_site, NULL);
+	mono_mutex_unlock (&tiered_mutex);
+}
+
+/*
+ * mini_tiered_get_call_site:
+ *
+ *   Return the receiver profile of the virtual call at IL_OFFSET in METHOD,
+ * creating it if CREATE is TRUE. Return NULL if it doesn't exist.
+ */
+MiniReceiverProfile*
+mini_tiered_get_call_site (MonoMethod *method, guint32 il_offset, gboolean create)
+{
+	CallSiteKey key;
+	CallSite *site;
+
+	if (!mono_tiered_compilation)
+		return NULL;
+
+	key.method = method;
+	key.il_offset = il_offset;
+
+	mono_mutex_lock (&tiered_mutex);
+	site = g_hash_table_lookup (call_sites, &key);
+	if (!site && create) {
+		site = g_new0 (CallSite, 1);
+		site->key = key;
+		g_hash_table_insert (call_sites, &site->key, site);
+	}
+	mono_mutex_unlock (&tiered_mutex);
+
+	return site ? &site->profile : NULL;
+}
+
+/*
+ * mini_tiered_record_receiver:
+ *
+ *   Called by tier 0 code before a virtual call, with the receiver OBJ.
+ * The counts are not exact, since they are incremented without atomics.
+ */
+void
+mini_tiered_record_receiver (MiniReceiverProfile *site, MonoObject *obj)
+{
+	MonoClass *klass;
+	int i;
+
+	/* The call will throw a NullReferenceException */
+	if (!obj)
+		return;
+
+	klass = obj->vtable->klass;
+	for (i = 0; i < MINI_MAX_RECEIVER_CLASSES; ++i) {
+		if (!site->classes [i])
+			InterlockedCompareExchangePointer ((gpointer*)&site->classes [i], klass, NULL);
+		if (site->classes [i] == klass) {
+			site->counts [i]++;
+			return;
+		}
+	}
+	site->other++;
+}
+
+#else
+
+void
+mini_tiered_init (void)
+{
+}
+
+guint32
+mini_tiered_get_tier0_opts (MonoMethod *method, guint32 opts)
+{
+	return opts;
+}
+
+guint32
+mini_tiered_get_tier1_opts (guint32 opts)
+{
+	return opts;
+}
+
+gboolean
+mini_tiered_count_call (MonoMethod *method, gpointer code)
+{
+	return FALSE;
+}
+
+void
+mini_tiered_tier_up_done (MonoJitInfo *tier0_ji, gboolean success)
+{
+}
+
+void
+mini_tiered_free_domain (MonoDomain *domain)
+{
+}
+
+MiniReceiverProfile*
+mini_tiered_get_call_site (MonoMethod *method, guint32 il_offset, gboolean create)
+{
+	return NULL;
+}
+
+void
+mini_tiered_record_receiver (MiniReceiverProfile *site, MonoObject *obj)
+{
+}
+
+#endif /* DISABLE_JIT */
@@ -635,6 +635,10 @@ common_call_trampoline (mgreg_t *regs, guint8 *code, MonoMethod *m, guint8* tram
 		return addr;
 	}
 
+	/* Keep calling tier 0 code through the trampoline, so the calls are counted */
+	if (mono_tiered_compilation && mini_tiered_count_call (m, mono_get_addr_from_ftnptr (compiled_method)))
+		return addr;
+
 	vtable_slot = orig_vtable_slot;
 
 	if (vtable_slot) {
@@ -56,6 +56,8 @@
 #include <mono/utils/mono-logger-internal.h>
 #include <mono/utils/mono-mmap.h>
 #include <mono/utils/mono-path.h>
+#include <mono/utils/mono-proclib.h>
+#include <mono/utils/mono-time.h>
 #include <mono/utils/mono-tls.h>
 #include <mono/utils/mono-hwcap.h>
 #include <mono/utils/dtrace.h>
@@ -78,7 +80,7 @@
 #include "debugger-agent.h"
 #include "seq-points.h"
 
-static gpointer mono_jit_compile_method_with_opt (MonoMethod *method, guint32 opt, MonoException **ex);
+static gpointer mono_jit_compile_method_with_opt (MonoMethod *method, guint32 opt, JitFlags flags, MonoException **ex);
 
 
 static guint32 default_opt = 0;
@@ -4782,7 +4784,8 @@ mini_method_compile (MonoMethod *method, guint32 opts, MonoDomain *domain, JitFl
 	gboolean try_generic_shared, try_llvm = FALSE;
 	MonoMethod *method_to_compile, *method_to_register;
 	gboolean method_is_gshared = FALSE;
-	gboolean run_cctors = (flags & JIT_FLAG_RUN_CCTORS) ? 1 : 0;
+	/* JIT_FLAG_NO_CCTORS code is published too, so it has to be patched as JIT code */
+	gboolean run_cctors = (flags & (JIT_FLAG_RUN_CCTORS | JIT_FLAG_NO_CCTORS)) ? 1 : 0;
 	gboolean compile_aot = (flags & JIT_FLAG_AOT) ? 1 : 0;
 	gboolean full_aot = (flags & JIT_FLAG_FULL_AOT) ? 1 : 0;
 #ifdef ENABLE_LLVM
@@ -4853,10 +4856,13 @@ mini_method_compile (MonoMethod *method, guint32 opts, MonoDomain *domain, JitFl
 	cfg->opt = opts;
 	cfg->prof_options = mono_profiler_get_events ();
 	cfg->run_cctors = run_cctors;
+	cfg->no_cctors = (flags & JIT_FLAG_NO_CCTORS) ? 1 : 0;
 	cfg->domain = domain;
 	cfg->verbose_level = mini_verbose;
 	cfg->compile_aot = compile_aot;
 	cfg->full_aot = full_aot;
+	cfg->tier0 = (flags & JIT_FLAG_TIER0) ? 1 : 0;
+	cfg->tier1 = (flags & JIT_FLAG_TIER1) ? 1 : 0;
 	cfg->skip_visibility = method->skip_visibility;
 	cfg->orig_method = method;
 	cfg->gen_seq_points = debug_options.gen_seq_points_compact_data || debug_options.gen_seq_points_debug_data;
@@ -5020,6 +5026,10 @@ mini_method_compile (MonoMethod *method, guint32 opts, MonoDomain *domain, JitFl
 		cfg->opt |= MONO_OPT_ABCREM;
 	}
 
+	/* Loop versioning needs the loop info, and the removed checks have to be visible to ABC removal */
+	if (cfg->opt & MONO_OPT_LICM)
+		cfg->opt |= MONO_OPT_ABCREM | MONO_OPT_LOOP;
+
 	if (!verbose_method_inited) {
 		verbose_method_name = g_getenv ("MONO_VERBOSE_METHOD");
 		verbose_method_inited = TRUE;
@@ -5279,8 +5289,31 @@ mini_method_compile (MonoMethod *method, guint32 opts, MonoDomain *domain, JitFl
 	if (cfg->opt & MONO_OPT_LOOP) {
 		mono_compile_dominator_info (cfg, MONO_COMP_DOM | MONO_COMP_IDOM);
 		mono_compute_natural_loops (cfg);
+
+		if ((cfg->opt & MONO_OPT_LICM) && mono_loop_versioning (cfg)) {
+			MonoBasicBlock *bb;
+
+			/* Versioning added bblocks, have to recompute cfg->bblocks, bb->dfn and the loop info */
+			mono_free_loop_info (cfg);
+			cfg->comp_done &= ~MONO_COMP_DOM;
+
+			for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+				bb->dfn = 0;
+				bb->loop_body_start = 0;
+			}
+			cfg->bblocks = mono_mempool_alloc (cfg->mempool, sizeof (MonoBasicBlock*) * (cfg->max_block_num + 1));
+			dfn = 0;
+			df_visit (cfg->bb_entry, &dfn, cfg->bblocks);
+			cfg->num_bblocks = dfn + 1;
+
+			mono_compile_dominator_info (cfg, MONO_COMP_DOM | MONO_COMP_IDOM);
+			mono_compute_natural_loops (cfg);
+		}
 	}
 
+	if ((cfg->opt & MONO_OPT_ESCAPE) && cfg->alloc_sites)
+		mono_escape_analysis (cfg);
+
 	/* after method_to_ir */
 	if (parts == 1) {
 		if (MONO_METHOD_COMPILE_END_ENABLED ())
@@ -5350,6 +5383,9 @@ mini_method_compile (MonoMethod *method, guint32 opts, MonoDomain *domain, JitFl
 		if ((cfg->flags & (MONO_CFG_HAS_LDELEMA|MONO_CFG_HAS_CHECK_THIS)) && (cfg->opt & MONO_OPT_ABCREM))
 			mono_perform_abc_removal (cfg);
 
+		if (cfg->opt & MONO_OPT_LICM)
+			mono_ssa_loop_optimizations (cfg);
+
 		mono_ssa_remove (cfg);
 		mono_local_cprop (cfg);
 		mono_handle_global_vregs (cfg);
@@ -5744,7 +5780,7 @@ mono_jit_map_is_enabled (void)
 #endif
 
 static gpointer
-mono_jit_compile_method_inner (MonoMethod *method, MonoDomain *target_domain, int opt, MonoException **jit_ex)
+mono_jit_compile_method_inner (MonoMethod *method, MonoDomain *target_domain, int opt, JitFlags flags, MonoException **jit_ex)
 {
 	MonoCompile *cfg;
 	gpointer code = NULL;
@@ -5754,6 +5790,7 @@ mono_jit_compile_method_inner (MonoMethod *method, MonoDomain *target_domain, in
 	guint32 prof_options;
 	GTimer *jit_timer;
 	MonoMethod *prof_method, *shared;
+	guint32 tier0_opt;
 
 #ifdef MONO_USE_AOT_COMPILER
 	if (opt & MONO_OPT_AOT) {
@@ -5764,7 +5801,8 @@ mono_jit_compile_method_inner (MonoMethod *method, MonoDomain *target_domain, in
 		if ((code = mono_aot_get_method (domain, method))) {
 			vtable = mono_class_vtable (domain, method->klass);
 			g_assert (vtable);
-			mono_runtime_class_init (vtable);
+			if (flags & JIT_FLAG_RUN_CCTORS)
+				mono_runtime_class_init (vtable);
 
 			return code;
 		}
@@ -5884,9 +5922,14 @@ mono_jit_compile_method_inner (MonoMethod *method, MonoDomain *target_domain, in
 		return NULL;
 	}
 
+	tier0_opt = mini_tiered_get_tier0_opts (method, opt);
+
 	jit_timer = g_timer_new ();
 
-	cfg = mini_method_compile (method, opt, target_domain, JIT_FLAG_RUN_CCTORS, 0);
+	if (tier0_opt != opt)
+		flags |= JIT_FLAG_TIER0;
+
+	cfg = mini_method_compile (method, tier0_opt, target_domain, flags, 0);
 	prof_method = cfg->method;
 
 	g_timer_stop (jit_timer);
@@ -6000,6 +6043,9 @@ mono_jit_compile_method_inner (MonoMethod *method, MonoDomain *target_domain, in
 		}
 	}
 	if (code == NULL) {
+		if (cfg->tier0)
+			cfg->jit_info->tier0 = TRUE;
+
 		/* The lookup + insert is atomic since this is done inside the domain lock */
 		mono_domain_jit_code_hash_lock (target_domain);
 		mono_internal_hash_table_insert (&target_domain->jit_code_hash, cfg->jit_info->d.method, cfg->jit_info);
@@ -6029,11 +6075,21 @@ mono_jit_compile_method_inner (MonoMethod *method, MonoDomain *target_domain, in
 	mono_jit_stats.regvars += cfg->stat_n_regvars;
 	mono_jit_stats.inlineable_methods += cfg->stat_inlineable_methods;
 	mono_jit_stats.inlined_methods += cfg->stat_inlined_methods;
+	mono_jit_stats.pgo_hot_inlined += cfg->stat_pgo_hot_inlined;
+	mono_jit_stats.pgo_hot_inlined_size += cfg->stat_pgo_hot_inlined_size;
+	mono_jit_stats.pgo_cold_not_inlined += cfg->stat_pgo_cold_not_inlined;
+	mono_jit_stats.pgo_cold_not_inlined_size += cfg->stat_pgo_cold_not_inlined_size;
+	mono_jit_stats.guarded_virtual_calls += cfg->stat_guarded_virtual_calls;
+	mono_jit_stats.megamorphic_virtual_calls += cfg->stat_megamorphic_virtual_calls;
+	mono_jit_stats.scalar_replaced_objects += cfg->stat_scalar_replaced_objects;
 	mono_jit_stats.cas_demand_generation += cfg->stat_cas_demand_generation;
 	mono_jit_stats.code_reallocs += cfg->stat_code_reallocs;
 
 	mono_destroy_compile (cfg);
 
+	if (mono_jit_cache_dir)
+		mini_jit_cache_add_method (method);
+
 #ifndef DISABLE_JIT
 	if (domain_jit_info (target_domain)->jump_target_hash) {
 		MonoJumpInfo patch_info;
@@ -6085,16 +6141,115 @@ mono_jit_compile_method_inner (MonoMethod *method, MonoDomain *target_domain, in
 		}
 	}
 
+	if (!(flags & JIT_FLAG_RUN_CCTORS))
+		return code;
+
 	ex = mono_runtime_class_init_full (vtable, FALSE);
 	if (ex) {
 		*jit_ex = ex;
 		return NULL;
 	}
+
+	if (mono_jit_speculative)
+		mini_jit_pool_queue_class (vtable);
+
 	return code;
 }
 
+/*
+ * mono_jit_tier_up_method:
+ *
+ *   Recompile METHOD, whose tier 0 code is described by TIER0_JI, with all
+ * optimizations, and make the new code the one returned by
+ * mono_jit_compile_method (). Callers of tier 0 code always go through a
+ * trampoline, so they are patched to the new code on their next call.
+ * Return whenever the new code was published.
+ */
+gboolean
+mono_jit_tier_up_method (MonoDomain *domain, MonoMethod *method, MonoJitInfo *tier0_ji)
+{
+	MonoCompile *cfg;
+	MonoJitInfo *info;
+	GTimer *jit_timer;
+	guint32 opt;
+	gboolean published = FALSE;
+
+	opt = mini_tiered_get_tier1_opts (mono_get_optimizations_for_method (method, default_opt));
+	if (!tier0_ji->domain_neutral)
+		opt &= ~MONO_OPT_SHARED;
+
+	jit_timer = g_timer_new ();
+
+	/*
+	 * Don't run cctors on this thread, the tier 0 code already ran them. The new
+	 * code replaces the tier 0 code, so it still needs to be patched as JIT code.
+	 */
+	cfg = mini_method_compile (method, opt, domain, JIT_FLAG_TIER1 | JIT_FLAG_NO_CCTORS, 0);
+
+	g_timer_stop (jit_timer);
+	mono_jit_stats.jit_time += g_timer_elapsed (jit_timer, NULL);
+	g_timer_destroy (jit_timer);
+
+	if (cfg->exception_type != MONO_EXCEPTION_NONE) {
+		if (cfg->exception_type == MONO_EXCEPTION_OBJECT_SUPPLIED)
+			MONO_GC_UNREGISTER_ROOT (cfg->exception_ptr);
+		if (cfg->prof_options & MONO_PROFILE_JIT_COMPILATION)
+			mono_profiler_method_end_jit (method, NULL, MONO_PROFILE_FAILED);
+		mono_loader_clear_error ();
+		mono_destroy_compile (cfg);
+
+		/* Stay at tier 0, and let the callers be patched to it */
+		mono_domain_lock (domain);
+		tier0_ji->tier0 = FALSE;
+		mono_domain_unlock (domain);
+		return FALSE;
+	}
+
+	mono_domain_lock (domain);
+
+	/* The tier 0 code might have been replaced already if the method was queued twice */
+	mono_domain_jit_code_hash_lock (domain);
+	info = mono_internal_hash_table_lookup (&domain->jit_code_hash, cfg->jit_info->d.method);
+	if (info == tier0_ji) {
+		mono_internal_hash_table_remove (&domain->jit_code_hash, cfg->jit_info->d.method);
+		mono_internal_hash_table_insert (&domain->jit_code_hash, cfg->jit_info->d.method, cfg->jit_info);
+		published = TRUE;
+	}
+	mono_domain_jit_code_hash_unlock (domain);
+
+	mono_jit_stats.allocate_var += cfg->stat_allocate_var;
+	mono_jit_stats.locals_stack_size += cfg->stat_locals_stack_size;
+	mono_jit_stats.basic_blocks += cfg->stat_basic_blocks;
+	mono_jit_stats.max_basic_blocks = MAX (cfg->stat_basic_blocks, mono_jit_stats.max_basic_blocks);
+	mono_jit_stats.cil_code_size += cfg->stat_cil_code_size;
+	mono_jit_stats.regvars += cfg->stat_n_regvars;
+	mono_jit_stats.inlineable_methods += cfg->stat_inlineable_methods;
+	mono_jit_stats.inlined_methods += cfg->stat_inlined_methods;
+	mono_jit_stats.pgo_hot_inlined += cfg->stat_pgo_hot_inlined;
+	mono_jit_stats.pgo_hot_inlined_size += cfg->stat_pgo_hot_inlined_size;
+	mono_jit_stats.pgo_cold_not_inlined += cfg->stat_pgo_cold_not_inlined;
+	mono_jit_stats.pgo_cold_not_inlined_size += cfg->stat_pgo_cold_not_inlined_size;
+	mono_jit_stats.guarded_virtual_calls += cfg->stat_guarded_virtual_calls;
+	mono_jit_stats.megamorphic_virtual_calls += cfg->stat_megamorphic_virtual_calls;
+	mono_jit_stats.scalar_replaced_objects += cfg->stat_scalar_replaced_objects;
+	mono_jit_stats.code_reallocs += cfg->stat_code_reallocs;
+
+#ifndef DISABLE_JIT
+	if (published)
+		mono_emit_jit_map (cfg->jit_info);
+#endif
+	mono_domain_unlock (domain);
+
+	if (cfg->prof_options & MONO_PROFILE_JIT_COMPILATION)
+		mono_profiler_method_end_jit (method, cfg->jit_info, MONO_PROFILE_OK);
+
+	mono_destroy_compile (cfg);
+
+	return published;
+}
+
 static gpointer
-mono_jit_compile_method_with_opt (MonoMethod *method, guint32 opt, MonoException **ex)
+mono_jit_compile_method_with_opt (MonoMethod *method, guint32 opt, JitFlags flags, MonoException **ex)
 {
 	MonoDomain *target_domain, *domain = mono_domain_get ();
 	MonoJitInfo *info;
@@ -6144,6 +6299,9 @@ mono_jit_compile_method_with_opt (MonoMethod *method, guint32 opt, MonoException
 	}
 
 	info = lookup_method (target_domain, method);
+	if (!info && (flags & JIT_FLAG_RUN_CCTORS) && mini_jit_pool_wait_for_method (target_domain, method))
+		/* It was compiled in the background */
+		info = lookup_method (target_domain, method);
 	if (info) {
 		/* We can't use a domain specific method in another domain */
 		if (! ((domain != target_domain) && !info->domain_neutral)) {
@@ -6153,6 +6311,8 @@ mono_jit_compile_method_with_opt (MonoMethod *method, guint32 opt, MonoException
 			mono_jit_stats.methods_lookups++;
 			vtable = mono_class_vtable (domain, method->klass);
 			g_assert (vtable);
+			if (!(flags & JIT_FLAG_RUN_CCTORS))
+				return mono_create_ftnptr (target_domain, info->code_start);
 			tmpEx = mono_runtime_class_init_full (vtable, ex == NULL);
 			if (tmpEx) {
 				*ex = tmpEx;
@@ -6162,7 +6322,7 @@ mono_jit_compile_method_with_opt (MonoMethod *method, guint32 opt, MonoException
 		}
 	}
 
-	code = mono_jit_compile_method_inner (method, target_domain, opt, ex);
+	code = mono_jit_compile_method_inner (method, target_domain, opt, flags, ex);
 	if (!code)
 		return NULL;
 
@@ -6199,7 +6359,7 @@ mono_jit_compile_method (MonoMethod *method)
 	MonoException *ex = NULL;
 	gpointer code;
 
-	code = mono_jit_compile_method_with_opt (method, mono_get_optimizations_for_method (method, default_opt), &ex);
+	code = mono_jit_compile_method_with_opt (method, mono_get_optimizations_for_method (method, default_opt), JIT_FLAG_RUN_CCTORS, &ex);
 	if (!code) {
 		g_assert (ex);
 		mono_raise_exception (ex);
@@ -6208,6 +6368,24 @@ mono_jit_compile_method (MonoMethod *method)
 	return code;
 }
 
+/*
+ * mono_jit_compile_method_speculative:
+ *
+ *   Compile METHOD ahead of its first call, without running cctors.
+ * Return whenever it succeeded.
+ */
+gboolean
+mono_jit_compile_method_speculative (MonoMethod *method)
+{
+	MonoException *ex = NULL;
+	gpointer code;
+
+	code = mono_jit_compile_method_with_opt (method, mono_get_optimizations_for_method (method, default_opt), JIT_FLAG_NO_CCTORS, &ex);
+	if (!code)
+		mono_loader_clear_error ();
+	return code != NULL;
+}
+
 #ifdef MONO_ARCH_HAVE_INVALIDATE_METHOD
 static void
 invalidated_delegate_trampoline (char *desc)
@@ -6437,7 +6615,7 @@ mono_jit_runtime_invoke (MonoMethod *method, void *obj, void **params, MonoObjec
 		if (callee) {
 			MonoException *jit_ex = NULL;
 
-			info->compiled_method = mono_jit_compile_method_with_opt (callee, mono_get_optimizations_for_method (callee, default_opt), &jit_ex);
+			info->compiled_method = mono_jit_compile_method_with_opt (callee, mono_get_optimizations_for_method (callee, default_opt), JIT_FLAG_RUN_CCTORS, &jit_ex);
 			if (!info->compiled_method) {
 				g_free (info);
 				g_assert (jit_ex);
@@ -7009,6 +7187,13 @@ register_jit_stats (void)
 	mono_counters_register ("Allocated seq points size", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.allocated_seq_points_size);
 	mono_counters_register ("Inlineable methods", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.inlineable_methods);
 	mono_counters_register ("Inlined methods", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.inlined_methods);
+	mono_counters_register ("PGO hot calls inlined", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.pgo_hot_inlined);
+	mono_counters_register ("PGO hot IL bytes inlined", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.pgo_hot_inlined_size);
+	mono_counters_register ("PGO cold calls not inlined", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.pgo_cold_not_inlined);
+	mono_counters_register ("PGO cold IL bytes not inlined", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.pgo_cold_not_inlined_size);
+	mono_counters_register ("Guarded virtual calls", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.guarded_virtual_calls);
+	mono_counters_register ("Megamorphic virtual calls", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.megamorphic_virtual_calls);
+	mono_counters_register ("Scalar replaced objects", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.scalar_replaced_objects);
 	mono_counters_register ("Regvars", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.regvars);
 	mono_counters_register ("Locals stack size", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.locals_stack_size);
 	mono_counters_register ("Method cache lookups", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.methods_lookups);
@@ -7091,11 +7276,20 @@ runtime_invoke_info_free (gpointer value)
 	g_free (info);
 }
 
+static void
+remove_domain_jit_jobs (MonoDomain *domain)
+{
+	mini_tiered_free_domain (domain);
+	mini_jit_pool_remove_domain_jobs (domain);
+}
+
 static void
 mini_free_jit_domain_info (MonoDomain *domain)
 {
 	MonoJitDomainInfo *info = domain_jit_info (domain);
 
+	remove_domain_jit_jobs (domain);
+
 	g_hash_table_foreach (info->jump_target_hash, delete_jump_list, NULL);
 	g_hash_table_destroy (info->jump_target_hash);
 	if (info->jump_target_got_slot_hash) {
@@ -7217,6 +7411,7 @@ mini_init (const char *filename, const char *runtime_version)
 	callbacks.debug_log = mono_debugger_agent_debug_log;
 	callbacks.debug_log_is_enabled = mono_debugger_agent_debug_log_is_enabled;
 	callbacks.tls_key_supported = mini_tls_key_supported;
+	callbacks.remove_domain_jit_jobs = remove_domain_jit_jobs;
 
 	if (mono_use_imt) {
 		callbacks.get_vtable_trampoline = mini_get_vtable_trampoline;
@@ -7239,6 +7434,10 @@ mini_init (const char *filename, const char *runtime_version)
 
 	mono_code_manager_init ();
 
+	mini_tiered_init ();
+	mini_jit_pool_init ();
+	mini_jit_cache_init ();
+
 	mono_hwcap_init ();
 
 	mono_arch_cpu_init ();
@@ -7425,6 +7624,7 @@ register_icalls (void)
 	 */
 	register_icall (mono_profiler_method_enter, "mono_profiler_method_enter", "void ptr", TRUE);
 	register_icall (mono_profiler_method_leave, "mono_profiler_method_leave", "void ptr", TRUE);
+	register_icall (mini_tiered_record_receiver, "mini_tiered_record_receiver", "void ptr object", TRUE);
 
 	register_icall (mono_trace_enter_method, "mono_trace_enter_method", NULL, TRUE);
 	register_icall (mono_trace_leave_method, "mono_trace_leave_method", NULL, TRUE);
@@ -7701,6 +7901,8 @@ mini_cleanup (MonoDomain *domain)
 	/* This accesses metadata so needs to be called before runtime shutdown */
 	print_jit_stats ();
 
+	mini_jit_cache_save ();
+
 	mono_profiler_shutdown ();
 
 #ifndef MONO_CROSS_COMPILE
@@ -7857,9 +8059,208 @@ mono_precompile_assembly (MonoAssembly *ass, void *user_data)
 	}
 }
 
+typedef struct {
+	MonoAssembly *assembly;
+	int methods;
+	volatile gint32 failed;
+	/* The time spent compiling its methods, summed over all threads */
+	volatile gint64 time;
+} PrecompAssembly;
+
+typedef struct {
+	MonoMethod *method;
+	PrecompAssembly *assembly;
+} PrecompMethod;
+
+int mono_precompile_threads;
+
+/* The methods compiled by mono_precompile_assemblies_parallel () */
+static GArray *precomp_methods;
+static volatile gint32 precomp_next;
+static int precomp_running;
+static mono_mutex_t precomp_mutex;
+static mono_cond_t precomp_done_cond;
+
+static void
+add_precompile_method (PrecompAssembly *passembly, MonoMethod *method)
+{
+	PrecompMethod pmethod;
+
+	pmethod.method = method;
+	pmethod.assembly = passembly;
+	g_array_append_val (precomp_methods, pmethod);
+	passembly->methods++;
+}
+
+/*
+ * collect_precompile_methods:
+ *
+ *   Add the methods mono_precompile_assembly () would compile to
+ * precomp_methods, loading the referenced assemblies on the way.
+ */
+static void
+collect_precompile_methods (MonoAssembly *ass, GPtrArray *assemblies)
+{
+	MonoImage *image = mono_assembly_get_image (ass);
+	PrecompAssembly *passembly;
+	MonoMethod *method;
+	int i;
+
+	for (i = 0; i < assemblies->len; ++i) {
+		if (((PrecompAssembly*)g_ptr_array_index (assemblies, i))->assembly == ass)
+			return;
+	}
+
+	passembly = g_new0 (PrecompAssembly, 1);
+	passembly->assembly = ass;
+	g_ptr_array_add (assemblies, passembly);
+
+	for (i = 0; i < mono_image_get_table_rows (image, MONO_TABLE_METHOD); ++i) {
+		method = mono_get_method (image, MONO_TOKEN_METHOD_DEF | (i + 1), NULL);
+		if (!method) {
+			mono_loader_clear_error ();
+			continue;
+		}
+		if (method->flags & METHOD_ATTRIBUTE_ABSTRACT)
+			continue;
+		if (method->is_generic || method->klass->generic_container)
+			continue;
+
+		add_precompile_method (passembly, method);
+		if (strcmp (method->name, "Finalize") == 0)
+			add_precompile_method (passembly, mono_marshal_get_runtime_invoke (method, FALSE));
+#ifndef DISABLE_REMOTING
+		if (mono_class_is_marshalbyref (method->klass) && mono_method_signature (method)->hasthis)
+			add_precompile_method (passembly, mono_marshal_get_remoting_invoke_with_check (method));
+#endif
+	}
+
+	for (i = 0; i < mono_image_get_table_rows (image, MONO_TABLE_ASSEMBLYREF); ++i) {
+		mono_assembly_load_reference (image, i);
+		if (image->references [i] && image->references [i] != REFERENCE_MISSING)
+			collect_precompile_methods (image->references [i], assemblies);
+	}
+}
+
+static void
+precompile_methods (void)
+{
+	PrecompMethod *pmethod;
+	gint64 start;
+	int i;
+
+	while ((i = InterlockedIncrement (&precomp_next) - 1) < precomp_methods->len) {
+		pmethod = &g_array_index (precomp_methods, PrecompMethod, i);
+
+		if (mini_verbose > 1) {
+			char *desc = mono_method_full_name (pmethod->method, TRUE);
+			g_print ("Compiling %d %s\n", i + 1, desc);
+			g_free (desc);
+		}
+
+		start = mono_100ns_ticks ();
+		if (!mono_jit_compile_method_speculative (pmethod->method))
+			InterlockedIncrement (&pmethod->assembly->failed);
+		InterlockedAdd64 (&pmethod->assembly->time, mono_100ns_ticks () - start);
+	}
+}
+
+static void
+precompile_worker (gpointer unused)
+{
+	precompile_methods ();
+
+	mono_mutex_lock (&precomp_mutex);
+	precomp_running--;
+	mono_cond_signal (&precomp_done_cond);
+	mono_mutex_unlock (&precomp_mutex);
+}
+
+/*
+ * mono_precompile_assemblies_parallel:
+ *
+ *   Like mono_precompile_assemblies (), but compile the methods on
+ * mono_precompile_threads threads. The methods are compiled the way the JIT
+ * pool compiles them, with JIT_FLAG_NO_CCTORS: the code is patched and
+ * published like normal JIT code, but the workers don't run cctors. The JIT
+ * takes the domain and loader locks as usual. The assemblies are loaded on the
+ * current thread first, so it can run AssemblyResolve handlers.
+ */
+static void
+mono_precompile_assemblies_parallel (void)
+{
+	GPtrArray *assemblies = g_ptr_array_new ();
+	MonoDomain *domain = mono_domain_get ();
+	MonoInternalThread *thread;
+	PrecompAssembly *passembly;
+	gint64 start, elapsed;
+	int i, nthreads, failed;
+
+	start = mono_100ns_ticks ();
+
+	precomp_methods = g_array_new (FALSE, FALSE, sizeof (PrecompMethod));
+	precomp_next = 0;
+	mono_assembly_foreach ((GFunc)collect_precompile_methods, assemblies);
+
+	nthreads = mono_precompile_threads > 0 ? mono_precompile_threads : mono_cpu_count ();
+	nthreads = MAX (1, MIN (nthreads, precomp_methods->len));
+
+	mono_mutex_init (&precomp_mutex);
+	mono_cond_init (&precomp_done_cond, NULL);
+
+	/* The current thread is one of the workers */
+	precomp_running = 0;
+	for (i = 0; i < nthreads - 1; ++i) {
+		mono_mutex_lock (&precomp_mutex);
+		precomp_running++;
+		mono_mutex_unlock (&precomp_mutex);
+		thread = mono_thread_create_internal (domain, precompile_worker, NULL, FALSE, 0);
+		if (!thread) {
+			mono_mutex_lock (&precomp_mutex);
+			precomp_running--;
+			mono_mutex_unlock (&precomp_mutex);
+			break;
+		}
+	}
+	precompile_methods ();
+
+	mono_mutex_lock (&precomp_mutex);
+	while (precomp_running)
+		mono_cond_wait (&precomp_done_cond, &precomp_mutex);
+	mono_mutex_unlock (&precomp_mutex);
+
+	elapsed = mono_100ns_ticks () - start;
+
+	failed = 0;
+	for (i = 0; i < assemblies->len; ++i) {
+		passembly = g_ptr_array_index (assemblies, i);
+		failed += passembly->failed;
+		if (mini_verbose > 0 || mono_jit_stats.enabled)
+			printf ("PRECOMPILE: %s: %d methods, %d failed, %.2f ms\n", mono_image_get_filename (mono_assembly_get_image (passembly->assembly)),
+					passembly->methods, passembly->failed, passembly->time / 10000.0);
+		g_free (passembly);
+	}
+	if (mini_verbose > 0 || mono_jit_stats.enabled)
+		printf ("PRECOMPILE: %d assemblies, %d methods, %d failed, %.2f ms on %d threads\n",
+				assemblies->len, precomp_methods->len, failed, elapsed / 10000.0, nthreads);
+
+	g_ptr_array_free (assemblies, TRUE);
+	g_array_free (precomp_methods, TRUE);
+	precomp_methods = NULL;
+	mono_cond_destroy (&precomp_done_cond);
+	mono_mutex_destroy (&precomp_mutex);
+}
+
 void mono_precompile_assemblies ()
 {
-	GHashTable *assemblies = g_hash_table_new (NULL, NULL);
+	GHashTable *assemblies;
+
+	if (mono_precompile_threads) {
+		mono_precompile_assemblies_parallel ();
+		return;
+	}
+
+	assemblies = g_hash_table_new (NULL, NULL);
 
 	mono_assembly_foreach ((GFunc)mono_precompile_assembly, assemblies);
 
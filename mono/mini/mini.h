@@ -832,6 +832,34 @@ struct MonoCallInst {
 #endif
 };
 
+/*
+ * An object allocation emitted for newobj, which escape analysis can replace by
+ * local variables if the object doesn't escape the method.
+ */
+typedef struct {
+	MonoClass *klass;
+	/* The first instruction computing the arguments of the allocation call */
+	MonoInst *first;
+	MonoInst *call;
+} MonoAllocSite;
+
+/*
+ * The memory read or written by a load or store, as computed by
+ * alias-analysis.c.
+ */
+typedef struct {
+	/* The base register of the address, -1 if VAR is set */
+	int basereg;
+	/* The offset from the base register or from the start of VAR */
+	int offset;
+	/* The number of bytes accessed, -1 if not known */
+	int size;
+	/* The local variable the address points into, if known */
+	MonoInst *var;
+	/* Whenever the address points into an object on the GC heap */
+	gboolean in_heap;
+} MonoMemoryAccess;
+
 struct MonoCallArgParm {
 	MonoInst ins;
 	gint32 size;
@@ -1294,6 +1322,15 @@ typedef enum {
 	JIT_FLAG_FULL_AOT = (1 << 2),
 	/* Whenever to compile with LLVM */
 	JIT_FLAG_LLVM = (1 << 3),
+	/* Whenever this is a recompilation of a hot method by tiered compilation */
+	JIT_FLAG_TIER1 = (1 << 4),
+	/* Whenever this is a quick compilation by tiered compilation, which will be recompiled once hot */
+	JIT_FLAG_TIER0 = (1 << 5),
+	/*
+	 * Whenever to compile code which is published like normal JIT code, but without
+	 * running cctors during JITting, i.e. from a background thread
+	 */
+	JIT_FLAG_NO_CCTORS = (1 << 6),
 } JitFlags;
 
 /* Bit-fields in the MonoBasicBlock.region */
@@ -1349,6 +1386,7 @@ typedef struct {
 	gint             spill_info_len [16];
 	/* unsigned char   *cil_code; */
 	MonoMethod      *inlined_method; /* the method which is currently inlined */
+	MonoMethod      *pgo_hot_inline; /* the last callee allowed above the inline limit by the profile */
 	MonoInst        *domainvar; /* a cache for the current domain */
 	MonoInst        *got_var; /* Global Offset Table variable */
 	MonoInst        **locals;
@@ -1442,6 +1480,8 @@ typedef struct {
 	guint            disable_llvm : 1;
 	guint            enable_extended_bblocks : 1;
 	guint            run_cctors : 1;
+	/* JIT code (run_cctors is set), but cctors are left to the generated code */
+	guint            no_cctors : 1;
 	guint            need_lmf_area : 1;
 	guint            compile_aot : 1;
 	guint            full_aot : 1;
@@ -1497,6 +1537,8 @@ typedef struct {
 	guint            disable_inline : 1;
 	guint            gshared : 1;
 	guint            gsharedvt : 1;
+	guint            tier0 : 1;
+	guint            tier1 : 1;
 	gpointer         debug_info;
 	guint32          lmf_offset;
     guint16          *intvars;
@@ -1584,6 +1626,9 @@ typedef struct {
 	/* Method headers which need to be freed after compilation */
 	GSList *headers_to_free;
 
+	/* The MonoAllocSite structures of the objects allocated by the method */
+	GSList *alloc_sites;
+
 	/* Used by AOT */
 	guint32 got_offset, ex_info_offset, method_info_offset, method_index;
 	/* Symbol used to refer to this method in generated assembly */
@@ -1635,6 +1680,13 @@ typedef struct {
 	int stat_n_regvars;
 	int stat_inlineable_methods;
 	int stat_inlined_methods;
+	int stat_pgo_hot_inlined;
+	int stat_pgo_hot_inlined_size;
+	int stat_pgo_cold_not_inlined;
+	int stat_pgo_cold_not_inlined_size;
+	int stat_guarded_virtual_calls;
+	int stat_megamorphic_virtual_calls;
+	int stat_scalar_replaced_objects;
 	int stat_cas_demand_generation;
 	int stat_code_reallocs;
 } MonoCompile;
@@ -1665,6 +1717,13 @@ typedef struct {
 	gint32 allocated_seq_points_size;
 	gint32 inlineable_methods;
 	gint32 inlined_methods;
+	gint32 pgo_hot_inlined;
+	gint32 pgo_hot_inlined_size;
+	gint32 pgo_cold_not_inlined;
+	gint32 pgo_cold_not_inlined_size;
+	gint32 guarded_virtual_calls;
+	gint32 megamorphic_virtual_calls;
+	gint32 scalar_replaced_objects;
 	gint32 basic_blocks;
 	gint32 max_basic_blocks;
 	gint32 locals_stack_size;
@@ -2031,6 +2090,7 @@ MonoInst* mono_find_exvar_for_offset        (MonoCompile *cfg, int offset) MONO_
 int       mono_get_block_region_notry       (MonoCompile *cfg, int region) MONO_LLVM_INTERNAL;
 
 void      mono_precompile_assemblies        (void) MONO_INTERNAL;
+extern int mono_precompile_threads;
 MONO_API int       mono_parse_default_optimizations  (const char* p);
 void      mono_bblock_add_inst              (MonoBasicBlock *bb, MonoInst *inst) MONO_LLVM_INTERNAL;
 void      mono_bblock_insert_after_ins      (MonoBasicBlock *bb, MonoInst *ins, MonoInst *ins_to_insert) MONO_INTERNAL;
@@ -2096,6 +2156,8 @@ gpointer  mono_resolve_patch_target         (MonoMethod *method, MonoDomain *dom
 gpointer  mono_jit_find_compiled_method_with_jit_info (MonoDomain *domain, MonoMethod *method, MonoJitInfo **ji) MONO_INTERNAL;
 gpointer  mono_jit_find_compiled_method     (MonoDomain *domain, MonoMethod *method) MONO_INTERNAL;
 gpointer  mono_jit_compile_method           (MonoMethod *method) MONO_INTERNAL;
+gboolean  mono_jit_tier_up_method           (MonoDomain *domain, MonoMethod *method, MonoJitInfo *tier0_ji) MONO_INTERNAL;
+gboolean  mono_jit_compile_method_speculative (MonoMethod *method) MONO_INTERNAL;
 MonoLMF * mono_get_lmf                      (void) MONO_INTERNAL;
 MonoLMF** mono_get_lmf_addr                 (void) MONO_INTERNAL;
 void      mono_set_lmf                      (MonoLMF *lmf) MONO_INTERNAL;
@@ -2608,6 +2670,8 @@ void        mono_ssa_deadce                     (MonoCompile *cfg) MONO_INTERNAL
 void        mono_ssa_strength_reduction         (MonoCompile *cfg) MONO_INTERNAL;
 void        mono_free_loop_info                 (MonoCompile *cfg) MONO_INTERNAL;
 void        mono_ssa_loop_invariant_code_motion (MonoCompile *cfg) MONO_INTERNAL;
+void        mono_ssa_loop_optimizations (MonoCompile *cfg) MONO_INTERNAL;
+gboolean    mono_loop_versioning (MonoCompile *cfg) MONO_INTERNAL;
 
 void        mono_ssa_compute2                   (MonoCompile *cfg);
 void        mono_ssa_remove2                    (MonoCompile *cfg);
@@ -2652,6 +2716,14 @@ extern void
 mono_local_deadce (MonoCompile *cfg);
 void
 mono_local_alias_analysis (MonoCompile *cfg) MONO_INTERNAL;
+gboolean
+mono_alias_analysis_get_store (MonoCompile *cfg, MonoInst *ins, MonoMemoryAccess *acc) MONO_INTERNAL;
+gboolean
+mono_alias_analysis_get_load (MonoCompile *cfg, MonoInst *ins, MonoMemoryAccess *acc) MONO_INTERNAL;
+gboolean
+mono_alias_analysis_may_alias (MonoMemoryAccess *a, MonoMemoryAccess *b) MONO_INTERNAL;
+void
+mono_escape_analysis (MonoCompile *cfg) MONO_INTERNAL;
 
 /* CAS - stack walk */
 MonoSecurityFrame* ves_icall_System_Security_SecurityFrame_GetSecurityFrame (gint32 skip) MONO_INTERNAL;
@@ -2780,6 +2852,68 @@ void mini_init_gsctx (MonoDomain *domain, MonoMemPool *mp, MonoGenericContext *c
 gpointer mini_get_gsharedvt_wrapper (gboolean gsharedvt_in, gpointer addr, MonoMethodSignature *normal_sig, MonoMethodSignature *gsharedvt_sig, MonoGenericSharingContext *gsctx,
 									 gint32 vcall_offset, gboolean calli) MONO_INTERNAL;
 
+/*
+ * The receiver classes seen by a virtual call site, used by guarded
+ * devirtualization. Filled out by tier 0 code or from the inlining profile.
+ */
+#define MINI_MAX_RECEIVER_CLASSES 4
+
+typedef struct {
+	MonoClass *classes [MINI_MAX_RECEIVER_CLASSES];
+	/* The method called for each class, if known */
+	MonoMethod *methods [MINI_MAX_RECEIVER_CLASSES];
+	guint32 counts [MINI_MAX_RECEIVER_CLASSES];
+	/* Calls with any other receiver class */
+	guint32 other;
+} MiniReceiverProfile;
+
+/* Tiered compilation */
+extern gboolean mono_tiered_compilation;
+extern int mono_tiered_threshold;
+
+void     mini_tiered_init                       (void) MONO_INTERNAL;
+guint32  mini_tiered_get_tier0_opts             (MonoMethod *method, guint32 opts) MONO_INTERNAL;
+guint32  mini_tiered_get_tier1_opts             (guint32 opts) MONO_INTERNAL;
+gboolean mini_tiered_count_call                 (MonoMethod *method, gpointer code) MONO_INTERNAL;
+void     mini_tiered_tier_up_done               (MonoJitInfo *tier0_ji, gboolean success) MONO_INTERNAL;
+void     mini_tiered_free_domain                (MonoDomain *domain) MONO_INTERNAL;
+MiniReceiverProfile* mini_tiered_get_call_site  (MonoMethod *method, guint32 il_offset, gboolean create) MONO_INTERNAL;
+void     mini_tiered_record_receiver            (MiniReceiverProfile *site, MonoObject *obj) MONO_INTERNAL;
+
+/* Background compilation */
+extern int mono_jit_pool_threads;
+extern gboolean mono_jit_speculative;
+
+void       mini_jit_pool_init                   (void) MONO_INTERNAL;
+void       mini_jit_pool_queue_method           (MonoDomain *domain, MonoMethod *method) MONO_INTERNAL;
+void       mini_jit_pool_queue_class            (MonoVTable *vtable) MONO_INTERNAL;
+void       mini_jit_pool_queue_profile_methods  (MonoAssembly *assembly, gpointer user_data) MONO_INTERNAL;
+void       mini_jit_pool_queue_tier_up          (MonoDomain *domain, MonoMethod *method, MonoJitInfo *tier0_ji) MONO_INTERNAL;
+gboolean   mini_jit_pool_wait_for_method        (MonoDomain *domain, MonoMethod *method) MONO_INTERNAL;
+void       mini_jit_pool_remove_domain_jobs     (MonoDomain *domain) MONO_INTERNAL;
+GPtrArray* mini_load_profile_methods            (MonoImage *image, gboolean verbose) MONO_INTERNAL;
+
+/* Profile guided inlining */
+typedef enum {
+	MINI_PGO_UNKNOWN,
+	MINI_PGO_HOT,
+	MINI_PGO_COLD
+} MiniPgoHint;
+
+gboolean    mini_pgo_load                       (const char *filename, gboolean verbose) MONO_INTERNAL;
+MiniPgoHint mini_pgo_get_call_hint              (MonoMethod *caller, MonoMethod *callee) MONO_INTERNAL;
+gboolean    mini_pgo_get_receiver_profile       (MonoMethod *caller, MonoMethod *cmethod, MiniReceiverProfile *profile) MONO_INTERNAL;
+
+/* Persistent JIT code cache */
+extern char *mono_jit_cache_dir;
+extern char *mono_jit_cache_runtime;
+
+void        mini_jit_cache_init                 (void) MONO_INTERNAL;
+GHashTable* mini_jit_cache_load_methods         (const char *filename) MONO_INTERNAL;
+MonoDl*     mini_jit_cache_load_module          (MonoAssembly *assembly, char **aot_name) MONO_INTERNAL;
+void        mini_jit_cache_add_method           (MonoMethod *method) MONO_INTERNAL;
+void        mini_jit_cache_save                 (void) MONO_INTERNAL;
+
 /* wapihandles.c */
 int mini_wapi_hps (int argc, char **argv) MONO_INTERNAL;
 
@@ -1653,6 +1653,72 @@ ncells ) {
 		else
 			return 0;
 	}
+
+	class EAPoint {
+		public int x, y;
+		public object tag;
+		public double d;
+		public byte b;
+
+		public EAPoint (int x, int y) {
+			this.x = x;
+			this.y = y;
+		}
+
+		public int Sum {
+			get {
+				return x + y;
+			}
+		}
+	}
+
+	static int ea_sum (int x, int y) {
+		var p = new EAPoint (x, y);
+		p.b = 300 & 0xff;
+		p.d = 1.5;
+		return p.Sum + p.b + (int)(p.d * 2);
+	}
+
+	static int ea_cond (bool flag) {
+		var p = new EAPoint (1, 2);
+		if (flag)
+			p.x = 10;
+		else
+			p.y = 20;
+		return p.Sum;
+	}
+
+	static object ea_escaped;
+
+	static int ea_escape (bool flag) {
+		var p = new EAPoint (3, 4);
+		if (flag)
+			ea_escaped = p;
+		p.x = 5;
+		return p.Sum;
+	}
+
+	static int ea_ref_field (string s) {
+		var p = new EAPoint (0, 0);
+		p.tag = s;
+		if (p.tag == null)
+			return 1;
+		return ((string)p.tag).Length;
+	}
+
+	static int test_0_escape_analysis () {
+		if (ea_sum (1, 2) != 3 + 44 + 3)
+			return 1;
+		if (ea_cond (true) != 12 || ea_cond (false) != 21)
+			return 2;
+		if (ea_escape (true) != 9 || ((EAPoint)ea_escaped).x != 5)
+			return 3;
+		if (ea_escape (false) != 9)
+			return 4;
+		if (ea_ref_field ("abc") != 3 || ea_ref_field (null) != 1)
+			return 5;
+		return 0;
+	}
 }
 
 #if MOBILE
@@ -1477,13 +1477,8 @@ simd_version_name (guint32 version)
 }
 
 static MonoInst*
-emit_intrinsics (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig, MonoInst **args, const SimdIntrinsc *intrinsics, guint32 size)
+emit_intrinsic (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig, MonoInst **args, const SimdIntrinsc *result)
 {
-	const SimdIntrinsc * result = mono_binary_search (cmethod->name, intrinsics, size, sizeof (SimdIntrinsc), &simd_intrinsic_compare_by_name);
-	if (!result) {
-		DEBUG (printf ("function doesn't have a simd intrinsic %s::%s/%d\n", cmethod->klass->name, cmethod->name, fsig->param_count));
-		return NULL;
-	}
 	if (IS_DEBUG_ON (cfg)) {
 		int i, max;
 		printf ("found call to intrinsic %s::%s/%d -> %s\n", cmethod->klass->name, cmethod->name, fsig->param_count, method_name (result->name));
@@ -1539,6 +1534,17 @@ emit_intrinsics (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsi
 	g_assert_not_reached ();
 }
 
+static MonoInst*
+emit_intrinsics (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig, MonoInst **args, const SimdIntrinsc *intrinsics, guint32 size)
+{
+	const SimdIntrinsc * result = mono_binary_search (cmethod->name, intrinsics, size, sizeof (SimdIntrinsc), &simd_intrinsic_compare_by_name);
+	if (!result) {
+		DEBUG (printf ("function doesn't have a simd intrinsic %s::%s/%d\n", cmethod->klass->name, cmethod->name, fsig->param_count));
+		return NULL;
+	}
+	return emit_intrinsic (cfg, cmethod, fsig, args, result);
+}
+
 static int
 mono_emit_vector_ldelema (MonoCompile *cfg, MonoType *array_type, MonoInst *arr, MonoInst *index, gboolean check_bounds)
 {
@@ -1631,6 +1637,260 @@ emit_simd_runtime_intrinsics (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodS
 	return NULL;
 }
 
+/*
+ * Mono.Simd.Vector<T> is a vector of elements of the primitive numeric type T,
+ * stored in a single SIMD register. Most of its methods behave like the methods
+ * with the same name of the fixed width type with the same element type, so they
+ * are emitted using the intrinsics of that type.
+ *
+ * The vector is always 128 bits wide, even on hardware with AVX2: the register
+ * allocator, the spill slots and the backends only handle 128-bit xmm registers,
+ * and the managed fallbacks are built around a Vector16b, so wider vectors would
+ * need changes to all of them.
+ */
+
+static const char * const vector_t_element_methods [] = {
+	".ctor",
+	"CompareEqual",
+	"Max",
+	"Min",
+	"op_Addition",
+	"op_BitwiseAnd",
+	"op_BitwiseOr",
+	"op_Division",
+	"op_Equality",
+	"op_ExclusiveOr",
+	"op_Inequality",
+	"op_Multiply",
+	"op_Subtraction"
+};
+
+static const SimdIntrinsc*
+get_vector_t_element_intrinsics (MonoType *etype, guint32 *size)
+{
+#define RETURN_INTRINSICS(intrinsics) do { *size = sizeof (intrinsics) / sizeof (SimdIntrinsc); return intrinsics; } while (0)
+	switch (etype->type) {
+	case MONO_TYPE_R4:
+		RETURN_INTRINSICS (vector4f_intrinsics);
+	case MONO_TYPE_R8:
+		RETURN_INTRINSICS (vector2d_intrinsics);
+	case MONO_TYPE_I1:
+		RETURN_INTRINSICS (vector16sb_intrinsics);
+	case MONO_TYPE_U1:
+		RETURN_INTRINSICS (vector16b_intrinsics);
+	case MONO_TYPE_I2:
+		RETURN_INTRINSICS (vector8s_intrinsics);
+	case MONO_TYPE_U2:
+		RETURN_INTRINSICS (vector8us_intrinsics);
+	case MONO_TYPE_I4:
+		RETURN_INTRINSICS (vector4i_intrinsics);
+	case MONO_TYPE_U4:
+		RETURN_INTRINSICS (vector4ui_intrinsics);
+	case MONO_TYPE_I8:
+		RETURN_INTRINSICS (vector2l_intrinsics);
+	case MONO_TYPE_U8:
+		RETURN_INTRINSICS (vector2ul_intrinsics);
+	default:
+		g_assert_not_reached ();
+	}
+#undef RETURN_INTRINSICS
+}
+
+static int
+emit_simd_binop (MonoCompile *cfg, MonoClass *klass, int opcode, int sreg1, int sreg2)
+{
+	MonoInst *ins;
+
+	MONO_INST_NEW (cfg, ins, opcode);
+	ins->klass = klass;
+	ins->sreg1 = sreg1;
+	ins->sreg2 = sreg2;
+	ins->type = STACK_VTYPE;
+	ins->dreg = alloc_ireg (cfg);
+	MONO_ADD_INS (cfg->cbb, ins);
+	return ins->dreg;
+}
+
+/*
+ * Vector<T> (T[] values [, int index])
+ */
+static MonoInst*
+emit_vector_t_load (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *sig, MonoInst **args)
+{
+	MonoInst *ins, *index;
+	gboolean is_ldaddr = args [0]->opcode == OP_LDADDR;
+	int addr, dreg;
+
+	if (sig->param_count == 2)
+		index = args [2];
+	else
+		EMIT_NEW_ICONST (cfg, index, 0);
+	addr = mono_emit_vector_ldelema (cfg, sig->params [0], args [1], index, TRUE);
+
+	if (is_ldaddr) {
+		dreg = ((MonoInst*)args [0]->inst_p0)->dreg;
+		NULLIFY_INS (args [0]);
+	} else {
+		g_assert (args [0]->type == STACK_MP || args [0]->type == STACK_PTR);
+		dreg = alloc_ireg (cfg);
+	}
+
+	MONO_INST_NEW (cfg, ins, OP_LOADX_MEMBASE);
+	ins->klass = cmethod->klass;
+	ins->sreg1 = addr;
+	ins->type = STACK_VTYPE;
+	ins->dreg = dreg;
+	MONO_ADD_INS (cfg->cbb, ins);
+
+	if (!is_ldaddr) {
+		MONO_INST_NEW (cfg, ins, OP_STOREX_MEMBASE);
+		ins->dreg = args [0]->dreg;
+		ins->sreg1 = dreg;
+		MONO_ADD_INS (cfg->cbb, ins);
+	}
+	return ins;
+}
+
+/*
+ * void CopyTo (T[] destination [, int index])
+ */
+static MonoInst*
+emit_vector_t_store (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *sig, MonoInst **args)
+{
+	MonoInst *ins, *index;
+	int addr, vreg;
+
+	vreg = load_simd_vreg (cfg, cmethod, args [0], NULL);
+	if (sig->param_count == 2)
+		index = args [2];
+	else
+		EMIT_NEW_ICONST (cfg, index, 0);
+	addr = mono_emit_vector_ldelema (cfg, sig->params [0], args [1], index, TRUE);
+
+	MONO_INST_NEW (cfg, ins, OP_STOREX_MEMBASE);
+	ins->klass = cmethod->klass;
+	ins->dreg = addr;
+	ins->sreg1 = vreg;
+	MONO_ADD_INS (cfg->cbb, ins);
+	return ins;
+}
+
+/*
+ * T Dot (Vector<T> v1, Vector<T> v2)
+ *
+ *   The products are added up in pairs using horizontal adds, the managed
+ * implementation uses the same order.
+ */
+static MonoInst*
+emit_vector_t_dot (MonoCompile *cfg, MonoMethod *cmethod, MonoType *etype, MonoInst **args)
+{
+	MonoInst *ins;
+	int vreg, i, nadds, mul_op, hadd_op;
+
+	if (!(simd_supported_versions & SIMD_VERSION_SSE3))
+		return NULL;
+
+	if (etype->type == MONO_TYPE_R4) {
+		mul_op = OP_MULPS;
+		hadd_op = OP_HADDPS;
+		nadds = 2;
+	} else if (etype->type == MONO_TYPE_R8) {
+		mul_op = OP_MULPD;
+		hadd_op = OP_HADDPD;
+		nadds = 1;
+	} else {
+		return NULL;
+	}
+
+	vreg = emit_simd_binop (cfg, cmethod->klass, mul_op, get_simd_vreg (cfg, cmethod, args [0]), get_simd_vreg (cfg, cmethod, args [1]));
+	for (i = 0; i < nadds; ++i)
+		vreg = emit_simd_binop (cfg, cmethod->klass, hadd_op, vreg, vreg);
+
+	/* The sum is in every element, extract the first one */
+	if (etype->type == MONO_TYPE_R4) {
+		MONO_INST_NEW (cfg, ins, OP_EXTRACT_I4);
+		ins->klass = cmethod->klass;
+		ins->sreg1 = vreg;
+		ins->inst_c0 = 0;
+		ins->type = STACK_I4;
+		ins->dreg = vreg = alloc_ireg (cfg);
+		MONO_ADD_INS (cfg->cbb, ins);
+
+		MONO_INST_NEW (cfg, ins, OP_ICONV_TO_R8_RAW);
+		ins->klass = mono_defaults.single_class;
+		ins->sreg1 = vreg;
+		ins->type = STACK_R8;
+		ins->dreg = alloc_freg (cfg);
+		ins->backend.spill_var = get_int_to_float_spill_area (cfg);
+		MONO_ADD_INS (cfg->cbb, ins);
+	} else {
+		MONO_INST_NEW (cfg, ins, OP_EXTRACT_R8);
+		ins->klass = cmethod->klass;
+		ins->sreg1 = vreg;
+		ins->inst_c0 = 0;
+		ins->type = STACK_R8;
+		ins->dreg = alloc_freg (cfg);
+		ins->backend.spill_var = get_double_spill_area (cfg);
+		MONO_ADD_INS (cfg->cbb, ins);
+	}
+	return ins;
+}
+
+static MonoInst*
+emit_vector_t_intrinsics (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig, MonoInst **args)
+{
+	MonoMethodSignature *sig = mono_method_signature (cmethod);
+	MonoType *etype = mono_class_get_context (cmethod->klass)->class_inst->type_argv [0];
+	const SimdIntrinsc *intrinsics, *result;
+	guint32 size;
+	MonoInst *ins;
+	int i, align;
+
+	if (!strcmp ("get_Count", cmethod->name)) {
+		/* Use the size of the managed type, so this agrees with the fallbacks */
+		EMIT_NEW_ICONST (cfg, ins, mono_class_value_size (cmethod->klass, NULL) / mono_type_size (etype, &align));
+		return ins;
+	}
+	if (!strcmp ("get_IsHardwareAccelerated", cmethod->name)) {
+		EMIT_NEW_ICONST (cfg, ins, (simd_supported_versions & SIMD_VERSION_SSE2) ? 1 : 0);
+		return ins;
+	}
+	if (!strcmp (".ctor", cmethod->name) && sig->params [0]->type == MONO_TYPE_SZARRAY)
+		return emit_vector_t_load (cfg, cmethod, sig, args);
+	if (!strcmp ("CopyTo", cmethod->name))
+		return emit_vector_t_store (cfg, cmethod, sig, args);
+	if (!strcmp ("Dot", cmethod->name))
+		return emit_vector_t_dot (cfg, cmethod, etype, args);
+
+	intrinsics = get_vector_t_element_intrinsics (etype, &size);
+
+	if (!strcmp ("CompareGreaterThan", cmethod->name) || !strcmp ("CompareLessThan", cmethod->name)) {
+		gboolean gt = !strcmp ("CompareGreaterThan", cmethod->name);
+		MonoInst *swapped_args [2];
+
+		result = mono_binary_search (cmethod->name, intrinsics, size, sizeof (SimdIntrinsc), &simd_intrinsic_compare_by_name);
+		if (result)
+			return emit_intrinsic (cfg, cmethod, fsig, args, result);
+		/* Only one of them is available for most types, a > b is b < a */
+		result = mono_binary_search (gt ? "CompareLessThan" : "CompareGreaterThan", intrinsics, size, sizeof (SimdIntrinsc), &simd_intrinsic_compare_by_name);
+		if (!result)
+			return NULL;
+		swapped_args [0] = args [1];
+		swapped_args [1] = args [0];
+		return emit_intrinsic (cfg, cmethod, fsig, swapped_args, result);
+	}
+
+	/* PMULQ only multiplies the low 32 bits of the elements */
+	if (!strcmp ("op_Multiply", cmethod->name) && (etype->type == MONO_TYPE_I8 || etype->type == MONO_TYPE_U8))
+		return NULL;
+
+	for (i = 0; i < G_N_ELEMENTS (vector_t_element_methods); ++i) {
+		if (!strcmp (vector_t_element_methods [i], cmethod->name))
+			return emit_intrinsics (cfg, cmethod, fsig, args, intrinsics, size);
+	}
+	return NULL;
+}
+
 MonoInst*
 mono_emit_simd_intrinsics (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig, MonoInst **args)
 {
@@ -1654,6 +1914,8 @@ mono_emit_simd_intrinsics (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSign
 		return NULL;
 
 	cfg->uses_simd_intrinsics = 1;
+	if (!strcmp ("Vector`1", class_name))
+		return emit_vector_t_intrinsics (cfg, cmethod, fsig, args);
 	if (!strcmp ("Vector2d", class_name))
 		return emit_intrinsics (cfg, cmethod, fsig, args, vector2d_intrinsics, sizeof (vector2d_intrinsics) / sizeof (SimdIntrinsc));
 	if (!strcmp ("Vector4f", class_name))
@@ -970,7 +970,8 @@ mono_arch_create_monitor_enter_trampoline (MonoTrampInfo **info, gboolean is_v4,
 {
 	guint8 *tramp;
 	guint8 *code, *buf;
-	guint8 *jump_obj_null, *jump_sync_null, *jump_cmpxchg_failed, *jump_other_owner, *jump_tid, *jump_sync_thin_hash = NULL;
+	guint8 *jump_obj_null, *jump_cmpxchg_failed, *jump_other_owner, *jump_tid, *jump_sync_thin_hash;
+	guint8 *jump_not_flat, *jump_flat_owned, *jump_flat_cmpxchg_failed, *jump_flat_other_owner, *jump_flat_max_nest, *jump_flat_nest_cmpxchg_failed;
 	guint8 *jump_lock_taken_true = NULL;
 	int tramp_size;
 	int status_offset, nest_offset;
@@ -995,7 +996,7 @@ mono_arch_create_monitor_enter_trampoline (MonoTrampInfo **info, gboolean is_v4,
 	status_offset = MONO_THREADS_SYNC_MEMBER_OFFSET (status_offset);
 	nest_offset = MONO_THREADS_SYNC_MEMBER_OFFSET (nest_offset);
 
-	tramp_size = 96;
+	tramp_size = 224;
 
 	code = buf = mono_global_codeman_reserve (tramp_size);
 
@@ -1007,39 +1008,83 @@ mono_arch_create_monitor_enter_trampoline (MonoTrampInfo **info, gboolean is_v4,
 		amd64_test_reg_reg (code, obj_reg, obj_reg);
 		/* if yes, jump to actual trampoline */
 		jump_obj_null = code;
-		amd64_branch8 (code, X86_CC_Z, -1, 1);
+		amd64_branch32 (code, X86_CC_Z, -1, 1);
 
 		if (is_v4) {
 			amd64_test_membase_imm (code, lock_taken_reg, 0, 1);
 			/* if *lock_taken is 1, jump to actual trampoline */
 			jump_lock_taken_true = code;
-			x86_branch8 (code, X86_CC_NZ, -1, 1);
+			amd64_branch32 (code, X86_CC_NZ, -1, 1);
 		}
 
-		/* load obj->synchronization to sync_reg */
-		amd64_mov_reg_membase (code, sync_reg, obj_reg, MONO_STRUCT_OFFSET (MonoObject, synchronisation), 8);
+		/* load MonoInternalThread* into tid_reg */
+		code = mono_amd64_emit_tls_get (code, tid_reg, mono_thread_get_tls_offset ());
+		/* load TID into tid_reg */
+		amd64_mov_reg_membase (code, tid_reg, tid_reg, MONO_STRUCT_OFFSET (MonoInternalThread, small_id), 4);
 
-		if (mono_gc_is_moving ()) {
-			/*if bit zero is set it's a thin hash*/
-			/*FIXME use testb encoding*/
-			amd64_test_reg_imm (code, sync_reg, 0x01);
-			jump_sync_thin_hash = code;
-			amd64_branch8 (code, X86_CC_NE, -1, 1);
+		/* load the lock word to sync_reg */
+		amd64_mov_reg_membase (code, sync_reg, obj_reg, MONO_STRUCT_OFFSET (MonoObject, synchronisation), 8);
 
-			/*clear bits used by the gc*/
-			amd64_alu_reg_imm (code, X86_AND, sync_reg, ~0x3);
-		}
+		/* is it a flat lock? */
+		amd64_test_reg_imm (code, sync_reg, LOCK_WORD_STATUS_MASK);
+		/* if not, jump to the inflated case */
+		jump_not_flat = code;
+		amd64_branch8 (code, X86_CC_NZ, -1, 1);
 
-		/* is synchronization null? */
+		/* form the lock word of a flat lock held by us in tid_reg */
+		amd64_shift_reg_imm (code, X86_SHL, tid_reg, LOCK_WORD_OWNER_SHIFT);
+		/* is the lock free? */
 		amd64_test_reg_reg (code, sync_reg, sync_reg);
-		/* if yes, jump to actual trampoline */
-		jump_sync_null = code;
-		amd64_branch8 (code, X86_CC_Z, -1, 1);
+		/* if not, jump to next case */
+		jump_flat_owned = code;
+		amd64_branch8 (code, X86_CC_NZ, -1, 1);
 
-		/* load MonoInternalThread* into tid_reg */
-		code = mono_amd64_emit_tls_get (code, tid_reg, mono_thread_get_tls_offset ());
-		/* load TID into tid_reg */
-		amd64_mov_reg_membase (code, tid_reg, tid_reg, MONO_STRUCT_OFFSET (MonoInternalThread, small_id), 4);
+		/* if yes, try a compare-exchange with the new lock word */
+		g_assert (tid_reg != AMD64_RAX && sync_reg != AMD64_RAX);
+		amd64_alu_reg_reg_size (code, X86_XOR, AMD64_RAX, AMD64_RAX, 4);
+		amd64_prefix (code, X86_LOCK_PREFIX);
+		amd64_cmpxchg_membase_reg_size (code, obj_reg, MONO_STRUCT_OFFSET (MonoObject, synchronisation), tid_reg, 8);
+		/* if not successful, jump to actual trampoline */
+		jump_flat_cmpxchg_failed = code;
+		amd64_branch32 (code, X86_CC_NZ, -1, 1);
+		/* if successful, return */
+		if (is_v4)
+			amd64_mov_membase_imm (code, lock_taken_reg, 0, 1, 1);
+		amd64_ret (code);
+
+		/* next case: the flat lock is held */
+		x86_patch (jump_flat_owned, code);
+		/* is the owner TID? this leaves the nest bits in tid_reg */
+		amd64_alu_reg_reg (code, X86_XOR, tid_reg, sync_reg);
+		amd64_test_reg_imm (code, tid_reg, LOCK_WORD_OWNER_MASK);
+		/* if not, jump to actual trampoline which inflates the lock */
+		jump_flat_other_owner = code;
+		amd64_branch32 (code, X86_CC_NZ, -1, 1);
+		/* if yes, does nest still fit in the lock word? */
+		amd64_alu_reg_imm (code, X86_CMP, tid_reg, LOCK_WORD_NEST_MASK);
+		jump_flat_max_nest = code;
+		amd64_branch32 (code, X86_CC_Z, -1, 1);
+		/* if yes, try to increment nest with a compare-exchange */
+		amd64_mov_reg_reg (code, AMD64_RAX, sync_reg, 8);
+		amd64_lea_membase (code, tid_reg, sync_reg, 1 << LOCK_WORD_NEST_SHIFT);
+		amd64_prefix (code, X86_LOCK_PREFIX);
+		amd64_cmpxchg_membase_reg_size (code, obj_reg, MONO_STRUCT_OFFSET (MonoObject, synchronisation), tid_reg, 8);
+		/* if not successful, the lock was inflated under us */
+		jump_flat_nest_cmpxchg_failed = code;
+		amd64_branch32 (code, X86_CC_NZ, -1, 1);
+		if (is_v4)
+			amd64_mov_membase_imm (code, lock_taken_reg, 0, 1, 1);
+		amd64_ret (code);
+
+		/* next case: the lock word is not flat */
+		x86_patch (jump_not_flat, code);
+		/* is it a thin hash? */
+		amd64_test_reg_imm (code, sync_reg, LOCK_WORD_INFLATED);
+		/* if yes, jump to actual trampoline which inflates the lock */
+		jump_sync_thin_hash = code;
+		amd64_branch32 (code, X86_CC_Z, -1, 1);
+		/* clear the status bits to get the MonoThreadsSync */
+		amd64_alu_reg_imm (code, X86_AND, sync_reg, ~LOCK_WORD_STATUS_MASK);
 
 		/* is synchronization->owner free */
 		amd64_mov_reg_membase (code, status_reg, sync_reg, status_offset, 4);
@@ -1079,9 +1124,11 @@ mono_arch_create_monitor_enter_trampoline (MonoTrampInfo **info, gboolean is_v4,
 		amd64_ret (code);
 
 		x86_patch (jump_obj_null, code);
-		if (jump_sync_thin_hash)
-			x86_patch (jump_sync_thin_hash, code);
-		x86_patch (jump_sync_null, code);
+		x86_patch (jump_flat_cmpxchg_failed, code);
+		x86_patch (jump_flat_other_owner, code);
+		x86_patch (jump_flat_max_nest, code);
+		x86_patch (jump_flat_nest_cmpxchg_failed, code);
+		x86_patch (jump_sync_thin_hash, code);
 		x86_patch (jump_cmpxchg_failed, code);
 		x86_patch (jump_other_owner, code);
 		if (is_v4)
@@ -1129,7 +1176,8 @@ mono_arch_create_monitor_exit_trampoline (MonoTrampInfo **info, gboolean aot)
 {
 	guint8 *tramp;
 	guint8 *code, *buf;
-	guint8 *jump_obj_null, *jump_have_waiters, *jump_sync_null, *jump_not_owned, *jump_cmpxchg_failed, *jump_sync_thin_hash = NULL;
+	guint8 *jump_obj_null, *jump_have_waiters, *jump_not_owned, *jump_cmpxchg_failed, *jump_sync_thin_hash;
+	guint8 *jump_not_flat, *jump_flat_not_owned, *jump_flat_nested, *jump_flat_cmpxchg_failed, *jump_flat_nest_cmpxchg_failed;
 	guint8 *jump_next;
 	int tramp_size;
 	int status_offset, nest_offset;
@@ -1138,6 +1186,7 @@ mono_arch_create_monitor_exit_trampoline (MonoTrampInfo **info, gboolean aot)
 	int obj_reg = MONO_AMD64_ARG_REG1;
 	int sync_reg = MONO_AMD64_ARG_REG2;
 	int status_reg = MONO_AMD64_ARG_REG3;
+	int tid_reg = MONO_AMD64_ARG_REG4;
 
 	g_assert (obj_reg == MONO_ARCH_MONITOR_OBJECT_REG);
 
@@ -1147,7 +1196,7 @@ mono_arch_create_monitor_exit_trampoline (MonoTrampInfo **info, gboolean aot)
 	status_offset = MONO_THREADS_SYNC_MEMBER_OFFSET (status_offset);
 	nest_offset = MONO_THREADS_SYNC_MEMBER_OFFSET (nest_offset);
 
-	tramp_size = 112;
+	tramp_size = 192;
 
 	code = buf = mono_global_codeman_reserve (tramp_size);
 
@@ -1159,37 +1208,71 @@ mono_arch_create_monitor_exit_trampoline (MonoTrampInfo **info, gboolean aot)
 		amd64_test_reg_reg (code, obj_reg, obj_reg);
 		/* if yes, jump to actual trampoline */
 		jump_obj_null = code;
-		amd64_branch8 (code, X86_CC_Z, -1, 1);
+		amd64_branch32 (code, X86_CC_Z, -1, 1);
+
+		/* load MonoInternalThread* into tid_reg */
+		code = mono_amd64_emit_tls_get (code, tid_reg, mono_thread_get_tls_offset ());
+		/* load TID into tid_reg */
+		amd64_mov_reg_membase (code, tid_reg, tid_reg, MONO_STRUCT_OFFSET (MonoInternalThread, small_id), 4);
 
-		/* load obj->synchronization to RCX */
+		/* load the lock word to sync_reg */
 		amd64_mov_reg_membase (code, sync_reg, obj_reg, MONO_STRUCT_OFFSET (MonoObject, synchronisation), 8);
 
-		if (mono_gc_is_moving ()) {
-			/*if bit zero is set it's a thin hash*/
-			/*FIXME use testb encoding*/
-			amd64_test_reg_imm (code, sync_reg, 0x01);
-			jump_sync_thin_hash = code;
-			amd64_branch8 (code, X86_CC_NE, -1, 1);
+		/* is it a flat lock? */
+		amd64_test_reg_imm (code, sync_reg, LOCK_WORD_STATUS_MASK);
+		/* if not, jump to the inflated case */
+		jump_not_flat = code;
+		amd64_branch8 (code, X86_CC_NZ, -1, 1);
 
-			/*clear bits used by the gc*/
-			amd64_alu_reg_imm (code, X86_AND, sync_reg, ~0x3);
-		}
+		/* is the owner TID? this leaves the nest bits in tid_reg */
+		amd64_shift_reg_imm (code, X86_SHL, tid_reg, LOCK_WORD_OWNER_SHIFT);
+		amd64_alu_reg_reg (code, X86_XOR, tid_reg, sync_reg);
+		amd64_test_reg_imm (code, tid_reg, LOCK_WORD_OWNER_MASK);
+		/* if not, jump to actual trampoline */
+		jump_flat_not_owned = code;
+		amd64_branch32 (code, X86_CC_NZ, -1, 1);
+
+		/* old lock word in RAX */
+		g_assert (status_reg != AMD64_RAX && tid_reg != AMD64_RAX);
+		amd64_mov_reg_reg (code, AMD64_RAX, sync_reg, 8);
+		/* is the lock nested? */
+		amd64_test_reg_reg (code, tid_reg, tid_reg);
+		/* if yes, jump to next case */
+		jump_flat_nested = code;
+		amd64_branch8 (code, X86_CC_NZ, -1, 1);
+		/* if not, try to clear the lock word and return */
+		amd64_alu_reg_reg_size (code, X86_XOR, status_reg, status_reg, 4);
+		amd64_prefix (code, X86_LOCK_PREFIX);
+		amd64_cmpxchg_membase_reg_size (code, obj_reg, MONO_STRUCT_OFFSET (MonoObject, synchronisation), status_reg, 8);
+		/* if not successful, the lock was inflated under us */
+		jump_flat_cmpxchg_failed = code;
+		amd64_branch32 (code, X86_CC_NZ, -1, 1);
+		amd64_ret (code);
 
-		/* is synchronization null? */
-		amd64_test_reg_reg (code, sync_reg, sync_reg);
+		/* next case: the flat lock is nested */
+		x86_patch (jump_flat_nested, code);
+		/* try to decrement nest and return */
+		amd64_lea_membase (code, status_reg, sync_reg, -(1 << LOCK_WORD_NEST_SHIFT));
+		amd64_prefix (code, X86_LOCK_PREFIX);
+		amd64_cmpxchg_membase_reg_size (code, obj_reg, MONO_STRUCT_OFFSET (MonoObject, synchronisation), status_reg, 8);
+		jump_flat_nest_cmpxchg_failed = code;
+		amd64_branch32 (code, X86_CC_NZ, -1, 1);
+		amd64_ret (code);
+
+		/* next case: the lock word is not flat */
+		x86_patch (jump_not_flat, code);
+		/* is it a thin hash? */
+		amd64_test_reg_imm (code, sync_reg, LOCK_WORD_INFLATED);
 		/* if yes, jump to actual trampoline */
-		jump_sync_null = code;
-		amd64_branch8 (code, X86_CC_Z, -1, 1);
+		jump_sync_thin_hash = code;
+		amd64_branch32 (code, X86_CC_Z, -1, 1);
+		/* clear the status bits to get the MonoThreadsSync */
+		amd64_alu_reg_imm (code, X86_AND, sync_reg, ~LOCK_WORD_STATUS_MASK);
 
-		/* next case: synchronization is not null */
-		/* load MonoInternalThread* into RAX */
-		code = mono_amd64_emit_tls_get (code, AMD64_RAX, mono_thread_get_tls_offset ());
-		/* load TID into RAX */
-		amd64_mov_reg_membase (code, AMD64_RAX, AMD64_RAX, MONO_STRUCT_OFFSET (MonoInternalThread, small_id), 4);
 		/* is synchronization->owner == TID */
 		amd64_mov_reg_membase (code, status_reg, sync_reg, status_offset, 4);
-		amd64_alu_reg_reg_size (code, X86_XOR, AMD64_RAX, status_reg, 4);
-		amd64_test_reg_imm_size (code, AMD64_RAX, OWNER_MASK, 4);
+		amd64_alu_reg_reg_size (code, X86_XOR, tid_reg, status_reg, 4);
+		amd64_test_reg_imm_size (code, tid_reg, OWNER_MASK, 4);
 
 		/* if no, jump to actual trampoline */
 		jump_not_owned = code;
@@ -1227,10 +1310,13 @@ mono_arch_create_monitor_exit_trampoline (MonoTrampInfo **info, gboolean aot)
 		amd64_ret (code);
 
 		x86_patch (jump_obj_null, code);
+		x86_patch (jump_flat_not_owned, code);
+		x86_patch (jump_flat_cmpxchg_failed, code);
+		x86_patch (jump_flat_nest_cmpxchg_failed, code);
+		x86_patch (jump_sync_thin_hash, code);
 		x86_patch (jump_have_waiters, code);
 		x86_patch (jump_not_owned, code);
 		x86_patch (jump_cmpxchg_failed, code);
-		x86_patch (jump_sync_null, code);
 	}
 
 	/* jump to the actual trampoline */
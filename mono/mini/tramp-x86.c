@@ -761,13 +761,23 @@ mono_arch_create_generic_class_init_trampoline (MonoTrampInfo **info, gboolean a
  * The code produced by this trampoline is equivalent to this:
  *
  * if (obj) {
- * 	if (obj->synchronisation) {
- * 		if (obj->synchronisation->owner == 0) {
- * 			if (cmpxch (&obj->synchronisation->owner, TID, 0) == 0)
+ * 	lw = obj->synchronisation;
+ * 	if (lw is flat) {
+ * 		if (lw == 0) {
+ * 			if (cmpxch (&obj->synchronisation, FLAT (TID), 0) == 0)
+ * 				return;
+ * 		} else if (owner (lw) == TID && nest (lw) < max) {
+ * 			if (cmpxch (&obj->synchronisation, lw + 1 nest, lw) == lw)
+ * 				return;
+ * 		}
+ * 	} else if (lw is inflated) {
+ * 		sync = lw & ~status bits;
+ * 		if (sync->owner == 0) {
+ * 			if (cmpxch (&sync->owner, TID, 0) == 0)
  * 				return;
  * 		}
- * 		if (obj->synchronisation->owner == TID) {
- * 			++obj->synchronisation->nest;
+ * 		if (sync->owner == TID) {
+ * 			++sync->nest;
  * 			return;
  * 		}
  * 	}
@@ -779,7 +789,8 @@ gpointer
 mono_arch_create_monitor_enter_trampoline (MonoTrampInfo **info, gboolean is_v4, gboolean aot)
 {
 	guint8 *code, *buf;
-	guint8 *jump_obj_null, *jump_sync_null, *jump_other_owner, *jump_cmpxchg_failed, *jump_tid, *jump_sync_thin_hash = NULL;
+	guint8 *jump_obj_null, *jump_other_owner, *jump_cmpxchg_failed, *jump_tid, *jump_sync_thin_hash;
+	guint8 *jump_not_flat, *jump_flat_owned, *jump_flat_cmpxchg_failed, *jump_flat_other_owner, *jump_flat_max_nest, *jump_flat_nest_cmpxchg_failed;
 	guint8 *jump_lock_taken_true = NULL;
 	int tramp_size;
 	int status_offset, nest_offset;
@@ -799,7 +810,7 @@ mono_arch_create_monitor_enter_trampoline (MonoTrampInfo **info, gboolean is_v4,
 	status_offset = MONO_THREADS_SYNC_MEMBER_OFFSET (status_offset);
 	nest_offset = MONO_THREADS_SYNC_MEMBER_OFFSET (nest_offset);
 
-	tramp_size = NACL_SIZE (96, 128);
+	tramp_size = NACL_SIZE (224, 288);
 
 	code = buf = mono_global_codeman_reserve (tramp_size);
 
@@ -809,7 +820,7 @@ mono_arch_create_monitor_enter_trampoline (MonoTrampInfo **info, gboolean is_v4,
 			x86_test_membase_imm (code, X86_EDX, 0, 1);
 			/* if *lock_taken is 1, jump to actual trampoline */
 			jump_lock_taken_true = code;
-			x86_branch8 (code, X86_CC_NZ, -1, 1);
+			x86_branch32 (code, X86_CC_NZ, -1, 1);
 			x86_push_reg (code, X86_EDX);
 		}
 		/* MonoObject* obj is in EAX */
@@ -817,28 +828,7 @@ mono_arch_create_monitor_enter_trampoline (MonoTrampInfo **info, gboolean is_v4,
 		x86_test_reg_reg (code, X86_EAX, X86_EAX);
 		/* if yes, jump to actual trampoline */
 		jump_obj_null = code;
-		x86_branch8 (code, X86_CC_Z, -1, 1);
-
-		/* load obj->synchronization to ECX */
-		x86_mov_reg_membase (code, X86_ECX, X86_EAX, MONO_STRUCT_OFFSET (MonoObject, synchronisation), 4);
-
-		if (mono_gc_is_moving ()) {
-			/*if bit zero is set it's a thin hash*/
-			/*FIXME use testb encoding*/
-			x86_test_reg_imm (code, X86_ECX, 0x01);
-			jump_sync_thin_hash = code;
-			x86_branch8 (code, X86_CC_NE, -1, 1);
-
-			/*clear bits used by the gc*/
-			x86_alu_reg_imm (code, X86_AND, X86_ECX, ~0x3);
-		}
-
-		/* is synchronization null? */
-		x86_test_reg_reg (code, X86_ECX, X86_ECX);
-
-		/* if yes, jump to actual trampoline */
-		jump_sync_null = code;
-		x86_branch8 (code, X86_CC_Z, -1, 1);
+		x86_branch32 (code, X86_CC_Z, -1, 1);
 
 		/* load MonoInternalThread* into EDX */
 		if (aot) {
@@ -853,6 +843,77 @@ mono_arch_create_monitor_enter_trampoline (MonoTrampInfo **info, gboolean is_v4,
 		/* load TID into EDX */
 		x86_mov_reg_membase (code, X86_EDX, X86_EDX, MONO_STRUCT_OFFSET (MonoInternalThread, small_id), 4);
 
+		/* load the lock word to ECX */
+		x86_mov_reg_membase (code, X86_ECX, X86_EAX, MONO_STRUCT_OFFSET (MonoObject, synchronisation), 4);
+
+		/* is it a flat lock? */
+		x86_test_reg_imm (code, X86_ECX, LOCK_WORD_STATUS_MASK);
+		/* if not, jump to the inflated case */
+		jump_not_flat = code;
+		x86_branch8 (code, X86_CC_NZ, -1, 1);
+
+		/* form the lock word of a flat lock held by us in EDX */
+		x86_shift_reg_imm (code, X86_SHL, X86_EDX, LOCK_WORD_OWNER_SHIFT);
+		/* is the lock free? */
+		x86_test_reg_reg (code, X86_ECX, X86_ECX);
+		/* if not, jump to next case */
+		jump_flat_owned = code;
+		x86_branch8 (code, X86_CC_NZ, -1, 1);
+
+		/* if yes, try a compare-exchange with the new lock word */
+		x86_mov_reg_reg (code, X86_ECX, X86_EAX, 4);
+		x86_alu_reg_reg (code, X86_XOR, X86_EAX, X86_EAX);
+		x86_prefix (code, X86_LOCK_PREFIX);
+		x86_cmpxchg_membase_reg (code, X86_ECX, MONO_STRUCT_OFFSET (MonoObject, synchronisation), X86_EDX);
+		/* if not successful, jump to actual trampoline */
+		jump_flat_cmpxchg_failed = code;
+		x86_branch32 (code, X86_CC_NZ, -1, 1);
+		/* if successful, pop and return */
+		if (is_v4) {
+			x86_pop_reg (code, X86_EDX);
+			x86_mov_membase_imm (code, X86_EDX, 0, 1, 1);
+		}
+		x86_pop_reg (code, X86_EAX);
+		x86_ret (code);
+
+		/* next case: the flat lock is held */
+		x86_patch (jump_flat_owned, code);
+		/* is the owner TID? this leaves the nest bits in EDX */
+		x86_alu_reg_reg (code, X86_XOR, X86_EDX, X86_ECX);
+		x86_test_reg_imm (code, X86_EDX, LOCK_WORD_OWNER_MASK);
+		/* if not, jump to actual trampoline which inflates the lock */
+		jump_flat_other_owner = code;
+		x86_branch32 (code, X86_CC_NZ, -1, 1);
+		/* if yes, does nest still fit in the lock word? */
+		x86_alu_reg_imm (code, X86_CMP, X86_EDX, LOCK_WORD_NEST_MASK);
+		jump_flat_max_nest = code;
+		x86_branch32 (code, X86_CC_Z, -1, 1);
+		/* if yes, try to increment nest with a compare-exchange */
+		x86_lea_membase (code, X86_EDX, X86_ECX, 1 << LOCK_WORD_NEST_SHIFT);
+		/* old lock word in EAX, obj in ECX */
+		x86_xchg_reg_reg (code, X86_EAX, X86_ECX, 4);
+		x86_prefix (code, X86_LOCK_PREFIX);
+		x86_cmpxchg_membase_reg (code, X86_ECX, MONO_STRUCT_OFFSET (MonoObject, synchronisation), X86_EDX);
+		/* if not successful, the lock was inflated under us */
+		jump_flat_nest_cmpxchg_failed = code;
+		x86_branch32 (code, X86_CC_NZ, -1, 1);
+		if (is_v4) {
+			x86_pop_reg (code, X86_EDX);
+			x86_mov_membase_imm (code, X86_EDX, 0, 1, 1);
+		}
+		x86_pop_reg (code, X86_EAX);
+		x86_ret (code);
+
+		/* next case: the lock word is not flat */
+		x86_patch (jump_not_flat, code);
+		/* is it a thin hash? */
+		x86_test_reg_imm (code, X86_ECX, LOCK_WORD_INFLATED);
+		/* if yes, jump to actual trampoline which inflates the lock */
+		jump_sync_thin_hash = code;
+		x86_branch32 (code, X86_CC_Z, -1, 1);
+		/* clear the status bits to get the MonoThreadsSync */
+		x86_alu_reg_imm (code, X86_AND, X86_ECX, ~LOCK_WORD_STATUS_MASK);
+
 		/* is synchronization->owner free */
 		x86_mov_reg_membase (code, X86_EAX, X86_ECX, status_offset, 4);
 		x86_test_reg_imm (code, X86_EAX, OWNER_MASK);
@@ -897,9 +958,11 @@ mono_arch_create_monitor_enter_trampoline (MonoTrampInfo **info, gboolean is_v4,
 
 		/* obj is pushed, jump to the actual trampoline */
 		x86_patch (jump_obj_null, code);
-		if (jump_sync_thin_hash)
-			x86_patch (jump_sync_thin_hash, code);
-		x86_patch (jump_sync_null, code);
+		x86_patch (jump_flat_cmpxchg_failed, code);
+		x86_patch (jump_flat_other_owner, code);
+		x86_patch (jump_flat_max_nest, code);
+		x86_patch (jump_flat_nest_cmpxchg_failed, code);
+		x86_patch (jump_sync_thin_hash, code);
 		x86_patch (jump_other_owner, code);
 		x86_patch (jump_cmpxchg_failed, code);
 
@@ -946,7 +1009,8 @@ mono_arch_create_monitor_exit_trampoline (MonoTrampInfo **info, gboolean aot)
 {
 	guint8 *tramp = mono_get_trampoline_code (MONO_TRAMPOLINE_MONITOR_EXIT);
 	guint8 *code, *buf;
-	guint8 *jump_obj_null, *jump_have_waiters, *jump_sync_null, *jump_not_owned, *jump_sync_thin_hash = NULL;
+	guint8 *jump_obj_null, *jump_have_waiters, *jump_not_owned, *jump_sync_thin_hash;
+	guint8 *jump_not_flat, *jump_flat_not_owned, *jump_flat_nested, *jump_flat_cmpxchg_failed, *jump_flat_nest_cmpxchg_failed;
 	guint8 *jump_next, *jump_cmpxchg_failed;
 	int tramp_size;
 	int status_offset, nest_offset;
@@ -961,7 +1025,7 @@ mono_arch_create_monitor_exit_trampoline (MonoTrampInfo **info, gboolean aot)
 	status_offset = MONO_THREADS_SYNC_MEMBER_OFFSET (status_offset);
 	nest_offset = MONO_THREADS_SYNC_MEMBER_OFFSET (nest_offset);
 
-	tramp_size = NACL_SIZE (96, 128);
+	tramp_size = NACL_SIZE (224, 288);
 
 	code = buf = mono_global_codeman_reserve (tramp_size);
 
@@ -972,29 +1036,8 @@ mono_arch_create_monitor_exit_trampoline (MonoTrampInfo **info, gboolean aot)
 		x86_test_reg_reg (code, X86_EAX, X86_EAX);
 		/* if yes, jump to actual trampoline */
 		jump_obj_null = code;
-		x86_branch8 (code, X86_CC_Z, -1, 1);
-
-		/* load obj->synchronization to ECX */
-		x86_mov_reg_membase (code, X86_ECX, X86_EAX, MONO_STRUCT_OFFSET (MonoObject, synchronisation), 4);
+		x86_branch32 (code, X86_CC_Z, -1, 1);
 
-		if (mono_gc_is_moving ()) {
-			/*if bit zero is set it's a thin hash*/
-			/*FIXME use testb encoding*/
-			x86_test_reg_imm (code, X86_ECX, 0x01);
-			jump_sync_thin_hash = code;
-			x86_branch8 (code, X86_CC_NE, -1, 1);
-
-			/*clear bits used by the gc*/
-			x86_alu_reg_imm (code, X86_AND, X86_ECX, ~0x3);
-		}
-
-		/* is synchronization null? */
-		x86_test_reg_reg (code, X86_ECX, X86_ECX);
-		/* if yes, jump to actual trampoline */
-		jump_sync_null = code;
-		x86_branch8 (code, X86_CC_Z, -1, 1);
-
-		/* next case: synchronization is not null */
 		/* load MonoInternalThread* into EDX */
 		if (aot) {
 			/* load_aotconst () puts the result into EAX */
@@ -1007,6 +1050,62 @@ mono_arch_create_monitor_exit_trampoline (MonoTrampInfo **info, gboolean aot)
 		}
 		/* load TID into EDX */
 		x86_mov_reg_membase (code, X86_EDX, X86_EDX, MONO_STRUCT_OFFSET (MonoInternalThread, small_id), 4);
+
+		/* load the lock word to ECX */
+		x86_mov_reg_membase (code, X86_ECX, X86_EAX, MONO_STRUCT_OFFSET (MonoObject, synchronisation), 4);
+
+		/* is it a flat lock? */
+		x86_test_reg_imm (code, X86_ECX, LOCK_WORD_STATUS_MASK);
+		/* if not, jump to the inflated case */
+		jump_not_flat = code;
+		x86_branch8 (code, X86_CC_NZ, -1, 1);
+
+		/* is the owner TID? this leaves the nest bits in EDX */
+		x86_shift_reg_imm (code, X86_SHL, X86_EDX, LOCK_WORD_OWNER_SHIFT);
+		x86_alu_reg_reg (code, X86_XOR, X86_EDX, X86_ECX);
+		x86_test_reg_imm (code, X86_EDX, LOCK_WORD_OWNER_MASK);
+		/* if not, jump to actual trampoline */
+		jump_flat_not_owned = code;
+		x86_branch32 (code, X86_CC_NZ, -1, 1);
+
+		/* is the lock nested? */
+		x86_test_reg_reg (code, X86_EDX, X86_EDX);
+		/* if yes, jump to next case */
+		jump_flat_nested = code;
+		x86_branch8 (code, X86_CC_NZ, -1, 1);
+		/* if not, try to clear the lock word (EDX is 0) and return */
+		/* old lock word in EAX, obj in ECX */
+		x86_xchg_reg_reg (code, X86_EAX, X86_ECX, 4);
+		x86_prefix (code, X86_LOCK_PREFIX);
+		x86_cmpxchg_membase_reg (code, X86_ECX, MONO_STRUCT_OFFSET (MonoObject, synchronisation), X86_EDX);
+		/* if not successful, the lock was inflated under us */
+		jump_flat_cmpxchg_failed = code;
+		x86_branch32 (code, X86_CC_NZ, -1, 1);
+		x86_pop_reg (code, X86_EAX);
+		x86_ret (code);
+
+		/* next case: the flat lock is nested */
+		x86_patch (jump_flat_nested, code);
+		/* try to decrement nest and return */
+		x86_lea_membase (code, X86_EDX, X86_ECX, -(1 << LOCK_WORD_NEST_SHIFT));
+		x86_xchg_reg_reg (code, X86_EAX, X86_ECX, 4);
+		x86_prefix (code, X86_LOCK_PREFIX);
+		x86_cmpxchg_membase_reg (code, X86_ECX, MONO_STRUCT_OFFSET (MonoObject, synchronisation), X86_EDX);
+		jump_flat_nest_cmpxchg_failed = code;
+		x86_branch32 (code, X86_CC_NZ, -1, 1);
+		x86_pop_reg (code, X86_EAX);
+		x86_ret (code);
+
+		/* next case: the lock word is not flat */
+		x86_patch (jump_not_flat, code);
+		/* is it a thin hash? */
+		x86_test_reg_imm (code, X86_ECX, LOCK_WORD_INFLATED);
+		/* if yes, jump to actual trampoline */
+		jump_sync_thin_hash = code;
+		x86_branch32 (code, X86_CC_Z, -1, 1);
+		/* clear the status bits to get the MonoThreadsSync */
+		x86_alu_reg_imm (code, X86_AND, X86_ECX, ~LOCK_WORD_STATUS_MASK);
+
 		/* is synchronization->owner == TID */
 		x86_mov_reg_membase (code, X86_EAX, X86_ECX, status_offset, 4);
 		x86_alu_reg_reg (code, X86_XOR, X86_EDX, X86_EAX);
@@ -1049,12 +1148,13 @@ mono_arch_create_monitor_exit_trampoline (MonoTrampInfo **info, gboolean aot)
 
 		/* push obj and jump to the actual trampoline */
 		x86_patch (jump_obj_null, code);
-		if (jump_sync_thin_hash)
-			x86_patch (jump_sync_thin_hash, code);
+		x86_patch (jump_flat_not_owned, code);
+		x86_patch (jump_flat_cmpxchg_failed, code);
+		x86_patch (jump_flat_nest_cmpxchg_failed, code);
+		x86_patch (jump_sync_thin_hash, code);
 		x86_patch (jump_have_waiters, code);
 		x86_patch (jump_cmpxchg_failed, code);
 		x86_patch (jump_not_owned, code);
-		x86_patch (jump_sync_null, code);
 	}
 
 	/* obj is pushed, jump to the actual trampoline */
@@ -92,6 +92,7 @@ static int do_mono_sample = 0;
 static int in_shutdown = 0;
 static int do_debug = 0;
 static int do_counters = 0;
+static char *pgo_filename = NULL;
 static MonoProfileSamplingMode sampling_mode = MONO_PROFILER_STAT_MODE_PROCESS;
 
 /* For linux compile with:
@@ -109,6 +110,7 @@ static MonoProfileSamplingMode sampling_mode = MONO_PROFILER_STAT_MODE_PROCESS;
  */
 
 typedef struct _LogBuffer LogBuffer;
+typedef struct _PgoThreadData PgoThreadData;
 
 /*
  * file format:
@@ -353,6 +355,7 @@ struct _LogBuffer {
 	int locked;
 	int size;
 	int call_depth;
+	PgoThreadData *pgo;
 	unsigned char buf [1];
 };
 
@@ -471,8 +474,10 @@ ensure_logbuf (int bytes)
 	TLS_SET (tlsbuffer, NULL);
 	init_thread ();
 	TLS_GET (tlsbuffer)->next = old;
-	if (old)
+	if (old) {
 		TLS_GET (tlsbuffer)->call_depth = old->call_depth;
+		TLS_GET (tlsbuffer)->pgo = old->pgo;
+	}
 	//printf ("new logbuffer\n");
 	return TLS_GET (tlsbuffer);
 }
@@ -700,12 +705,14 @@ static void
 safe_dump (MonoProfiler *profiler, LogBuffer *logbuffer)
 {
 	int cd = logbuffer->call_depth;
+	PgoThreadData *pgo = logbuffer->pgo;
 	take_lock ();
 	dump_buffer (profiler, TLS_GET (tlsbuffer));
 	release_lock ();
 	TLS_SET (tlsbuffer, NULL);
 	init_thread ();
 	TLS_GET (tlsbuffer)->call_depth = cd;
+	TLS_GET (tlsbuffer)->pgo = pgo;
 }
 
 static int
@@ -1048,11 +1055,177 @@ class_loaded (MonoProfiler *prof, MonoClass *klass, int result)
 	process_requests (prof);
 }
 
+/*
+ * Call counts for profile guided inlining (pgo=FILENAME).
+ * Each thread keeps a shadow stack of the methods it entered and
+ * counts how many times each method was entered, and from which caller.
+ * The counts of all the threads are merged and written out at shutdown,
+ * while other threads might still be running, so each thread's counts are
+ * protected by a lock of their own, which is uncontended until then.
+ */
+typedef struct {
+	MonoMethod *caller; /* NULL for the count of all the entries into callee */
+	MonoMethod *callee;
+	uint64_t count;
+} PgoEdge;
+
+struct _PgoThreadData {
+	PgoThreadData *next;
+	MonoMethod **stack;
+	int stack_size;
+	/* Protects EDGES */
+	mono_mutex_t edges_mutex;
+	GHashTable *edges;
+};
+
+static PgoThreadData *pgo_threads;
+
+static guint
+pgo_edge_hash (gconstpointer key)
+{
+	const PgoEdge *edge = key;
+	return (guint)(((uintptr_t)edge->caller >> 3) * 31 + ((uintptr_t)edge->callee >> 3));
+}
+
+static gboolean
+pgo_edge_equal (gconstpointer a, gconstpointer b)
+{
+	const PgoEdge *ea = a;
+	const PgoEdge *eb = b;
+	return ea->caller == eb->caller && ea->callee == eb->callee;
+}
+
+static void
+pgo_count_edge (GHashTable *edges, MonoMethod *caller, MonoMethod *callee, uint64_t count)
+{
+	PgoEdge key, *edge;
+	key.caller = caller;
+	key.callee = callee;
+	edge = g_hash_table_lookup (edges, &key);
+	if (!edge) {
+		edge = g_new0 (PgoEdge, 1);
+		edge->caller = caller;
+		edge->callee = callee;
+		g_hash_table_insert (edges, edge, edge);
+	}
+	edge->count += count;
+}
+
+/*
+ * Called with the call depth of the current thread before METHOD
+ * was entered.
+ */
+static void
+pgo_method_enter (LogBuffer *logbuffer, MonoMethod *method, int depth)
+{
+	PgoThreadData *pgo = logbuffer->pgo;
+	if (!pgo) {
+		pgo = g_new0 (PgoThreadData, 1);
+		pgo->edges = g_hash_table_new (pgo_edge_hash, pgo_edge_equal);
+		mono_mutex_init (&pgo->edges_mutex);
+		take_lock ();
+		pgo->next = pgo_threads;
+		pgo_threads = pgo;
+		release_lock ();
+		logbuffer->pgo = pgo;
+	}
+	if (depth < 0)
+		depth = 0;
+	if (depth >= pgo->stack_size) {
+		pgo->stack_size = MAX (64, depth * 2);
+		pgo->stack = g_realloc (pgo->stack, pgo->stack_size * sizeof (MonoMethod*));
+	}
+	pgo->stack [depth] = method;
+	mono_mutex_lock (&pgo->edges_mutex);
+	pgo_count_edge (pgo->edges, NULL, method, 1);
+	if (depth > 0)
+		pgo_count_edge (pgo->edges, pgo->stack [depth - 1], method, 1);
+	mono_mutex_unlock (&pgo->edges_mutex);
+}
+
+static void
+pgo_merge_edge (gpointer key, gpointer value, gpointer user_data)
+{
+	PgoEdge *edge = value;
+	pgo_count_edge (user_data, edge->caller, edge->callee, edge->count);
+}
+
+static const char*
+pgo_image_name (MonoMethod *method)
+{
+	return mono_image_get_name (mono_class_get_image (mono_method_get_class (method)));
+}
+
+static void
+pgo_write_edge (gpointer key, gpointer value, gpointer user_data)
+{
+	PgoEdge *edge = value;
+	FILE *file = user_data;
+	MonoMethodHeader *header;
+	uint32_t il_size = 0;
+	char *name, *caller_name;
+
+	/* Wrappers have no token, so they can't be matched with the methods of later runs */
+	if (!mono_method_get_token (edge->callee) || (edge->caller && !mono_method_get_token (edge->caller)))
+		return;
+
+	name = mono_method_full_name (edge->callee, TRUE);
+	if (!edge->caller) {
+		header = mono_method_get_header (edge->callee);
+		if (header) {
+			mono_method_header_get_code (header, &il_size, NULL);
+			mono_metadata_free_mh (header);
+		}
+		fprintf (file, "M %llu %u %s %08x\t%s\n", (unsigned long long)edge->count, il_size,
+			pgo_image_name (edge->callee), mono_method_get_token (edge->callee), name);
+	} else {
+		caller_name = mono_method_full_name (edge->caller, TRUE);
+		fprintf (file, "C %llu %s %08x %s %08x\t%s -> %s\n", (unsigned long long)edge->count,
+			pgo_image_name (edge->caller), mono_method_get_token (edge->caller),
+			pgo_image_name (edge->callee), mono_method_get_token (edge->callee), caller_name, name);
+		g_free (caller_name);
+	}
+	g_free (name);
+}
+
+/*
+ * Write the call counts for profile guided inlining, the format is
+ * described in mono/mini/mini-pgo.c.
+ */
+static void
+pgo_dump (void)
+{
+	PgoThreadData *pgo;
+	GHashTable *edges;
+	FILE *file;
+
+	file = fopen (pgo_filename, "w");
+	if (!file) {
+		fprintf (stderr, "Cannot create pgo file %s: %s\n", pgo_filename, strerror (errno));
+		return;
+	}
+
+	edges = g_hash_table_new (pgo_edge_hash, pgo_edge_equal);
+	take_lock ();
+	for (pgo = pgo_threads; pgo; pgo = pgo->next) {
+		mono_mutex_lock (&pgo->edges_mutex);
+		g_hash_table_foreach (pgo->edges, pgo_merge_edge, edges);
+		mono_mutex_unlock (&pgo->edges_mutex);
+	}
+	release_lock ();
+
+	fprintf (file, "#PGO:1\n");
+	g_hash_table_foreach (edges, pgo_write_edge, file);
+	fclose (file);
+}
+
 static void
 method_enter (MonoProfiler *prof, MonoMethod *method)
 {
 	uint64_t now;
 	LogBuffer *logbuffer = ensure_logbuf (16);
+	if (pgo_filename)
+		pgo_method_enter (logbuffer, method, logbuffer->call_depth);
 	if (logbuffer->call_depth++ > max_call_depth)
 		return;
 	now = current_time ();
@@ -2418,6 +2591,8 @@ log_shutdown (MonoProfiler *prof)
 		dump_buffer (prof, TLS_GET (tlsbuffer));
 	TLS_SET (tlsbuffer, NULL);
 	release_lock ();
+	if (pgo_filename)
+		pgo_dump ();
 #if defined (HAVE_SYS_ZLIB)
 	if (prof->gzfile)
 		gzclose (prof->gzfile);
@@ -2782,6 +2957,7 @@ usage (int do_exit)
 	printf ("\ttime=fast        use a faster (but more inaccurate) timer\n");
 	printf ("\tmaxframes=NUM    collect up to NUM stack frames\n");
 	printf ("\tcalldepth=NUM    ignore method events for call chain depth bigger than NUM\n");
+	printf ("\tpgo=FILENAME     write method call counts for profile guided inlining to FILENAME\n");
 	printf ("\toutput=FILENAME  write the data to file FILENAME (-FILENAME to overwrite)\n");
 	printf ("\toutput=|PROGRAM  write the data to the stdin of PROGRAM\n");
 	printf ("\t                 %%t is subtituted with date and time, %%p with the pid\n");
@@ -3056,6 +3232,13 @@ mono_profiler_startup (const char *desc)
 			free (val);
 			continue;
 		}
+		if ((opt = match_option (p, "pgo", &val)) != p) {
+			if (val == NULL)
+				usage (1);
+			pgo_filename = val;
+			calls_enabled = 1;
+			continue;
+		}
 		if ((opt = match_option (p, "counters", NULL)) != p) {
 			do_counters = 1;
 			continue;
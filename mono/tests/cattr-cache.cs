@@ -0,0 +1,67 @@
+using System;
+using System.Reflection;
+
+/*
+ * Decoded custom attributes are cached per image, check that every query
+ * still constructs fresh attribute objects and that members without
+ * attributes stay without them.
+ */
+[AttributeUsage (AttributeTargets.All, AllowMultiple = true)]
+class MyAttribute : Attribute {
+	public int val;
+
+	public MyAttribute (int val) {
+		this.val = val;
+	}
+}
+
+class OtherAttribute : Attribute {
+}
+
+[My (1)]
+[My (2)]
+class T {
+	[My (3)]
+	public int field;
+
+	public int plain;
+
+	[Other]
+	public static void method () {
+	}
+
+	static int Main () {
+		for (int i = 0; i < 2; ++i) {
+			object[] a = typeof (T).GetCustomAttributes (typeof (MyAttribute), false);
+			if (a.Length != 2)
+				return 1;
+			if (((MyAttribute)a [0]).val + ((MyAttribute)a [1]).val != 3)
+				return 2;
+			/* Callers may modify the returned attributes */
+			((MyAttribute)a [0]).val = 42;
+
+			object[] b = typeof (T).GetCustomAttributes (false);
+			if (b.Length != 2 || b [0] == a [0] || b [1] == a [0])
+				return 3;
+			if (((MyAttribute)b [0]).val == 42 || ((MyAttribute)b [1]).val == 42)
+				return 4;
+
+			FieldInfo f = typeof (T).GetField ("field");
+			if (!f.IsDefined (typeof (MyAttribute), false))
+				return 5;
+			if (((MyAttribute)f.GetCustomAttributes (false) [0]).val != 3)
+				return 6;
+
+			FieldInfo p = typeof (T).GetField ("plain");
+			if (p.IsDefined (typeof (MyAttribute), false) || p.GetCustomAttributes (false).Length != 0)
+				return 7;
+
+			MethodInfo m = typeof (T).GetMethod ("method");
+			if (!m.IsDefined (typeof (OtherAttribute), false) || m.IsDefined (typeof (MyAttribute), false))
+				return 8;
+			if (Attribute.GetCustomAttribute (m, typeof (OtherAttribute)) == null)
+				return 9;
+		}
+		return 0;
+	}
+}
@@ -0,0 +1,51 @@
+using System;
+using System.Threading;
+
+/*
+ * Interns the same set of strings from several threads at once, so that
+ * inserts race with each other and with the intern table growing, and
+ * checks that every thread got the same instance for each string.
+ */
+class T {
+	const int THREADS = 8;
+	const int STRINGS = 5000;
+
+	static string[][] results = new string [THREADS][];
+
+	static void thread (object o) {
+		int n = (int)o;
+		string[] res = new string [STRINGS];
+
+		for (int i = 0; i < STRINGS; ++i) {
+			int k = (i * 7 + n * 13) % STRINGS;
+			res [k] = String.Intern (new String ('x', 1) + k.ToString ());
+		}
+		results [n] = res;
+	}
+
+	static int Main () {
+		Thread[] threads = new Thread [THREADS];
+
+		for (int i = 0; i < THREADS; ++i) {
+			threads [i] = new Thread (thread);
+			threads [i].Start (i);
+		}
+		for (int i = 0; i < THREADS; ++i)
+			threads [i].Join ();
+
+		for (int k = 0; k < STRINGS; ++k) {
+			string s = results [0][k];
+			if (String.IsInterned ("x" + k) != (object)s)
+				return 1;
+			for (int i = 1; i < THREADS; ++i) {
+				if ((object)results [i][k] != (object)s)
+					return 2;
+			}
+		}
+
+		if ((object)String.Intern ("x42") != (object)"x42")
+			return 3;
+
+		return 0;
+	}
+}
@@ -0,0 +1,48 @@
+using System;
+using System.Collections.Generic;
+
+/*
+ * Run by the test-jit-cache target with --jit-cache, first to record the
+ * methods the JIT compiles, then to run them from the cached image.
+ */
+class Tests {
+	struct Point {
+		public int x, y;
+
+		public Point (int x, int y) {
+			this.x = x;
+			this.y = y;
+		}
+	}
+
+	static int sum (int[] arr) {
+		int res = 0;
+		foreach (int i in arr)
+			res += i;
+		return res;
+	}
+
+	static int fib (int n) {
+		return n < 2 ? n : fib (n - 1) + fib (n - 2);
+	}
+
+	static string concat (List<string> l) {
+		return String.Join (",", l.ToArray ());
+	}
+
+	static int distance (Point a, Point b) {
+		return Math.Abs (a.x - b.x) + Math.Abs (a.y - b.y);
+	}
+
+	public static int Main () {
+		if (sum (new int [] { 1, 2, 3, 4 }) != 10)
+			return 1;
+		if (fib (20) != 6765)
+			return 2;
+		if (concat (new List<string> { "a", "b", "c" }) != "a,b,c")
+			return 3;
+		if (distance (new Point (1, 2), new Point (4, -2)) != 7)
+			return 4;
+		return 0;
+	}
+}
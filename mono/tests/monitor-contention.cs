@@ -0,0 +1,159 @@
+using System;
+using System.Threading;
+
+/*
+ * Takes the same locks from several threads at once, so that flat locks are
+ * inflated while their owner holds them: by contention, by a hash code
+ * request, by Wait/Pulse and by a nest count overflow. Checks that mutual
+ * exclusion, recursion counts and hash codes survive the inflation.
+ */
+class T {
+	const int THREADS = 8;
+	const int ROUNDS = 20000;
+	const int LOCKS = 16;
+	/* More than the nest count of a flat lock can hold */
+	const int DEPTH = 300;
+
+	static object[] locks;
+	static int[] counters;
+	static int[] hashes;
+	static int failures;
+
+	static void contend (object o) {
+		int n = (int)o;
+
+		for (int r = 0; r < ROUNDS; ++r) {
+			int k = (r * 7 + n) % LOCKS;
+			object obj = locks [k];
+
+			lock (obj) {
+				/* Not atomic, the lock has to make it safe */
+				int c = counters [k];
+				if ((r & 63) == 0)
+					Thread.Yield ();
+				counters [k] = c + 1;
+
+				if ((r & 127) == n && obj.GetHashCode () != hashes [k])
+					Interlocked.Increment (ref failures);
+			}
+
+			/* Uncontended, so it stays flat */
+			lock (new object ()) {
+			}
+		}
+	}
+
+	static void recurse (object obj, int depth) {
+		lock (obj) {
+			if (depth > 0)
+				recurse (obj, depth - 1);
+		}
+	}
+
+	static void nest (object o) {
+		object obj = o;
+
+		for (int r = 0; r < ROUNDS / 100; ++r) {
+			recurse (obj, DEPTH);
+			Monitor.Enter (obj);
+			Monitor.Enter (obj);
+			Monitor.Exit (obj);
+			Monitor.Exit (obj);
+		}
+	}
+
+	static object ping_lock = new object ();
+	static int ping;
+
+	static void pong (object o) {
+		int n = (int)o;
+
+		for (int r = 0; r < 1000; ++r) {
+			lock (ping_lock) {
+				while (ping % 2 != n)
+					Monitor.Wait (ping_lock);
+				ping ++;
+				Monitor.PulseAll (ping_lock);
+			}
+		}
+	}
+
+	static int run (ParameterizedThreadStart start, object[] args) {
+		Thread[] threads = new Thread [args.Length];
+
+		for (int i = 0; i < args.Length; ++i) {
+			threads [i] = new Thread (start);
+			threads [i].Start (args [i]);
+		}
+		for (int i = 0; i < args.Length; ++i)
+			threads [i].Join ();
+		return failures;
+	}
+
+	static int Main () {
+		object[] args;
+		int total;
+
+		locks = new object [LOCKS];
+		counters = new int [LOCKS];
+		hashes = new int [LOCKS];
+		for (int i = 0; i < LOCKS; ++i) {
+			locks [i] = new object ();
+			hashes [i] = locks [i].GetHashCode ();
+		}
+
+		args = new object [THREADS];
+		for (int i = 0; i < THREADS; ++i)
+			args [i] = i;
+		if (run (contend, args) != 0)
+			return 1;
+		total = 0;
+		for (int i = 0; i < LOCKS; ++i)
+			total += counters [i];
+		if (total != THREADS * ROUNDS)
+			return 2;
+
+		/* Overflow the nest count while other threads contend for the same lock */
+		object nested = new object ();
+		for (int i = 0; i < THREADS; ++i)
+			args [i] = nested;
+		run (nest, args);
+		if (!Monitor.TryEnter (nested))
+			return 3;
+		Monitor.Exit (nested);
+
+		/* Wait and Pulse on a lock which starts out flat */
+		if (run (pong, new object [] { 0, 1 }) != 0 || ping != 2000)
+			return 4;
+
+		/* Only the owner can release a lock */
+		object owned = new object ();
+		ManualResetEvent entered = new ManualResetEvent (false);
+		ManualResetEvent release = new ManualResetEvent (false);
+		Thread owner = new Thread (delegate () {
+			lock (owned) {
+				entered.Set ();
+				release.WaitOne ();
+			}
+		});
+		owner.Start ();
+		entered.WaitOne ();
+		int res = 0;
+		if (Monitor.TryEnter (owned, 0))
+			res = 5;
+		try {
+			Monitor.Exit (owned);
+			res = 6;
+		} catch (SynchronizationLockException) {
+		}
+		release.Set ();
+		owner.Join ();
+		if (res != 0)
+			return res;
+		if (!Monitor.TryEnter (owned, 1000))
+			return 7;
+		Monitor.Exit (owned);
+
+		return 0;
+	}
+}
@@ -0,0 +1,65 @@
+using System;
+using System.Reflection;
+using System.Threading;
+
+/*
+ * Creates runtime-invoke and delegate-invoke wrappers for the same set of
+ * signatures from several threads at once, so that wrapper cache inserts
+ * race with each other and with lookups.
+ */
+class T {
+	const int THREADS = 8;
+	const int ROUNDS = 50;
+
+	delegate object Getter (object o);
+
+	static Type[] types = new Type [] {
+		typeof (int), typeof (long), typeof (byte), typeof (char),
+		typeof (short), typeof (double), typeof (float), typeof (string),
+		typeof (object), typeof (DateTime), typeof (Guid), typeof (decimal)
+	};
+
+	static int failures;
+
+	public static T2 Id<T2> (T2 t) {
+		return t;
+	}
+
+	public static object Box<T2> (object o) {
+		return (T2)o;
+	}
+
+	static void thread (object o) {
+		int n = (int)o;
+		MethodInfo id = typeof (T).GetMethod ("Id");
+		MethodInfo box = typeof (T).GetMethod ("Box");
+
+		for (int r = 0; r < ROUNDS; ++r) {
+			for (int i = 0; i < types.Length; ++i) {
+				Type t = types [(i + n) % types.Length];
+				object val = t == typeof (string) ? "a" : Activator.CreateInstance (t);
+
+				object res = id.MakeGenericMethod (t).Invoke (null, new object [] { val });
+				if (!val.Equals (res))
+					Interlocked.Increment (ref failures);
+
+				Getter g = (Getter)Delegate.CreateDelegate (typeof (Getter), box.MakeGenericMethod (t));
+				if (!val.Equals (g (val)))
+					Interlocked.Increment (ref failures);
+			}
+		}
+	}
+
+	static int Main () {
+		Thread[] threads = new Thread [THREADS];
+
+		for (int i = 0; i < THREADS; ++i) {
+			threads [i] = new Thread (thread);
+			threads [i].Start (i);
+		}
+		for (int i = 0; i < THREADS; ++i)
+			threads [i].Join ();
+
+		return failures == 0 ? 0 : 1;
+	}
+}
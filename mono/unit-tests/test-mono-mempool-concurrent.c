@@ -0,0 +1,302 @@
+/*
+ * test-mono-mempool-concurrent.c: Stress test for concurrent mempools,
+ * and a class loading microbenchmark.
+ *
+ * Copyright (C) 2014 Xamarin Inc
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License 2.0 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 2.0 along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+
+#include "metadata/appdomain.h"
+#include "metadata/class.h"
+#include "metadata/metadata-internals.h"
+#include "metadata/mempool.h"
+#include "metadata/mempool-internals.h"
+#include "metadata/tabledefs.h"
+#include "metadata/tokentype.h"
+#include "metadata/threads.h"
+#include "utils/mono-time.h"
+#include "utils/atomic.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#define NUM_THREADS 16
+#define ALLOCS_PER_THREAD 100000
+/* More than the pools a thread keeps a chunk for */
+#define NUM_POOLS 8
+
+typedef struct {
+	int id;
+	guint32 seed;
+	void *allocs [ALLOCS_PER_THREAD];
+	guint32 sizes [ALLOCS_PER_THREAD];
+} AllocData;
+
+static MonoMemPool *pool;
+static MonoMemPool *pools [NUM_POOLS];
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static gboolean use_lock;
+static AllocData alloc_data [NUM_THREADS];
+static volatile gint32 ready;
+static volatile gint32 go;
+
+static guint32
+next_size (AllocData *data)
+{
+	data->seed = data->seed * 1103515245 + 12345;
+	/* Mostly small, sometimes big enough for a chunk of its own */
+	if ((data->seed >> 16) % 64 == 0)
+		return 2048 + (data->seed >> 8) % 4096;
+	return 8 + (data->seed >> 8) % 120;
+}
+
+static void*
+alloc_thread (void *arg)
+{
+	AllocData *data = arg;
+	int i;
+
+	InterlockedIncrement (&ready);
+	while (!go)
+		sched_yield ();
+
+	for (i = 0; i < ALLOCS_PER_THREAD; ++i) {
+		guint32 size = next_size (data);
+		guint8 *p;
+
+		if (use_lock) {
+			pthread_mutex_lock (&pool_mutex);
+			p = mono_mempool_alloc (pool, size);
+			pthread_mutex_unlock (&pool_mutex);
+		} else {
+			p = mono_mempool_alloc (pool, size);
+		}
+		memset (p, data->id, size);
+		data->allocs [i] = p;
+		data->sizes [i] = size;
+	}
+	return NULL;
+}
+
+static int
+check_allocs (void)
+{
+	int i, j;
+	guint32 k;
+
+	for (i = 0; i < NUM_THREADS; ++i) {
+		for (j = 0; j < ALLOCS_PER_THREAD; ++j) {
+			guint8 *p = alloc_data [i].allocs [j];
+			for (k = 0; k < alloc_data [i].sizes [j]; ++k) {
+				if (p [k] != alloc_data [i].id) {
+					printf ("MEMPOOL TEST FAILED: allocation %p of thread %d was overwritten\n", p, i);
+					return 1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+/* Allocates from 16 threads, then checks that no two allocations overlapped. */
+static int
+stress_mempool (gboolean concurrent)
+{
+	pthread_t threads [NUM_THREADS];
+	gint64 start, elapsed;
+	int i, j;
+
+	pool = concurrent ? mono_mempool_new_concurrent () : mono_mempool_new ();
+	use_lock = !concurrent;
+	ready = 0;
+	go = 0;
+
+	for (i = 0; i < NUM_THREADS; ++i) {
+		alloc_data [i].id = i + 1;
+		alloc_data [i].seed = i * 7919 + 1;
+		pthread_create (&threads [i], NULL, alloc_thread, &alloc_data [i]);
+	}
+	while (ready < NUM_THREADS)
+		sched_yield ();
+
+	start = mono_100ns_ticks ();
+	go = 1;
+	for (i = 0; i < NUM_THREADS; ++i)
+		pthread_join (threads [i], NULL);
+	elapsed = mono_100ns_ticks () - start;
+
+	printf ("%-10s mempool, %d threads: %10.1f allocs/ms\n", concurrent ? "concurrent" : "locked",
+		NUM_THREADS, (double)NUM_THREADS * ALLOCS_PER_THREAD / (elapsed / 10000.0 + 1e-9));
+
+	for (i = 0; i < NUM_THREADS; ++i) {
+		for (j = 0; j < ALLOCS_PER_THREAD; ++j) {
+			guint8 *p = alloc_data [i].allocs [j];
+			/* This walks all the chunks, so only check some */
+			if (j % 1000 == 0 && !mono_mempool_contains_addr (pool, p)) {
+				printf ("MEMPOOL TEST FAILED: %p not in the pool\n", p);
+				return 1;
+			}
+		}
+	}
+	if (check_allocs ())
+		return 1;
+
+	mono_mempool_destroy (pool);
+	return 0;
+}
+
+static void*
+many_pools_alloc_thread (void *arg)
+{
+	AllocData *data = arg;
+	int i;
+
+	InterlockedIncrement (&ready);
+	while (!go)
+		sched_yield ();
+
+	for (i = 0; i < ALLOCS_PER_THREAD; ++i) {
+		guint32 size = 8 + i % 64;
+		guint8 *p = mono_mempool_alloc (pools [(i + data->id) % NUM_POOLS], size);
+
+		memset (p, data->id, size);
+		data->allocs [i] = p;
+		data->sizes [i] = size;
+	}
+	return NULL;
+}
+
+/*
+ * Allocates from more pools than a thread keeps a chunk for, then checks
+ * that the allocations don't overlap and that the space left in the chunks
+ * of the pools was reused.
+ */
+static int
+stress_many_pools (void)
+{
+	pthread_t threads [NUM_THREADS];
+	guint64 requested = 0, allocated = 0;
+	int i, j;
+
+	for (i = 0; i < NUM_POOLS; ++i)
+		pools [i] = mono_mempool_new_concurrent ();
+	ready = 0;
+	go = 0;
+
+	for (i = 0; i < NUM_THREADS; ++i) {
+		alloc_data [i].id = i + 1;
+		pthread_create (&threads [i], NULL, many_pools_alloc_thread, &alloc_data [i]);
+	}
+	while (ready < NUM_THREADS)
+		sched_yield ();
+	go = 1;
+	for (i = 0; i < NUM_THREADS; ++i)
+		pthread_join (threads [i], NULL);
+
+	if (check_allocs ())
+		return 1;
+
+	for (i = 0; i < NUM_THREADS; ++i)
+		for (j = 0; j < ALLOCS_PER_THREAD; ++j)
+			requested += (alloc_data [i].sizes [j] + 7) & ~7;
+	for (i = 0; i < NUM_POOLS; ++i) {
+		allocated += mono_mempool_get_allocated (pools [i]);
+		mono_mempool_destroy (pools [i]);
+	}
+	if (allocated > requested * 2) {
+		printf ("MEMPOOL TEST FAILED: %llu bytes allocated for %llu bytes of requests\n",
+			(unsigned long long)allocated, (unsigned long long)requested);
+		return 1;
+	}
+	return 0;
+}
+
+static MonoDomain *domain;
+static MonoImage *corlib;
+static int num_typedefs;
+static volatile gint32 classes_loaded;
+
+static void*
+class_load_thread (void *arg)
+{
+	int id = GPOINTER_TO_INT (arg);
+	int i;
+
+	mono_thread_attach (domain);
+
+	InterlockedIncrement (&ready);
+	while (!go)
+		sched_yield ();
+
+	/* Each thread starts somewhere else, so they race to load different classes */
+	for (i = 0; i < num_typedefs; ++i) {
+		int row = (i + id * num_typedefs / NUM_THREADS) % num_typedefs;
+		MonoClass *klass = mono_class_get (corlib, MONO_TOKEN_TYPE_DEF | (row + 1));
+		if (klass && mono_class_init (klass))
+			InterlockedIncrement (&classes_loaded);
+	}
+
+	mono_thread_detach (mono_thread_current ());
+	return NULL;
+}
+
+static void
+bench_class_loading (void)
+{
+	pthread_t threads [NUM_THREADS];
+	gint64 start, elapsed;
+	int i;
+
+	corlib = mono_get_corlib ();
+	num_typedefs = mono_image_get_table_rows (corlib, MONO_TABLE_TYPEDEF);
+	ready = 0;
+	go = 0;
+
+	for (i = 0; i < NUM_THREADS; ++i)
+		pthread_create (&threads [i], NULL, class_load_thread, GINT_TO_POINTER (i));
+	while (ready < NUM_THREADS)
+		sched_yield ();
+
+	start = mono_100ns_ticks ();
+	go = 1;
+	for (i = 0; i < NUM_THREADS; ++i)
+		pthread_join (threads [i], NULL);
+	elapsed = mono_100ns_ticks () - start;
+
+	printf ("class loading, %d threads: %d classes, %10.1f classes/ms\n", NUM_THREADS,
+		num_typedefs, classes_loaded / (elapsed / 10000.0 + 1e-9));
+}
+
+int
+main (void)
+{
+	int res = 0;
+
+	res += stress_mempool (FALSE);
+	res += stress_mempool (TRUE);
+	res += stress_many_pools ();
+
+	domain = mono_init ("test-mono-mempool-concurrent");
+	mono_thread_attach (domain);
+	bench_class_loading ();
+
+	return res ? 1 : 0;
+}
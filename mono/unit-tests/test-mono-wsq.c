@@ -0,0 +1,175 @@
+/*
+ * test-mono-wsq.c: Unit test and microbenchmark for the work-stealing queue.
+ *
+ * Copyright (C) 2014 Xamarin Inc
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License 2.0 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 2.0 along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+
+#include "metadata/appdomain.h"
+#include "metadata/object.h"
+#include "metadata/mono-wsq.h"
+#include "utils/mono-threads.h"
+#include "utils/mono-time.h"
+#include "utils/atomic.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <pthread.h>
+
+#define MAX_THREADS 64
+#define POOL_SIZE 1024
+/* Pushes per round, enough to make the queues grow a few times */
+#define BATCH 200
+#define ROUNDS 500
+
+typedef struct {
+	int id;
+	int nthreads;
+	gint64 pushed;
+	gint64 popped;
+	gint64 stolen;
+} WorkerData;
+
+static MonoArray *pool;
+static MonoWSQ *queues [MAX_THREADS];
+static volatile gint32 ready;
+static volatile gint32 go;
+
+static void*
+worker (void *arg)
+{
+	WorkerData *data = arg;
+	MonoWSQ *wsq;
+	void *obj;
+	int i, r;
+	guint32 victim = data->id * 7919 + 1;
+
+	mono_thread_info_attach ((gpointer)&arg);
+
+	wsq = mono_wsq_create ();
+	queues [data->id] = wsq;
+	InterlockedIncrement (&ready);
+	while (!go)
+		;
+
+	for (r = 0; r < ROUNDS; ++r) {
+		for (i = 0; i < BATCH; ++i) {
+			if (mono_wsq_local_push (mono_array_get (pool, MonoObject*, (r + i) % POOL_SIZE)))
+				data->pushed++;
+		}
+
+		/* Keep half of the batch around for the thieves */
+		for (i = 0; i < BATCH / 2; ++i) {
+			obj = NULL;
+			if (!mono_wsq_local_pop (&obj))
+				break;
+			g_assert (obj);
+			data->popped++;
+		}
+
+		if (data->nthreads == 1)
+			continue;
+
+		for (i = 0; i < BATCH / 4; ++i) {
+			victim = victim * 1103515245 + 12345;
+			obj = NULL;
+			mono_wsq_try_steal (queues [(victim >> 8) % data->nthreads], &obj, 0);
+			if (obj)
+				data->stolen++;
+		}
+	}
+
+	/* Drain what the thieves left us */
+	obj = NULL;
+	while (mono_wsq_local_pop (&obj)) {
+		g_assert (obj);
+		data->popped++;
+		obj = NULL;
+	}
+
+	InterlockedDecrement (&ready);
+	while (ready)
+		;
+	mono_wsq_destroy (wsq);
+	return NULL;
+}
+
+static int
+run (int nthreads)
+{
+	pthread_t threads [MAX_THREADS];
+	WorkerData data [MAX_THREADS];
+	gint64 start, elapsed, pushed = 0, taken = 0, stolen = 0;
+	int i;
+
+	memset (data, 0, sizeof (data));
+	ready = 0;
+	go = 0;
+
+	for (i = 0; i < nthreads; ++i) {
+		data [i].id = i;
+		data [i].nthreads = nthreads;
+		pthread_create (&threads [i], NULL, worker, &data [i]);
+	}
+	while (ready < nthreads)
+		;
+
+	start = mono_100ns_ticks ();
+	go = 1;
+	for (i = 0; i < nthreads; ++i)
+		pthread_join (threads [i], NULL);
+	elapsed = mono_100ns_ticks () - start;
+
+	for (i = 0; i < nthreads; ++i) {
+		pushed += data [i].pushed;
+		taken += data [i].popped + data [i].stolen;
+		stolen += data [i].stolen;
+	}
+
+	printf ("threads: %2d  ops/ms: %10.1f  stolen: %5.1f%%\n", nthreads,
+		(pushed + taken) / (elapsed / 10000.0 + 1e-9), 100.0 * stolen / (taken ? taken : 1));
+
+	if (pushed != taken) {
+		printf ("WSQ TEST FAILED with %d threads: pushed %lld, taken %lld\n", nthreads, (long long)pushed, (long long)taken);
+		return 1;
+	}
+	return 0;
+}
+
+int
+main (void)
+{
+	MonoDomain *domain;
+	int i, res = 0;
+
+	domain = mono_init ("test-mono-wsq");
+	mono_thread_info_attach ((gpointer)&domain);
+	mono_wsq_init ();
+
+	MONO_GC_REGISTER_ROOT_SINGLE (pool);
+	pool = mono_array_new (domain, mono_defaults.object_class, POOL_SIZE);
+	for (i = 0; i < POOL_SIZE; ++i)
+		mono_array_setref (pool, i, mono_object_new (domain, mono_defaults.object_class));
+
+	for (i = 1; i <= MAX_THREADS; i *= 2)
+		res += run (i);
+
+	mono_wsq_cleanup ();
+	return res;
+}
@@ -0,0 +1,146 @@
+/*
+ * test-sgen-cardtable.c: Unit test and microbenchmark for the card table
+ * scanning kernels.
+ *
+ * Copyright (C) 2014 Xamarin Inc
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License 2.0 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 2.0 along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+
+#include <metadata/sgen-gc.h>
+#include <metadata/sgen-cardtable.h>
+#include <metadata/sgen-memory-governor.h>
+#include <utils/mono-time.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+/* 4MB of cards covers 2GB of heap with 512 byte cards */
+#define NUM_CARDS	(4 * 1024 * 1024)
+#define ROUNDS		20
+
+static guint8 *cards;
+static guint8 *dest;
+static guint8 *expected;
+
+static void
+fill_cards (int one_in)
+{
+	int i;
+
+	memset (cards, 0, NUM_CARDS);
+	for (i = 0; i < NUM_CARDS; ++i) {
+		if (rand () % one_in == 0)
+			cards [i] = 1;
+	}
+}
+
+static int
+count_cards (const SgenCardTableKernels *k, guint8 *start, guint8 *end)
+{
+	guint8 *card;
+	int count = 0;
+
+	for (card = k->find_next_card (start, end); card < end; card = k->find_next_card (card + 1, end))
+		++count;
+	return count;
+}
+
+/* Checks K against the scalar kernels, including unaligned ranges */
+static int
+check_kernels (const SgenCardTableKernels *scalar, const SgenCardTableKernels *k)
+{
+	int i, start, len;
+
+	for (i = 0; i < 10000; ++i) {
+		start = rand () % 4096;
+		len = rand () % 4096;
+
+		if (k->find_next_card (cards + start, cards + start + len) != scalar->find_next_card (cards + start, cards + start + len)) {
+			printf ("%s find_next_card mismatch at [%d, %d)\n", k->name, start, start + len);
+			return 1;
+		}
+
+		memset (dest, 0, 8192);
+		dest [rand () % 8192] = 1;
+		memcpy (expected, dest, 8192);
+		scalar->update_mod_union (expected, cards + start, len);
+		k->update_mod_union (dest, cards + start, len);
+		if (memcmp (dest, expected, 8192)) {
+			printf ("%s update_mod_union mismatch at [%d, %d)\n", k->name, start, start + len);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int
+bench (const SgenCardTableKernels **kernels, int num_kernels, const char *pattern, int one_in)
+{
+	gint64 start, elapsed;
+	int i, r, count, expected_count = -1;
+
+	fill_cards (one_in);
+	printf ("%s (1 in %d cards marked):\n", pattern, one_in);
+
+	for (i = 0; i < num_kernels; ++i) {
+		if (i > 0 && check_kernels (kernels [0], kernels [i]))
+			return 1;
+
+		start = mono_100ns_ticks ();
+		for (r = 0; r < ROUNDS; ++r)
+			count = count_cards (kernels [i], cards, cards + NUM_CARDS);
+		elapsed = mono_100ns_ticks () - start;
+		if (expected_count == -1)
+			expected_count = count;
+		if (count != expected_count) {
+			printf ("%s found %d cards, expected %d\n", kernels [i]->name, count, expected_count);
+			return 1;
+		}
+		printf ("  find_next_card    %-8s %8.1f MB/s\n", kernels [i]->name,
+			(double)NUM_CARDS * ROUNDS / (1024 * 1024) / (elapsed / 10000000.0 + 1e-9));
+
+		start = mono_100ns_ticks ();
+		for (r = 0; r < ROUNDS; ++r)
+			kernels [i]->update_mod_union (dest, cards, NUM_CARDS);
+		elapsed = mono_100ns_ticks () - start;
+		printf ("  update_mod_union  %-8s %8.1f MB/s\n", kernels [i]->name,
+			(double)NUM_CARDS * ROUNDS / (1024 * 1024) / (elapsed / 10000000.0 + 1e-9));
+	}
+	return 0;
+}
+
+int
+main (void)
+{
+	const SgenCardTableKernels *kernels [SGEN_CARD_TABLE_MAX_KERNELS];
+	int num_kernels, res = 0;
+
+	num_kernels = sgen_card_table_get_available_kernels (kernels);
+
+	/* Page aligned, like the real card table */
+	cards = sgen_alloc_os_memory (NUM_CARDS, SGEN_ALLOC_INTERNAL | SGEN_ALLOC_ACTIVATE, "card table");
+	dest = sgen_alloc_os_memory (NUM_CARDS, SGEN_ALLOC_INTERNAL | SGEN_ALLOC_ACTIVATE, "mod union");
+	expected = malloc (8192);
+
+	srand (time (NULL));
+	res += bench (kernels, num_kernels, "sparse", 4096);
+	res += bench (kernels, num_kernels, "dense", 8);
+
+	return res ? 1 : 0;
+}
@@ -26,6 +26,7 @@
 
 #if defined(_MSC_VER)
 #include <intrin.h>
+#include <immintrin.h>
 #endif
 
 gboolean mono_hwcap_x86_is_xen = FALSE;
@@ -38,6 +39,8 @@ gboolean mono_hwcap_x86_has_ssse3 = FALSE;
 gboolean mono_hwcap_x86_has_sse41 = FALSE;
 gboolean mono_hwcap_x86_has_sse42 = FALSE;
 gboolean mono_hwcap_x86_has_sse4a = FALSE;
+gboolean mono_hwcap_x86_has_avx = FALSE;
+gboolean mono_hwcap_x86_has_avx2 = FALSE;
 
 static gboolean
 cpuid (int id, int *p_eax, int *p_ebx, int *p_ecx, int *p_edx)
@@ -88,9 +91,9 @@ cpuid (int id, int *p_eax, int *p_ebx, int *p_ecx, int *p_edx)
 #endif
 
 	/* Now issue the actual cpuid instruction. We can use
-	   MSVC's __cpuid on both 32-bit and 64-bit. */
+	   MSVC's __cpuidex on both 32-bit and 64-bit. */
 #if defined(_MSC_VER)
-	__cpuid (info, id);
+	__cpuidex (info, id, 0);
 	*p_eax = info [0];
 	*p_ebx = info [1];
 	*p_ecx = info [2];
@@ -103,19 +106,40 @@ cpuid (int id, int *p_eax, int *p_ebx, int *p_ecx, int *p_edx)
 		"cpuid\n\t"
 		"xchgl\t%%ebx, %k1\n\t"
 		: "=a" (*p_eax), "=&r" (*p_ebx), "=c" (*p_ecx), "=d" (*p_edx)
-		: "0" (id)
+		: "0" (id), "2" (0)
 	);
 #else
 	__asm__ __volatile__ (
 		"cpuid\n\t"
 		: "=a" (*p_eax), "=b" (*p_ebx), "=c" (*p_ecx), "=d" (*p_edx)
-		: "a" (id)
+		: "a" (id), "c" (0)
 	);
 #endif
 
 	return TRUE;
 }
 
+/* Whether the OS saves the YMM registers on context switches. */
+static gboolean
+os_saves_ymm (void)
+{
+	int eax;
+
+#if defined(_MSC_VER)
+	eax = (int) _xgetbv (0);
+#else
+	int edx;
+
+	__asm__ __volatile__ (
+		".byte 0x0f, 0x01, 0xd0\n\t" /* xgetbv */
+		: "=a" (eax), "=d" (edx)
+		: "c" (0)
+	);
+#endif
+
+	return (eax & 6) == 6;
+}
+
 void
 mono_hwcap_arch_init (void)
 {
@@ -146,6 +170,17 @@ mono_hwcap_arch_init (void)
 
 		if (ecx & (1 << 20))
 			mono_hwcap_x86_has_sse42 = TRUE;
+
+		/* AVX needs both the CPU (bit 28) and the OS (OSXSAVE, bit 27). */
+		if ((ecx & (1 << 27)) && (ecx & (1 << 28)) && os_saves_ymm ())
+			mono_hwcap_x86_has_avx = TRUE;
+	}
+
+	if (mono_hwcap_x86_has_avx && cpuid (0, &eax, &ebx, &ecx, &edx) && eax >= 7) {
+		if (cpuid (7, &eax, &ebx, &ecx, &edx)) {
+			if (ebx & (1 << 5))
+				mono_hwcap_x86_has_avx2 = TRUE;
+		}
 	}
 
 	if (cpuid (0x80000000, &eax, &ebx, &ecx, &edx)) {
@@ -175,4 +210,6 @@ mono_hwcap_print (FILE *f)
 	g_fprintf (f, "mono_hwcap_x86_has_sse41 = %i\n", mono_hwcap_x86_has_sse41);
 	g_fprintf (f, "mono_hwcap_x86_has_sse42 = %i\n", mono_hwcap_x86_has_sse42);
 	g_fprintf (f, "mono_hwcap_x86_has_sse4a = %i\n", mono_hwcap_x86_has_sse4a);
+	g_fprintf (f, "mono_hwcap_x86_has_avx = %i\n", mono_hwcap_x86_has_avx);
+	g_fprintf (f, "mono_hwcap_x86_has_avx2 = %i\n", mono_hwcap_x86_has_avx2);
 }
@@ -49,4 +49,6 @@ mono_hwcap_init (void)
 
 	if (verbose && !strncmp (verbose, "1", 1))
 		mono_hwcap_print (stdout);
+
+	hwcap_inited = TRUE;
 }
@@ -581,6 +581,32 @@ mono_cpu_count (void)
 	return 1;
 }
 
+/**
+ * mono_numa_node_count:
+ *
+ * Return the number of NUMA nodes on the system, or 1 if it can't be
+ * determined.
+ */
+int
+mono_numa_node_count (void)
+{
+	int count = 0;
+#ifdef __linux__
+	GDir *dir;
+	const char *name;
+
+	dir = g_dir_open ("/sys/devices/system/node", 0, NULL);
+	if (dir) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			if (strncmp (name, "node", 4) == 0 && g_ascii_isdigit (name [4]))
+				count++;
+		}
+		g_dir_close (dir);
+	}
+#endif
+	return MAX (count, 1);
+}
+
 static void
 get_cpu_times (int cpu_id, gint64 *user, gint64 *systemt, gint64 *irq, gint64 *sirq, gint64 *idle)
 {
@@ -51,6 +51,7 @@ gint64    mono_process_get_data_with_error (gpointer pid, MonoProcessData data,
 int       mono_process_current_pid (void) MONO_INTERNAL;
 
 int       mono_cpu_count    (void) MONO_INTERNAL;
+int       mono_numa_node_count (void) MONO_INTERNAL;
 gint64    mono_cpu_get_data (int cpu_id, MonoCpuData data, MonoProcessError *error) MONO_INTERNAL;
 
 int       mono_atexit (void (*func)(void)) MONO_INTERNAL;
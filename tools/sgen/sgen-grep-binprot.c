@@ -62,6 +62,8 @@ read_entry (FILE *in, void **data)
 	case SGEN_PROTOCOL_DOMAIN_UNLOAD_END: size = sizeof (SGenProtocolDomainUnload); break;
 	case SGEN_PROTOCOL_GRAY_ENQUEUE: size = sizeof (SGenProtocolGrayQueue); break;
 	case SGEN_PROTOCOL_GRAY_DEQUEUE: size = sizeof (SGenProtocolGrayQueue); break;
+	case SGEN_PROTOCOL_SWEEP_BEGIN: size = sizeof (SGenProtocolSweep); break;
+	case SGEN_PROTOCOL_SWEEP_END: size = sizeof (SGenProtocolSweep); break;
 	default: assert (0);
 	}
 
@@ -97,6 +99,8 @@ is_always_match (int type)
 	case SGEN_PROTOCOL_CEMENT_RESET:
 	case SGEN_PROTOCOL_DOMAIN_UNLOAD_BEGIN:
 	case SGEN_PROTOCOL_DOMAIN_UNLOAD_END:
+	case SGEN_PROTOCOL_SWEEP_BEGIN:
+	case SGEN_PROTOCOL_SWEEP_END:
 		return TRUE;
 	default:
 		return FALSE;
@@ -324,6 +328,16 @@ print_entry (int type, void *data)
 		printf ("dequeue queue %p cursor %p value %p\n", entry->queue, entry->cursor, entry->value);
 		break;
 	}
+	case SGEN_PROTOCOL_SWEEP_BEGIN: {
+		SGenProtocolSweep *entry = data;
+		printf ("sweep begin concurrent %d blocks %d\n", entry->concurrent, entry->num_blocks);
+		break;
+	}
+	case SGEN_PROTOCOL_SWEEP_END: {
+		SGenProtocolSweep *entry = data;
+		printf ("sweep end concurrent %d swept %d\n", entry->concurrent, entry->num_blocks);
+		break;
+	}
 	default:
 		assert (0);
 	}